@@ -48,7 +48,7 @@ void AABBCollidableComponentUpdater::collideWithVoxels(AabbCollidableComponent&
     for (auto& it : boundedVoxels) {
         ChunkHandle chunk = grid.accessor.acquire(it.first);
         if (chunk->genLevel == GEN_DONE) {
-            std::lock_guard<std::mutex> l(chunk->dataMutex);
+            std::shared_lock<RWSpinLock> l(chunk->dataMutex);
             for (auto& i : it.second) {
                 BlockID id = chunk->blocks.get(i);
                 if (bp->operator[](id).collide) {
@@ -66,7 +66,7 @@ void AABBCollidableComponentUpdater::collideWithVoxels(AabbCollidableComponent&
     if (id != currentID) { \
         /* Release current chunk */ \
         if (chunk.isAquired()) { \
-            chunk->dataMutex.unlock(); \
+            chunk->dataMutex.unlock_shared(); \
             chunk.release(); \
         } \
         chunk = grid.accessor.acquire(id); \
@@ -74,7 +74,7 @@ void AABBCollidableComponentUpdater::collideWithVoxels(AabbCollidableComponent&
             chunk.release(); \
             currentID = ChunkID(0xffffffffffffffffu); \
         } else { \
-            chunk->dataMutex.lock(); \
+            chunk->dataMutex.lock_shared(); \
             currentID = id; \
             /* Check the voxel */ \
             if (chunk->genLevel == GEN_DONE && bp->operator[](chunk->blocks.get(index)).collide) { \
@@ -164,7 +164,7 @@ void AABBCollidableComponentUpdater::collideWithVoxels(AabbCollidableComponent&
     }
     // Release chunk if needed
     if (chunk.isAquired()) {
-        chunk->dataMutex.unlock();
+        chunk->dataMutex.unlock_shared();
         chunk.release();
     }
 #undef CHECK_CODE
@@ -0,0 +1,36 @@
+#include "stdafx.h"
+#include "BiomeTileMap.h"
+
+std::shared_ptr<const BiomeTile> BiomeTileMap::get(const BiomeTileKey& key) {
+    std::lock_guard<std::mutex> l(m_lock);
+    auto it = m_tileMap.find(key);
+    if (it == m_tileMap.end()) return nullptr;
+    // Move to the front
+    m_tiles.splice(m_tiles.begin(), m_tiles, it->second);
+    return *it->second;
+}
+
+std::shared_ptr<const BiomeTile> BiomeTileMap::insert(std::shared_ptr<const BiomeTile> tile) {
+    std::lock_guard<std::mutex> l(m_lock);
+    auto it = m_tileMap.find(tile->key);
+    if (it != m_tileMap.end()) return *it->second;
+
+    m_tiles.push_front(tile);
+    m_tileMap[tile->key] = m_tiles.begin();
+    while (m_tiles.size() > m_maxTiles) {
+        m_tileMap.erase(m_tiles.back()->key);
+        m_tiles.pop_back();
+    }
+    return tile;
+}
+
+void BiomeTileMap::clear() {
+    std::lock_guard<std::mutex> l(m_lock);
+    m_tileMap.clear();
+    m_tiles.clear();
+}
+
+size_t BiomeTileMap::getNumTiles() const {
+    std::lock_guard<std::mutex> l(m_lock);
+    return m_tiles.size();
+}
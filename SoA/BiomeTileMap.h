@@ -0,0 +1,80 @@
+//
+// BiomeTileMap.h
+// Seed of Andromeda
+//
+// Copyright 2014 Regrowth Studios
+// MIT License
+//
+// Summary:
+// Child biome noise sampled on a coarse lattice in square tiles of a cube
+// face. The noise that picks sub biomes changes slowly over the surface,
+// so columns can interpolate it from a tile instead of evaluating it.
+//
+
+#pragma once
+
+#ifndef BiomeTileMap_h__
+#define BiomeTileMap_h__
+
+#include "VoxelCoordinateSpaces.h"
+
+#include <list>
+#include <memory>
+
+const ui32 BIOME_TILE_SPACING = 16; ///< Voxels between samples
+const ui32 BIOME_TILE_CELLS = 16; ///< Cells per tile side
+const ui32 BIOME_TILE_SAMPLES = BIOME_TILE_CELLS + 1; ///< Samples per tile side, including the far edge
+const ui32 BIOME_TILE_WIDTH = BIOME_TILE_CELLS * BIOME_TILE_SPACING; ///< Voxels per tile side
+
+struct BiomeTileKey {
+    WorldCubeFace face;
+    i32v2 pos; ///< Position on the face in tiles
+
+    bool operator==(const BiomeTileKey& other) const {
+        return face == other.face && pos == other.pos;
+    }
+};
+
+namespace std {
+    template <>
+    struct hash<BiomeTileKey> {
+        size_t operator()(const BiomeTileKey& k) const {
+            ui64 h = ((ui64)(ui32)k.pos.x << 32) | (ui32)k.pos.y;
+            h ^= (ui64)k.face << 59;
+            return std::hash<ui64>()(h);
+        }
+    };
+}
+
+struct BiomeTile {
+    BiomeTileKey key;
+    /// Child noise of each biome that has children, for each sample.
+    /// Samples are row by row, and each holds one value per such biome.
+    std::vector<f64> values;
+};
+
+class BiomeTileMap {
+public:
+    /// @param maxTiles: Tiles kept in memory
+    BiomeTileMap(size_t maxTiles = 256) : m_maxTiles(maxTiles) {}
+
+    /// Gets a cached tile and marks it as recently used. Thread safe.
+    /// @return nullptr if it isn't cached
+    std::shared_ptr<const BiomeTile> get(const BiomeTileKey& key);
+    /// Caches a tile, dropping the least recently used past maxTiles. Thread safe.
+    /// @return The cached tile, which is an earlier one if another thread got there first
+    std::shared_ptr<const BiomeTile> insert(std::shared_ptr<const BiomeTile> tile);
+    /// Drops all tiles. Tiles still held by callers stay valid.
+    void clear();
+
+    size_t getNumTiles() const;
+private:
+    typedef std::list<std::shared_ptr<const BiomeTile> > TileList;
+
+    mutable std::mutex m_lock;
+    TileList m_tiles; ///< Most recently used first
+    std::unordered_map<BiomeTileKey, TileList::iterator> m_tileMap;
+    size_t m_maxTiles;
+};
+
+#endif // BiomeTileMap_h__
@@ -1,6 +1,7 @@
 #include "stdafx.h"
 #include "Chunk.h"
 
+#include "ChunkCompressionScheduler.h"
 #include "VoxelSpaceConversions.h"
 
 Event<ChunkHandle&> Chunk::DataChange;
@@ -22,12 +23,40 @@ void Chunk::initAndFillEmpty(WorldCubeFace face, vvox::VoxelStorageState /*= vvo
     tertiary.initFromSortedArray(vvox::VoxelStorageState::INTERVAL_TREE, &tertiaryNode, 1);
 }
 
+void Chunk::flagVoxelDirty(BlockIndex blockIndex) {
+    int x = blockIndex % CHUNK_WIDTH;
+    int y = blockIndex / CHUNK_LAYER;
+    int z = (blockIndex % CHUNK_LAYER) / CHUNK_WIDTH;
+    int section = y / CHUNK_MESH_SECTION_HEIGHT;
+    ui8 bit = (ui8)(1 << section);
+
+    // Voxels on a section boundary also change the faces of the next section
+    ui8 sections = bit;
+    if (y % CHUNK_MESH_SECTION_HEIGHT == 0 && section > 0) sections |= bit >> 1;
+    if (y % CHUNK_MESH_SECTION_HEIGHT == CHUNK_MESH_SECTION_HEIGHT - 1 && section < NUM_CHUNK_MESH_SECTIONS - 1) sections |= bit << 1;
+    dirtyMeshSections |= sections;
+
+    if (x == 0 && neighbor.left.isAquired()) neighbor.left->dirtyMeshSections |= bit;
+    if (x == CHUNK_WIDTH_M1 && neighbor.right.isAquired()) neighbor.right->dirtyMeshSections |= bit;
+    if (z == 0 && neighbor.back.isAquired()) neighbor.back->dirtyMeshSections |= bit;
+    if (z == CHUNK_WIDTH_M1 && neighbor.front.isAquired()) neighbor.front->dirtyMeshSections |= bit;
+    if (y == 0 && neighbor.bottom.isAquired()) neighbor.bottom->dirtyMeshSections |= (ui8)(1 << (NUM_CHUNK_MESH_SECTIONS - 1));
+    if (y == CHUNK_WIDTH_M1 && neighbor.top.isAquired()) neighbor.top->dirtyMeshSections |= 1;
+}
+
 void Chunk::setRecyclers(vcore::FixedSizeArrayRecycler<CHUNK_SIZE, ui16>* shortRecycler) {
     blocks.setArrayRecycler(shortRecycler);
     tertiary.setArrayRecycler(shortRecycler);
 }
 
-void Chunk::updateContainers() {
-    blocks.update(dataMutex);
-    tertiary.update(dataMutex);
+void Chunk::updateContainers(ChunkCompressionScheduler& scheduler) {
+    bool coldBlocks = blocks.updateHeat(dataMutex);
+    bool coldTertiary = tertiary.updateHeat(dataMutex);
+    size_t residentBytes;
+    {
+        std::shared_lock<RWSpinLock> l(dataMutex);
+        residentBytes = blocks.getMemoryUsage() + tertiary.getMemoryUsage();
+    }
+    ui32 quietFrames = (ui32)std::min(blocks.getQuietFrames(), tertiary.getQuietFrames());
+    scheduler.report(this, residentBytes, quietFrames, coldBlocks || coldTertiary);
 }
\ No newline at end of file
@@ -22,8 +22,11 @@
 #include "MetaSection.h"
 #include "ChunkGenerator.h"
 #include "ChunkID.h"
+#include "RWSpinLock.h"
 #include <Vorb/FixedSizeArrayRecycler.hpp>
 
+#include <atomic>
+
 #if defined(_MSC_VER)
 #define ALIGNED_(x) __declspec(align(x))
 #else
@@ -31,6 +34,8 @@
 #endif
 
 class Chunk;
+class ChunkCompressionScheduler;
+struct VoxelNodeBatch;
 typedef Chunk* ChunkPtr;
 
 // TODO(Ben): Move to file
@@ -50,6 +55,9 @@ class ChunkGridData {
     bool isLoading;
     bool isLoaded;
     int refCount;
+    // Links for ChunkGridDataStore's LRU list of unreferenced columns
+    ChunkGridData* lruPrev = nullptr;
+    ChunkGridData* lruNext = nullptr;
 };
 
 // TODO(Ben): Can lock two chunks without deadlock worry with checkerboard pattern updates.
@@ -64,14 +72,16 @@ class Chunk {
     friend class SphericalVoxelComponentUpdater;
 public:
     
-    Chunk() : neighbor(), genLevel(ChunkGenLevel::GEN_NONE), pendingGenLevel(ChunkGenLevel::GEN_NONE), isAccessible(false), accessor(nullptr), m_inLoadRange(false),  m_handleState(0), m_handleRefCount(0) {}
+    Chunk() : neighbor(), genLevel(ChunkGenLevel::GEN_NONE), pendingGenLevel(ChunkGenLevel::GEN_NONE), isAccessible(false), pendingNodes(nullptr), dirtyMeshSections(0), accessor(nullptr), m_inLoadRange(false), m_handleRefCount(0) {}
     // Initializes the chunk but does not set voxel data
     // Should be called after ChunkAccessor sets m_id
     void init(WorldCubeFace face);
     // Initializes the chunk and sets all voxel data to 0
     void initAndFillEmpty(WorldCubeFace face, vvox::VoxelStorageState = vvox::VoxelStorageState::INTERVAL_TREE);
     void setRecyclers(vcore::FixedSizeArrayRecycler<CHUNK_SIZE, ui16>* shortRecycler);
-    void updateContainers();
+    // Updates container heat and reports cold containers to the scheduler,
+    // which compresses them off the main thread
+    void updateContainers(ChunkCompressionScheduler& scheduler);
 
     /************************************************************************/
     /* Getters                                                              */
@@ -92,6 +102,9 @@ class Chunk {
 
     // Marks the chunks as dirty and flags for a re-mesh
     void flagDirty() { isDirty = true; }
+    // Flags the mesh sections that show the voxel, including those of neighbors
+    // that pad their meshes with it. Fire DataChange on them to remesh.
+    void flagVoxelDirty(BlockIndex blockIndex);
 
     /************************************************************************/
     /* Members                                                              */
@@ -110,13 +123,15 @@ class Chunk {
         } neighbor;
         ChunkHandle neighbors[6];
     };
-    volatile ChunkGenLevel genLevel;
+    // Atomic since VoxelNodeSetter checks it against pendingNodes on other threads
+    std::atomic<ChunkGenLevel> genLevel;
     ChunkGenLevel pendingGenLevel;
     bool isDirty;
     f32 distance2; //< Squared distance
     int numBlocks;
-    // TODO(Ben): reader/writer lock
-    std::mutex dataMutex;
+    // Guards blocks and tertiary. Readers such as meshing and raycasts
+    // should take it with std::shared_lock so they don't serialize.
+    RWSpinLock dataMutex;
 
     volatile bool isAccessible;
 
@@ -125,6 +140,10 @@ class Chunk {
     vvox::SmartVoxelContainer<ui16> tertiary;
     // Block indexes where flora must be generated.
     std::vector<ui16> floraToGenerate;
+    // Voxels from other chunks waiting on genLevel, newest first. See VoxelNodeSetter.
+    std::atomic<VoxelNodeBatch*> pendingNodes;
+    // Bit per mesh section to rebuild on the next mesh task. See CHUNK_MESH_SECTION_HEIGHT.
+    std::atomic<ui8> dirtyMeshSections;
     volatile ui32 updateVersion;
 
     ChunkAccessor* accessor;
@@ -146,9 +165,7 @@ class Chunk {
     /************************************************************************/
     /* Chunk Handle Data                                                    */
     /************************************************************************/
-    std::mutex m_handleMutex;
-    ALIGNED_(4) volatile ui32 m_handleState;
-    ALIGNED_(4) volatile ui32 m_handleRefCount;
+    std::atomic<ui32> m_handleRefCount; ///< Only ChunkAccessor may change this
 };
 
 #endif // NChunk_h__
@@ -3,13 +3,6 @@
 
 #include "ChunkAllocator.h"
 
-const ui32 HANDLE_STATE_ALIVE = 2;
-#ifdef FAST_CHUNK_ACCESS
-const ui32 HANDLE_STATE_DEAD = 0;
-const ui32 HANDLE_STATE_ACQUIRING = 1;
-const ui32 HANDLE_STATE_FREEING = 3;
-#endif
-
 ChunkHandle::ChunkHandle(const ChunkHandle& other) :
     m_accessor(other.m_acquired ? other.m_chunk->accessor : other.m_accessor),
     m_id(other.m_id),
@@ -25,14 +18,11 @@ ChunkHandle& ChunkHandle::operator= (const ChunkHandle& other) {
 }
 
 void ChunkHandle::acquireSelf() {
-    if (!m_acquired) m_chunk->accessor->acquire(*this);
+    if (!m_acquired) *this = m_accessor->acquire(m_id);
 }
 ChunkHandle ChunkHandle::acquire() {
     if (m_acquired) {
-        ChunkHandle h(m_chunk->accessor->acquire(*this));
-        h.m_acquired = true;
-        h.m_chunk = m_chunk;
-        return h;
+        return m_chunk->accessor->acquire(*this);
     } else {
         return m_accessor->acquire(m_id);
     }
@@ -45,154 +35,92 @@ void ChunkAccessor::init(PagedChunkAllocator* allocator) {
     m_allocator = allocator;
 }
 void ChunkAccessor::destroy() {
-    std::unordered_map<ChunkID, ChunkHandle>().swap(m_chunkLookup);
-}
-
-#ifdef FAST_CHUNK_ACCESS
-
-ChunkHandle ChunkAccessor::acquire(ChunkID id) {
-    std::unique_lock<std::mutex> lMap(m_lckLookup);
-    auto& it = m_chunkLookup.find(id);
-    if (it == m_chunkLookup.end()) {
-        ChunkHandle& h = m_chunkLookup[id];
-        h.m_chunk = m_allocator->alloc();
-        h->m_handleRefCount = 1;
-        h->m_id = id;
-        h->accessor = this;
-        h->m_handleState = HANDLE_STATE_ALIVE;
-        lMap.unlock();
-        onAdd(ChunkHandle(h));
-        return h;
-    } else {
-        InterlockedIncrement(&it->second->m_handleRefCount);
-        it->second->m_handleState = HANDLE_STATE_ALIVE;
-        return it->second;
+    for (auto& shard : m_lookupShards) {
+        std::lock_guard<RWSpinLock> l(shard.lock);
+        std::unordered_map<ChunkID, Chunk*>().swap(shard.chunks);
     }
+    m_countAlive = 0;
 }
-ChunkHandle ChunkAccessor::acquire(ChunkHandle& chunk) {
-    switch (InterlockedCompareExchange(&chunk->m_handleState, HANDLE_STATE_ACQUIRING, HANDLE_STATE_ALIVE)) {
-    case HANDLE_STATE_FREEING:
-        return acquire(chunk->m_id);
-    case HANDLE_STATE_ACQUIRING:
-        InterlockedIncrement(&chunk->m_handleRefCount);
-        return chunk;
-    case HANDLE_STATE_ALIVE:
-        InterlockedIncrement(&chunk->m_handleRefCount);
-        InterlockedCompareExchange(&chunk->m_handleState, HANDLE_STATE_ALIVE, HANDLE_STATE_ACQUIRING);
-        return chunk;
-    default:
-        throw std::invalid_argument("INVALID CHUNK HANDLE STATE");
-    }
-}
-void ChunkAccessor::release(ChunkHandle& chunk) {
-    ui32 retries = 0;
 
-    // TODO(Cristian): Heavy thread-safety
-    ui32 currentCount = InterlockedDecrement(&chunk->m_handleRefCount);
-RETEST_CHUNK_LIVELINESS:
-    if (currentCount == 0) {
-        // If the chunk is alive, set it to zombie mode. Otherwise, it's being birthed or already dead.
-        switch (InterlockedCompareExchange(&chunk->m_handleState, HANDLE_STATE_FREEING, HANDLE_STATE_ALIVE)) {
-        case HANDLE_STATE_ALIVE:
-        { // Highlander... there can only be one... killer of chunks
-            std::lock_guard<std::mutex> chunkLock(chunk->m_handleMutex);
-            currentCount = InterlockedDecrement(&chunk->m_handleRefCount);
-            if (chunk->m_handleState == HANDLE_STATE_FREEING) {
-                // We are able to kill this chunk
-                safeRemove(chunk);
-            }
-        }
-        case HANDLE_STATE_FREEING:
-            // Let the other thread do the work
-            break;
-        case HANDLE_STATE_ACQUIRING:
-            // Need to retry
-            std::this_thread::yield();
-            currentCount = chunk->m_handleRefCount;
-            retries++;
-            goto RETEST_CHUNK_LIVELINESS;
+ChunkHandle ChunkAccessor::acquire(ChunkID id) {
+    LookupShard& shard = getShard(id);
+    { // Most requests are for chunks that already exist, and only need the shard shared
+        std::shared_lock<RWSpinLock> l(shard.lock);
+        auto it = shard.chunks.find(id);
+        if (it != shard.chunks.end()) {
+            // The entry can't be erased while we hold the shard lock. If the count
+            // was 0 this revives the chunk, and the pending safeRemove will see that.
+            it->second->m_handleRefCount.fetch_add(1, std::memory_order_relaxed);
+            return makeHandle(it->second, id);
         }
     }
-
-    // Invalidate the handle
-    chunk.m_chunk = nullptr;
-    if (retries > 2) {
-        printf("A lot of release retries occurred: %d\n", retries);
-        fflush(stdout);
-    }
-}
-
-#else
-
-ChunkHandle ChunkAccessor::acquire(ChunkID id) {
-    bool wasOld;
-    ChunkHandle chunk = safeAdd(id, wasOld);
-
-    if (wasOld) return acquire(chunk);
-
-    chunk.m_acquired = true;
-    return chunk;
+    return safeAdd(id);
 }
 ChunkHandle ChunkAccessor::acquire(ChunkHandle& chunk) {
-    std::lock_guard<std::mutex> lChunk(chunk->m_handleMutex);
-    if (chunk->m_handleRefCount == 0) {
-        // We need to re-add the chunk
-        bool wasOld = false;
-        chunk.m_acquired = true;
-        return safeAdd(chunk.m_id, wasOld);
-    } else {
-        ChunkHandle retValue = {};
-        memcpy(&retValue, &chunk, sizeof(ChunkHandle));
-        retValue->m_handleRefCount++;
-        retValue.m_acquired = true;
-        return retValue;
-    }
+    // The caller holds a reference, so the chunk can't be removed
+    chunk->m_handleRefCount.fetch_add(1, std::memory_order_relaxed);
+    return makeHandle(chunk.m_chunk, chunk.m_id);
 }
 void ChunkAccessor::release(ChunkHandle& chunk) {
-    std::lock_guard<std::mutex> lChunk(chunk->m_handleMutex);
-    chunk->m_handleRefCount--;
-    if (chunk->m_handleRefCount == 0) {
-        // We need to remove the chunk
-        safeRemove(chunk);
+    if (chunk->m_handleRefCount.fetch_sub(1, std::memory_order_release) == 1) {
+        // Last reference, but it may be revived before we get the shard lock
+        std::atomic_thread_fence(std::memory_order_acquire);
+        safeRemove(chunk.m_chunk, chunk.m_id);
     }
     chunk.m_acquired = false;
     chunk.m_accessor = this;
 }
 
-#endif
+ChunkHandle ChunkAccessor::makeHandle(Chunk* chunk, const ChunkID& id) {
+    ChunkHandle h;
+    h.m_chunk = chunk;
+    h.m_id = id;
+    h.m_acquired = true;
+    return h;
+}
 
-ChunkHandle ChunkAccessor::safeAdd(ChunkID id, bool& wasOld) {
-    std::unique_lock<std::mutex> l(m_lckLookup);
-    auto it = m_chunkLookup.find(id);
-    if (it == m_chunkLookup.end()) {
-        wasOld = false;
-        ChunkHandle& h = m_chunkLookup[id];
-        h.m_chunk = m_allocator->alloc();
-        h.m_id = id;
-        h->m_id = id;
-        h->accessor = this;
-        h->m_handleState = HANDLE_STATE_ALIVE;
-        h->m_handleRefCount = 1;
-        ChunkHandle tmp(h);
-        l.unlock();
-        onAdd(tmp);
-        return h;
-    } else {
-        wasOld = true;
-        return it->second;
+ChunkHandle ChunkAccessor::safeAdd(ChunkID id) {
+    LookupShard& shard = getShard(id);
+    std::unique_lock<RWSpinLock> l(shard.lock);
+    // Another thread may have added it while we waited for the lock
+    auto it = shard.chunks.find(id);
+    if (it != shard.chunks.end()) {
+        it->second->m_handleRefCount.fetch_add(1, std::memory_order_relaxed);
+        return makeHandle(it->second, id);
     }
+
+    Chunk* chunk = m_allocator->alloc();
+    chunk->m_id = id;
+    chunk->accessor = this;
+    chunk->m_handleRefCount.store(1, std::memory_order_relaxed);
+    shard.chunks[id] = chunk;
+    l.unlock();
+    m_countAlive++;
+
+    ChunkHandle h = makeHandle(chunk, id);
+    onAdd(h);
+    return h;
 }
-void ChunkAccessor::safeRemove(ChunkHandle& chunk) {
+void ChunkAccessor::safeRemove(Chunk* chunk, const ChunkID& id) {
     { // TODO(Cristian): This needs to be added to a free-list?
-        std::lock_guard<std::mutex> l(m_lckLookup);
+        LookupShard& shard = getShard(id);
+        std::lock_guard<RWSpinLock> l(shard.lock);
+        // Another thread may have revived the chunk, or revived and removed it
+        // already, in which case the chunk may be gone. Check the table before
+        // touching the chunk.
+        auto it = shard.chunks.find(id);
+        if (it == shard.chunks.end() || it->second != chunk) return;
+        if (chunk->m_handleRefCount.load(std::memory_order_acquire) != 0) return;
 
         // Make sure it can't be accessed until acquired again
         chunk->accessor = nullptr;
 
         // TODO(Ben): Time based free?
-        m_chunkLookup.erase(chunk.m_id);
+        shard.chunks.erase(it);
     }
+    m_countAlive--;
     // Fire event before deallocating
-    onRemove(chunk);
-    m_allocator->free(chunk.m_chunk);
+    ChunkHandle h = makeHandle(chunk, id);
+    onRemove(h);
+    m_allocator->free(chunk);
 }
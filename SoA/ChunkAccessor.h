@@ -20,6 +20,8 @@
 
 #include <Vorb/Event.hpp>
 
+#include <atomic>
+
 class ChunkAccessor {
     friend class ChunkHandle;
 public:
@@ -29,7 +31,7 @@ class ChunkAccessor {
     ChunkHandle acquire(ChunkID id);
 
     size_t getCountAlive() const {
-        return m_chunkLookup.size();
+        return m_countAlive;
     }
 
     Event<ChunkHandle&> onAdd; ///< Called when a handle is added
@@ -38,11 +40,28 @@ class ChunkAccessor {
     ChunkHandle acquire(ChunkHandle& chunk);
     void release(ChunkHandle& chunk);
 
-    ChunkHandle safeAdd(ChunkID id, bool& wasOld);
-    void safeRemove(ChunkHandle& chunk);
+    static ChunkHandle makeHandle(Chunk* chunk, const ChunkID& id);
+    /// Adds the chunk if it doesn't exist yet and acquires it
+    ChunkHandle safeAdd(ChunkID id);
+    /// Removes the chunk if nothing has acquired it since its count reached 0
+    void safeRemove(Chunk* chunk, const ChunkID& id);
+
+    // Lookup is split into shards so that threads working on different
+    // chunks rarely touch the same lock. Hits take the shard's spin lock
+    // shared, so they run alongside each other but not wait-free: they spin
+    // while an add or remove holds the shard.
+    static const size_t NUM_LOOKUP_SHARDS = 64;
+    struct LookupShard {
+        RWSpinLock lock;
+        std::unordered_map<ChunkID, Chunk*> chunks;
+    };
+    LookupShard& getShard(const ChunkID& id) {
+        // Fibonacci hash so neighboring IDs spread across shards
+        return m_lookupShards[(id.id * 0x9E3779B97F4A7C15ull) >> 58];
+    }
 
-    std::mutex m_lckLookup;
-    std::unordered_map<ChunkID, ChunkHandle> m_chunkLookup;
+    LookupShard m_lookupShards[NUM_LOOKUP_SHARDS];
+    std::atomic<size_t> m_countAlive{ 0 };
     PagedChunkAllocator* m_allocator = nullptr;
 };
 
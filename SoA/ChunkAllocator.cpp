@@ -2,41 +2,91 @@
 #include "ChunkAllocator.h"
 #include "Chunk.h"
 
+#if defined(_WIN32) || defined(_WIN64)
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
 #define MAX_VOXEL_ARRAYS_TO_CACHE 200
 #define NUM_SHORT_VOXEL_ARRAYS 3
 #define NUM_BYTE_VOXEL_ARRAYS 1
 
 #define INITIAL_UPDATE_VERSION 1
 
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+namespace {
+    /// Gets page aligned memory straight from the OS so that it can be returned
+    /// @param bytes: Requested size. May be rounded up.
+    /// @param isHuge: Set to true if the memory is backed by huge pages
+    void* allocPageMemory(size_t& bytes, bool useHugePages VORB_MAYBE_UNUSED, bool& isHuge) {
+        isHuge = false;
+#if defined(_WIN32) || defined(_WIN64)
+        // Large pages need SeLockMemoryPrivilege, so we stick to regular pages here
+        return VirtualAlloc(nullptr, bytes, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#else
+        if (useHugePages) {
+            // Round up so the whole allocation can be huge page backed
+            bytes = (bytes + HUGE_PAGE_SIZE - 1) & ~(size_t)(HUGE_PAGE_SIZE - 1);
+#ifdef MAP_HUGETLB
+            void* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (memory != MAP_FAILED) {
+                isHuge = true;
+                return memory;
+            }
+#endif
+        }
+        void* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) return nullptr;
+#ifdef MADV_HUGEPAGE
+        // No reserved huge pages, so ask for transparent huge pages instead
+        if (useHugePages && madvise(memory, bytes, MADV_HUGEPAGE) == 0) isHuge = true;
+#endif
+        return memory;
+#endif
+    }
+
+    void freePageMemory(void* memory, size_t bytes VORB_MAYBE_UNUSED) {
+#if defined(_WIN32) || defined(_WIN64)
+        VirtualFree(memory, 0, MEM_RELEASE);
+#else
+        munmap(memory, bytes);
+#endif
+    }
+}
+
 PagedChunkAllocator::PagedChunkAllocator() :
-m_shortFixedSizeArrayRecycler(MAX_VOXEL_ARRAYS_TO_CACHE * NUM_SHORT_VOXEL_ARRAYS) {
+m_shortFixedSizeArrayRecycler(MAX_VOXEL_ARRAYS_TO_CACHE * NUM_SHORT_VOXEL_ARRAYS),
+m_numLive(0),
+m_peakLive(0) {
     // Empty
 }
 
 PagedChunkAllocator::~PagedChunkAllocator() {
-    for (auto& page : m_chunkPages) {
-        delete page;
+    while (m_chunkPages.size()) {
+        freePage(m_chunkPages.back());
     }
 }
 
 Chunk* PagedChunkAllocator::alloc() {
     // TODO(Ben): limit
-    std::lock_guard<std::mutex> lock(m_lock);
-
-    // Allocate chunk pages if needed
-    if (m_freeChunks.empty()) {
-        ChunkPage* page = new ChunkPage();
-        m_chunkPages.push_back(page);
-        // Add chunks to free chunks lists
-        for (size_t i = 0; i < CHUNK_PAGE_SIZE; i++) {
-            Chunk* chunk = &page->chunks[CHUNK_PAGE_SIZE - i - 1];
-            chunk->setRecyclers(&m_shortFixedSizeArrayRecycler);
-            m_freeChunks.push_back(chunk);
+    Chunk* chunk;
+    {
+        Magazine& magazine = getMagazine();
+        std::lock_guard<std::mutex> l(magazine.lock);
+        if (magazine.size == 0) {
+            std::lock_guard<std::mutex> lock(m_lock);
+            refill(magazine, MAGAZINE_SIZE / 2);
         }
+        // Grab a free chunk
+        chunk = magazine.chunks[--magazine.size];
     }
-    // Grab a free chunk
-    Chunk* chunk = m_freeChunks.back();
-    m_freeChunks.pop_back();
+
+    // Track the peak
+    size_t live = ++m_numLive;
+    size_t peak = m_peakLive.load(std::memory_order_relaxed);
+    while (live > peak && !m_peakLive.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
 
     // Set defaults
     chunk->gridData = nullptr;
@@ -45,6 +95,7 @@ Chunk* PagedChunkAllocator::alloc() {
     chunk->genLevel = ChunkGenLevel::GEN_NONE;
     chunk->pendingGenLevel = ChunkGenLevel::GEN_NONE;
     chunk->isAccessible = false;
+    chunk->pendingNodes = nullptr;
     chunk->distance2 = FLT_MAX;
     chunk->updateVersion = INITIAL_UPDATE_VERSION;
     memset(chunk->neighbors, 0, sizeof(chunk->neighbors));
@@ -53,12 +104,149 @@ Chunk* PagedChunkAllocator::alloc() {
 }
 
 void PagedChunkAllocator::free(Chunk* chunk) {
-    // TODO(Ben): Deletion if there is a lot?
-    std::lock_guard<std::mutex> lock(m_lock);
-    m_freeChunks.push_back(chunk);
-
     // Free data
     chunk->blocks.clear();
     chunk->tertiary.clear();
     std::vector<ChunkQuery*>().swap(chunk->m_genQueryData.pending);
+    m_numLive--;
+
+    Magazine& magazine = getMagazine();
+    std::lock_guard<std::mutex> l(magazine.lock);
+    if (magazine.size == MAGAZINE_SIZE) {
+        // Flush the oldest half back to the pages
+        const size_t NUM_TO_FLUSH = MAGAZINE_SIZE / 2;
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            for (size_t i = 0; i < NUM_TO_FLUSH; i++) {
+                returnToPage(magazine.chunks[i]);
+            }
+        }
+        memmove(magazine.chunks, magazine.chunks + NUM_TO_FLUSH, (MAGAZINE_SIZE - NUM_TO_FLUSH) * sizeof(Chunk*));
+        magazine.size -= NUM_TO_FLUSH;
+    }
+    magazine.chunks[magazine.size++] = chunk;
+}
+
+void PagedChunkAllocator::trim() {
+    for (auto& magazine : m_magazines) {
+        std::lock_guard<std::mutex> l(magazine.lock);
+        std::lock_guard<std::mutex> lock(m_lock);
+        for (size_t i = 0; i < magazine.size; i++) {
+            returnToPage(magazine.chunks[i]);
+        }
+        magazine.size = 0;
+    }
+
+    // Release pages that were kept around as slack
+    std::lock_guard<std::mutex> lock(m_lock);
+    for (size_t i = 0; i < m_chunkPages.size();) {
+        if (m_chunkPages[i]->freeChunks.size() == CHUNK_PAGE_SIZE) {
+            freePage(m_chunkPages[i]);
+        } else {
+            i++;
+        }
+    }
+}
+
+ChunkAllocatorStats PagedChunkAllocator::getStats() {
+    ChunkAllocatorStats stats;
+    stats.liveChunks = m_numLive;
+    stats.peakLiveChunks = m_peakLive;
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    stats.pages = m_chunkPages.size();
+    for (auto& page : m_chunkPages) {
+        if (page->isHuge) stats.hugePages++;
+        stats.residentBytes += page->bytes;
+    }
+    stats.reclaimedPages = m_numReclaimedPages;
+    // Chunks in magazines count as free
+    size_t capacity = stats.pages * CHUNK_PAGE_SIZE;
+    stats.freeChunks = capacity > stats.liveChunks ? capacity - stats.liveChunks : 0;
+    return stats;
+}
+
+PagedChunkAllocator::Magazine& PagedChunkAllocator::getMagazine() {
+    // Each thread picks a slot once. Threads only share a magazine when
+    // there are more than NUM_MAGAZINES of them.
+    static std::atomic<ui32> nextSlot(0);
+    thread_local ui32 slot = nextSlot++;
+    return m_magazines[slot % NUM_MAGAZINES];
+}
+
+void PagedChunkAllocator::refill(Magazine& magazine, size_t count) {
+    while (magazine.size < count) {
+        // Take from the fullest page so that emptier pages can drain and be reclaimed
+        ChunkPage* page = nullptr;
+        for (auto& p : m_chunkPages) {
+            if (p->freeChunks.size() && (!page || p->freeChunks.size() < page->freeChunks.size())) {
+                page = p;
+            }
+        }
+        // Allocate chunk pages if needed
+        if (!page) page = allocPage();
+
+        while (magazine.size < count && page->freeChunks.size()) {
+            magazine.chunks[magazine.size++] = page->freeChunks.back();
+            page->freeChunks.pop_back();
+            m_numFreeInPages--;
+        }
+    }
+}
+
+void PagedChunkAllocator::returnToPage(Chunk* chunk) {
+    ChunkPage* page = findPage(chunk);
+    page->freeChunks.push_back(chunk);
+    m_numFreeInPages++;
+
+    // Keep half a page of free chunks around so we don't thrash
+    // pages when the live count hovers around a page boundary
+    if (m_reclaimPages && page->freeChunks.size() == CHUNK_PAGE_SIZE &&
+        m_numFreeInPages - CHUNK_PAGE_SIZE >= CHUNK_PAGE_SIZE / 2) {
+        freePage(page);
+    }
+}
+
+PagedChunkAllocator::ChunkPage* PagedChunkAllocator::allocPage() {
+    ChunkPage* page = new ChunkPage;
+    page->bytes = CHUNK_PAGE_SIZE * sizeof(Chunk);
+    page->chunks = (Chunk*)allocPageMemory(page->bytes, m_useHugePages, page->isHuge);
+    if (!page->chunks) {
+        delete page;
+        throw std::bad_alloc();
+    }
+
+    // Add chunks to free chunks lists
+    page->freeChunks.resize(CHUNK_PAGE_SIZE);
+    for (size_t i = 0; i < CHUNK_PAGE_SIZE; i++) {
+        Chunk* chunk = new (&page->chunks[i]) Chunk();
+        chunk->setRecyclers(&m_shortFixedSizeArrayRecycler);
+        page->freeChunks[CHUNK_PAGE_SIZE - i - 1] = chunk;
+    }
+    m_numFreeInPages += CHUNK_PAGE_SIZE;
+
+    auto it = std::upper_bound(m_chunkPages.begin(), m_chunkPages.end(), page, [](const ChunkPage* a, const ChunkPage* b) {
+        return std::less<const Chunk*>()(a->chunks, b->chunks);
+    });
+    m_chunkPages.insert(it, page);
+    return page;
+}
+
+void PagedChunkAllocator::freePage(ChunkPage* page) {
+    for (size_t i = 0; i < CHUNK_PAGE_SIZE; i++) {
+        page->chunks[i].~Chunk();
+    }
+    freePageMemory(page->chunks, page->bytes);
+    m_numFreeInPages -= page->freeChunks.size();
+    m_chunkPages.erase(std::find(m_chunkPages.begin(), m_chunkPages.end(), page));
+    m_numReclaimedPages++;
+    delete page;
+}
+
+PagedChunkAllocator::ChunkPage* PagedChunkAllocator::findPage(Chunk* chunk) {
+    auto it = std::upper_bound(m_chunkPages.begin(), m_chunkPages.end(), chunk, [](const Chunk* c, const ChunkPage* p) {
+        return std::less<const Chunk*>()(c, p->chunks);
+    });
+    assert(it != m_chunkPages.begin());
+    return *(it - 1);
 }
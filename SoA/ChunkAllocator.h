@@ -15,12 +15,28 @@
 #ifndef ChunkAllocator_h__
 #define ChunkAllocator_h__
 
+#include <atomic>
 #include <Vorb/FixedSizeArrayRecycler.hpp>
 
 #include "Chunk.h"
 #include "Constants.h"
 
+struct ChunkAllocatorStats {
+    size_t liveChunks = 0; ///< Chunks currently handed out
+    size_t freeChunks = 0; ///< Chunks in resident pages that are not handed out
+    size_t peakLiveChunks = 0; ///< Highest liveChunks has been
+    size_t pages = 0; ///< Resident pages
+    size_t hugePages = 0; ///< Resident pages backed by huge pages
+    size_t reclaimedPages = 0; ///< Pages returned to the OS so far
+    size_t residentBytes = 0; ///< Memory held by resident pages
+};
+
 /*! @brief The chunk allocator.
+ *
+ * Chunks are carved out of pages of CHUNK_PAGE_SIZE chunks. Each thread
+ * allocates from and frees into its own small magazine, so the shared free
+ * lists are only touched once per magazine refill or flush. Pages whose
+ * chunks have all been freed are returned to the OS.
  */
 class PagedChunkAllocator {
     friend class SphericalVoxelComponentUpdater;
@@ -36,16 +52,61 @@ class PagedChunkAllocator {
     Chunk* alloc();
     /// Frees a chunk
     void free(Chunk* chunk);
+
+    /// Flushes all magazines and returns every fully free page to the OS
+    void trim();
+
+    /// Back new pages with huge pages where the OS supports it.
+    /// Only affects pages allocated after the call.
+    void setUseHugePages(bool useHugePages) { m_useHugePages = useHugePages; }
+    /// Return fully free pages to the OS as they empty. On by default.
+    void setReclaimPages(bool reclaimPages) { m_reclaimPages = reclaimPages; }
+
+    ChunkAllocatorStats getStats();
 protected:
     static const size_t CHUNK_PAGE_SIZE = 2048;
+    static const size_t NUM_MAGAZINES = 16;
+    static const size_t MAGAZINE_SIZE = 32;
     struct ChunkPage {
-        Chunk chunks[CHUNK_PAGE_SIZE];
+        Chunk* chunks; ///< CHUNK_PAGE_SIZE chunks in one OS allocation
+        size_t bytes; ///< Size of the OS allocation
+        bool isHuge;
+        std::vector<Chunk*> freeChunks; ///< Free chunks that are not in a magazine
     };
+    /// Per thread cache of free chunks
+    struct Magazine {
+        std::mutex lock;
+        Chunk* chunks[MAGAZINE_SIZE];
+        size_t size = 0;
+    };
+
+    Magazine& getMagazine();
+    /// Moves up to count free chunks into the magazine. Allocates a page if needed.
+    /// m_lock must be held.
+    void refill(Magazine& magazine, size_t count);
+    /// Returns the chunk to its page's free list and releases the page if it is empty.
+    /// m_lock must be held.
+    void returnToPage(Chunk* chunk);
+    /// m_lock must be held.
+    ChunkPage* allocPage();
+    /// m_lock must be held.
+    void freePage(ChunkPage* page);
+    /// Finds the page that holds chunk. m_lock must be held.
+    ChunkPage* findPage(Chunk* chunk);
+
+    Magazine m_magazines[NUM_MAGAZINES];
 
-    std::vector<Chunk*> m_freeChunks; ///< List of inactive chunks
-    std::vector<ChunkPage*> m_chunkPages; ///< All pages
+    std::vector<ChunkPage*> m_chunkPages; ///< All resident pages, sorted by address
+    size_t m_numFreeInPages = 0; ///< Sum of freeChunks over all pages
+    size_t m_numReclaimedPages = 0;
     vcore::FixedSizeArrayRecycler<CHUNK_SIZE, ui16> m_shortFixedSizeArrayRecycler; ///< For recycling voxel data
-    std::mutex m_lock; ///< Lock access to free-list
+    std::mutex m_lock; ///< Lock access to pages and their free lists
+
+    std::atomic<size_t> m_numLive;
+    std::atomic<size_t> m_peakLive;
+
+    bool m_useHugePages = false;
+    bool m_reclaimPages = true;
 };
 
 #endif // ChunkAllocator_h__
@@ -0,0 +1,131 @@
+#include "stdafx.h"
+#include "ChunkCompressionScheduler.h"
+
+#include <Vorb/Timing.h>
+#include <algorithm>
+
+#include "Chunk.h"
+#include "ChunkAccessor.h"
+
+// Weight of the newest sample in the running averages
+#define COMPRESSION_AVG_ALPHA 0.1
+// Assumed cost of a task before any have finished
+#define DEFAULT_COMPRESS_MS 0.25
+
+void ChunkCompressionTask::execute(WorkerData* workerData VORB_MAYBE_UNUSED) {
+    ChunkCompressionScheduler::Result result;
+    result.id = chunk.getID();
+
+    size_t bytesBefore;
+    {
+        std::shared_lock<RWSpinLock> l(chunk->dataMutex);
+        bytesBefore = chunk->blocks.getMemoryUsage() + chunk->tertiary.getMemoryUsage();
+    }
+
+    PreciseTimer timer;
+    timer.start();
+    bool didBlocks = chunk->blocks.tryCompress(chunk->dataMutex);
+    bool didTertiary = chunk->tertiary.tryCompress(chunk->dataMutex);
+    result.ms = timer.stop();
+    result.didCompress = didBlocks || didTertiary;
+
+    size_t bytesAfter;
+    {
+        std::shared_lock<RWSpinLock> l(chunk->dataMutex);
+        bytesAfter = chunk->blocks.getMemoryUsage() + chunk->tertiary.getMemoryUsage();
+    }
+    result.bytesSaved = bytesBefore > bytesAfter ? bytesBefore - bytesAfter : 0;
+
+    chunk.release();
+    scheduler->m_finishedTasks.enqueue(result);
+}
+
+void ChunkCompressionTask::cleanup() {
+    delete this;
+}
+
+void ChunkCompressionScheduler::init(vcore::ThreadPool<WorkerData>* threadPool, ChunkAccessor* accessor) {
+    m_threadPool = threadPool;
+    m_accessor = accessor;
+}
+
+void ChunkCompressionScheduler::report(Chunk* chunk, size_t residentBytes, ui32 quietFrames, bool isCold) {
+    m_residentBytes += residentBytes;
+    if (isCold && m_inFlight.find(chunk->getID()) == m_inFlight.end()) {
+        m_candidates.push_back(Candidate{ chunk->getID(), quietFrames });
+    }
+}
+
+void ChunkCompressionScheduler::update() {
+    // Collect finished tasks
+#define MAX_RESULTS 1024
+    Result results[MAX_RESULTS];
+    size_t numResults;
+    while ((numResults = m_finishedTasks.try_dequeue_bulk(results, MAX_RESULTS)) != 0) {
+        for (size_t i = 0; i < numResults; i++) {
+            finishTask(results[i]);
+        }
+    }
+#undef MAX_RESULTS
+
+    m_counters.residentBytes = m_residentBytes;
+    m_counters.coldChunks = (ui32)m_candidates.size();
+    m_counters.dispatched = 0;
+
+    // Only compress when we are over the memory target
+    if (m_threadPool && (m_residentTarget == 0 || m_residentBytes > m_residentTarget)) {
+        // Coldest chunks first
+        std::sort(m_candidates.begin(), m_candidates.end(), [](const Candidate& a, const Candidate& b) {
+            return a.quietFrames > b.quietFrames;
+        });
+
+        f64 taskMs = m_counters.avgCompressMs > 0.0 ? m_counters.avgCompressMs : DEFAULT_COMPRESS_MS;
+        // Tasks still queued from earlier frames eat into this frame's budget
+        f64 budgetMs = m_frameBudgetMs - m_inFlight.size() * taskMs;
+        size_t projectedBytes = m_residentBytes;
+
+        for (auto& c : m_candidates) {
+            // Always allow one task so that we can't stall completely
+            if (m_counters.dispatched > 0 && budgetMs < taskMs) break;
+            if (m_residentTarget && projectedBytes <= m_residentTarget) break;
+
+            ChunkHandle chunk = m_accessor->acquire(c.id);
+            ChunkCompressionTask* task = new ChunkCompressionTask;
+            task->chunk = std::move(chunk);
+            task->scheduler = this;
+            m_threadPool->addTask(task);
+            m_inFlight.insert(c.id);
+
+            budgetMs -= taskMs;
+            projectedBytes -= std::min(projectedBytes, (size_t)m_avgBytesSaved);
+            m_counters.dispatched++;
+        }
+    }
+
+    m_counters.inFlight = (ui32)m_inFlight.size();
+    m_candidates.clear();
+    m_residentBytes = 0;
+}
+
+void ChunkCompressionScheduler::finishTask(const Result& result) {
+    m_inFlight.erase(result.id);
+
+    m_counters.totalCompressMs += result.ms;
+    if (m_counters.avgCompressMs == 0.0) {
+        m_counters.avgCompressMs = result.ms;
+    } else {
+        m_counters.avgCompressMs += (result.ms - m_counters.avgCompressMs) * COMPRESSION_AVG_ALPHA;
+    }
+
+    if (result.didCompress) {
+        m_counters.compressions++;
+        m_counters.bytesSaved += result.bytesSaved;
+        if (m_avgBytesSaved == 0.0) {
+            m_avgBytesSaved = (f64)result.bytesSaved;
+        } else {
+            m_avgBytesSaved += ((f64)result.bytesSaved - m_avgBytesSaved) * COMPRESSION_AVG_ALPHA;
+        }
+    } else {
+        m_counters.skipped++;
+    }
+}
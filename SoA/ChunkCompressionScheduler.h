@@ -0,0 +1,107 @@
+//
+// ChunkCompressionScheduler.h
+// Seed of Andromeda
+//
+// Copyright 2014 Regrowth Studios
+// MIT License
+//
+// Summary:
+// Compresses cold chunk voxel containers on worker threads within
+// a per-frame time budget and a resident memory target.
+//
+
+#pragma once
+
+#ifndef ChunkCompressionScheduler_h__
+#define ChunkCompressionScheduler_h__
+
+#include <Vorb/concurrentqueue.h>
+#include <Vorb/IThreadPoolTask.h>
+
+#include "ChunkHandle.h"
+#include "ChunkID.h"
+#include "VoxPool.h"
+
+class Chunk;
+class ChunkAccessor;
+class ChunkCompressionScheduler;
+
+#define CHUNK_COMPRESSION_TASK_ID 7
+
+struct ChunkCompressionCounters {
+    ui64 compressions = 0; ///< Chunks with at least one container compressed
+    ui64 skipped = 0; ///< Tasks that found their chunk already compressed or hot again
+    ui64 bytesSaved = 0; ///< Total resident bytes freed by compression
+    f64 totalCompressMs = 0.0; ///< Total worker time spent compressing
+    f64 avgCompressMs = 0.0; ///< Running average cost of one task
+    size_t residentBytes = 0; ///< Voxel memory reported in the last frame
+    ui32 coldChunks = 0; ///< Chunks reported cold in the last frame
+    ui32 dispatched = 0; ///< Tasks dispatched in the last frame
+    ui32 inFlight = 0; ///< Tasks currently queued or running
+};
+
+class ChunkCompressionTask : public vcore::IThreadPoolTask<WorkerData> {
+public:
+    ChunkCompressionTask() : vcore::IThreadPoolTask<WorkerData>(CHUNK_COMPRESSION_TASK_ID) {}
+
+    void execute(WorkerData* workerData) override;
+
+    void cleanup() override;
+
+    ChunkHandle chunk;
+    ChunkCompressionScheduler* scheduler = nullptr;
+};
+
+class ChunkCompressionScheduler {
+    friend class ChunkCompressionTask;
+public:
+    void init(vcore::ThreadPool<WorkerData>* threadPool, ChunkAccessor* accessor);
+
+    /// Called by Chunk::updateContainers once per frame for each active chunk.
+    /// @param chunk: The chunk that was updated
+    /// @param residentBytes: Memory currently held by the chunk's voxel containers
+    /// @param quietFrames: Frames since the chunk was last accessed heavily
+    /// @param isCold: True if any of the chunk's containers can be compressed
+    void report(Chunk* chunk, size_t residentBytes, ui32 quietFrames, bool isCold);
+
+    /// Dispatches compression for the coldest chunks. Call once per frame
+    /// after all chunks have reported.
+    void update();
+
+    /// Sets how much worker time compression may use per frame
+    void setFrameBudget(f64 ms) { m_frameBudgetMs = ms; }
+    /// Sets the resident voxel memory below which cold chunks are left alone.
+    /// 0 means always compress cold chunks.
+    void setResidentMemoryTarget(size_t bytes) { m_residentTarget = bytes; }
+
+    const ChunkCompressionCounters& getCounters() const { return m_counters; }
+private:
+    struct Candidate {
+        ChunkID id;
+        ui32 quietFrames;
+    };
+    struct Result {
+        ChunkID id;
+        f64 ms;
+        size_t bytesSaved;
+        bool didCompress;
+    };
+
+    void finishTask(const Result& result);
+
+    vcore::ThreadPool<WorkerData>* m_threadPool = nullptr;
+    ChunkAccessor* m_accessor = nullptr;
+
+    std::vector<Candidate> m_candidates; ///< Cold chunks reported this frame
+    std::unordered_set<ChunkID> m_inFlight; ///< Chunks with a pending task
+    moodycamel::ConcurrentQueue<Result> m_finishedTasks;
+    size_t m_residentBytes = 0; ///< Accumulated this frame
+
+    f64 m_frameBudgetMs = 2.0;
+    size_t m_residentTarget = 0;
+    f64 m_avgBytesSaved = 0.0;
+
+    ChunkCompressionCounters m_counters;
+};
+
+#endif // ChunkCompressionScheduler_h__
@@ -8,9 +8,10 @@
 
 void ChunkGenerator::init(vcore::ThreadPool<WorkerData>* threadPool,
                           PlanetGenData* genData,
-                          ChunkGrid* grid) {
+                          ChunkGrid* grid,
+                          OPT HeightmapTileCache* heightmapCache /*= nullptr*/) {
     m_threadPool = threadPool;
-    m_proceduralGenerator.init(genData);
+    m_proceduralGenerator.init(genData, heightmapCache);
     m_grid = grid;
 }
 
@@ -32,9 +33,24 @@ void ChunkGenerator::submitQuery(ChunkQuery* query) {
     if (!chunk.gridData->isLoaded) {
         // If this heightmap isn't already loading, send it
         if (!chunk.gridData->isLoading) {
-            // Send heightmap gen query
+            // Send the whole column as one task
             chunk.gridData->isLoading = true;
-            m_threadPool->addTask(&query->genTask);
+            ColumnQueries* column = new ColumnQueries;
+            column->queries.push_back(query);
+            m_loadingColumns[chunk.gridData] = column;
+            ColumnGenerateTask* task = new ColumnGenerateTask;
+            task->init(chunk.gridData, column, this);
+            m_threadPool->addTask(task);
+            return;
+        }
+        // Add to the column's task if it hasn't started generating chunks
+        ColumnQueries* column = m_loadingColumns[chunk.gridData];
+        {
+            std::lock_guard<std::mutex> l(column->lock);
+            if (!column->isClosed) {
+                column->queries.push_back(query);
+                return;
+            }
         }
         // Store as a pending query
         m_pendingQueries[chunk.gridData].push_back(query);
@@ -54,8 +70,14 @@ void ChunkGenerator::finishQuery(ChunkQuery* query) {
     m_finishedQueries.enqueue(query);
 }
 
+void ChunkGenerator::finishColumn(ChunkGridData* gridData) {
+    m_finishedColumns.enqueue(gridData);
+}
+
 // Updates finished queries
 void ChunkGenerator::update() {
+    updateFinishedColumns();
+
 #define MAX_QUERIES 100
     ChunkQuery* queries[MAX_QUERIES];
     size_t numQueries = m_finishedQueries.try_dequeue_bulk(queries, MAX_QUERIES);
@@ -64,18 +86,7 @@ void ChunkGenerator::update() {
         Chunk& chunk = q->chunk;
         chunk.m_genQueryData.current = nullptr;
         
-        // Check if it was a heightmap gen
-        if (chunk.gridData->isLoading) {
-            chunk.gridData->isLoaded = true;
-            chunk.gridData->isLoading = false;
-
-            // Submit all the pending queries on this grid data
-            auto it = m_pendingQueries.find(chunk.gridData); // TODO(Ben): Should this be shared? ( I don't think it should )
-            for (auto& p : it->second) {
-                submitQuery(p);
-            }
-            m_pendingQueries.erase(it);
-        } else if (chunk.genLevel == GEN_DONE) {
+        if (chunk.genLevel == GEN_DONE) {
             // If the chunk is done generating, we can signal all queries as done.
             for (auto& q2 : chunk.m_genQueryData.pending) {
                 q2->m_isFinished = true;
@@ -122,3 +133,48 @@ void ChunkGenerator::update() {
         }
     }
 }
+
+void ChunkGenerator::updateFinishedColumns() {
+#define MAX_COLUMNS 100
+    ChunkGridData* columns[MAX_COLUMNS];
+    size_t numColumns = m_finishedColumns.try_dequeue_bulk(columns, MAX_COLUMNS);
+    for (size_t i = 0; i < numColumns; i++) {
+        ChunkGridData* gridData = columns[i];
+        gridData->isLoaded = true;
+        gridData->isLoading = false;
+
+        auto it = m_loadingColumns.find(gridData);
+        ColumnQueries* column = it->second;
+        m_loadingColumns.erase(it);
+
+        // Queries are sorted by chunk, so only the first for each chunk did the gen
+        Chunk* prevChunk = nullptr;
+        for (auto& q : column->queries) {
+            Chunk& chunk = q->chunk;
+            if (chunk.genLevel < q->genLevel) {
+                // Shouldn't happen, but the column is loaded now so it can go the normal way
+                submitQuery(q);
+                continue;
+            }
+            q->m_isFinished = true;
+            q->m_cond.notify_all();
+            if (&chunk != prevChunk) {
+                // Notify listeners that this chunk is finished
+                onGenFinish(q->chunk, q->genLevel);
+                prevChunk = &chunk;
+            }
+            q->chunk.release();
+            if (q->shouldRelease) q->release();
+        }
+        delete column;
+
+        // Submit the queries that came in too late for the task
+        auto pit = m_pendingQueries.find(gridData);
+        if (pit != m_pendingQueries.end()) {
+            for (auto& p : pit->second) {
+                submitQuery(p);
+            }
+            m_pendingQueries.erase(pit);
+        }
+    }
+}
@@ -26,6 +26,7 @@
 class PagedChunkAllocator;
 class ChunkGridData;
 class ChunkGrid;
+class HeightmapTileCache;
 
 // Data stored in Chunk and used only by ChunkGenerator
 struct ChunkGenQueryData {
@@ -39,12 +40,15 @@ struct ChunkGenQueryData {
 
 class ChunkGenerator {
     friend class GenerateTask;
+    friend class ColumnGenerateTask;
 public:
     void init(vcore::ThreadPool<WorkerData>* threadPool,
               PlanetGenData* genData,
-              ChunkGrid* grid);
+              ChunkGrid* grid,
+              OPT HeightmapTileCache* heightmapCache = nullptr);
     void submitQuery(ChunkQuery* query);
     void finishQuery(ChunkQuery* query);
+    void finishColumn(ChunkGridData* gridData);
     // Updates finished queries
     void update();
 
@@ -53,8 +57,12 @@ class ChunkGenerator {
     void tryFlagMeshableNeighbors(ChunkHandle& ch);
     void flagMeshbleNeighbor(ChunkHandle& n, ui32 bit);
 
+    void updateFinishedColumns();
+
     moodycamel::ConcurrentQueue<ChunkQuery*> m_finishedQueries;
-    std::map < ChunkGridData*, std::vector<ChunkQuery*> >m_pendingQueries; ///< Queries waiting on height map
+    moodycamel::ConcurrentQueue<ChunkGridData*> m_finishedColumns;
+    std::map<ChunkGridData*, ColumnQueries*> m_loadingColumns; ///< Queries taken by each ColumnGenerateTask
+    std::map < ChunkGridData*, std::vector<ChunkQuery*> >m_pendingQueries; ///< Queries waiting on height map after its task closed
 
     ChunkGrid* m_grid = nullptr;
     ProceduralChunkGenerator m_proceduralGenerator;
@@ -10,19 +10,21 @@ void ChunkGrid::init(WorldCubeFace face,
                       OPT vcore::ThreadPool<WorkerData>* threadPool,
                       ui32 generatorsPerRow,
                       PlanetGenData* genData,
-                      PagedChunkAllocator* allocator) {
+                      PagedChunkAllocator* allocator,
+                      OPT HeightmapTileCache* heightmapCache /*= nullptr*/) {
     m_face = face;
     this->generatorsPerRow = generatorsPerRow;
     numGenerators = generatorsPerRow * generatorsPerRow;
     generators = new ChunkGenerator[numGenerators];
     for (ui32 i = 0; i < numGenerators; i++) {
-        generators[i].init(threadPool, genData, this);
+        generators[i].init(threadPool, genData, this, heightmapCache);
     }
     accessor.init(allocator);
     accessor.onAdd += makeDelegate(this, &ChunkGrid::onAccessorAdd);
     accessor.onRemove += makeDelegate(this, &ChunkGrid::onAccessorRemove);
     nodeSetter.grid = this;
     nodeSetter.threadPool = threadPool;
+    compressionScheduler.init(threadPool, &accessor);
 }
 
 void ChunkGrid::dispose() {
@@ -64,9 +66,12 @@ void ChunkGrid::releaseQuery(ChunkQuery* query) {
 
 ChunkGridData* ChunkGrid::getChunkGridData(const i32v2& gridPos) {
     std::lock_guard<std::mutex> l(m_lckGridData);
-    auto it = m_chunkGridDataMap.find(gridPos);
-    if (it == m_chunkGridDataMap.end()) return nullptr;
-    return it->second;
+    return m_gridData.get(gridPos);
+}
+
+void ChunkGrid::setMaxCachedColumns(size_t maxCachedColumns) {
+    std::lock_guard<std::mutex> l(m_lckGridData);
+    m_gridData.setMaxCachedColumns(maxCachedColumns);
 }
 
 void ChunkGrid::update() {
@@ -84,9 +89,17 @@ void ChunkGrid::update() {
         q->genTask.init(q, q->chunk->gridData->heightData, &generators[0]);
         generators[0].submitQuery(q);
     }
-    
-    // Place any needed nodes
-    nodeSetter.update();
+
+    /* Update voxel containers */
+    {
+        std::lock_guard<std::mutex> l(m_lckActiveChunks);
+        for (auto& h : m_activeChunks) {
+            // Only update chunks that are done generating
+            if (h->genLevel != ChunkGenLevel::GEN_DONE) continue;
+            h->updateContainers(compressionScheduler);
+        }
+    }
+    compressionScheduler.update();
 }
 
 void ChunkGrid::onAccessorAdd(Sender s VORB_MAYBE_UNUSED, ChunkHandle& chunk) {
@@ -99,21 +112,9 @@ void ChunkGrid::onAccessorAdd(Sender s VORB_MAYBE_UNUSED, ChunkHandle& chunk) {
     // Init the chunk
     chunk->init(m_face);
 
-    i32v2 gridPos = chunk->getChunkPosition();
-
     { // Get grid data
         std::lock_guard<std::mutex> l(m_lckGridData);
-        // Check and see if the grid data is already allocated here
-        auto it = m_chunkGridDataMap.find(gridPos);
-        if (it == m_chunkGridDataMap.end()) {
-            // If its not allocated, make a new one with a new voxelMapData
-            // TODO(Ben): Cache this
-            chunk->gridData = new ChunkGridData(chunk->getChunkPosition());
-            m_chunkGridDataMap[gridPos] = chunk->gridData;
-        } else {
-            chunk->gridData = it->second;
-            chunk->gridData->refCount++;
-        }
+        chunk->gridData = m_gridData.acquire(chunk->getChunkPosition());
     }
 }
 
@@ -125,15 +126,9 @@ void ChunkGrid::onAccessorRemove(Sender s VORB_MAYBE_UNUSED, ChunkHandle& chunk)
         m_activeChunks.pop_back();
     }
 
-    // TODO(Ben): Could be slightly faster with InterlockedDecrement and FSM?
-    { // Remove and possibly free grid data
-        std::unique_lock<std::mutex> l(m_lckGridData);
-        chunk->gridData->refCount--;
-        if (chunk->gridData->refCount == 0) {
-            m_chunkGridDataMap.erase(chunk->getChunkPosition());
-            l.unlock();
-            delete chunk->gridData;
-            chunk->gridData = nullptr;
-        }
+    { // Release grid data. It stays cached until evicted.
+        std::lock_guard<std::mutex> l(m_lckGridData);
+        m_gridData.release(chunk->gridData);
+        chunk->gridData = nullptr;
     }
 }
@@ -24,11 +24,14 @@
 #include "Chunk.h"
 #include "ChunkAllocator.h"
 #include "ChunkAccessor.h"
+#include "ChunkCompressionScheduler.h"
+#include "ChunkGridDataStore.h"
 #include "ChunkHandle.h"
 
 #include "VoxelNodeSetter.h"
 
 class BlockPack;
+class HeightmapTileCache;
 
 class ChunkGrid {
     friend class ChunkMeshManager;
@@ -37,7 +40,8 @@ class ChunkGrid {
               OPT vcore::ThreadPool<WorkerData>* threadPool,
               ui32 generatorsPerRow,
               PlanetGenData* genData,
-              PagedChunkAllocator* allocator);
+              PagedChunkAllocator* allocator,
+              OPT HeightmapTileCache* heightmapCache = nullptr);
     void dispose();
 
     /// Will generate chunk if it doesn't exist
@@ -51,6 +55,8 @@ class ChunkGrid {
     /// Gets a chunkGridData for a specific 2D position
     /// @param gridPos: The grid position for the data
     ChunkGridData* getChunkGridData(const i32v2& gridPos);
+    /// Sets how many columns of height data to keep for areas with no live chunks
+    void setMaxCachedColumns(size_t maxCachedColumns);
 
     // Processes chunk queries and set active chunks
     void update();
@@ -70,6 +76,7 @@ class ChunkGrid {
     BlockPack* blockPack = nullptr; ///< Handle to the block pack for this grid
 
     VoxelNodeSetter nodeSetter;
+    ChunkCompressionScheduler compressionScheduler; ///< Compresses cold chunks in the background
 
     Event<ChunkHandle&> onNeighborsAcquire;
     Event<ChunkHandle&> onNeighborsRelease;
@@ -85,9 +92,8 @@ class ChunkGrid {
     std::mutex m_lckActiveChunks;
     std::vector<ChunkHandle> m_activeChunks;
 
-    // TODO(Ben): Compare to std::map performance
     std::mutex m_lckGridData;
-    std::unordered_map<i32v2, ChunkGridData*> m_chunkGridDataMap; ///< 2D grid specific data
+    ChunkGridDataStore m_gridData; ///< 2D grid specific data
     
     vcore::IDGenerator<ChunkID> m_idGenerator;
 
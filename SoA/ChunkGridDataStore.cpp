@@ -0,0 +1,127 @@
+#include "stdafx.h"
+#include "ChunkGridDataStore.h"
+
+ChunkGridDataStore::~ChunkGridDataStore() {
+    clear();
+}
+
+ChunkGridData* ChunkGridDataStore::acquire(const ChunkPosition3D& chunkPos) {
+    i32v2 gridPos(chunkPos.pos.x, chunkPos.pos.z);
+    ChunkGridData*& slot = getSlot(getTile(toTilePos(gridPos), true), gridPos);
+    if (slot) {
+        if (slot->refCount++ == 0) {
+            // Back in use, so take it out of the cache
+            lruRemove(slot);
+        }
+    } else {
+        // If its not allocated, make a new one. The heightmap is generated on demand.
+        slot = new ChunkGridData(chunkPos);
+        m_lastTile->numColumns++;
+        m_numColumns++;
+    }
+    return slot;
+}
+
+void ChunkGridDataStore::release(ChunkGridData* data) {
+    if (--data->refCount > 0) return;
+
+    if (!data->isLoaded || m_maxCached == 0) {
+        // Nothing worth keeping
+        freeColumn(data);
+        return;
+    }
+    lruPushFront(data);
+    while (m_numCached > m_maxCached) {
+        ChunkGridData* evict = m_lruTail;
+        lruRemove(evict);
+        freeColumn(evict);
+    }
+}
+
+ChunkGridData* ChunkGridDataStore::get(const i32v2& gridPos) {
+    Tile* tile = getTile(toTilePos(gridPos), false);
+    if (!tile) return nullptr;
+    return getSlot(tile, gridPos);
+}
+
+void ChunkGridDataStore::setMaxCachedColumns(size_t maxCachedColumns) {
+    m_maxCached = maxCachedColumns;
+    while (m_numCached > m_maxCached) {
+        ChunkGridData* evict = m_lruTail;
+        lruRemove(evict);
+        freeColumn(evict);
+    }
+}
+
+void ChunkGridDataStore::clear() {
+    for (auto& it : m_tiles) {
+        for (auto& column : it.second->columns) {
+            delete column;
+        }
+        delete it.second;
+    }
+    std::unordered_map<i32v2, Tile*>().swap(m_tiles);
+    m_lastTile = nullptr;
+    m_lruHead = nullptr;
+    m_lruTail = nullptr;
+    m_numCached = 0;
+    m_numColumns = 0;
+}
+
+ChunkGridDataStore::Tile* ChunkGridDataStore::getTile(const i32v2& tilePos, bool create) {
+    if (m_lastTile && m_lastTilePos == tilePos) return m_lastTile;
+
+    Tile* tile;
+    auto it = m_tiles.find(tilePos);
+    if (it != m_tiles.end()) {
+        tile = it->second;
+    } else if (create) {
+        tile = new Tile;
+        m_tiles[tilePos] = tile;
+    } else {
+        return nullptr;
+    }
+    m_lastTilePos = tilePos;
+    m_lastTile = tile;
+    return tile;
+}
+
+void ChunkGridDataStore::lruPushFront(ChunkGridData* data) {
+    data->lruPrev = nullptr;
+    data->lruNext = m_lruHead;
+    if (m_lruHead) m_lruHead->lruPrev = data;
+    m_lruHead = data;
+    if (!m_lruTail) m_lruTail = data;
+    m_numCached++;
+}
+
+void ChunkGridDataStore::lruRemove(ChunkGridData* data) {
+    if (data->lruPrev) {
+        data->lruPrev->lruNext = data->lruNext;
+    } else {
+        m_lruHead = data->lruNext;
+    }
+    if (data->lruNext) {
+        data->lruNext->lruPrev = data->lruPrev;
+    } else {
+        m_lruTail = data->lruPrev;
+    }
+    data->lruPrev = nullptr;
+    data->lruNext = nullptr;
+    m_numCached--;
+}
+
+void ChunkGridDataStore::freeColumn(ChunkGridData* data) {
+    const i32v2& gridPos = data->gridPosition.pos;
+    i32v2 tilePos = toTilePos(gridPos);
+    Tile* tile = getTile(tilePos, false);
+    getSlot(tile, gridPos) = nullptr;
+    delete data;
+    m_numColumns--;
+
+    if (--tile->numColumns == 0) {
+        m_tiles.erase(tilePos);
+        delete tile;
+        m_lastTile = nullptr;
+    }
+}
@@ -0,0 +1,83 @@
+//
+// ChunkGridDataStore.h
+// Seed of Andromeda
+//
+// Copyright 2014 Regrowth Studios
+// MIT License
+//
+// Summary:
+// Paged 2D store of ChunkGridData columns for one ChunkGrid. Columns
+// without live chunks are kept in an LRU cache so that their heightmaps
+// don't need to be regenerated, and are evicted when the cache is full.
+//
+
+#pragma once
+
+#ifndef ChunkGridDataStore_h__
+#define ChunkGridDataStore_h__
+
+#include "Chunk.h"
+
+#define DEFAULT_MAX_CACHED_COLUMNS 1024
+
+/// Not thread safe, the owner must lock around it.
+class ChunkGridDataStore {
+public:
+    ~ChunkGridDataStore();
+
+    /// Gets the column data for a chunk and adds a reference to it. Creates
+    /// the column, with no heightmap loaded, if it doesn't exist.
+    /// @param chunkPos: Position of the chunk that needs the column
+    ChunkGridData* acquire(const ChunkPosition3D& chunkPos);
+    /// Removes a reference. Loaded columns with no references are cached
+    /// until they are evicted.
+    void release(ChunkGridData* data);
+
+    /// Gets column data without adding a reference.
+    /// @return The column data, or nullptr if it isn't resident.
+    ChunkGridData* get(const i32v2& gridPos);
+
+    /// Sets how many unreferenced columns to keep. 0 frees them right away.
+    void setMaxCachedColumns(size_t maxCachedColumns);
+
+    /// Frees every column. There must be no references left.
+    void clear();
+
+    size_t getNumColumns() const { return m_numColumns; }
+    size_t getNumCachedColumns() const { return m_numCached; }
+private:
+    static const i32 TILE_SHIFT = 4;
+    static const i32 TILE_WIDTH = 1 << TILE_SHIFT;
+    static const i32 TILE_MASK = TILE_WIDTH - 1;
+    struct Tile {
+        ChunkGridData* columns[TILE_WIDTH * TILE_WIDTH] = {};
+        ui32 numColumns = 0;
+    };
+
+    /// @param create: When true, allocates the tile if it doesn't exist
+    Tile* getTile(const i32v2& tilePos, bool create);
+    ChunkGridData*& getSlot(Tile* tile, const i32v2& gridPos) {
+        return tile->columns[(gridPos.y & TILE_MASK) * TILE_WIDTH + (gridPos.x & TILE_MASK)];
+    }
+    static i32v2 toTilePos(const i32v2& gridPos) {
+        return i32v2(gridPos.x >> TILE_SHIFT, gridPos.y >> TILE_SHIFT);
+    }
+
+    void lruPushFront(ChunkGridData* data);
+    void lruRemove(ChunkGridData* data);
+    /// Frees the column and its tile if the tile is now empty
+    void freeColumn(ChunkGridData* data);
+
+    std::unordered_map<i32v2, Tile*> m_tiles;
+    // Lookups come in spatially coherent runs, so remember the last tile
+    i32v2 m_lastTilePos = i32v2(0);
+    Tile* m_lastTile = nullptr;
+
+    ChunkGridData* m_lruHead = nullptr; ///< Most recently released
+    ChunkGridData* m_lruTail = nullptr; ///< Next to be evicted
+    size_t m_numCached = 0;
+    size_t m_maxCached = DEFAULT_MAX_CACHED_COLUMNS;
+    size_t m_numColumns = 0;
+};
+
+#endif // ChunkGridDataStore_h__
@@ -30,7 +30,9 @@ class ChunkHandle {
     }
     ChunkHandle(const ChunkHandle& other);
     ChunkHandle& operator= (const ChunkHandle& other);
-    ChunkHandle(ChunkHandle&& other) :
+    // noexcept so std::vector moves handles when it grows instead of
+    // copying them, since copies are not acquired
+    ChunkHandle(ChunkHandle&& other) noexcept :
         m_chunk(other.m_chunk),
         m_id(other.m_id),
         m_acquired(other.m_acquired) {
@@ -39,7 +41,7 @@ class ChunkHandle {
         other.m_chunk = nullptr;
         other.m_id = 0;
     }
-    ChunkHandle& operator= (ChunkHandle&& other) {
+    ChunkHandle& operator= (ChunkHandle&& other) noexcept {
         m_acquired = other.m_acquired;
         m_chunk = other.m_chunk;
         m_id = other.m_id;
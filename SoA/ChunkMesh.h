@@ -2,6 +2,7 @@
 #include "Vertex.h"
 #include "BlockTextureMethods.h"
 #include "ChunkHandle.h"
+#include "Constants.h"
 #include <Vorb/io/Keg.h>
 #include <Vorb/graphics/gtypes.h>
 
@@ -82,6 +83,52 @@ struct VoxelQuad {
     };
 };
 
+/// An opaque quad in ChunkVertexFormat::PACKED
+struct PackedVoxelQuad {
+    PackedBlockVertex verts[4];
+};
+
+/// Per quad attributes that are the same for most quads of a chunk. Opaque
+/// vertices index these so they don't each carry colors and overlays.
+/// Laid out as one RGBA32UI texel.
+struct ChunkPaletteEntry {
+    ui32 color; ///< Base color RGB, blend mode in the top byte
+    ui32 overlayColor; ///< Overlay color RGB
+    ui32 overlayTexture; ///< Overlay texture index, atlas page included
+    ui32 textureDims; ///< Base texture dims then overlay texture dims, a byte each
+
+    bool operator==(const ChunkPaletteEntry& rhs) const {
+        return color == rhs.color && overlayColor == rhs.overlayColor &&
+            overlayTexture == rhs.overlayTexture && textureDims == rhs.textureDims;
+    }
+};
+static_assert(sizeof(ChunkPaletteEntry) == 16, "ChunkPaletteEntry must be one RGBA32UI texel");
+
+#define MAX_CHUNK_PALETTE_SIZE 256
+
+// Coarsest mesh LOD. An LOD n mesh voxel covers 2^n voxels along each axis.
+#define MAX_CHUNK_MESH_LOD 3
+
+/// The mesh of one CHUNK_MESH_SECTION_HEIGHT slab of a chunk. Quads never
+/// cross sections, so a section can be rebuilt without its neighbors.
+struct ChunkMeshSection {
+    // Only the vector of ChunkMesher::vertexFormat is filled. Both are sorted by face.
+    std::vector <VoxelQuad> opaqueQuads; ///< ChunkVertexFormat::BLOCK
+    std::vector <PackedVoxelQuad> packedQuads; ///< ChunkVertexFormat::PACKED
+    ui32 faceSizes[6] = {}; ///< Opaque quads of each face
+    std::vector <ChunkPaletteEntry> palette; ///< Indexed by packedQuads
+    std::vector <VoxelQuad> cutoutQuads;
+    // Bounds of the opaque quads in voxels
+    i32 highestY = INT_MIN;
+    i32 lowestY = INT_MAX;
+    i32 highestX = INT_MIN;
+    i32 lowestX = INT_MAX;
+    i32 highestZ = INT_MIN;
+    i32 lowestZ = INT_MAX;
+
+    size_t getNumOpaqueQuads() const { return opaqueQuads.size() + packedQuads.size(); }
+};
+
 class ChunkMeshData
 {
 public:
@@ -93,9 +140,10 @@ class ChunkMeshData
     ChunkMeshRenderData chunkMeshRenderData;
 
     // TODO(Ben): Could use a contiguous buffer for this?
-    std::vector <VoxelQuad> opaqueQuads;
+    ChunkMeshSection sections[NUM_CHUNK_MESH_SECTIONS];
+    ui8 sectionMask = ALL_CHUNK_MESH_SECTIONS; ///< Sections that were meshed and replace the mesh's
+    ui8 lod = 0; ///< See MAX_CHUNK_MESH_LOD
     std::vector <VoxelQuad> transQuads;
-    std::vector <VoxelQuad> cutoutQuads;
     std::vector <LiquidVertex> waterVertices;
     MeshTaskType type;
 
@@ -143,6 +191,15 @@ class ChunkMesh
     bool needsSort = true;
     ChunkID id;
 
+    VGTexture paletteTextureID = 0; ///< A row of palette entries per section
+    ui32 paletteWidth = 0; ///< Entries per row of the palette texture
+    bool isMeshed = false; ///< Has had a full mesh uploaded, so sections can be replaced
+    ui8 lod = 0; ///< LOD of the uploaded mesh. Positions are scaled by 2^lod when drawn.
+    ui8 targetLod = 0; ///< LOD for the current distance, meshed when they differ
+    ChunkHandle chunk; ///< Held while the mesh exists so it can be remeshed at another LOD
+    // Kept so single sections can be swapped out and the buffers rebuilt
+    ChunkMeshSection sections[NUM_CHUNK_MESH_SECTIONS];
+
     //*** Transparency info for sorting ***
     VGIndexBuffer transIndexID = 0;
     std::vector<i8v3> transQuadPositions;
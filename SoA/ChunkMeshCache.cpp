@@ -0,0 +1,508 @@
+#include "stdafx.h"
+#include "ChunkMeshCache.h"
+
+#include "BlockPack.h"
+#include "BlockTexturePack.h"
+#include "ChunkMesh.h"
+#include "ChunkMesher.h"
+#include "PlanetHeightData.h"
+
+#define MESH_FILE_MAGIC 0x48534D43 // "CMSH"
+#define MESH_FILE_VERSION 4 ///< Bump when the mesher's output changes
+#define MAX_MESH_FILE_BYTES (64 * 1024 * 1024)
+#define MAX_QUEUED_WRITE_BYTES (32 * 1024 * 1024) ///< Writes past this are dropped
+
+namespace {
+    struct MeshFileHeader {
+        ui32 magic;
+        ui32 version;
+        ui64 fingerprint;
+        ui64 hash; ///< ChunkMeshKey::hash of the stored mesh
+        ui64 size; ///< Serialized mesh bytes after the header
+        // Which chunk LOD, since several share a file
+        i32 face;
+        i32v3 pos;
+        ui32 lod;
+    };
+
+    /// Murmur3 style, a word at a time. FNV-1a is too slow for a chunk per mesh.
+    class ContentHash {
+    public:
+        void add(const void* data, size_t size) {
+            const ui8* bytes = (const ui8*)data;
+            size_t i = 0;
+            for (; i + sizeof(ui64) <= size; i += sizeof(ui64)) {
+                ui64 word;
+                memcpy(&word, bytes + i, sizeof(ui64));
+                mix(word);
+            }
+            if (i < size) {
+                ui64 word = 0;
+                memcpy(&word, bytes + i, size - i);
+                mix(word);
+            }
+            m_length += size;
+        }
+        template<typename T>
+        void add(const T& value) { add(&value, sizeof(T)); }
+        ui64 get() const {
+            ui64 h = m_hash ^ m_length;
+            h ^= h >> 33;
+            h *= 0xFF51AFD7ED558CCDull;
+            h ^= h >> 33;
+            h *= 0xC4CEB9FE1A85EC53ull;
+            h ^= h >> 33;
+            return h;
+        }
+    private:
+        static ui64 rotl(ui64 x, int r) { return (x << r) | (x >> (64 - r)); }
+        void mix(ui64 word) {
+            word *= 0x87C37B91114253D5ull;
+            word = rotl(word, 31);
+            word *= 0x4CF5AD432745937Full;
+            m_hash ^= word;
+            m_hash = rotl(m_hash, 27) * 5 + 0x52DCE729;
+        }
+        ui64 m_hash = 0x9E3779B97F4A7C15ull;
+        ui64 m_length = 0;
+    };
+
+    /// FNV-1a
+    class Fingerprint {
+    public:
+        void add(const void* data, size_t size) {
+            const ui8* bytes = (const ui8*)data;
+            for (size_t i = 0; i < size; i++) {
+                m_hash ^= bytes[i];
+                m_hash *= 1099511628211ull;
+            }
+        }
+        template<typename T>
+        void add(const T& value) { add(&value, sizeof(T)); }
+        void add(const nString& s) { add(s.data(), s.size()); add(s.size()); }
+        /// Color maps are shared, so each is only hashed the first time it is seen
+        void add(const BlockTextureLayer& layer, std::vector<const BlockColorMap*>& colorMaps) {
+            add(layer.method);
+            add(layer.size);
+            add(layer.symmetry);
+            add(layer.reducedMethod);
+            add(layer.averageColor);
+            add(layer.color);
+            add(layer.floraHeight);
+            add(layer.weights.size());
+            for (size_t i = 0; i < layer.weights.size(); i++) add(layer.weights[i]);
+            add(layer.totalWeight);
+            add(layer.numTiles);
+            add(layer.indices);
+            add(layer.innerSeams);
+            add(layer.transparency);
+            add(layer.colorMapPath);
+            auto it = std::find(colorMaps.begin(), colorMaps.end(), layer.colorMap);
+            add((size_t)(it - colorMaps.begin()));
+            if (layer.colorMap && it == colorMaps.end()) {
+                colorMaps.push_back(layer.colorMap);
+                add(layer.colorMap->pixels);
+            }
+        }
+        ui64 get() const { return m_hash; }
+    private:
+        ui64 m_hash = 14695981039346656037ull;
+    };
+
+    class MeshWriter {
+    public:
+        MeshWriter(std::vector<ui8>& bytes) : m_bytes(bytes) {}
+        void write(const void* data, size_t size) {
+            size_t offset = m_bytes.size();
+            m_bytes.resize(offset + size);
+            if (size) memcpy(&m_bytes[offset], data, size);
+        }
+        template<typename T>
+        void write(const T& value) { write(&value, sizeof(T)); }
+        /// Elements are copied as bytes. Mesh vertex types are plain data.
+        template<typename T>
+        void writeVector(const std::vector<T>& v) {
+            write((ui32)v.size());
+            write(v.data(), v.size() * sizeof(T));
+        }
+    private:
+        std::vector<ui8>& m_bytes;
+    };
+
+    class MeshReader {
+    public:
+        MeshReader(const std::vector<ui8>& bytes) : m_pos(bytes.data()), m_end(bytes.data() + bytes.size()) {}
+        bool read(void* data, size_t size) {
+            if (size > (size_t)(m_end - m_pos)) return false;
+            if (size) memcpy(data, m_pos, size);
+            m_pos += size;
+            return true;
+        }
+        template<typename T>
+        bool read(T& value) { return read(&value, sizeof(T)); }
+        template<typename T>
+        bool readVector(std::vector<T>& v) {
+            ui32 size;
+            if (!read(size) || size > (size_t)(m_end - m_pos) / sizeof(T)) return false;
+            v.resize(size);
+            return read(v.data(), size * sizeof(T));
+        }
+        bool isDone() const { return m_pos == m_end; }
+    private:
+        const ui8* m_pos;
+        const ui8* m_end;
+    };
+}
+
+ChunkMeshCache::ChunkMeshCache(const BlockPack* blocks, size_t maxBytes) :
+    m_blocks(blocks),
+    m_maxBytes(maxBytes) {
+    // Empty
+}
+
+ChunkMeshCache::~ChunkMeshCache() {
+    closeDiskStore();
+}
+
+ChunkMeshKey ChunkMeshCache::computeKey(const ChunkMesher& mesher) {
+    ChunkMeshKey key;
+    key.face = mesher.chunkVoxelPos.face;
+    key.pos = i32v3(glm::floor(mesher.chunkVoxelPos.pos / (f64)CHUNK_WIDTH));
+    key.lod = mesher.getLod();
+
+    ContentHash h;
+    h.add(mesher.blockData, sizeof(mesher.blockData));
+    h.add(mesher.tertiaryData, sizeof(mesher.tertiaryData));
+    // Block colors depend on the climate of each column
+    const PlanetHeightData* heights = mesher.getChunkHeightData();
+    ui8 climate[CHUNK_LAYER * 2];
+    for (int i = 0; i < CHUNK_LAYER; i++) {
+        climate[i * 2] = heights[i].temperature;
+        climate[i * 2 + 1] = heights[i].humidity;
+    }
+    h.add(climate, sizeof(climate));
+    h.add(ChunkMesher::opaqueMeshMethod.load());
+    h.add(ChunkMesher::vertexFormat);
+    key.hash = h.get();
+    return key;
+}
+
+CALLER_DELETE ChunkMeshData* ChunkMeshCache::get(const ChunkMeshKey& key) {
+    { // Memory
+        std::lock_guard<std::mutex> l(m_lock);
+        auto it = m_entryMap.find(key);
+        if (it != m_entryMap.end()) {
+            ChunkMeshData* meshData = deserialize(it->second->bytes);
+            if (meshData) {
+                // Move to the front
+                m_entries.splice(m_entries.begin(), m_entries, it->second);
+                m_numHits++;
+                return meshData;
+            }
+        }
+    }
+    // Disk
+    std::vector<ui8> bytes;
+    if (loadFromDisk(key, bytes)) {
+        ChunkMeshData* meshData = deserialize(bytes);
+        if (meshData) {
+            m_numDiskHits++;
+            insert(key, std::move(bytes));
+            return meshData;
+        }
+    }
+    m_numMisses++;
+    return nullptr;
+}
+
+void ChunkMeshCache::put(const ChunkMeshKey& key, const ChunkMeshData& meshData) {
+    std::vector<ui8> bytes;
+    serialize(meshData, bytes);
+    queueWrite(key, bytes);
+    insert(key, std::move(bytes));
+}
+
+bool ChunkMeshCache::openDiskStore(const nString& dir, ui32 maxFiles /*= 16384*/) {
+    {
+        std::lock_guard<std::mutex> l(m_diskLock);
+        m_fingerprint = computeFingerprint(m_blocks);
+        m_maxFiles = glm::max(maxFiles, 1u);
+        m_diskDir = dir;
+        if (m_diskDir.size() && (m_diskDir.back() == '/' || m_diskDir.back() == '\\')) m_diskDir.pop_back();
+        if (m_diskDir.empty()) return false;
+    }
+    if (!m_writeThread) {
+        {
+            std::lock_guard<std::mutex> l(m_writeLock);
+            m_isWriterDone = false;
+        }
+        m_writeThread = new std::thread(&ChunkMeshCache::writeFiles, this);
+    }
+    return true;
+}
+
+void ChunkMeshCache::closeDiskStore() {
+    if (m_writeThread) {
+        {
+            std::lock_guard<std::mutex> l(m_writeLock);
+            m_isWriterDone = true;
+        }
+        m_writeCond.notify_one();
+        if (m_writeThread->joinable()) m_writeThread->join();
+        delete m_writeThread;
+        m_writeThread = nullptr;
+    }
+    std::lock_guard<std::mutex> l(m_diskLock);
+    m_diskDir.clear();
+}
+
+void ChunkMeshCache::clear() {
+    std::lock_guard<std::mutex> l(m_lock);
+    m_entries.clear();
+    m_entryMap.clear();
+    m_numBytes = 0;
+}
+
+void ChunkMeshCache::setMaxBytes(size_t maxBytes) {
+    std::lock_guard<std::mutex> l(m_lock);
+    m_maxBytes = maxBytes;
+    evict();
+}
+
+size_t ChunkMeshCache::getNumBytes() const {
+    std::lock_guard<std::mutex> l(m_lock);
+    return m_numBytes;
+}
+
+void ChunkMeshCache::insert(const ChunkMeshKey& key, std::vector<ui8>&& bytes) {
+    std::lock_guard<std::mutex> l(m_lock);
+    if (bytes.size() > m_maxBytes || m_entryMap.find(key) != m_entryMap.end()) return;
+    m_entries.emplace_front();
+    Entry& entry = m_entries.front();
+    entry.key = key;
+    entry.bytes.swap(bytes);
+    m_numBytes += entry.bytes.size();
+    m_entryMap[key] = m_entries.begin();
+    evict();
+}
+
+void ChunkMeshCache::evict() {
+    while (m_numBytes > m_maxBytes && m_entries.size()) {
+        Entry& entry = m_entries.back();
+        m_numBytes -= entry.bytes.size();
+        m_entryMap.erase(entry.key);
+        m_entries.pop_back();
+    }
+}
+
+/************************************************************************/
+/* Disk                                                                 */
+/************************************************************************/
+bool ChunkMeshCache::getDiskStore(OUT DiskStore& store) {
+    std::lock_guard<std::mutex> l(m_diskLock);
+    if (m_diskDir.empty()) return false;
+    store.dir = m_diskDir;
+    store.fingerprint = m_fingerprint;
+    store.maxFiles = m_maxFiles;
+    return true;
+}
+
+nString ChunkMeshCache::getFilePath(const DiskStore& store, const ChunkMeshKey& key) {
+    // Only the position picks the file, so a changed chunk replaces its old mesh
+    ui64 h = (ui64)key.face * 0x9E3779B97F4A7C15ull;
+    h = (h ^ (ui32)key.pos.x) * 0xFF51AFD7ED558CCDull;
+    h = (h ^ (ui32)key.pos.y) * 0xC4CEB9FE1A85EC53ull;
+    h = (h ^ (ui32)key.pos.z) * 0xFF51AFD7ED558CCDull;
+    h = (h ^ key.lod) * 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+    char name[32];
+    snprintf(name, sizeof(name), "/%u.cmsh", (ui32)(h % store.maxFiles));
+    return store.dir + name;
+}
+
+bool ChunkMeshCache::loadFromDisk(const ChunkMeshKey& key, OUT std::vector<ui8>& bytes) {
+    DiskStore store;
+    if (!getDiskStore(store)) return false;
+
+    // Files are replaced by renaming, so this never sees a half written one
+    FILE* file = fopen(getFilePath(store, key).c_str(), "rb");
+    if (!file) return false;
+    MeshFileHeader header;
+    bool isValid = fread(&header, sizeof(header), 1, file) == 1 &&
+        header.magic == MESH_FILE_MAGIC && header.version == MESH_FILE_VERSION &&
+        header.fingerprint == store.fingerprint && header.hash == key.hash && header.size <= MAX_MESH_FILE_BYTES &&
+        header.face == (i32)key.face && header.pos == key.pos && header.lod == key.lod;
+    if (isValid) {
+        bytes.resize((size_t)header.size);
+        isValid = fread(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    }
+    fclose(file);
+    return isValid;
+}
+
+void ChunkMeshCache::queueWrite(const ChunkMeshKey& key, const std::vector<ui8>& bytes) {
+    if (bytes.size() > MAX_MESH_FILE_BYTES) return;
+    {
+        std::lock_guard<std::mutex> l(m_writeLock);
+        if (m_isWriterDone) return; // No disk store
+        // It's only a cache, so fall behind rather than use unbounded memory
+        if (m_numWriteBytes + bytes.size() > MAX_QUEUED_WRITE_BYTES) return;
+        m_writes.emplace_back();
+        m_writes.back().key = key;
+        m_writes.back().bytes = bytes;
+        m_numWriteBytes += bytes.size();
+    }
+    m_writeCond.notify_one();
+}
+
+void ChunkMeshCache::saveToDisk(const ChunkMeshKey& key, const std::vector<ui8>& bytes) {
+    DiskStore store;
+    if (!getDiskStore(store)) return;
+
+    // Write beside the file and swap it in, so readers never see half of it
+    nString path = getFilePath(store, key);
+    nString tmpPath = path + ".tmp";
+    FILE* file = fopen(tmpPath.c_str(), "wb");
+    if (!file) {
+        fprintf(stderr, "Failed to open chunk mesh file %s\n", tmpPath.c_str());
+        return;
+    }
+    MeshFileHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = MESH_FILE_MAGIC;
+    header.version = MESH_FILE_VERSION;
+    header.fingerprint = store.fingerprint;
+    header.hash = key.hash;
+    header.size = bytes.size();
+    header.face = (i32)key.face;
+    header.pos = key.pos;
+    header.lod = key.lod;
+    bool isWritten = fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    isWritten = (fclose(file) == 0) && isWritten;
+    // rename won't replace an existing file on Windows
+    remove(path.c_str());
+    if (!isWritten || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        remove(tmpPath.c_str());
+    }
+}
+
+void ChunkMeshCache::writeFiles() {
+    std::unique_lock<std::mutex> l(m_writeLock);
+    while (true) {
+        m_writeCond.wait(l, [&] { return m_isWriterDone || m_writes.size(); });
+        // Finish the queue before quitting, closeDiskStore waits for it
+        if (m_writes.empty()) break;
+        Entry entry = std::move(m_writes.front());
+        m_writes.pop_front();
+        l.unlock();
+        saveToDisk(entry.key, entry.bytes);
+        l.lock();
+        m_numWriteBytes -= entry.bytes.size();
+    }
+}
+
+/************************************************************************/
+/* Serialization                                                        */
+/************************************************************************/
+void ChunkMeshCache::serialize(const ChunkMeshData& meshData, OUT std::vector<ui8>& bytes) {
+    size_t size = sizeof(ChunkMeshData);
+    for (auto& section : meshData.sections) {
+        size += section.opaqueQuads.size() * sizeof(VoxelQuad) +
+            section.packedQuads.size() * sizeof(PackedVoxelQuad) +
+            section.palette.size() * sizeof(ChunkPaletteEntry) +
+            section.cutoutQuads.size() * sizeof(VoxelQuad);
+    }
+    size += meshData.transQuads.size() * sizeof(VoxelQuad) +
+        meshData.waterVertices.size() * sizeof(LiquidVertex) +
+        meshData.transQuadPositions.size() * sizeof(i8v3) +
+        meshData.transQuadIndices.size() * sizeof(ui32);
+    bytes.clear();
+    bytes.reserve(size);
+
+    MeshWriter w(bytes);
+    w.write(meshData.chunkMeshRenderData);
+    w.write(meshData.sectionMask);
+    w.write(meshData.lod);
+    w.write(meshData.type);
+    w.write(meshData.transVertIndex);
+    for (auto& section : meshData.sections) {
+        w.writeVector(section.opaqueQuads);
+        w.writeVector(section.packedQuads);
+        w.write(section.faceSizes);
+        w.writeVector(section.palette);
+        w.writeVector(section.cutoutQuads);
+        w.write(section.highestY);
+        w.write(section.lowestY);
+        w.write(section.highestX);
+        w.write(section.lowestX);
+        w.write(section.highestZ);
+        w.write(section.lowestZ);
+    }
+    w.writeVector(meshData.transQuads);
+    w.writeVector(meshData.waterVertices);
+    w.writeVector(meshData.transQuadPositions);
+    w.writeVector(meshData.transQuadIndices);
+}
+
+CALLER_DELETE ChunkMeshData* ChunkMeshCache::deserialize(const std::vector<ui8>& bytes) {
+    ChunkMeshData* meshData = new ChunkMeshData(MeshTaskType::DEFAULT);
+    MeshReader r(bytes);
+    bool isValid = r.read(meshData->chunkMeshRenderData) &&
+        r.read(meshData->sectionMask) &&
+        r.read(meshData->lod) &&
+        r.read(meshData->type) &&
+        r.read(meshData->transVertIndex);
+    for (auto& section : meshData->sections) {
+        isValid = isValid &&
+            r.readVector(section.opaqueQuads) &&
+            r.readVector(section.packedQuads) &&
+            r.read(section.faceSizes) &&
+            r.readVector(section.palette) &&
+            r.readVector(section.cutoutQuads) &&
+            r.read(section.highestY) &&
+            r.read(section.lowestY) &&
+            r.read(section.highestX) &&
+            r.read(section.lowestX) &&
+            r.read(section.highestZ) &&
+            r.read(section.lowestZ);
+    }
+    isValid = isValid &&
+        r.readVector(meshData->transQuads) &&
+        r.readVector(meshData->waterVertices) &&
+        r.readVector(meshData->transQuadPositions) &&
+        r.readVector(meshData->transQuadIndices) &&
+        r.isDone();
+    if (!isValid) {
+        delete meshData;
+        return nullptr;
+    }
+    return meshData;
+}
+
+ui64 ChunkMeshCache::computeFingerprint(const BlockPack* blocks) {
+    Fingerprint f;
+    std::vector<const BlockColorMap*> colorMaps;
+    f.add(blocks->size());
+    for (auto& block : blocks->getBlockList()) {
+        f.add(block.sID);
+        f.add(block.ID);
+        f.add(block.meshType);
+        f.add(block.occlude);
+        f.add(block.floraHeight);
+        f.add(block.liquidStartID);
+        f.add(block.liquidLevels);
+        f.add(block.waterMeshLevel);
+        f.add(block.altColors.size());
+        for (auto& color : block.altColors) f.add(color);
+        for (int i = 0; i < 6; i++) {
+            const BlockTexture* texture = block.textures[i];
+            f.add(texture != nullptr);
+            if (!texture) continue;
+            f.add(texture->blendMode);
+            f.add(texture->layers.base, colorMaps);
+            f.add(texture->layers.overlay, colorMaps);
+        }
+    }
+    return f.get();
+}
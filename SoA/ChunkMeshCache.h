@@ -0,0 +1,150 @@
+//
+// ChunkMeshCache.h
+// Seed of Andromeda
+//
+// Copyright 2014 Regrowth Studios
+// MIT License
+//
+// Summary:
+// Caches finished chunk meshes by a hash of the padded voxels they were
+// meshed from, so a chunk that unloads and comes back unchanged isn't
+// meshed again. Meshes are kept serialized in an in-memory LRU. Once a save
+// is open they can also be kept in files under the save's cache directory.
+// A background thread writes the files, and their number is capped.
+//
+
+#pragma once
+
+#ifndef ChunkMeshCache_h__
+#define ChunkMeshCache_h__
+
+#include "VoxelCoordinateSpaces.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <thread>
+
+class BlockPack;
+class ChunkMeshData;
+class ChunkMesher;
+
+struct ChunkMeshKey {
+    WorldCubeFace face;
+    i32v3 pos; ///< Position on the face in chunks
+    ui32 lod;
+    ui64 hash; ///< Hash of the padded voxels and everything else the mesher reads
+
+    bool operator==(const ChunkMeshKey& other) const {
+        return face == other.face && pos == other.pos && lod == other.lod && hash == other.hash;
+    }
+};
+
+namespace std {
+    template <>
+    struct hash<ChunkMeshKey> {
+        size_t operator()(const ChunkMeshKey& k) const {
+            // The content hash is already well mixed
+            return std::hash<ui64>()(k.hash ^ ((ui64)(ui32)k.pos.x << 32) ^ (ui32)k.pos.z);
+        }
+    };
+}
+
+class ChunkMeshCache {
+public:
+    /// @param blocks: Blocks the meshes are made from. Must outlive the cache.
+    /// @param maxBytes: Serialized mesh bytes kept in memory
+    ChunkMeshCache(const BlockPack* blocks, size_t maxBytes = 64 * 1024 * 1024);
+    ~ChunkMeshCache();
+
+    /// Hashes the data prepared in mesher. Call after prepareDataAsync and downsampleData.
+    static ChunkMeshKey computeKey(const ChunkMesher& mesher);
+
+    /// Copies out a cached mesh of all sections. Thread safe.
+    /// @return nullptr if it isn't cached
+    CALLER_DELETE ChunkMeshData* get(const ChunkMeshKey& key);
+    /// Caches a mesh of all sections made from the data key was computed from. Thread safe.
+    void put(const ChunkMeshKey& key, const ChunkMeshData& meshData);
+
+    /// Also stores meshes in dir, so they are kept between sessions. Each
+    /// chunk LOD maps to one of maxFiles files, and replaces whatever mesh
+    /// it holds. Block textures must be loaded first, files from other
+    /// blocks are ignored.
+    /// @param dir: Existing directory for this planet
+    /// @param maxFiles: Most files dir will hold
+    /// @return false if the directory can't be used
+    bool openDiskStore(const nString& dir, ui32 maxFiles = 16384);
+    /// Finishes queued writes, then stops using the directory
+    void closeDiskStore();
+    bool hasDiskStore() const { return m_diskDir.size() != 0; }
+
+    /// Empties the memory tier. Call when block textures change.
+    void clear();
+    void setMaxBytes(size_t maxBytes);
+    size_t getNumBytes() const;
+
+    // Counters, to check the cache is pulling its weight
+    size_t getNumHits() const { return m_numHits; }
+    size_t getNumDiskHits() const { return m_numDiskHits; }
+    size_t getNumMisses() const { return m_numMisses; }
+private:
+    struct Entry {
+        ChunkMeshKey key;
+        std::vector<ui8> bytes; ///< Serialized ChunkMeshData
+    };
+    struct DiskStore {
+        nString dir;
+        ui64 fingerprint;
+        ui32 maxFiles;
+    };
+
+    void insert(const ChunkMeshKey& key, std::vector<ui8>&& bytes);
+    /// Drops least recently used meshes until under m_maxBytes. Needs m_lock.
+    void evict();
+
+    /// Copies the store settings so files can be used without m_diskLock
+    /// @return false if there is no disk store
+    bool getDiskStore(OUT DiskStore& store);
+    static nString getFilePath(const DiskStore& store, const ChunkMeshKey& key);
+    bool loadFromDisk(const ChunkMeshKey& key, OUT std::vector<ui8>& bytes);
+    /// Queues bytes for the writer thread. Dropped if too much is queued already.
+    void queueWrite(const ChunkMeshKey& key, const std::vector<ui8>& bytes);
+    void saveToDisk(const ChunkMeshKey& key, const std::vector<ui8>& bytes);
+    void writeFiles(); ///< Runs on m_writeThread
+
+    static void serialize(const ChunkMeshData& meshData, OUT std::vector<ui8>& bytes);
+    /// @return nullptr if bytes are malformed
+    static CALLER_DELETE ChunkMeshData* deserialize(const std::vector<ui8>& bytes);
+    /// Changes whenever anything about the blocks that affects meshes changes
+    static ui64 computeFingerprint(const BlockPack* blocks);
+
+    const BlockPack* m_blocks;
+
+    // Memory, most recently used first
+    mutable std::mutex m_lock;
+    std::list<Entry> m_entries;
+    std::unordered_map<ChunkMeshKey, std::list<Entry>::iterator> m_entryMap;
+    size_t m_numBytes = 0;
+    size_t m_maxBytes;
+
+    // Disk
+    std::mutex m_diskLock;
+    nString m_diskDir;
+    ui64 m_fingerprint = 0;
+    ui32 m_maxFiles = 0;
+
+    // Writes waiting for m_writeThread
+    std::mutex m_writeLock;
+    std::condition_variable m_writeCond;
+    std::deque<Entry> m_writes;
+    size_t m_numWriteBytes = 0;
+    bool m_isWriterDone = true; ///< Also set while there is no disk store
+    std::thread* m_writeThread = nullptr;
+
+    std::atomic<size_t> m_numHits{ 0 };
+    std::atomic<size_t> m_numDiskHits{ 0 };
+    std::atomic<size_t> m_numMisses{ 0 };
+};
+
+#endif // ChunkMeshCache_h__
@@ -10,7 +10,19 @@
 
 #define MAX_UPDATES_PER_FRAME 300
 
-ChunkMeshManager::ChunkMeshManager(vcore::ThreadPool<WorkerData>* threadPool, BlockPack* blockPack) {
+// Distance in chunks past which each LOD is used. Meshes only return to a finer
+// LOD a chunk closer than this, so they don't remesh back and forth on the boundary.
+const f64 LOD_DISTANCES[MAX_CHUNK_MESH_LOD] = { 4.0, 8.0, 16.0 };
+
+inline ui8 getMeshLod(f64 distance2, ui8 currentLod) {
+    f64 distance = sqrt(distance2) / CHUNK_WIDTH;
+    ui8 lod = 0;
+    while (lod < MAX_CHUNK_MESH_LOD && distance > LOD_DISTANCES[lod] - (lod < currentLod ? 1.0 : 0.0)) lod++;
+    return lod;
+}
+
+ChunkMeshManager::ChunkMeshManager(vcore::ThreadPool<WorkerData>* threadPool, BlockPack* blockPack) :
+    m_meshCache(blockPack) {
     m_threadPool = threadPool;
     m_blockPack = blockPack;
     SpaceSystemAssemblages::onAddSphericalVoxelComponent += makeDelegate(this, &ChunkMeshManager::onAddSphericalVoxelComponent);
@@ -18,6 +30,7 @@ ChunkMeshManager::ChunkMeshManager(vcore::ThreadPool<WorkerData>* threadPool, Bl
 }
 
 void ChunkMeshManager::update(const f64v3& cameraPosition, bool shouldSort) {
+    m_cameraPosition = cameraPosition;
     ChunkMeshUpdateMessage updateBuffer[MAX_UPDATES_PER_FRAME];
     size_t numUpdates;
     if ((numUpdates = m_messages.try_dequeue_bulk(updateBuffer, MAX_UPDATES_PER_FRAME))) {
@@ -39,6 +52,13 @@ void ChunkMeshManager::update(const f64v3& cameraPosition, bool shouldSort) {
 
                     assert(iter!=m_activeChunks.end());
                     iter->second->updateVersion = it->second->updateVersion;
+
+                    // Edits only remesh the sections they touched, once there is a whole
+                    // full detail mesh to splice into. LOD meshes are always rebuilt whole.
+                    ChunkMesh* mesh = iter->second;
+                    task->lod = mesh->targetLod;
+                    task->sections = it->second->dirtyMeshSections.exchange(0);
+                    if (!task->sections || !mesh->isMeshed || task->lod || mesh->lod) task->sections = ALL_CHUNK_MESH_SECTIONS;
                 }
                 m_threadPool->addTask(task);
                 it->second.release();
@@ -57,6 +77,9 @@ void ChunkMeshManager::update(const f64v3& cameraPosition, bool shouldSort) {
 }
 
 void ChunkMeshManager::destroy() {
+    for (auto& it : m_activeChunks) {
+        it.second->chunk.release();
+    }
     std::vector <ChunkMesh*>().swap(m_activeChunkMeshes);
     moodycamel::ConcurrentQueue<ChunkMeshUpdateMessage>().swap(m_messages);
     std::unordered_map<ChunkID, ChunkMesh*>().swap(m_activeChunks);
@@ -77,6 +100,16 @@ ChunkMesh* ChunkMeshManager::createMesh(ChunkHandle& h) {
     memset(mesh->vbos, 0, sizeof(mesh->vbos));
     memset(mesh->vaos, 0, sizeof(mesh->vaos));
     mesh->transIndexID = 0;
+    mesh->paletteTextureID = 0;
+    mesh->paletteWidth = 0;
+    mesh->isMeshed = false;
+    mesh->lod = 0;
+    // Distant chunks go straight to their LOD
+    mesh->targetLod = getMeshLod(selfDot(getClosestPointOnAABB(m_cameraPosition, mesh->position, f64v3(CHUNK_WIDTH)) - m_cameraPosition), 0);
+    mesh->chunk = h.acquire();
+    for (auto& section : mesh->sections) {
+        section = ChunkMeshSection();
+    }
     mesh->activeMeshesIndex = ACTIVE_MESH_INDEX_NONE;
 
     { // Register chunk as active and give it a mesh
@@ -123,6 +156,7 @@ void ChunkMeshManager::disposeMesh(ChunkMesh* mesh) {
     glDeleteBuffers(4, mesh->vbos);
     glDeleteVertexArrays(4, mesh->vaos);
     if (mesh->transIndexID) glDeleteBuffers(1, &mesh->transIndexID);
+    if (mesh->paletteTextureID) glDeleteTextures(1, &mesh->paletteTextureID);
 
     { // Remove from mesh list
         std::lock_guard<std::mutex> l(lckActiveChunkMeshes);
@@ -132,6 +166,8 @@ void ChunkMeshManager::disposeMesh(ChunkMesh* mesh) {
             m_activeChunkMeshes.pop_back();
             mesh->activeMeshesIndex = ACTIVE_MESH_INDEX_NONE;
         }
+        // Under the lock so LOD updates never see a released handle
+        mesh->chunk.release();
     }
     
     { // Release the mesh
@@ -151,6 +187,12 @@ void ChunkMeshManager::updateMesh(ChunkMeshUpdateMessage& message) {
         }
         mesh = it->second;
     }
+
+    // Sections meshed before an LOD change don't fit the new mesh
+    if (message.meshData->sectionMask != ALL_CHUNK_MESH_SECTIONS && message.meshData->lod != mesh->lod) {
+        delete message.meshData;
+        return;
+    }
     
     if (ChunkMesher::uploadMeshData(*mesh, message.meshData)) {
         // Add to active list if its not there
@@ -177,13 +219,34 @@ void ChunkMeshManager::updateMesh(ChunkMeshUpdateMessage& message) {
 
 void ChunkMeshManager::updateMeshDistances(const f64v3& cameraPosition) {
     static const f64v3 CHUNK_DIMS(CHUNK_WIDTH);
-    // TODO(Ben): Spherical instead?
-    std::lock_guard<std::mutex> l(lckActiveChunkMeshes);
-    for (auto& mesh : m_activeChunkMeshes) { //update distances for all chunk meshes
-        //calculate distance
-        f64v3 closestPoint = getClosestPointOnAABB(cameraPosition, mesh->position, CHUNK_DIMS);
-        // Omit sqrt for faster calculation
-        mesh->distance2 = selfDot(closestPoint - cameraPosition);
+    std::vector<ChunkHandle> lodChanges;
+    { // TODO(Ben): Spherical instead?
+        std::lock_guard<std::mutex> l(lckActiveChunkMeshes);
+        for (auto& mesh : m_activeChunkMeshes) { //update distances for all chunk meshes
+            //calculate distance
+            f64v3 closestPoint = getClosestPointOnAABB(cameraPosition, mesh->position, CHUNK_DIMS);
+            // Omit sqrt for faster calculation
+            mesh->distance2 = selfDot(closestPoint - cameraPosition);
+
+            ui8 lod = getMeshLod(mesh->distance2, mesh->targetLod);
+            if (lod != mesh->targetLod) {
+                mesh->targetLod = lod;
+                lodChanges.push_back(mesh->chunk.acquire());
+            }
+        }
+    }
+
+    // Remesh at the new LODs. The old mesh draws until they are uploaded.
+    if (lodChanges.size()) {
+        std::lock_guard<std::mutex> l(m_lckPendingMesh);
+        for (auto& h : lodChanges) {
+            if (m_pendingMesh.find(h.getID()) == m_pendingMesh.end()) {
+                ChunkID id = h.getID();
+                m_pendingMesh.emplace(id, std::move(h));
+            } else {
+                h.release();
+            }
+        }
     }
 }
 
@@ -207,11 +270,14 @@ void ChunkMeshManager::onRemoveSphericalVoxelComponent(Sender s VORB_MAYBE_UNUSE
         cmp.chunkGrids[i].onNeighborsRelease -= makeDelegate(this, &ChunkMeshManager::onNeighborsRelease);
         Chunk::DataChange -= makeDelegate(this, &ChunkMeshManager::onDataChange);
     }
+    // The disk store belongs to this planet's save
+    m_meshCache.closeDiskStore();
 }
 
 void ChunkMeshManager::onGenFinish(Sender s VORB_MAYBE_UNUSED, ChunkHandle& chunk, ChunkGenLevel gen VORB_MAYBE_UNUSED) {
     // Check if can be meshed.
     if (chunk->genLevel == GEN_DONE && chunk->neighbor.left.isAquired() && chunk->numBlocks) {
+        chunk->dirtyMeshSections |= ALL_CHUNK_MESH_SECTIONS;
         std::lock_guard<std::mutex> l(m_lckPendingMesh);
         m_pendingMesh.emplace(chunk.getID(), chunk.acquire());
     }
@@ -221,6 +287,7 @@ void ChunkMeshManager::onNeighborsAcquire(Sender s VORB_UNUSED, ChunkHandle& chu
     createMesh(chunk);
     // Check if can be meshed.
     if (chunk->genLevel == GEN_DONE && chunk->numBlocks) {
+        chunk->dirtyMeshSections |= ALL_CHUNK_MESH_SECTIONS;
         std::lock_guard<std::mutex> l(m_lckPendingMesh);
         m_pendingMesh.emplace(chunk.getID(), chunk.acquire());
     }
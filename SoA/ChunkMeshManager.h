@@ -19,6 +19,7 @@
 #include "Vorb/concurrentqueue.h"
 #include "Chunk.h"
 #include "ChunkMesh.h"
+#include "ChunkMeshCache.h"
 #include "SpaceSystemAssemblages.h"
 #include <mutex>
 
@@ -40,6 +41,9 @@ class ChunkMeshManager {
     // Be sure to lock lckActiveChunkMeshes
     const std::vector <ChunkMesh*>& getChunkMeshes() { return m_activeChunkMeshes; }
     std::mutex lckActiveChunkMeshes;
+
+    /// Finished meshes of every chunk, shared by the mesh tasks
+    ChunkMeshCache& getMeshCache() { return m_meshCache; }
 private:
     VORB_NON_COPYABLE(ChunkMeshManager);
 
@@ -68,10 +72,12 @@ class ChunkMeshManager {
     /* Members                                                              */
     /************************************************************************/
     std::vector<ChunkMesh*> m_activeChunkMeshes; ///< Meshes that should be drawn
+    f64v3 m_cameraPosition = f64v3(0.0); ///< From the last update, for picking LODs
     moodycamel::ConcurrentQueue<ChunkMeshUpdateMessage> m_messages; ///< Lock-free queue of messages
    
     BlockPack* m_blockPack = nullptr;
     vcore::ThreadPool<WorkerData>* m_threadPool = nullptr;
+    ChunkMeshCache m_meshCache;
 
     std::mutex m_lckPendingMesh;
     std::map<ChunkID, ChunkHandle> m_pendingMesh;
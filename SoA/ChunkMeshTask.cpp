@@ -5,6 +5,7 @@
 
 #include "BlockData.h"
 #include "BlockPack.h"
+#include "ChunkMeshCache.h"
 #include "ChunkMeshManager.h"
 #include "ChunkMesher.h"
 #include "GameManager.h"
@@ -31,10 +32,24 @@ void ChunkMeshTask::execute(WorkerData* workerData) {
     msg.chunkID = chunk.getID();
 
     // Pre-processing
-    workerData->chunkMesher->prepareDataAsync(chunk, neighborHandles);
+    ChunkMesher* mesher = workerData->chunkMesher;
+    mesher->prepareDataAsync(chunk, neighborHandles);
+    mesher->downsampleData(lod);
 
-    // Create the actual mesh
-    msg.meshData = workerData->chunkMesher->createChunkMeshData(type);
+    // Create the actual mesh. Whole meshes are cached by their input, since
+    // chunks that unload and come back are usually unchanged.
+    if (sections == ALL_CHUNK_MESH_SECTIONS) {
+        ChunkMeshCache& cache = meshManager->getMeshCache();
+        ChunkMeshKey key = ChunkMeshCache::computeKey(*mesher);
+        msg.meshData = cache.get(key);
+        if (!msg.meshData) {
+            msg.meshData = mesher->createChunkMeshData(type, sections);
+            // Before sending, the upload takes the mesh apart
+            cache.put(key, *msg.meshData);
+        }
+    } else {
+        msg.meshData = mesher->createChunkMeshData(type, sections);
+    }
 
     // Send it for update
     meshManager->sendMessage(msg);
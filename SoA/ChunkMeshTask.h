@@ -55,6 +55,8 @@ class ChunkMeshTask : public vcore::IThreadPoolTask<WorkerData> {
     void init(ChunkHandle& ch, MeshTaskType cType, const BlockPack* blockPack, ChunkMeshManager* meshManager);
 
     MeshTaskType type; 
+    ui8 sections = ALL_CHUNK_MESH_SECTIONS; ///< Sections to mesh. See CHUNK_MESH_SECTION_HEIGHT.
+    ui8 lod = 0; ///< See MAX_CHUNK_MESH_LOD
     ChunkHandle chunk;
     ChunkMeshManager* meshManager = nullptr;
     const BlockPack* blockPack = nullptr;
@@ -2,7 +2,9 @@
 #include "ChunkMesher.h"
 
 #include <random>
-
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 #include "Biome.h"
 #include "BlockData.h"
@@ -37,6 +39,8 @@ const int PADDED_WIDTH_M1 = PADDED_WIDTH - 1;
 
 #define QUAD_SIZE 7
 
+#define INDICES_PER_QUAD 6
+
 //#define USE_AO
 
 // Base texture index
@@ -60,8 +64,61 @@ const int FACE_AXIS[6][2] = { { 2, 1 }, { 2, 1 }, { 0, 2 }, { 0, 2 }, { 0, 1 },
 
 const int FACE_AXIS_SIGN[6][2] = { { 1, 1 }, { -1, 1 }, { 1, 1 }, { -1, 1 }, { -1, 1 }, { 1, 1 } };
 
+// Binary greedy meshing
+#define GREEDY_FLAG_MESH 0x1
+#define GREEDY_FLAG_OCCLUDE 0x2
+#define GREEDY_FLAG_OCCLUDE_SELF 0x4
+// Shifted left by the face. Set when a face looks the same on every voxel of the block.
+#define GREEDY_FLAG_MERGE 0x8
+// Padded x bits 1 to 32, the voxels that belong to the chunk
+#define GREEDY_INTERIOR_BITS 0x1FFFFFFFEull
+
+struct GreedyFace {
+    int sliceStride; ///< Padded index step along the face normal
+    int rightStride; ///< Padded index step along the right axis, the bits of a row
+    int frontStride; ///< Padded index step along the front axis, the rows of a slice
+    int rightAxis;
+    int frontAxis;
+    int rightStretchIndex; ///< First of the two vertices moved when stretching right
+    i8 texOffset; ///< Texture u step when stretching right. v always steps by 1.
+};
+// Same axes and stretching as addBlock and tryMergeQuad
+const GreedyFace GREEDY_FACES[6] = {
+    { 1, PADDED_WIDTH, PADDED_LAYER, (int)vvox::Axis::Z, (int)vvox::Axis::Y, 2, 1 }, // X_NEG
+    { 1, PADDED_WIDTH, PADDED_LAYER, (int)vvox::Axis::Z, (int)vvox::Axis::Y, 0, -1 }, // X_POS
+    { PADDED_LAYER, 1, PADDED_WIDTH, (int)vvox::Axis::X, (int)vvox::Axis::Z, 2, 1 }, // Y_NEG
+    { PADDED_LAYER, 1, PADDED_WIDTH, (int)vvox::Axis::X, (int)vvox::Axis::Z, 0, -1 }, // Y_POS
+    { PADDED_WIDTH, 1, PADDED_LAYER, (int)vvox::Axis::X, (int)vvox::Axis::Y, 0, -1 }, // Z_NEG
+    { PADDED_WIDTH, 1, PADDED_LAYER, (int)vvox::Axis::X, (int)vvox::Axis::Y, 2, 1 } // Z_POS
+};
+
+// Index of the lowest set bit. v must not be 0.
+inline int lowestSetBit(ui32 v) {
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanForward(&i, v);
+    return (int)i;
+#else
+    return __builtin_ctz(v);
+#endif
+}
+inline int lowestSetBit(ui64 v) {
+    ui32 low = (ui32)v;
+    return low ? lowestSetBit(low) : 32 + lowestSetBit((ui32)(v >> 32));
+}
+
+// Whether a layer textures every voxel the same way, so its faces can be merged
+inline bool isMergeableLayer(const BlockTextureLayer& layer) {
+    // Color maps are sampled per column and the other methods look at neighbors or position
+    return !layer.colorMap && (layer.method == ConnectedTextureMethods::NONE ||
+                               layer.method == ConnectedTextureMethods::REPEAT);
+}
+
 PlanetHeightData ChunkMesher::defaultChunkHeightData[CHUNK_LAYER] = {};
 
+std::atomic<OpaqueMeshMethod> ChunkMesher::opaqueMeshMethod(OpaqueMeshMethod::QUAD_MERGE);
+ChunkVertexFormat ChunkMesher::vertexFormat = ChunkVertexFormat::BLOCK;
+
 void ChunkMesher::init(const BlockPack* blocks) {
     this->blocks = blocks;
 
@@ -86,20 +143,8 @@ void ChunkMesher::init(const BlockPack* blocks) {
 }
 
 void ChunkMesher::prepareData(const Chunk* chunk) {
-    int x, y, z, off1, off2;
-
-    const Chunk* left = chunk->neighbor.left;
-    const Chunk* right = chunk->neighbor.right;
-    const Chunk* bottom = chunk->neighbor.bottom;
-    const Chunk* top = chunk->neighbor.top;
-    const Chunk* back = chunk->neighbor.back;
-    const Chunk* front = chunk->neighbor.front;
-    int wc;
-    int c = 0;
-
-    i32v3 pos;
-
     wSize = 0;
+    m_lod = 0;
     chunkVoxelPos = chunk->getVoxelPosition();
     if (chunk->gridData) {
         m_chunkHeightData = chunk->gridData->heightData;
@@ -108,141 +153,69 @@ void ChunkMesher::prepareData(const Chunk* chunk) {
     }
 
     // TODO(Ben): Do this last so we can be queued for mesh longer?
-    // TODO(Ben): Dude macro this or something.
 
     memset(blockData, 0, sizeof(blockData));
     memset(tertiaryData, 0, sizeof(tertiaryData));
- 
-    if (chunk->blocks.getState() == vvox::VoxelStorageState::INTERVAL_TREE) {
 
-        int s = 0;
-        //block data
-        auto& dataTree = chunk->blocks.getTree();
-        for (size_t i = 0; i < dataTree.size(); i++) {
-            for (size_t j = 0; j < dataTree[i].length; j++) {
-                c = dataTree[i].getStart() + j;
+    copyChunkData(chunk);
 
-                getPosFromBlockIndex(c, pos);
+    const Chunk* left = chunk->neighbor.left;
+    const Chunk* right = chunk->neighbor.right;
+    const Chunk* bottom = chunk->neighbor.bottom;
+    const Chunk* top = chunk->neighbor.top;
+    const Chunk* back = chunk->neighbor.back;
+    const Chunk* front = chunk->neighbor.front;
+    if (left) copyNeighborSlab(left, i32v3(CHUNK_WIDTH - 1, 0, 0), i32v3(CHUNK_WIDTH), i32v3(0, 1, 1));
+    if (right) copyNeighborSlab(right, i32v3(0), i32v3(1, CHUNK_WIDTH, CHUNK_WIDTH), i32v3(PADDED_WIDTH - 1, 1, 1));
+    if (bottom) copyNeighborSlab(bottom, i32v3(0, CHUNK_WIDTH - 1, 0), i32v3(CHUNK_WIDTH), i32v3(1, 0, 1));
+    if (top) copyNeighborSlab(top, i32v3(0), i32v3(CHUNK_WIDTH, 1, CHUNK_WIDTH), i32v3(1, PADDED_WIDTH - 1, 1));
+    if (back) copyNeighborSlab(back, i32v3(0, 0, CHUNK_WIDTH - 1), i32v3(CHUNK_WIDTH), i32v3(1, 1, 0));
+    if (front) copyNeighborSlab(front, i32v3(0), i32v3(CHUNK_WIDTH, CHUNK_WIDTH, 1), i32v3(1, 1, PADDED_WIDTH - 1));
+}
 
-                wc = (pos.y + 1)*PADDED_LAYER + (pos.z + 1)*PADDED_WIDTH + (pos.x + 1);
-                blockData[wc] = dataTree[i].data;
+void ChunkMesher::copyChunkData(const Chunk* chunk) {
+    int s = 0;
+    // Block data. A single bulk copy rather than a lookup per voxel.
+    chunk->blocks.copyRange(0, CHUNK_SIZE, m_voxelBuffer);
+    int c = 0;
+    for (int y = 0; y < CHUNK_WIDTH; y++) {
+        for (int z = 0; z < CHUNK_WIDTH; z++, c += CHUNK_WIDTH) {
+            int wc = (y + 1)*PADDED_LAYER + (z + 1)*PADDED_WIDTH + 1;
+            memcpy(&blockData[wc], &m_voxelBuffer[c], CHUNK_WIDTH * sizeof(ui16));
+            for (int x = 0; x < CHUNK_WIDTH; x++, wc++) {
                 if (GETBLOCK(blockData[wc]).meshType == MeshType::LIQUID) {
                     m_wvec[s++] = wc;
                 }
-
             }
         }
-        wSize = s;
-    } else {
-        int s = 0;
-        for (y = 0; y < CHUNK_WIDTH; y++) {
-            for (z = 0; z < CHUNK_WIDTH; z++) {
-                for (x = 0; x < CHUNK_WIDTH; x++, c++) {
-                    wc = (y + 1)*PADDED_LAYER + (z + 1)*PADDED_WIDTH + (x + 1);
-                    blockData[wc] = chunk->blocks[c];
-                    if (GETBLOCK(blockData[wc]).meshType == MeshType::LIQUID) {
-                        m_wvec[s++] = wc;
-                    }
-                }
-            }
-        }
-        wSize = s;
     }
-    if (chunk->tertiary.getState() == vvox::VoxelStorageState::INTERVAL_TREE) {
-        //tertiary data
-        c = 0;
-        auto& dataTree = chunk->tertiary.getTree();
-        for (size_t i = 0; i < dataTree.size(); i++) {
-            for (size_t j = 0; j < dataTree[i].length; j++) {
-                c = dataTree[i].getStart() + j;
-
-                getPosFromBlockIndex(c, pos);
-                wc = (pos.y + 1)*PADDED_LAYER + (pos.z + 1)*PADDED_WIDTH + (pos.x + 1);
-
-                tertiaryData[wc] = dataTree[i].data;
-            }
-        }
-
-    } else {
-        c = 0;
-        for (y = 0; y < CHUNK_WIDTH; y++) {
-            for (z = 0; z < CHUNK_WIDTH; z++) {
-                for (x = 0; x < CHUNK_WIDTH; x++, c++) {
-                    wc = (y + 1)*PADDED_LAYER + (z + 1)*PADDED_WIDTH + (x + 1);
-                    tertiaryData[wc] = chunk->tertiary.get(c);
-                }
-            }
-        }
-    }
-
-    if (left) {
-        for (y = 1; y < PADDED_WIDTH - 1; y++) {
-            for (z = 1; z < PADDED_WIDTH - 1; z++) {
-                off1 = (z - 1)*CHUNK_WIDTH + (y - 1)*CHUNK_LAYER;
-                off2 = z*PADDED_WIDTH + y*PADDED_LAYER;
-
-                blockData[off2] = left->getBlockData(off1 + CHUNK_WIDTH - 1);
-                tertiaryData[off2] = left->getTertiaryData(off1 + CHUNK_WIDTH - 1);
-            }
-        }
-    }
-
-    if (right) {
-        for (y = 1; y < PADDED_WIDTH - 1; y++) {
-            for (z = 1; z < PADDED_WIDTH - 1; z++) {
-                off1 = (z - 1)*CHUNK_WIDTH + (y - 1)*CHUNK_LAYER;
-                off2 = z*PADDED_WIDTH + y*PADDED_LAYER;
-
-                blockData[off2 + PADDED_WIDTH - 1] = (right->getBlockData(off1));
-                tertiaryData[off2 + PADDED_WIDTH - 1] = right->getTertiaryData(off1);
-            }
-        }
-    }
-
-    if (bottom) {
-        for (z = 1; z < PADDED_WIDTH - 1; z++) {
-            for (x = 1; x < PADDED_WIDTH - 1; x++) {
-                off1 = (z - 1)*CHUNK_WIDTH + x - 1;
-                off2 = z*PADDED_WIDTH + x;
-                //data
-                blockData[off2] = (bottom->getBlockData(CHUNK_SIZE - CHUNK_LAYER + off1)); //bottom
-                tertiaryData[off2] = bottom->getTertiaryData(CHUNK_SIZE - CHUNK_LAYER + off1);
-            }
-        }
-    }
-
-    if (top) {
-        for (z = 1; z < PADDED_WIDTH - 1; z++) {
-            for (x = 1; x < PADDED_WIDTH - 1; x++) {
-                off1 = (z - 1)*CHUNK_WIDTH + x - 1;
-                off2 = z*PADDED_WIDTH + x;
-
-                blockData[off2 + PADDED_SIZE - PADDED_LAYER] = (top->getBlockData(off1)); //top
-                tertiaryData[off2 + PADDED_SIZE - PADDED_LAYER] = top->getTertiaryData(off1);
-            }
+    wSize = s;
+
+    // Tertiary data
+    chunk->tertiary.copyRange(0, CHUNK_SIZE, m_voxelBuffer);
+    c = 0;
+    for (int y = 0; y < CHUNK_WIDTH; y++) {
+        for (int z = 0; z < CHUNK_WIDTH; z++, c += CHUNK_WIDTH) {
+            int wc = (y + 1)*PADDED_LAYER + (z + 1)*PADDED_WIDTH + 1;
+            memcpy(&tertiaryData[wc], &m_voxelBuffer[c], CHUNK_WIDTH * sizeof(ui16));
         }
     }
+}
 
-    if (back) {
-        for (y = 1; y < PADDED_WIDTH - 1; y++) {
-            for (x = 1; x < PADDED_WIDTH - 1; x++) {
-                off1 = (x - 1) + (y - 1)*CHUNK_LAYER;
-                off2 = x + y*PADDED_LAYER;
-
-                blockData[off2] = back->getBlockData(off1 + CHUNK_LAYER - CHUNK_WIDTH);
-                tertiaryData[off2] = back->getTertiaryData(off1 + CHUNK_LAYER - CHUNK_WIDTH);
-            }
-        }
-    }
-
-    if (front) {
-        for (y = 1; y < PADDED_WIDTH - 1; y++) {
-            for (x = 1; x < PADDED_WIDTH - 1; x++) {
-                off1 = (x - 1) + (y - 1)*CHUNK_LAYER;
-                off2 = x + y*PADDED_LAYER;
-
-                blockData[off2 + PADDED_LAYER - PADDED_WIDTH] = (front->getBlockData(off1));
-                tertiaryData[off2 + PADDED_LAYER - PADDED_WIDTH] = front->getTertiaryData(off1);
+void ChunkMesher::copyNeighborSlab(const Chunk* neighbor, const i32v3& srcMin, const i32v3& srcMax, const i32v3& destMin) {
+    i32v3 size = srcMax - srcMin;
+    ui16* blockSlab = m_voxelBuffer;
+    ui16* tertiarySlab = m_voxelBuffer + CHUNK_LAYER;
+    neighbor->blocks.copyBox(srcMin, srcMax, blockSlab);
+    neighbor->tertiary.copyBox(srcMin, srcMax, tertiarySlab);
+
+    int i = 0;
+    for (int y = 0; y < size.y; y++) {
+        for (int z = 0; z < size.z; z++) {
+            int destIndex = (destMin.y + y) * PADDED_LAYER + (destMin.z + z) * PADDED_WIDTH + destMin.x;
+            for (int x = 0; x < size.x; x++, i++, destIndex++) {
+                blockData[destIndex] = blockSlab[i];
+                tertiaryData[destIndex] = tertiarySlab[i];
             }
         }
     }
@@ -250,7 +223,7 @@ void ChunkMesher::prepareData(const Chunk* chunk) {
 
 #define GET_EDGE_X(ch, sy, sz, dy, dz) \
     { \
-      std::lock_guard<std::mutex> l(ch->dataMutex); \
+      std::shared_lock<RWSpinLock> l(ch->dataMutex); \
       for (int x = 0; x < CHUNK_WIDTH; x++) { \
           srcIndex = (sy) * CHUNK_LAYER + (sz) * CHUNK_WIDTH + x; \
           destIndex = (dy) * PADDED_LAYER + (dz) * PADDED_WIDTH + (x + 1); \
@@ -262,7 +235,7 @@ void ChunkMesher::prepareData(const Chunk* chunk) {
 
 #define GET_EDGE_Y(ch, sx, sz, dx, dz) \
     { \
-      std::lock_guard<std::mutex> l(ch->dataMutex); \
+      std::shared_lock<RWSpinLock> l(ch->dataMutex); \
       for (int y = 0; y < CHUNK_WIDTH; y++) { \
         srcIndex = y * CHUNK_LAYER + (sz) * CHUNK_WIDTH + (sx); \
         destIndex = (y + 1) * PADDED_LAYER + (dz) * PADDED_WIDTH + (dx); \
@@ -274,7 +247,7 @@ void ChunkMesher::prepareData(const Chunk* chunk) {
 
 #define GET_EDGE_Z(ch, sx, sy, dx, dy) \
     { \
-      std::lock_guard<std::mutex> l(ch->dataMutex); \
+      std::shared_lock<RWSpinLock> l(ch->dataMutex); \
       for (int z = 0; z < CHUNK_WIDTH; z++) { \
         srcIndex = z * CHUNK_WIDTH + (sy) * CHUNK_LAYER + (sx); \
         destIndex = (z + 1) * PADDED_WIDTH + (dy) * PADDED_LAYER + (dx); \
@@ -288,7 +261,7 @@ void ChunkMesher::prepareData(const Chunk* chunk) {
     srcIndex = (sy) * CHUNK_LAYER + (sz) * CHUNK_WIDTH + (sx); \
     destIndex = (dy) * PADDED_LAYER + (dz) * PADDED_WIDTH + (dx); \
     { \
-      std::lock_guard<std::mutex> l(ch->dataMutex); \
+      std::shared_lock<RWSpinLock> l(ch->dataMutex); \
       blockData[destIndex] = ch->getBlockData(srcIndex); \
       tertiaryData[destIndex] = ch->getTertiaryData(srcIndex); \
     } \
@@ -297,12 +270,8 @@ void ChunkMesher::prepareData(const Chunk* chunk) {
 void ChunkMesher::prepareDataAsync(ChunkHandle& chunk, ChunkHandle neighbors[NUM_NEIGHBOR_HANDLES]) {
     int x, y, z, srcIndex, destIndex;
 
-    int wc;
-    int c = 0;
-
-    i32v3 pos;
-
     wSize = 0;
+    m_lod = 0;
     chunkVoxelPos = chunk->getVoxelPosition();
     if (chunk->gridData) {
         // If its async we copy to avoid storing a shared_ptr
@@ -313,159 +282,51 @@ void ChunkMesher::prepareDataAsync(ChunkHandle& chunk, ChunkHandle neighbors[NUM
     }
 
     // TODO(Ben): Do this last so we can be queued for mesh longer?
-    // TODO(Ben): Dude macro this or something.
     { // Main chunk
-        std::lock_guard<std::mutex> l(chunk->dataMutex);
-        if (chunk->blocks.getState() == vvox::VoxelStorageState::INTERVAL_TREE) {
-
-            int s = 0;
-            //block data
-            auto& dataTree = chunk->blocks.getTree();
-            for (size_t i = 0; i < dataTree.size(); i++) {
-                for (size_t j = 0; j < dataTree[i].length; j++) {
-                    c = dataTree[i].getStart() + j;
-
-                    getPosFromBlockIndex(c, pos);
-
-                    wc = (pos.y + 1)*PADDED_LAYER + (pos.z + 1)*PADDED_WIDTH + (pos.x + 1);
-                    blockData[wc] = dataTree[i].data;
-                    if (GETBLOCK(blockData[wc]).meshType == MeshType::LIQUID) {
-                        m_wvec[s++] = wc;
-                    }
-                }
-            }
-            wSize = s;
-        } else {
-            int s = 0;
-            for (y = 0; y < CHUNK_WIDTH; y++) {
-                for (z = 0; z < CHUNK_WIDTH; z++) {
-                    for (x = 0; x < CHUNK_WIDTH; x++, c++) {
-                        wc = (y + 1)*PADDED_LAYER + (z + 1)*PADDED_WIDTH + (x + 1);
-                        blockData[wc] = chunk->blocks[c];
-                        if (GETBLOCK(blockData[wc]).meshType == MeshType::LIQUID) {
-                            m_wvec[s++] = wc;
-                        }
-                    }
-                }
-            }
-            wSize = s;
-        }
-        if (chunk->tertiary.getState() == vvox::VoxelStorageState::INTERVAL_TREE) {
-            //tertiary data
-            c = 0;
-            auto& dataTree = chunk->tertiary.getTree();
-            for (size_t i = 0; i < dataTree.size(); i++) {
-                for (size_t j = 0; j < dataTree[i].length; j++) {
-                    c = dataTree[i].getStart() + j;
-
-                    getPosFromBlockIndex(c, pos);
-                    wc = (pos.y + 1)*PADDED_LAYER + (pos.z + 1)*PADDED_WIDTH + (pos.x + 1);
-
-                    tertiaryData[wc] = dataTree[i].data;
-                }
-            }
-
-        } else {
-            c = 0;
-            for (y = 0; y < CHUNK_WIDTH; y++) {
-                for (z = 0; z < CHUNK_WIDTH; z++) {
-                    for (x = 0; x < CHUNK_WIDTH; x++, c++) {
-                        wc = (y + 1)*PADDED_LAYER + (z + 1)*PADDED_WIDTH + (x + 1);
-                        tertiaryData[wc] = chunk->tertiary.get(c);
-                    }
-                }
-            }
-        }
+        std::shared_lock<RWSpinLock> l(chunk->dataMutex);
+        copyChunkData(chunk);
     }
     chunk.release();
 
     ChunkHandle& left = neighbors[NEIGHBOR_HANDLE_LEFT];
     { // Left
-        std::lock_guard<std::mutex> l(left->dataMutex);
-        for (y = 1; y < PADDED_WIDTH - 1; y++) {
-            for (z = 1; z < PADDED_WIDTH - 1; z++) {
-                srcIndex = (z - 1)*CHUNK_WIDTH + (y - 1)*CHUNK_LAYER;
-                destIndex = z*PADDED_WIDTH + y*PADDED_LAYER;
-
-                blockData[destIndex] = left->getBlockData(srcIndex + CHUNK_WIDTH - 1);
-                tertiaryData[destIndex] = left->getTertiaryData(srcIndex + CHUNK_WIDTH - 1);
-            }
-        }
+        std::shared_lock<RWSpinLock> l(left->dataMutex);
+        copyNeighborSlab(left, i32v3(CHUNK_WIDTH - 1, 0, 0), i32v3(CHUNK_WIDTH), i32v3(0, 1, 1));
     }
     left.release();
 
     ChunkHandle& right = neighbors[NEIGHBOR_HANDLE_RIGHT];
     { // Right
-        std::lock_guard<std::mutex> l(right->dataMutex);
-        for (y = 1; y < PADDED_WIDTH - 1; y++) {
-            for (z = 1; z < PADDED_WIDTH - 1; z++) {
-                srcIndex = (z - 1)*CHUNK_WIDTH + (y - 1)*CHUNK_LAYER;
-                destIndex = z*PADDED_WIDTH + y*PADDED_LAYER + PADDED_WIDTH - 1;
-
-                blockData[destIndex] = (right->getBlockData(srcIndex));
-                tertiaryData[destIndex] = right->getTertiaryData(srcIndex);
-            }
-        }
+        std::shared_lock<RWSpinLock> l(right->dataMutex);
+        copyNeighborSlab(right, i32v3(0), i32v3(1, CHUNK_WIDTH, CHUNK_WIDTH), i32v3(PADDED_WIDTH - 1, 1, 1));
     }
     right.release();
 
     ChunkHandle& bottom = neighbors[NEIGHBOR_HANDLE_BOT];
     { // Bottom
-        std::lock_guard<std::mutex> l(bottom->dataMutex);
-        for (z = 1; z < PADDED_WIDTH - 1; z++) {
-            for (x = 1; x < PADDED_WIDTH - 1; x++) {
-                srcIndex = (z - 1)*CHUNK_WIDTH + x - 1 + CHUNK_SIZE - CHUNK_LAYER;
-                destIndex = z*PADDED_WIDTH + x;
-                //data
-                blockData[destIndex] = (bottom->getBlockData(srcIndex)); //bottom
-                tertiaryData[destIndex] = bottom->getTertiaryData(srcIndex);
-            }
-        }
+        std::shared_lock<RWSpinLock> l(bottom->dataMutex);
+        copyNeighborSlab(bottom, i32v3(0, CHUNK_WIDTH - 1, 0), i32v3(CHUNK_WIDTH), i32v3(1, 0, 1));
     }
     bottom.release();
 
     ChunkHandle& top = neighbors[NEIGHBOR_HANDLE_TOP];
     { // Top
-        std::lock_guard<std::mutex> l(top->dataMutex);
-        for (z = 1; z < PADDED_WIDTH - 1; z++) {
-            for (x = 1; x < PADDED_WIDTH - 1; x++) {
-                srcIndex = (z - 1)*CHUNK_WIDTH + x - 1;
-                destIndex = z*PADDED_WIDTH + x + PADDED_SIZE - PADDED_LAYER;
-
-                blockData[destIndex] = (top->getBlockData(srcIndex)); //top
-                tertiaryData[destIndex] = top->getTertiaryData(srcIndex);
-            }
-        }
+        std::shared_lock<RWSpinLock> l(top->dataMutex);
+        copyNeighborSlab(top, i32v3(0), i32v3(CHUNK_WIDTH, 1, CHUNK_WIDTH), i32v3(1, PADDED_WIDTH - 1, 1));
     }
     top.release();
 
     ChunkHandle& back = neighbors[NEIGHBOR_HANDLE_BACK];
     { // Back
-        std::lock_guard<std::mutex> l(back->dataMutex);
-        for (y = 1; y < PADDED_WIDTH - 1; y++) {
-            for (x = 1; x < PADDED_WIDTH - 1; x++) {
-                srcIndex = (x - 1) + (y - 1)*CHUNK_LAYER + CHUNK_LAYER - CHUNK_WIDTH;
-                destIndex = x + y*PADDED_LAYER;
-
-                blockData[destIndex] = back->getBlockData(srcIndex);
-                tertiaryData[destIndex] = back->getTertiaryData(srcIndex);
-            }
-        }
+        std::shared_lock<RWSpinLock> l(back->dataMutex);
+        copyNeighborSlab(back, i32v3(0, 0, CHUNK_WIDTH - 1), i32v3(CHUNK_WIDTH), i32v3(1, 1, 0));
     }
     back.release();
 
     ChunkHandle& front = neighbors[NEIGHBOR_HANDLE_FRONT];
     { // Front
-        std::lock_guard<std::mutex> l(front->dataMutex);
-        for (y = 1; y < PADDED_WIDTH - 1; y++) {
-            for (x = 1; x < PADDED_WIDTH - 1; x++) {
-                srcIndex = (x - 1) + (y - 1)*CHUNK_LAYER;
-                destIndex = x + y*PADDED_LAYER + PADDED_LAYER - PADDED_WIDTH;
-
-                blockData[destIndex] = front->getBlockData(srcIndex);
-                tertiaryData[destIndex] = front->getTertiaryData(srcIndex);
-            }
-        }
+        std::shared_lock<RWSpinLock> l(front->dataMutex);
+        copyNeighborSlab(front, i32v3(0), i32v3(CHUNK_WIDTH, CHUNK_WIDTH, 1), i32v3(1, 1, PADDED_WIDTH - 1));
     }
     front.release();
     // Clone edge data
@@ -543,7 +404,108 @@ void ChunkMesher::prepareDataAsync(ChunkHandle& chunk, ChunkHandle neighbors[NUM
     }
 }
 
-CALLER_DELETE ChunkMeshData* ChunkMesher::createChunkMeshData(MeshTaskType type VORB_UNUSED) {
+// Distinct blocks counted per downsampled voxel. Rarer ones only count toward it being solid.
+#define MAX_DOWNSAMPLE_VOTES 16
+
+void ChunkMesher::downsampleData(ui8 lod) {
+    m_lod = lod;
+    if (lod == 0) return;
+    const int factor = 1 << lod;
+    const int width = CHUNK_WIDTH >> lod;
+
+    // Vote over each factor^3 cube. Air needs a strict majority, so thin
+    // surfaces and floors survive instead of eroding away.
+    ui16 ids[MAX_DOWNSAMPLE_VOTES];
+    int votes[MAX_DOWNSAMPLE_VOTES];
+    int i = 0;
+    for (int y = 0; y < width; y++) {
+        for (int z = 0; z < width; z++) {
+            for (int x = 0; x < width; x++, i++) {
+                int numIds = 0;
+                int numSolid = 0;
+                for (int dy = 0; dy < factor; dy++) {
+                    for (int dz = 0; dz < factor; dz++) {
+                        int index = (y * factor + dy + 1) * PADDED_LAYER + (z * factor + dz + 1) * PADDED_WIDTH + x * factor + 1;
+                        for (int dx = 0; dx < factor; dx++, index++) {
+                            ui16 id = blockData[index];
+                            if (id == 0) continue;
+                            numSolid++;
+                            int v = 0;
+                            while (v < numIds && ids[v] != id) v++;
+                            if (v < numIds) {
+                                votes[v]++;
+                            } else if (numIds < MAX_DOWNSAMPLE_VOTES) {
+                                ids[numIds] = id;
+                                votes[numIds++] = 1;
+                            }
+                        }
+                    }
+                }
+                ui16 winner = 0;
+                if (numSolid * 2 >= factor * factor * factor) {
+                    int best = 0;
+                    for (int v = 0; v < numIds; v++) {
+                        if (votes[v] > best) {
+                            best = votes[v];
+                            winner = ids[v];
+                        }
+                    }
+                }
+                m_voxelBuffer[i] = winner;
+            }
+        }
+    }
+
+    // The coarse voxels go in the low corner of the padded arrays. The
+    // padding is left as air, so faces on the chunk border are always meshed.
+    // They close the mesh off and hide cracks against neighbors at other LODs.
+    memset(blockData, 0, sizeof(blockData));
+    memset(tertiaryData, 0, sizeof(tertiaryData));
+    i = 0;
+    for (int y = 0; y < width; y++) {
+        for (int z = 0; z < width; z++, i += width) {
+            memcpy(&blockData[(y + 1) * PADDED_LAYER + (z + 1) * PADDED_WIDTH + 1], &m_voxelBuffer[i], width * sizeof(ui16));
+        }
+    }
+    // Liquids are only meshed at full detail
+    wSize = 0;
+}
+
+CALLER_DELETE ChunkMeshData* ChunkMesher::createChunkMeshData(MeshTaskType type VORB_UNUSED, ui8 sections /*= ALL_CHUNK_MESH_SECTIONS*/) {
+    const OpaqueMeshMethod opaqueMethod = opaqueMeshMethod;
+
+    // Clear quad indices. Only incremental merging uses them.
+    if (opaqueMethod == OpaqueMeshMethod::QUAD_MERGE) {
+        memset(m_quadIndices, 0xFF, sizeof(m_quadIndices));
+    }
+
+    // TODO(Ben): Here?
+    _waterVboVerts.clear();
+
+    // Stores the data for a chunk mesh
+    // TODO(Ben): new is bad mkay
+    m_chunkMeshData = new ChunkMeshData(MeshTaskType::DEFAULT);
+    m_chunkMeshData->sectionMask = sections;
+    m_chunkMeshData->lod = m_lod;
+
+    // Face culling needs the whole chunk, merging is per section
+    if (opaqueMethod == OpaqueMeshMethod::BINARY_GREEDY) buildGreedyFaceMasks();
+
+    for (int i = 0; i < NUM_CHUNK_MESH_SECTIONS; i++) {
+        // LOD data only fills the lower sections. The rest stay empty.
+        if (i * CHUNK_MESH_SECTION_HEIGHT >= (CHUNK_WIDTH >> m_lod)) break;
+        if (sections & (1 << i)) createSectionMesh(i, m_chunkMeshData->sections[i]);
+    }
+    m_section = nullptr;
+
+    return m_chunkMeshData;
+}
+
+void ChunkMesher::createSectionMesh(int section, OUT ChunkMeshSection& meshSection) {
+    const OpaqueMeshMethod opaqueMethod = opaqueMeshMethod;
+    const int firstY = section * CHUNK_MESH_SECTION_HEIGHT;
+    const int endY = firstY + CHUNK_MESH_SECTION_HEIGHT;
+    m_section = &meshSection;
     m_numQuads = 0;
     m_highestY = 0;
     m_lowestY = 256;
@@ -552,22 +514,18 @@ CALLER_DELETE ChunkMeshData* ChunkMesher::createChunkMeshData(MeshTaskType type
     m_highestZ = 0;
     m_lowestZ = 256;
 
-    // Clear quad indices
-    memset(m_quadIndices, 0xFF, sizeof(m_quadIndices));
-
     for (int i = 0; i < 6; i++) {
         m_quads[i].clear();
     }
+    m_floraQuads.clear();
 
-    // TODO(Ben): Here?
-    _waterVboVerts.clear();
-
-    // Stores the data for a chunk mesh
-    // TODO(Ben): new is bad mkay
-    m_chunkMeshData = new ChunkMeshData(MeshTaskType::DEFAULT);
+    // Forget the quads of the layer below so nothing merges into the last section
+    if (opaqueMethod == OpaqueMeshMethod::QUAD_MERGE) {
+        memset(m_quadIndices[firstY * PADDED_CHUNK_LAYER], 0xFF, PADDED_CHUNK_LAYER * sizeof(m_quadIndices[0]));
+    }
 
     // Loop through blocks
-    for (by = 0; by < CHUNK_WIDTH; by++) {
+    for (by = firstY; by < endY; by++) {
         for (bz = 0; bz < CHUNK_WIDTH; bz++) {
             for (bx = 0; bx < CHUNK_WIDTH; bx++) {
                 // Get data for this voxel
@@ -575,14 +533,14 @@ CALLER_DELETE ChunkMeshData* ChunkMesher::createChunkMeshData(MeshTaskType type
                 blockIndex = (by + 1) * PADDED_CHUNK_LAYER + (bz + 1) * PADDED_CHUNK_WIDTH + (bx + 1);
                 blockID = blockData[blockIndex];
                 if (blockID == 0) continue; // Skip air blocks
-                heightData = &m_chunkHeightData[bz * CHUNK_WIDTH + bx];
+                heightData = &m_chunkHeightData[(bz << m_lod) * CHUNK_WIDTH + (bx << m_lod)];
                 block = &blocks->operator[](blockID);
                 // TODO(Ben) Don't think bx needs to be member
                 voxelPosOffset = ui8v3(bx * QUAD_SIZE, by * QUAD_SIZE, bz * QUAD_SIZE);
 
                 switch (block->meshType) {
                     case MeshType::BLOCK:
-                        addBlock();
+                        if (opaqueMethod == OpaqueMeshMethod::QUAD_MERGE) addBlock();
                         break;
                     case MeshType::LEAVES:
                     case MeshType::CROSSFLORA:
@@ -596,78 +554,61 @@ CALLER_DELETE ChunkMeshData* ChunkMesher::createChunkMeshData(MeshTaskType type
             }
         }
     }
-
-    ChunkMeshRenderData& renderData = m_chunkMeshData->chunkMeshRenderData;
+    if (opaqueMethod == OpaqueMeshMethod::BINARY_GREEDY) addBlocksGreedy(section);
 
     // Get quad buffer to fill
-    std::vector<VoxelQuad>& finalQuads = m_chunkMeshData->opaqueQuads;
-
-    finalQuads.resize(m_numQuads);
+    const bool isPacked = vertexFormat == ChunkVertexFormat::PACKED;
+    if (isPacked) {
+        meshSection.packedQuads.resize(m_numQuads);
+        m_lastPaletteIndex = 0;
+    } else {
+        meshSection.opaqueQuads.resize(m_numQuads);
+    }
     // Copy the data
-    // TODO(Ben): Could construct in place and not need ANY copying with 6 iterations?
     i32 index = 0;
-    i32 sizes[6];
     for (int i = 0; i < 6; i++) {
         std::vector<VoxelQuad>& quads = m_quads[i];
         int tmp = index;
         for (size_t j = 0; j < quads.size(); j++) {
             VoxelQuad& q = quads[j];
             if (q.v.v0.mesherFlags & MESH_FLAG_ACTIVE) {
-                finalQuads[index++] = q;
+                if (isPacked) {
+                    packQuad(q, meshSection.packedQuads[index++]);
+                } else {
+                    meshSection.opaqueQuads[index++] = q;
+                }
             }
         }
-        sizes[i] = index - tmp;
+        meshSection.faceSizes[i] = index - tmp;
     }
 
     // Swap flora quads
-    renderData.cutoutVboSize = m_floraQuads.size() * INDICES_PER_QUAD;
-    m_chunkMeshData->cutoutQuads.swap(m_floraQuads);
-
-    m_highestY /= QUAD_SIZE;
-    m_lowestY /= QUAD_SIZE;
-    m_highestX /= QUAD_SIZE;
-    m_lowestX /= QUAD_SIZE;
-    m_highestZ /= QUAD_SIZE;
-    m_lowestZ /= QUAD_SIZE;
-
-#define INDICES_PER_QUAD 6
-
-    if (finalQuads.size()) {
-        renderData.nxVboOff = 0;
-        renderData.nxVboSize = sizes[0] * INDICES_PER_QUAD;
-        renderData.pxVboOff = renderData.nxVboSize;
-        renderData.pxVboSize = sizes[1] * INDICES_PER_QUAD;
-        renderData.nyVboOff = renderData.pxVboOff + renderData.pxVboSize;
-        renderData.nyVboSize = sizes[2] * INDICES_PER_QUAD;
-        renderData.pyVboOff = renderData.nyVboOff + renderData.nyVboSize;
-        renderData.pyVboSize = sizes[3] * INDICES_PER_QUAD;
-        renderData.nzVboOff = renderData.pyVboOff + renderData.pyVboSize;
-        renderData.nzVboSize = sizes[4] * INDICES_PER_QUAD;
-        renderData.pzVboOff = renderData.nzVboOff + renderData.nzVboSize;
-        renderData.pzVboSize = sizes[5] * INDICES_PER_QUAD;
-        renderData.indexSize = finalQuads.size() * INDICES_PER_QUAD;
-
-        // Redundant
-        renderData.highestX = m_highestX;
-        renderData.lowestX = m_lowestX;
-        renderData.highestY = m_highestY;
-        renderData.lowestY = m_lowestY;
-        renderData.highestZ = m_highestZ;
-        renderData.lowestZ = m_lowestZ;
+    meshSection.cutoutQuads.swap(m_floraQuads);
+
+    if (m_numQuads) {
+        meshSection.highestX = m_highestX / QUAD_SIZE;
+        meshSection.lowestX = m_lowestX / QUAD_SIZE;
+        meshSection.highestY = m_highestY / QUAD_SIZE;
+        meshSection.lowestY = m_lowestY / QUAD_SIZE;
+        meshSection.highestZ = m_highestZ / QUAD_SIZE;
+        meshSection.lowestZ = m_lowestZ / QUAD_SIZE;
     }
-
-    return m_chunkMeshData;
 }
 
-inline bool mapBufferData(GLuint& vboID, GLsizeiptr size, void* src, GLenum usage) {
-    // Block Vertices
+// Allocates the buffer and maps it for writing. Leaves it bound.
+inline void* mapBuffer(GLuint& vboID, GLsizeiptr size, GLenum usage) {
     if (vboID == 0) {
         glGenBuffers(1, &(vboID)); // Create the buffer ID
     }
     glBindBuffer(GL_ARRAY_BUFFER, vboID);
     glBufferData(GL_ARRAY_BUFFER, size, NULL, usage);
 
-    void *v = glMapBufferRange(GL_ARRAY_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    return glMapBufferRange(GL_ARRAY_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+}
+
+inline bool mapBufferData(GLuint& vboID, GLsizeiptr size, void* src, GLenum usage) {
+    // Block Vertices
+    void *v = mapBuffer(vboID, size, usage);
 
     if (v == NULL) return false;
 
@@ -677,6 +618,106 @@ inline bool mapBufferData(GLuint& vboID, GLsizeiptr size, void* src, GLenum usag
     return true;
 }
 
+inline void uploadPaletteTexture(ChunkMesh& mesh, ui8 sectionMask) {
+    ui32 width = 1;
+    for (int i = 0; i < NUM_CHUNK_MESH_SECTIONS; i++) {
+        width = glm::max(width, (ui32)mesh.sections[i].palette.size());
+    }
+
+    if (mesh.paletteTextureID == 0) {
+        glGenTextures(1, &mesh.paletteTextureID);
+        mesh.paletteWidth = 0;
+    }
+    glBindTexture(GL_TEXTURE_2D, mesh.paletteTextureID);
+    if (width != mesh.paletteWidth) {
+        // Reallocate with every section's row
+        std::vector<ChunkPaletteEntry> texels(width * NUM_CHUNK_MESH_SECTIONS);
+        for (int i = 0; i < NUM_CHUNK_MESH_SECTIONS; i++) {
+            const std::vector<ChunkPaletteEntry>& palette = mesh.sections[i].palette;
+            if (palette.size()) memcpy(&texels[i * width], palette.data(), palette.size() * sizeof(ChunkPaletteEntry));
+        }
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32UI, (GLsizei)width, NUM_CHUNK_MESH_SECTIONS, 0, GL_RGBA_INTEGER, GL_UNSIGNED_INT, texels.data());
+        // Integer textures can't be filtered
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        mesh.paletteWidth = width;
+    } else {
+        // Only the replaced rows changed
+        for (int i = 0; i < NUM_CHUNK_MESH_SECTIONS; i++) {
+            const std::vector<ChunkPaletteEntry>& palette = mesh.sections[i].palette;
+            if ((sectionMask & (1 << i)) && palette.size()) {
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, i, (GLsizei)palette.size(), 1, GL_RGBA_INTEGER, GL_UNSIGNED_INT, palette.data());
+            }
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// Uploads the opaque quads of every section a face at a time, so each face
+// still draws as one range. Sets the face ranges and bounds of renderData.
+template <typename Q>
+inline void uploadOpaqueQuads(ChunkMesh& mesh, std::vector<Q> ChunkMeshSection::*sectionQuads, size_t numQuads, OUT ChunkMeshRenderData& renderData) {
+    Q* dest = (Q*)mapBuffer(mesh.vboID, numQuads * sizeof(Q), GL_STATIC_DRAW);
+    i32 offsets[6];
+    i32 sizes[6];
+    size_t sectionStarts[NUM_CHUNK_MESH_SECTIONS] = {};
+    size_t index = 0;
+    for (int face = 0; face < 6; face++) {
+        offsets[face] = (i32)(index * INDICES_PER_QUAD);
+        for (int i = 0; i < NUM_CHUNK_MESH_SECTIONS; i++) {
+            const ChunkMeshSection& section = mesh.sections[i];
+            size_t size = section.faceSizes[face];
+            if (size && dest) memcpy(dest + index, &(section.*sectionQuads)[sectionStarts[i]], size * sizeof(Q));
+            sectionStarts[i] += size;
+            index += size;
+        }
+        sizes[face] = (i32)(index * INDICES_PER_QUAD) - offsets[face];
+    }
+    if (dest) glUnmapBuffer(GL_ARRAY_BUFFER);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    renderData.nxVboOff = offsets[0];
+    renderData.nxVboSize = sizes[0];
+    renderData.pxVboOff = offsets[1];
+    renderData.pxVboSize = sizes[1];
+    renderData.nyVboOff = offsets[2];
+    renderData.nyVboSize = sizes[2];
+    renderData.pyVboOff = offsets[3];
+    renderData.pyVboSize = sizes[3];
+    renderData.nzVboOff = offsets[4];
+    renderData.nzVboSize = sizes[4];
+    renderData.pzVboOff = offsets[5];
+    renderData.pzVboSize = sizes[5];
+    renderData.indexSize = (ui32)(numQuads * INDICES_PER_QUAD);
+
+    // Bounds are in voxels, LOD meshes are scaled up to them
+    for (int i = 0; i < NUM_CHUNK_MESH_SECTIONS; i++) {
+        const ChunkMeshSection& section = mesh.sections[i];
+        if ((section.*sectionQuads).empty()) continue;
+        renderData.highestX = glm::max(renderData.highestX, section.highestX << mesh.lod);
+        renderData.lowestX = glm::min(renderData.lowestX, section.lowestX << mesh.lod);
+        renderData.highestY = glm::max(renderData.highestY, section.highestY << mesh.lod);
+        renderData.lowestY = glm::min(renderData.lowestY, section.lowestY << mesh.lod);
+        renderData.highestZ = glm::max(renderData.highestZ, section.highestZ << mesh.lod);
+        renderData.lowestZ = glm::min(renderData.lowestZ, section.lowestZ << mesh.lod);
+    }
+}
+
+inline void uploadCutoutQuads(ChunkMesh& mesh, size_t numQuads) {
+    VoxelQuad* dest = (VoxelQuad*)mapBuffer(mesh.cutoutVboID, numQuads * sizeof(VoxelQuad), GL_STATIC_DRAW);
+    if (dest) {
+        for (int i = 0; i < NUM_CHUNK_MESH_SECTIONS; i++) {
+            const std::vector<VoxelQuad>& quads = mesh.sections[i].cutoutQuads;
+            if (quads.size()) {
+                memcpy(dest, quads.data(), quads.size() * sizeof(VoxelQuad));
+                dest += quads.size();
+            }
+        }
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
 bool ChunkMesher::uploadMeshData(ChunkMesh& mesh, ChunkMeshData* meshData) {
     bool canRender = false;
 
@@ -685,10 +726,30 @@ bool ChunkMesher::uploadMeshData(ChunkMesh& mesh, ChunkMeshData* meshData) {
     mesh.transQuadPositions.swap(meshData->transQuadPositions);
 
     switch (meshData->type) {
-        case MeshTaskType::DEFAULT:
-            if (meshData->opaqueQuads.size()) {
+        case MeshTaskType::DEFAULT: {
+            // Replace the remeshed sections. The buffers are rebuilt from all of them.
+            mesh.lod = meshData->lod;
+            for (int i = 0; i < NUM_CHUNK_MESH_SECTIONS; i++) {
+                if (meshData->sectionMask & (1 << i)) mesh.sections[i] = std::move(meshData->sections[i]);
+            }
+            if (meshData->sectionMask == ALL_CHUNK_MESH_SECTIONS) mesh.isMeshed = true;
+            size_t numOpaqueQuads = 0;
+            size_t numCutoutQuads = 0;
+            for (int i = 0; i < NUM_CHUNK_MESH_SECTIONS; i++) {
+                numOpaqueQuads += mesh.sections[i].getNumOpaqueQuads();
+                numCutoutQuads += mesh.sections[i].cutoutQuads.size();
+            }
 
-                mapBufferData(mesh.vboID, meshData->opaqueQuads.size() * sizeof(VoxelQuad), &(meshData->opaqueQuads[0]), GL_STATIC_DRAW);
+            // Opaque ranges and bounds are rebuilt below
+            ChunkMeshRenderData renderData = meshData->chunkMeshRenderData;
+            if (numOpaqueQuads) {
+
+                if (vertexFormat == ChunkVertexFormat::PACKED) {
+                    uploadOpaqueQuads(mesh, &ChunkMeshSection::packedQuads, numOpaqueQuads, renderData);
+                    uploadPaletteTexture(mesh, meshData->sectionMask);
+                } else {
+                    uploadOpaqueQuads(mesh, &ChunkMeshSection::opaqueQuads, numOpaqueQuads, renderData);
+                }
                 canRender = true;
 
                 if (!mesh.vaoID) buildVao(mesh);
@@ -701,6 +762,10 @@ bool ChunkMesher::uploadMeshData(ChunkMesh& mesh, ChunkMeshData* meshData) {
                     glDeleteVertexArrays(1, &(mesh.vaoID));
                     mesh.vaoID = 0;
                 }
+                if (mesh.paletteTextureID != 0) {
+                    glDeleteTextures(1, &(mesh.paletteTextureID));
+                    mesh.paletteTextureID = 0;
+                }
             }
 
             if (meshData->transQuads.size()) {
@@ -729,9 +794,10 @@ bool ChunkMesher::uploadMeshData(ChunkMesh& mesh, ChunkMeshData* meshData) {
                 }
             }
 
-            if (meshData->cutoutQuads.size()) {
+            renderData.cutoutVboSize = (i32)(numCutoutQuads * INDICES_PER_QUAD);
+            if (numCutoutQuads) {
 
-                mapBufferData(mesh.cutoutVboID, meshData->cutoutQuads.size() * sizeof(VoxelQuad), &(meshData->cutoutQuads[0]), GL_STATIC_DRAW);
+                uploadCutoutQuads(mesh, numCutoutQuads);
                 canRender = true;
                 if (!mesh.cutoutVaoID) buildCutoutVao(mesh);
             } else {
@@ -744,7 +810,8 @@ bool ChunkMesher::uploadMeshData(ChunkMesh& mesh, ChunkMeshData* meshData) {
                     mesh.cutoutVboID = 0;
                 }
             }
-            mesh.renderData = meshData->chunkMeshRenderData;
+            mesh.renderData = renderData;
+        }
             //The missing break is deliberate!
             VORB_FALLTHROUGH;
         case MeshTaskType::LIQUID:
@@ -777,6 +844,9 @@ void ChunkMesher::freeChunkMesh(CALLEE_DELETE ChunkMesh* mesh) {
     if (mesh->vaoID != 0) {
         glDeleteVertexArrays(1, &mesh->vaoID);
     }
+    if (mesh->paletteTextureID != 0) {
+        glDeleteTextures(1, &mesh->paletteTextureID);
+    }
     // Transparent
     if (mesh->transVaoID != 0) {
         glDeleteVertexArrays(1, &mesh->transVaoID);
@@ -926,7 +996,12 @@ void ChunkMesher::computeAmbientOcclusion(int upOffset VORB_UNUSED, int frontOff
 #endif
 }
 
-void ChunkMesher::addQuad(int face, int rightAxis, int frontAxis, int leftOffset, int backOffset, int rightStretchIndex, const ui8v2& texOffset, f32 ambientOcclusion VORB_UNUSED[]) {
+void ChunkMesher::addQuad(int face, int rightAxis, int frontAxis, int leftOffset, int backOffset, int rightStretchIndex, const ui8v2& texOffset, f32 ambientOcclusion[]) {
+    VoxelQuad* quad = createQuad(face, ambientOcclusion);
+    m_numQuads -= tryMergeQuad(quad, m_quads[face], face, rightAxis, frontAxis, leftOffset, backOffset, rightStretchIndex, texOffset);
+}
+
+VoxelQuad* ChunkMesher::createQuad(int face, f32 ambientOcclusion VORB_UNUSED[]) {
     // Get texture TODO(Ben): Null check?
     const BlockTexture* texture = block->textures[face];
 
@@ -973,17 +1048,22 @@ void ChunkMesher::addQuad(int face, int rightAxis, int frontAxis, int leftOffset
     for (int i = 0; i < 4; i++) {
         BlockVertex& v = quad->verts[i];
         v.position = VoxelMesher::VOXEL_POSITIONS[face][i] + voxelPosOffset;
-#ifdef USE_AO
-        f32& ao = ambientOcclusion[i];
-        v.color.r = (ui8)(blockColor[B_INDEX].r * ao);
-        v.color.g = (ui8)(blockColor[B_INDEX].g * ao);
-        v.color.b = (ui8)(blockColor[B_INDEX].b * ao);
-        v.overlayColor.r = (ui8)(blockColor[O_INDEX].r * ao);
-        v.overlayColor.g = (ui8)(blockColor[O_INDEX].g * ao);
-        v.overlayColor.b = (ui8)(blockColor[O_INDEX].b * ao);
-#else
         v.color = blockColor[B_INDEX];
         v.overlayColor = blockColor[O_INDEX];
+        v.ao = 3;
+#ifdef USE_AO
+        f32& ao = ambientOcclusion[i];
+        // 0.2 per occluder, so 1.0 is 3 and three or more occluders are 0
+        v.ao = (ui8)glm::clamp((int)glm::round((ao - 0.4f) / 0.2f), 0, 3);
+        // Packed vertices apply ao in the shader
+        if (vertexFormat == ChunkVertexFormat::BLOCK) {
+            v.color.r = (ui8)(blockColor[B_INDEX].r * ao);
+            v.color.g = (ui8)(blockColor[B_INDEX].g * ao);
+            v.color.b = (ui8)(blockColor[B_INDEX].b * ao);
+            v.overlayColor.r = (ui8)(blockColor[O_INDEX].r * ao);
+            v.overlayColor.g = (ui8)(blockColor[O_INDEX].g * ao);
+            v.overlayColor.b = (ui8)(blockColor[O_INDEX].b * ao);
+        }
 #endif
         // TODO(Ben) array?
         v.texturePosition.base.index = (ui8)methodDatas[0].index;
@@ -1022,8 +1102,268 @@ void ChunkMesher::addQuad(int face, int rightAxis, int frontAxis, int leftOffset
     if (quad->v.v0.position.y > m_highestY) m_highestY = quad->v.v0.position.y;
     if (quad->v.v0.position.z < m_lowestZ) m_lowestZ = quad->v.v0.position.z;
     if (quad->v.v0.position.z > m_highestZ) m_highestZ = quad->v.v0.position.z;
+    return quad;
+}
 
-    m_numQuads -= tryMergeQuad(quad, quads, face, rightAxis, frontAxis, leftOffset, backOffset, rightStretchIndex, texOffset);
+void ChunkMesher::addBlocksGreedy(int section) {
+    const int firstY = section * CHUNK_MESH_SECTION_HEIGHT;
+    const int endY = firstY + CHUNK_MESH_SECTION_HEIGHT;
+    for (int face = 0; face < 6; face++) {
+        if (face == Y_NEG || face == Y_POS) {
+            // Y slices lie within one section
+            for (int slice = firstY; slice < endY; slice++) {
+                greedyMergeSlice(face, slice, 0, CHUNK_WIDTH);
+            }
+        } else {
+            // The other faces have y as their rows
+            for (int slice = 0; slice < CHUNK_WIDTH; slice++) {
+                greedyMergeSlice(face, slice, firstY, endY);
+            }
+        }
+    }
+}
+
+void ChunkMesher::buildGreedyFaceMasks() {
+    // Flags per block so the voxel loop is a single lookup
+    m_greedyBlockFlags.resize(blocks->size());
+    for (size_t i = 0; i < m_greedyBlockFlags.size(); i++) {
+        const Block& b = blocks->operator[](i);
+        ui16 flags = 0;
+        if (b.meshType == MeshType::BLOCK) {
+            flags |= GREEDY_FLAG_MESH;
+            for (int face = 0; face < 6; face++) {
+                const BlockTexture* texture = b.textures[face];
+                if (texture && isMergeableLayer(texture->layers.base) && isMergeableLayer(texture->layers.overlay)) {
+                    flags |= GREEDY_FLAG_MERGE << face;
+                }
+            }
+        }
+        if (b.occlude == BlockOcclusion::ALL) flags |= GREEDY_FLAG_OCCLUDE;
+        if (b.occlude == BlockOcclusion::SELF) flags |= GREEDY_FLAG_OCCLUDE_SELF;
+        m_greedyBlockFlags[i] = flags;
+    }
+
+    // Column bitmasks along each axis, padding included
+    memset(m_meshColumns, 0, sizeof(m_meshColumns));
+    memset(m_occludeColumns, 0, sizeof(m_occludeColumns));
+    memset(m_selfOccludeColumns, 0, sizeof(m_selfOccludeColumns));
+    int i = 0;
+    for (int y = 0; y < PADDED_WIDTH; y++) {
+        for (int z = 0; z < PADDED_WIDTH; z++) {
+            for (int x = 0; x < PADDED_WIDTH; x++, i++) {
+                ui16 flags = m_greedyBlockFlags[blockData[i]];
+                if (!flags) continue;
+#define SET_COLUMN_BITS(columns, flag) \
+                if (flags & flag) { \
+                    columns[0][y][z] |= 1ull << x; \
+                    columns[1][z][x] |= 1ull << y; \
+                    columns[2][y][x] |= 1ull << z; \
+                }
+                SET_COLUMN_BITS(m_meshColumns, GREEDY_FLAG_MESH);
+                SET_COLUMN_BITS(m_occludeColumns, GREEDY_FLAG_OCCLUDE);
+                SET_COLUMN_BITS(m_selfOccludeColumns, GREEDY_FLAG_OCCLUDE_SELF);
+#undef SET_COLUMN_BITS
+            }
+        }
+    }
+
+    // Cull faces a column at a time and scatter the visible ones into slices
+    memset(m_faceMasks, 0, sizeof(m_faceMasks));
+    for (int axis = 0; axis < 3; axis++) {
+        const int negFace = axis * 2;
+        const int posFace = negFace + 1;
+        // Step between neighbors along the column
+        const int step = GREEDY_FACES[negFace].sliceStride;
+        for (int p = 1; p < PADDED_WIDTH_M1; p++) {
+            for (int q = 1; q < PADDED_WIDTH_M1; q++) {
+                ui64 mesh = m_meshColumns[axis][p][q] & GREEDY_INTERIOR_BITS;
+                if (!mesh) continue;
+                ui64 occlude = m_occludeColumns[axis][p][q];
+                ui64 self = m_selfOccludeColumns[axis][p][q];
+                ui64 faces[2];
+                faces[0] = mesh & ~(occlude << 1);
+                faces[1] = mesh & ~(occlude >> 1);
+                // Start of the column in padded indices
+                int columnIndex;
+                switch (axis) {
+                    case 0: columnIndex = p * PADDED_LAYER + q * PADDED_WIDTH; break;
+                    case 1: columnIndex = p * PADDED_WIDTH + q; break;
+                    default: columnIndex = p * PADDED_LAYER + q; break;
+                }
+                // Self occluding neighbors only hide faces of the same block
+                ui64 selfNeighbors[2] = { faces[0] & (self << 1), faces[1] & (self >> 1) };
+                for (int s = 0; s < 2; s++) {
+                    const int offset = s ? step : -step;
+                    while (selfNeighbors[s]) {
+                        int bit = lowestSetBit(selfNeighbors[s]);
+                        selfNeighbors[s] &= selfNeighbors[s] - 1;
+                        int index = columnIndex + bit * step;
+                        if (blockData[index] == blockData[index + offset]) faces[s] &= ~(1ull << bit);
+                    }
+                }
+                // Slices are along the column, rows are p and bits are q
+                const ui32 rowBit = 1u << (q - 1);
+                for (int s = 0; s < 2; s++) {
+                    ui32 (*slices)[CHUNK_WIDTH] = m_faceMasks[s ? posFace : negFace];
+                    while (faces[s]) {
+                        int bit = lowestSetBit(faces[s]);
+                        faces[s] &= faces[s] - 1;
+                        slices[bit - 1][p - 1] |= rowBit;
+                    }
+                }
+            }
+        }
+    }
+}
+
+void ChunkMesher::greedyMergeSlice(int face, int slice, int firstRow, int endRow) {
+    const GreedyFace& g = GREEDY_FACES[face];
+    ui32* rows = m_faceMasks[face][slice];
+    const int sliceIndex = (slice + 1) * g.sliceStride + g.rightStride + g.frontStride;
+    const ui16 mergeFlag = GREEDY_FLAG_MERGE << face;
+    for (int v = firstRow; v < endRow; v++) {
+        while (rows[v]) {
+            const int u = lowestSetBit(rows[v]);
+            const int index = sliceIndex + u * g.rightStride + v * g.frontStride;
+            const ui16 id = blockData[index];
+            int width = 1;
+            int height = 1;
+            if (m_greedyBlockFlags[id] & mergeFlag) {
+                // Grow right along the row
+                while (u + width < CHUNK_WIDTH && (rows[v] & (1u << (u + width))) &&
+                       blockData[index + width * g.rightStride] == id) {
+                    width++;
+                }
+                // Grow front while the whole span is visible and the same block
+                const ui32 span = (width == 32 ? 0xFFFFFFFFu : ((1u << width) - 1)) << u;
+                while (v + height < endRow && (rows[v + height] & span) == span) {
+                    const int rowIndex = index + height * g.frontStride;
+                    int i = 0;
+                    while (i < width && blockData[rowIndex + i * g.rightStride] == id) i++;
+                    if (i < width) break;
+                    height++;
+                }
+            }
+            const ui32 span = (width == 32 ? 0xFFFFFFFFu : ((1u << width) - 1)) << u;
+            for (int i = 0; i < height; i++) {
+                rows[v + i] &= ~span;
+            }
+            addGreedyQuad(face, index, width, height);
+        }
+    }
+}
+
+void ChunkMesher::addGreedyQuad(int face, int index, int width, int height) {
+    const GreedyFace& g = GREEDY_FACES[face];
+
+    // The quad is built for the voxel at its origin, then stretched
+    blockIndex = index;
+    bx = index % PADDED_WIDTH - 1;
+    by = index / PADDED_LAYER - 1;
+    bz = (index % PADDED_LAYER) / PADDED_WIDTH - 1;
+    blockID = blockData[index];
+    block = &blocks->operator[](blockID);
+    heightData = &m_chunkHeightData[(bz << m_lod) * CHUNK_WIDTH + (bx << m_lod)];
+    voxelPosOffset = ui8v3(bx * QUAD_SIZE, by * QUAD_SIZE, bz * QUAD_SIZE);
+
+    f32 ao[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    VoxelQuad* quad = createQuad(face, ao);
+    if (width > 1) {
+        BlockVertex& v1 = quad->verts[g.rightStretchIndex];
+        BlockVertex& v2 = quad->verts[g.rightStretchIndex + 1];
+        v1.position[g.rightAxis] += (ui8)((width - 1) * QUAD_SIZE);
+        v1.tex.x += (ui8)((width - 1) * g.texOffset);
+        v2.position[g.rightAxis] += (ui8)((width - 1) * QUAD_SIZE);
+        v2.tex.x += (ui8)((width - 1) * g.texOffset);
+    }
+    if (height > 1) {
+        quad->v.v0.position[g.frontAxis] += (ui8)((height - 1) * QUAD_SIZE);
+        quad->v.v0.tex.y += (ui8)(height - 1);
+        quad->v.v3.position[g.frontAxis] += (ui8)((height - 1) * QUAD_SIZE);
+        quad->v.v3.tex.y += (ui8)(height - 1);
+    }
+
+    // The far corner moved on both axes
+    const ui8v3& corner = quad->verts[g.rightStretchIndex == 0 ? 0 : 3].position;
+    if (corner.x < m_lowestX) m_lowestX = corner.x;
+    if (corner.x > m_highestX) m_highestX = corner.x;
+    if (corner.y < m_lowestY) m_lowestY = corner.y;
+    if (corner.y > m_highestY) m_highestY = corner.y;
+    if (corner.z < m_lowestZ) m_lowestZ = corner.z;
+    if (corner.z > m_highestZ) m_highestZ = corner.z;
+}
+
+// Sum of the differences of two packed RGB colors
+inline int colorDistance(ui32 a, ui32 b) {
+    int d = 0;
+    for (int i = 0; i < 24; i += 8) {
+        d += glm::abs((int)((a >> i) & 0xFF) - (int)((b >> i) & 0xFF));
+    }
+    return d;
+}
+
+void ChunkMesher::packQuad(const VoxelQuad& quad, OUT PackedVoxelQuad& packed) {
+    const BlockVertex& v0 = quad.v.v0;
+    const int face = v0.face;
+    const int rightAxis = FACE_AXIS[face][0];
+    const int frontAxis = FACE_AXIS[face][1];
+
+    // Merging only ever moves corners up, so the lowest corner is the origin voxel's
+    ui8v3 minPos = v0.position;
+    ui8v3 maxPos = v0.position;
+    for (int i = 1; i < 4; i++) {
+        minPos = glm::min(minPos, quad.verts[i].position);
+        maxPos = glm::max(maxPos, quad.verts[i].position);
+    }
+    ui8v3 voxel = minPos / (ui8)QUAD_SIZE;
+    // Positive faces are on the far side of their voxel
+    if (face & 1) voxel[face / 2]--;
+    ui32 width = (maxPos[rightAxis] - minPos[rightAxis]) / QUAD_SIZE;
+    ui32 height = (maxPos[frontAxis] - minPos[frontAxis]) / QUAD_SIZE;
+
+    ui32 texture = v0.texturePosition.base.atlas * ATLAS_SIZE + v0.texturePosition.base.index;
+    // Colors are per quad and AO is per corner. Merging only joins quads whose corners match.
+    ui32 palette = getPaletteIndex(v0);
+    for (int i = 0; i < 4; i++) {
+        packed.verts[i].geometry = PackedBlockVertex::packGeometry(voxel, face, i, width, height, quad.verts[i].ao);
+        // Voxels are fully lit until the mesher computes light
+        packed.verts[i].material = PackedBlockVertex::packMaterial(texture, palette, 255);
+    }
+}
+
+ui32 ChunkMesher::getPaletteIndex(const BlockVertex& v) {
+    ChunkPaletteEntry entry;
+    entry.color = v.color.r | (v.color.g << 8) | (v.color.b << 16) | ((ui32)v.blendMode << 24);
+    entry.overlayColor = v.overlayColor.r | (v.overlayColor.g << 8) | (v.overlayColor.b << 16);
+    entry.overlayTexture = v.texturePosition.overlay.atlas * ATLAS_SIZE + v.texturePosition.overlay.index;
+    entry.textureDims = v.textureDims.x | (v.textureDims.y << 8) | (v.overlayTextureDims.x << 16) | ((ui32)v.overlayTextureDims.y << 24);
+
+    std::vector<ChunkPaletteEntry>& palette = m_section->palette;
+    // Quads of the same block are usually packed one after another
+    if (m_lastPaletteIndex < palette.size() && palette[m_lastPaletteIndex] == entry) return m_lastPaletteIndex;
+    for (size_t i = 0; i < palette.size(); i++) {
+        if (palette[i] == entry) return m_lastPaletteIndex = (ui32)i;
+    }
+    if (palette.size() < MAX_CHUNK_PALETTE_SIZE) {
+        palette.push_back(entry);
+        return m_lastPaletteIndex = (ui32)palette.size() - 1;
+    }
+
+    // Full, which takes a lot of color mapped blocks. Use the closest colors
+    // with the same textures and blend mode.
+    ui32 best = 0;
+    int bestDistance = INT_MAX;
+    for (size_t i = 0; i < palette.size(); i++) {
+        const ChunkPaletteEntry& p = palette[i];
+        if (p.overlayTexture != entry.overlayTexture || p.textureDims != entry.textureDims ||
+            (p.color >> 24) != (entry.color >> 24)) continue;
+        int distance = colorDistance(p.color, entry.color) + colorDistance(p.overlayColor, entry.overlayColor);
+        if (distance < bestDistance) {
+            bestDistance = distance;
+            best = (ui32)i;
+        }
+    }
+    return best;
 }
 
 struct FloraQuadData {
@@ -1610,6 +1950,16 @@ void ChunkMesher::buildVao(ChunkMesh& cm) {
     glBindBuffer(GL_ARRAY_BUFFER, cm.vboID);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ChunkRenderer::sharedIBO);
 
+    if (vertexFormat == ChunkVertexFormat::PACKED) {
+        glEnableVertexAttribArray(0);
+
+        // vPacked
+        glVertexAttribIPointer(0, 2, GL_UNSIGNED_INT, sizeof(PackedBlockVertex), offsetptr(PackedBlockVertex, geometry));
+
+        glBindVertexArray(0);
+        return;
+    }
+
     for (int i = 0; i < 8; i++) {
         glEnableVertexAttribArray(i);
     }
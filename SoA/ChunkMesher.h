@@ -5,6 +5,8 @@
 #include "ChunkMesh.h"
 #include "ChunkMeshTask.h"
 
+#include <atomic>
+
 class BlockPack;
 class BlockTextureLayer;
 class ChunkMeshData;
@@ -12,6 +14,18 @@ struct BlockTexture;
 struct PlanetHeightData;
 struct FloraQuadData;
 
+/// How opaque block faces are meshed
+enum class OpaqueMeshMethod {
+    QUAD_MERGE, ///< A quad per visible face, merged with its left and back neighbors as it is added
+    BINARY_GREEDY ///< Faces culled on column bitmasks, then greedy merged in 2D per slice
+};
+
+/// How opaque quads are stored and uploaded
+enum class ChunkVertexFormat {
+    BLOCK, ///< BlockVertex, drawn by the standardShading data shaders
+    PACKED ///< PackedBlockVertex with a per section palette, drawn by ChunkRenderer's inline shaders
+};
+
 // Sizes For A Padded Chunk
 const int PADDED_CHUNK_WIDTH = (CHUNK_WIDTH + 2);
 const int PADDED_CHUNK_LAYER = (PADDED_CHUNK_WIDTH * PADDED_CHUNK_WIDTH);
@@ -28,7 +42,7 @@ const int PADDED_CHUNK_SIZE = (PADDED_CHUNK_LAYER * PADDED_CHUNK_WIDTH);
 // This class is too big to statically allocate
 class ChunkMesher {
 public:
-    ChunkMesher():blocks(nullptr), m_chunkMeshData(nullptr){}
+    ChunkMesher():blocks(nullptr), m_chunkMeshData(nullptr), m_section(nullptr), m_lod(0){}
 
     void init(const BlockPack* blocks);
 
@@ -45,11 +59,16 @@ class ChunkMesher {
     void prepareData(const Chunk* chunk);
     // For use with threadpool
     void prepareDataAsync(ChunkHandle& chunk, ChunkHandle neighbors[NUM_NEIGHBOR_HANDLES]);
+    // Replaces the prepared data with a downsample for an LOD mesh. Each voxel
+    // takes the most common block of the 2^lod cube it covers.
+    void downsampleData(ui8 lod);
 
     // TODO(Ben): Unique ptr?
     // Must call prepareData or prepareDataAsync first
-    CALLER_DELETE ChunkMeshData* createChunkMeshData(MeshTaskType type);
+    // @param sections: Bit per section to mesh. The rest are left empty.
+    CALLER_DELETE ChunkMeshData* createChunkMeshData(MeshTaskType type, ui8 sections = ALL_CHUNK_MESH_SECTIONS);
 
+    // Replaces the mesh's sections with those in meshData and rebuilds its buffers.
     // Returns true if the mesh is renderable
     static bool uploadMeshData(ChunkMesh& mesh, ChunkMeshData* meshData);
 
@@ -58,6 +77,10 @@ class ChunkMesher {
 
     void freeBuffers();
 
+    // Prepared input that isn't public, for ChunkMeshCache keys
+    const PlanetHeightData* getChunkHeightData() const { return m_chunkHeightData; }
+    ui8 getLod() const { return m_lod; }
+
     int bx, by, bz; // Block iterators
     int blockIndex;
     ui16 blockID;
@@ -74,10 +97,35 @@ class ChunkMesher {
     const BlockPack* blocks;
 
     VoxelPosition3D chunkVoxelPos;
+
+    /// Opaque mesher used by every ChunkMesher. Read once per mesh, so it can change at any time.
+    static std::atomic<OpaqueMeshMethod> opaqueMeshMethod;
+    /// Vertex format of every opaque mesh. Uploaded meshes and the chunk
+    /// programs must agree, so it is only set at startup from OPT_PACKED_CHUNK_VERTICES.
+    static ChunkVertexFormat vertexFormat;
 private:
+    // Copies the chunk's voxels into the center of the padded arrays
+    void copyChunkData(const Chunk* chunk);
+    // Copies the box [srcMin, srcMax) of a neighbor into the padded arrays at destMin
+    void copyNeighborSlab(const Chunk* neighbor, const i32v3& srcMin, const i32v3& srcMax, const i32v3& destMin);
+
+    // Meshes the voxels of one section into meshSection
+    void createSectionMesh(int section, OUT ChunkMeshSection& meshSection);
     void addBlock();
     void addQuad(int face, int rightAxis, int frontAxis, int leftOffset, int backOffset, int rightStretchIndex, const ui8v2& texOffset, f32 ambientOcclusion[]);
+    // Builds the quad for the current voxel's face without merging it
+    VoxelQuad* createQuad(int face, f32 ambientOcclusion[]);
+    // Meshes the section's BLOCK voxels with OpaqueMeshMethod::BINARY_GREEDY
+    void addBlocksGreedy(int section);
+    void buildGreedyFaceMasks();
+    // Merges the rows [firstRow, endRow) of a slice. Quads don't grow past endRow.
+    void greedyMergeSlice(int face, int slice, int firstRow, int endRow);
+    void addGreedyQuad(int face, int index, int width, int height);
     void computeAmbientOcclusion(int upOffset, int frontOffset, int rightOffset, f32 ambientOcclusion[]);
+    // Packs a merged opaque quad for ChunkMeshSection::packedQuads
+    void packQuad(const VoxelQuad& quad, OUT PackedVoxelQuad& packed);
+    // Finds or adds the quad's palette entry in the section being built
+    ui32 getPaletteIndex(const BlockVertex& v);
     void addFlora();
     void addFloraQuad(const ui8v3* positions, FloraQuadData& data);
     int tryMergeQuad(VoxelQuad* quad, std::vector<VoxelQuad>& quads, int face, int rightAxis, int frontAxis, int leftOffset, int backOffset, int rightStretchIndex, const ui8v2& texOffset);
@@ -96,13 +144,23 @@ class ChunkMesher {
     static void buildWaterVao(ChunkMesh& cm);
 
     ui16 m_quadIndices[PADDED_CHUNK_SIZE][6];
+
+    // Binary greedy meshing. Columns are indexed by the other two padded
+    // coordinates: x columns by [y][z], y columns by [z][x], z columns by [y][x].
+    ui64 m_meshColumns[3][PADDED_CHUNK_WIDTH][PADDED_CHUNK_WIDTH]; ///< BLOCK voxels
+    ui64 m_occludeColumns[3][PADDED_CHUNK_WIDTH][PADDED_CHUNK_WIDTH]; ///< BlockOcclusion::ALL voxels
+    ui64 m_selfOccludeColumns[3][PADDED_CHUNK_WIDTH][PADDED_CHUNK_WIDTH]; ///< BlockOcclusion::SELF voxels
+    ui32 m_faceMasks[6][CHUNK_WIDTH][CHUNK_WIDTH]; ///< Visible faces as [face][slice][front] rows of right bits
+    std::vector<ui16> m_greedyBlockFlags; ///< Per block ID mesh flags, rebuilt each greedy mesh
     ui16 m_wvec[CHUNK_SIZE];
+    ui16 m_voxelBuffer[CHUNK_SIZE]; ///< Scratch space for bulk copies out of voxel containers
 
     std::vector<BlockVertex> m_finalVerts[6];
 
     std::vector<VoxelQuad> m_floraQuads;
     std::vector<VoxelQuad> m_quads[6];
     ui32 m_numQuads;
+    ui32 m_lastPaletteIndex; ///< Palette entry of the last packed quad
 
     BlockTextureMethodParams m_textureMethodParams[6][2];
 
@@ -110,6 +168,8 @@ class ChunkMesher {
     std::vector<LiquidVertex> _waterVboVerts;
 
     ChunkMeshData* m_chunkMeshData;
+    ChunkMeshSection* m_section; ///< Section being built
+    ui8 m_lod; ///< LOD of the prepared data
 
     int m_highestY;
     int m_lowestY;
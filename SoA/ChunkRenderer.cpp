@@ -1,9 +1,11 @@
 #include "stdafx.h"
 #include "ChunkRenderer.h"
 
+#include "BlockTextureAtlas.h"
 #include "Camera.h"
 #include "Chunk.h"
 #include "ChunkMeshManager.h"
+#include "ChunkMesher.h"
 #include "Frustum.h"
 #include "GameManager.h"
 #include "GameRenderParams.h"
@@ -11,8 +13,134 @@
 #include "RenderUtils.h"
 #include "ShaderLoader.h"
 #include "SoaOptions.h"
+#include "VoxelMesher.h"
 #include "soaUtils.h"
 
+// Packed texture indices are atlas * ATLAS_SIZE + tile
+static_assert(BLOCK_TEXTURE_ATLAS_TILES_PER_PAGE == ATLAS_SIZE, "Atlas pages must hold ATLAS_SIZE tiles");
+
+// Opaque chunk shaders for ChunkVertexFormat::PACKED. The vertex shader
+// decodes PackedBlockVertex. Unlike the data shaders they don't sample
+// normal or displacement maps.
+const cString ChunkRenderer::OPAQUE_VERT_SRC = R"(
+uniform mat4 unWVP;
+uniform mat4 unW;
+uniform usampler2D unPalette;
+
+in uvec2 vPacked;
+
+out vec3 fPosition;
+out vec3 fNormal;
+out vec2 fTex;
+out float fAO;
+out float fLight;
+flat out uint fTexture;
+flat out uvec4 fPalette;
+
+// Unit corners of each face, VoxelMesher::VOXEL_POSITIONS divided by its resolution
+const vec3 CORNERS[24] = vec3[24](
+    vec3(0, 1, 0), vec3(0, 0, 0), vec3(0, 0, 1), vec3(0, 1, 1),
+    vec3(1, 1, 1), vec3(1, 0, 1), vec3(1, 0, 0), vec3(1, 1, 0),
+    vec3(0, 0, 1), vec3(0, 0, 0), vec3(1, 0, 0), vec3(1, 0, 1),
+    vec3(1, 1, 1), vec3(1, 1, 0), vec3(0, 1, 0), vec3(0, 1, 1),
+    vec3(1, 1, 0), vec3(1, 0, 0), vec3(0, 0, 0), vec3(0, 1, 0),
+    vec3(0, 1, 1), vec3(0, 0, 1), vec3(1, 0, 1), vec3(1, 1, 1)
+);
+const vec2 CORNER_UVS[4] = vec2[4](vec2(0, 1), vec2(0, 0), vec2(1, 0), vec2(1, 1));
+// Right and front axes of each face, and which way u runs along right
+const ivec2 FACE_AXES[6] = ivec2[6](ivec2(2, 1), ivec2(2, 1), ivec2(0, 2), ivec2(0, 2), ivec2(0, 1), ivec2(0, 1));
+const float FACE_U_SIGN[6] = float[6](1.0, -1.0, 1.0, -1.0, -1.0, 1.0);
+const vec3 NORMALS[6] = vec3[6](vec3(-1, 0, 0), vec3(1, 0, 0), vec3(0, -1, 0), vec3(0, 1, 0), vec3(0, 0, -1), vec3(0, 0, 1));
+
+void main() {
+    uint g = vPacked.x;
+    uint m = vPacked.y;
+    vec3 voxel = vec3(float(g & 31u), float((g >> 5u) & 31u), float((g >> 10u) & 31u));
+    int face = int((g >> 15u) & 7u);
+    int corner = int((g >> 18u) & 3u);
+    // Size in voxels minus one
+    vec2 stretch = vec2(float((g >> 20u) & 31u), float((g >> 25u) & 31u));
+    ivec2 axes = FACE_AXES[face];
+
+    // Corners on the far side of the right and front axes are stretched
+    vec3 unit = CORNERS[face * 4 + corner];
+    vec3 scale = vec3(1.0);
+    scale[axes.x] += stretch.x;
+    scale[axes.y] += stretch.y;
+    vec3 position = voxel + unit * scale;
+
+    fTex = CORNER_UVS[corner] + vec2(FACE_U_SIGN[face] * (voxel[axes.x] + unit[axes.x] * stretch.x),
+                                     voxel[axes.y] + unit[axes.y] * stretch.y);
+    fAO = 1.0 - float(3u - (g >> 30u)) * 0.2;
+    fLight = float(m >> 24u) / 255.0;
+    fTexture = m & 0xFFFFu;
+    // A palette row per section, which are CHUNK_MESH_SECTION_HEIGHT layers
+    fPalette = texelFetch(unPalette, ivec2(int((m >> 16u) & 255u), int((g >> 5u) & 31u) / 8), 0);
+    fNormal = NORMALS[face];
+    fPosition = (unW * vec4(position, 1.0)).xyz;
+    gl_Position = unWVP * vec4(position, 1.0);
+}
+)";
+namespace {
+    const cString OPAQUE_FRAG_SRC = R"(
+uniform sampler2DArray unTextures;
+uniform vec3 unLightDirWorld;
+uniform vec3 unSunColor;
+uniform vec3 unAmbientLight;
+uniform float unSpecularExponent;
+uniform float unSpecularIntensity;
+uniform float unFadeDist;
+
+in vec3 fPosition;
+in vec3 fNormal;
+in vec2 fTex;
+in float fAO;
+in float fLight;
+flat in uint fTexture;
+flat in uvec4 fPalette;
+
+out vec4 fColor;
+
+// Atlas pages are TILES_PER_SIDE tiles square. Repeating textures span dims tiles.
+vec4 sampleTile(uint index, uvec2 dims, vec2 tex) {
+    vec2 d = vec2(max(dims, uvec2(1u)));
+    uint page = index / (TILES_PER_SIDE * TILES_PER_SIDE);
+    index -= page * TILES_PER_SIDE * TILES_PER_SIDE;
+    vec2 tile = vec2(float(index % TILES_PER_SIDE), float(index / TILES_PER_SIDE));
+    vec2 uv = (tile + mod(tex, d)) / float(TILES_PER_SIDE);
+    // Gradients of the unwrapped coordinates, so mips don't break at tile edges
+    vec2 grad = tex / float(TILES_PER_SIDE);
+    return textureGrad(unTextures, vec3(uv, float(page)), dFdx(grad), dFdy(grad));
+}
+
+vec3 unpackColor(uint c) {
+    return vec3(float(c & 255u), float((c >> 8u) & 255u), float((c >> 16u) & 255u)) / 255.0;
+}
+
+void main() {
+    if (length(fPosition) > unFadeDist) discard;
+
+    vec3 base = sampleTile(fTexture, uvec2(fPalette.w & 255u, (fPalette.w >> 8u) & 255u), fTex).rgb * unpackColor(fPalette.x);
+    vec4 overlay = sampleTile(fPalette.z, uvec2((fPalette.w >> 16u) & 255u, fPalette.w >> 24u), fTex);
+    overlay.rgb *= unpackColor(fPalette.y);
+
+    // Blend mode bits are multiply, add and alpha from ChunkMesher::getBlendMode
+    uint blendMode = fPalette.x >> 24u;
+    float alpha = float(blendMode & 3u);
+    float add = float((blendMode >> 2u) & 3u) - 1.0;
+    float multiply = 1.0 - float((blendMode >> 4u) & 3u);
+    vec3 color = mix(base, overlay.rgb, overlay.a * alpha) + overlay.rgb * overlay.a * add;
+    color *= mix(vec3(1.0), overlay.rgb, overlay.a * multiply);
+
+    float diffuse = max(dot(fNormal, unLightDirWorld), 0.0);
+    vec3 halfDir = normalize(unLightDirWorld + normalize(-fPosition));
+    float specular = pow(max(dot(fNormal, halfDir), 0.0), unSpecularExponent) * unSpecularIntensity * step(0.0001, diffuse);
+    vec3 light = (unAmbientLight + unSunColor * diffuse * fLight) * fAO;
+    fColor = vec4(color * light + unSunColor * specular * fLight, 1.0);
+}
+)";
+}
+
 volatile f32 ChunkRenderer::fadeDist = 1.0f;
 f32m4 ChunkRenderer::worldMatrix = f32m4(1.0f);
 
@@ -43,9 +171,16 @@ void ChunkRenderer::init() {
     }
 
     { // Opaque
-        m_opaqueProgram = ShaderLoader::createProgramFromFile("Shaders/BlockShading/standardShading.vert",
-                                                              "Shaders/BlockShading/standardShading.frag");
-        m_opaqueProgram.use();
+        if (ChunkMesher::vertexFormat == ChunkVertexFormat::PACKED) {
+            nString defines = "#define TILES_PER_SIDE " + std::to_string(BLOCK_TEXTURE_ATLAS_TILES_PER_SIDE) + "u\n";
+            m_opaqueProgram = ShaderLoader::createProgram("OpaqueChunk", OPAQUE_VERT_SRC, OPAQUE_FRAG_SRC, nullptr, defines.c_str());
+            m_opaqueProgram.use();
+            glUniform1i(m_opaqueProgram.getUniform("unPalette"), 1);
+        } else {
+            m_opaqueProgram = ShaderLoader::createProgramFromFile("Shaders/BlockShading/standardShading.vert",
+                                                                  "Shaders/BlockShading/standardShading.frag");
+            m_opaqueProgram.use();
+        }
         glUniform1i(m_opaqueProgram.getUniform("unTextures"), 0);
     }
     // TODO(Ben): Fix the shaders
@@ -88,21 +223,39 @@ void ChunkRenderer::beginOpaque(VGTexture textureAtlas, const f32v3& sunDir, con
 
     // f32 blockAmbient = 0.000f;
     glUniform3fv(m_opaqueProgram.getUniform("unAmbientLight"), 1, &ambient[0]);
-    glUniform3fv(m_opaqueProgram.getUniform("unSunColor"), 1, &sunDir[0]);
+    if (ChunkMesher::vertexFormat == ChunkVertexFormat::PACKED) {
+        // The packed shader scales diffuse and specular by it, so it has to be a color
+        glUniform3fv(m_opaqueProgram.getUniform("unSunColor"), 1, &lightColor[0]);
+    } else {
+        glUniform3fv(m_opaqueProgram.getUniform("unSunColor"), 1, &sunDir[0]);
+    }
 
     glUniform1f(m_opaqueProgram.getUniform("unFadeDist"), 100000.0f/*ChunkRenderer::fadeDist*/);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sharedIBO);
 }
 
+void ChunkRenderer::setWorldMatrix(const ChunkMesh* cm, const f64v3& playerPos) {
+    setMatrixTranslation(worldMatrix, f64v3(cm->position), playerPos);
+    // LOD meshes are built in coarse voxels
+    setMatrixScale(worldMatrix, f32v3((f32)(1 << cm->lod)));
+}
+
+void ChunkRenderer::bindPalette(const ChunkMesh* cm) {
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, cm->paletteTextureID);
+    glActiveTexture(GL_TEXTURE0);
+}
+
 void ChunkRenderer::drawOpaque(const ChunkMesh *cm, const f64v3 &PlayerPos, const f32m4 &VP) const {
     if (cm->vaoID == 0) return;
     
-    setMatrixTranslation(worldMatrix, f64v3(cm->position), PlayerPos);
+    setWorldMatrix(cm, PlayerPos);
 
     f32m4 MVP = VP * worldMatrix;
     glUniformMatrix4fv(m_opaqueProgram.getUniform("unWVP"), 1, GL_FALSE, &MVP[0][0]);
     glUniformMatrix4fv(m_opaqueProgram.getUniform("unW"), 1, GL_FALSE, &worldMatrix[0][0]);
 
+    bindPalette(cm);
     glBindVertexArray(cm->vaoID);
 
     const ChunkMeshRenderData& chunkMeshInfo = cm->renderData;
@@ -137,13 +290,14 @@ void ChunkRenderer::drawOpaque(const ChunkMesh *cm, const f64v3 &PlayerPos, cons
 void ChunkRenderer::drawOpaqueCustom(const ChunkMesh* cm, vg::GLProgram& m_program, const f64v3& PlayerPos, const f32m4& VP) {
     if (cm->vaoID == 0) return;
     
-    setMatrixTranslation(worldMatrix, f64v3(cm->position), PlayerPos);
+    setWorldMatrix(cm, PlayerPos);
 
     f32m4 MVP = VP * worldMatrix;
 
     glUniformMatrix4fv(m_program.getUniform("unWVP"), 1, GL_FALSE, &MVP[0][0]);
     glUniformMatrix4fv(m_program.getUniform("unW"), 1, GL_FALSE, &worldMatrix[0][0]);
 
+    bindPalette(cm);
     glBindVertexArray(cm->vaoID);
 
     const ChunkMeshRenderData& chunkMeshInfo = cm->renderData;
@@ -199,7 +353,7 @@ void ChunkRenderer::beginTransparent(VGTexture textureAtlas, const f32v3& sunDir
 void ChunkRenderer::drawTransparent(const ChunkMesh *cm, const f64v3 &playerPos, const f32m4 &VP) const {
     if (cm->transVaoID == 0) return;
 
-    setMatrixTranslation(worldMatrix, f64v3(cm->position), playerPos);
+    setWorldMatrix(cm, playerPos);
 
     f32m4 MVP = VP * worldMatrix;
 
@@ -235,7 +389,7 @@ void ChunkRenderer::beginCutout(VGTexture textureAtlas, const f32v3& sunDir, con
 void ChunkRenderer::drawCutout(const ChunkMesh *cm, const f64v3 &playerPos, const f32m4 &VP) const {
     if (cm->cutoutVaoID == 0) return;
 
-    setMatrixTranslation(worldMatrix, f64v3(cm->position), playerPos);
+    setWorldMatrix(cm, playerPos);
 
     f32m4 MVP = VP * worldMatrix;
 
@@ -272,7 +426,7 @@ void ChunkRenderer::drawLiquid(const ChunkMesh *cm, const f64v3 &PlayerPos, cons
     //use drawWater bool to avoid checking frustum twice
     if (cm->inFrustum && cm->waterVboID){
 
-        setMatrixTranslation(worldMatrix, f64v3(cm->position), PlayerPos);
+        setWorldMatrix(cm, PlayerPos);
 
         f32m4 MVP = VP * worldMatrix;
 
@@ -36,7 +36,15 @@ class ChunkRenderer {
 
     static volatile f32 fadeDist;
     static VGIndexBuffer sharedIBO;
+    /// Decodes PackedBlockVertex. Programs that draw ChunkVertexFormat::PACKED
+    /// meshes with drawOpaqueCustom need it, and must set unPalette to texture unit 1.
+    static const cString OPAQUE_VERT_SRC;
 private:
+    /// Positions the mesh relative to the player and scales LOD meshes
+    static void setWorldMatrix(const ChunkMesh* cm, const f64v3& playerPos);
+    /// Binds the mesh's palette to texture unit 1
+    static void bindPalette(const ChunkMesh* cm);
+
     static f32m4 worldMatrix; ///< Reusable world matrix for chunks
     vg::GLProgram m_opaqueProgram;
     vg::GLProgram m_transparentProgram;
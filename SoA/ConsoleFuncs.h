@@ -18,6 +18,7 @@
 #include <Vorb/types.h>
 #include <Vorb/script/IEnvironment.hpp>
 
+#include "ChunkMesher.h"
 #include "DLLAPI.h"
 #include "SoAState.h"
 #include "SoaController.h"
@@ -92,6 +93,10 @@ void setStartingPlanet(SoaState* s, vecs::EntityID eID) {
     s->clientState.startingPlanet = eID;
 }
 
+void setGreedyMeshing(bool enabled) {
+    ChunkMesher::opaqueMeshMethod = enabled ? OpaqueMeshMethod::BINARY_GREEDY : OpaqueMeshMethod::QUAD_MERGE;
+}
+
 template <typename ScriptImpl>
 void registerFuncs(vscript::IEnvironment<ScriptImpl>* env) {
     env->setNamespaces("SC");
@@ -116,6 +121,7 @@ void registerFuncs(vscript::IEnvironment<ScriptImpl>* env) {
     env->addCDelegate("startGame",         makeDelegate(startGame));
     env->addCDelegate("stopGame",          makeDelegate(stopGame));
     env->addCDelegate("setStartingPlanet", makeDelegate(setStartingPlanet));
+    env->addCDelegate("setGreedyMeshing",  makeDelegate(setGreedyMeshing));
 
     /************************************************************************/
     /* Test methods                                                         */
@@ -124,9 +130,26 @@ void registerFuncs(vscript::IEnvironment<ScriptImpl>* env) {
     env->addCDelegate("create", makeDelegate(createCASData));
     env->addCDelegate("run",    makeDelegate(runCAS));
     env->addCDelegate("free",   makeDelegate(freeCAS));
+    env->addCDelegate("runScaling", makeDelegate(runCASScaling));
 
     env->setNamespaces("CHS");
     env->addCDelegate("run", makeDelegate(runCHS));
+    env->addCDelegate("stress", makeDelegate(runCHStress));
+
+    env->setNamespaces("CDL");
+    env->addCDelegate("run", makeDelegate(runCDL));
+
+    env->setNamespaces("VL");
+    env->addCDelegate("run", makeDelegate(runVoxelLayout));
+
+    env->setNamespaces("NB");
+    env->addCDelegate("run", makeDelegate(runNoiseBatch));
+
+    env->setNamespaces("AH");
+    env->addCDelegate("run", makeDelegate(runAdaptiveHeightmap));
+
+    env->setNamespaces("MB");
+    env->addCDelegate("run", makeDelegate(runMesher));
 
     env->setNamespaces();
 }
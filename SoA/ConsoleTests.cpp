@@ -1,10 +1,23 @@
 #include "stdafx.h"
 #include "ConsoleTests.h"
 
+#include "BlockPack.h"
 #include "ChunkAllocator.h"
 #include "ChunkAccessor.h"
+#include "ChunkMeshCache.h"
+#include "ChunkMesher.h"
+#include "Noise.h"
+#include "PlanetGenData.h"
+#include "PlanetGenLoader.h"
+#include "PlanetHeightData.h"
+#include "SphericalHeightmapGenerator.h"
+#include "VoxelLayout.h"
+#include "VoxelUtils.h"
 
+#include <atomic>
 #include <random>
+#include <Vorb/concurrentqueue.h>
+#include <Vorb/io/IOManager.h>
 #include <Vorb/Timing.h>
 
 struct ChunkAccessSpeedData {
@@ -21,6 +34,32 @@ struct ChunkAccessSpeedData {
     ChunkHandle* handles;
 };
 
+/// Acquires requestCount chunks and releases them in a random interleaving
+/// @return Time taken in milliseconds
+static f64 requestChunks(ChunkAccessor& accessor, ChunkID* id, ChunkHandle* handles, size_t requestCount, size_t threadID) {
+    std::mt19937 rEngine((ui32)threadID);
+    std::uniform_int_distribution<int> release(0, 1);
+
+    PreciseTimer timer;
+    timer.start();
+    ChunkHandle* hndAcquire = handles;
+    ChunkHandle* hndRelease = hndAcquire;
+    ChunkHandle* hndEnd = hndRelease + requestCount;
+    while (hndRelease != hndEnd) {
+        if ((hndAcquire > hndRelease) && release(rEngine)) {
+            // Release a handle
+            hndRelease->release();
+            hndRelease++;
+        } else if(hndAcquire != hndEnd) {
+            // Acquire a handle
+            *hndAcquire = accessor.acquire(*id);
+            hndAcquire++;
+            id++;
+        }
+    }
+    return timer.stop();
+}
+
 ChunkAccessSpeedData* createCASData(size_t numThreads, size_t requestCount, ui64 maxID) {
     ChunkAccessSpeedData* data = new ChunkAccessSpeedData;
 
@@ -37,30 +76,11 @@ ChunkAccessSpeedData* createCASData(size_t numThreads, size_t requestCount, ui64
                 data->cv.wait(lock);
             }
 
-            std::mt19937 rEngine(threadID);
-            std::uniform_int_distribution<int> release(0, 1);
-
             // Begin requesting chunks
             printf("Thread %zu starting\n", threadID);
-            PreciseTimer timer;
-            timer.start();
-            ChunkID* id = data->ids + (requestCount * threadID);
-            ChunkHandle* hndAcquire = data->handles + (requestCount * threadID);
-            ChunkHandle* hndRelease = hndAcquire;
-            ChunkHandle* hndEnd = hndRelease + requestCount;
-            while (hndRelease != hndEnd) {
-                if ((hndAcquire > hndRelease) && release(rEngine)) {
-                    // Release a handle
-                    hndRelease->release();
-                    hndRelease++;
-                } else if(hndAcquire != hndEnd) {
-                    // Acquire a handle
-                    *hndAcquire = data->accessor.acquire(*id);
-                    hndAcquire++;
-                    id++;
-                }
-            }
-            printf("Thread %zu finished in %lf ms\n", threadID, timer.stop());
+            f64 ms = requestChunks(data->accessor, data->ids + (requestCount * threadID),
+                                   data->handles + (requestCount * threadID), requestCount, threadID);
+            printf("Thread %zu finished in %lf ms\n", threadID, ms);
         }).swap(data->threads[threadID]);
         data->threads[threadID].detach();
     }
@@ -90,6 +110,48 @@ void freeCAS(ChunkAccessSpeedData* data) {
     delete data;
 }
 
+void runCASScaling(size_t maxThreads, size_t requestCount, ui64 maxID) {
+    printf("Chunk access scaling: %zu requests per thread, %llu IDs\n", requestCount, (unsigned long long)maxID);
+    // Powers of two, then maxThreads itself
+    std::vector<size_t> threadCounts;
+    for (size_t n = 1; n < maxThreads; n *= 2) threadCounts.push_back(n);
+    threadCounts.push_back(maxThreads);
+
+    f64 baseRate = 0.0;
+    for (size_t numThreads : threadCounts) {
+        PagedChunkAllocator allocator;
+        ChunkAccessor accessor;
+        accessor.init(&allocator);
+
+        std::vector<ChunkID> ids(requestCount * numThreads);
+        std::vector<ChunkHandle> handles(requestCount * numThreads);
+        std::mt19937 rEngine((ui32)numThreads);
+        for (auto& id : ids) id = rEngine() % maxID;
+
+        std::atomic<bool> go(false);
+        std::vector<std::thread> threads;
+        for (size_t threadID = 0; threadID < numThreads; threadID++) {
+            threads.emplace_back([&, threadID]() {
+                while (!go) std::this_thread::yield();
+                requestChunks(accessor, ids.data() + requestCount * threadID,
+                              handles.data() + requestCount * threadID, requestCount, threadID);
+            });
+        }
+        PreciseTimer timer;
+        timer.start();
+        go = true;
+        for (auto& t : threads) t.join();
+        f64 ms = timer.stop();
+
+        // Acquire and release per millisecond
+        f64 rate = (f64)(requestCount * numThreads * 2) / ms;
+        if (numThreads == 1) baseRate = rate;
+        printf("%3zu threads: %10.2lf ms %12.1lf ops/ms %6.2lfx\n", numThreads, ms, rate, rate / baseRate);
+        fflush(stdout);
+        accessor.destroy();
+    }
+}
+
 void runCHS() {
     PagedChunkAllocator allocator = {};
     ChunkAccessor accessor = {};
@@ -102,3 +164,550 @@ void runCHS() {
     h2.release();
     h1.release();
 }
+
+#define CHS_NUM_IDS 16 ///< Few IDs so chunks are removed and revived often
+#define CHS_MAX_HELD 64
+
+void runCHStress(size_t numThreads, size_t iterations) {
+    PagedChunkAllocator allocator;
+    ChunkAccessor accessor;
+    accessor.init(&allocator);
+
+    // Handles moved between threads
+    moodycamel::ConcurrentQueue<ChunkHandle> exchange;
+    std::atomic<size_t> errors(0);
+
+    std::atomic<bool> go(false);
+    std::vector<std::thread> threads;
+    for (size_t threadID = 0; threadID < numThreads; threadID++) {
+        threads.emplace_back([&, threadID]() {
+            std::mt19937 rEngine((ui32)threadID);
+            std::uniform_int_distribution<int> action(0, 4);
+            std::uniform_int_distribution<int> id(0, CHS_NUM_IDS - 1);
+            std::vector<ChunkHandle> held;
+            while (!go) std::this_thread::yield();
+
+            for (size_t i = 0; i < iterations; i++) {
+                switch (action(rEngine)) {
+                    case 0: // Lookup by ID
+                        held.push_back(accessor.acquire(id(rEngine)));
+                        break;
+                    case 1: // Acquire from a handle we hold, like mesh tasks do
+                        if (held.size()) held.push_back(held[rEngine() % held.size()].acquire());
+                        break;
+                    case 2: { // Copy to a weak handle and acquire through it, like neighbor wiring
+                        if (held.empty()) break;
+                        ChunkHandle copy = held[rEngine() % held.size()];
+                        held.push_back(copy.acquire());
+                    } break;
+                    case 3: // Hand one to another thread
+                        if (held.size()) {
+                            exchange.enqueue(std::move(held.back()));
+                            held.pop_back();
+                        }
+                        break;
+                    case 4: { // Release one from another thread
+                        ChunkHandle h;
+                        if (exchange.try_dequeue(h)) {
+                            if (h->getID() != h.getID()) errors++;
+                            h.release();
+                        }
+                    } break;
+                }
+                if (held.size() > CHS_MAX_HELD || (held.size() && action(rEngine) == 0)) {
+                    // The chunk must still be the one we acquired
+                    if (held.back()->getID() != held.back().getID()) errors++;
+                    held.back().release();
+                    held.pop_back();
+                }
+            }
+            for (auto& h : held) h.release();
+        });
+    }
+
+    PreciseTimer timer;
+    timer.start();
+    go = true;
+    for (auto& t : threads) t.join();
+    f64 ms = timer.stop();
+
+    ChunkHandle h;
+    while (exchange.try_dequeue(h)) h.release();
+
+    size_t alive = accessor.getCountAlive();
+    size_t live = allocator.getStats().liveChunks;
+    if (errors == 0 && alive == 0 && live == 0) {
+        printf("CHS stress passed in %lf ms\n", ms);
+    } else {
+        printf("CHS stress FAILED: %zu errors, %zu chunks alive, %zu allocated\n", (size_t)errors, alive, live);
+    }
+    fflush(stdout);
+}
+
+// Center chunk plus its six neighbors, the set a mesh task reads
+#define CDL_NUM_CHUNKS 7
+#define CDL_WRITES_PER_LOCK 64
+
+template<typename Lock>
+struct ContendedChunk {
+    Lock lock;
+    vvox::SmartVoxelContainer<ui16> blocks;
+};
+
+inline void lockRead(std::mutex& l) { l.lock(); }
+inline void unlockRead(std::mutex& l) { l.unlock(); }
+inline void lockRead(RWSpinLock& l) { l.lock_shared(); }
+inline void unlockRead(RWSpinLock& l) { l.unlock_shared(); }
+
+template<typename Lock>
+f64 runChunkLockContention(size_t numReaders, size_t numWriters, size_t iterations) {
+    vcore::FixedSizeArrayRecycler<CHUNK_SIZE, ui16> recycler;
+    ContendedChunk<Lock> chunks[CDL_NUM_CHUNKS];
+    for (auto& c : chunks) {
+        IntervalTree<ui16>::LNode node;
+        node.set(0, CHUNK_SIZE, 0);
+        c.blocks.setArrayRecycler(&recycler);
+        c.blocks.initFromSortedArray(vvox::VoxelStorageState::FLAT_ARRAY, &node, 1);
+    }
+
+    std::atomic<bool> go(false);
+    std::vector<std::thread> threads;
+    for (size_t r = 0; r < numReaders; r++) {
+        threads.emplace_back([&chunks, &go, iterations]() {
+            std::vector<ui16> buffer(CHUNK_SIZE);
+            while (!go) std::this_thread::yield();
+            for (size_t i = 0; i < iterations; i++) {
+                // Whole center chunk, then a face slab from each neighbor
+                lockRead(chunks[0].lock);
+                chunks[0].blocks.copyRange(0, CHUNK_SIZE, buffer.data());
+                unlockRead(chunks[0].lock);
+                for (size_t n = 1; n < CDL_NUM_CHUNKS; n++) {
+                    lockRead(chunks[n].lock);
+                    chunks[n].blocks.copyLayer(0, buffer.data());
+                    unlockRead(chunks[n].lock);
+                }
+            }
+        });
+    }
+    for (size_t w = 0; w < numWriters; w++) {
+        threads.emplace_back([&chunks, &go, iterations, w]() {
+            std::mt19937 rEngine((ui32)w);
+            std::uniform_int_distribution<int> voxel(0, CHUNK_SIZE - 1);
+            std::uniform_int_distribution<int> chunk(0, CDL_NUM_CHUNKS - 1);
+            ui16 indices[CDL_WRITES_PER_LOCK];
+            ui16 values[CDL_WRITES_PER_LOCK];
+            while (!go) std::this_thread::yield();
+            for (size_t i = 0; i < iterations; i++) {
+                for (size_t k = 0; k < CDL_WRITES_PER_LOCK; k++) {
+                    indices[k] = (ui16)voxel(rEngine);
+                    values[k] = (ui16)i;
+                }
+                ContendedChunk<Lock>& c = chunks[chunk(rEngine)];
+                std::lock_guard<Lock> l(c.lock);
+                c.blocks.setMany(indices, values, CDL_WRITES_PER_LOCK);
+            }
+        });
+    }
+
+    PreciseTimer timer;
+    timer.start();
+    go = true;
+    for (auto& t : threads) t.join();
+    f64 ms = timer.stop();
+
+    for (auto& c : chunks) c.blocks.clear();
+    return ms;
+}
+
+void runCDL(size_t numReaders, size_t numWriters, size_t iterations) {
+    printf("Chunk data lock: %zu readers, %zu writers, %zu iterations\n", numReaders, numWriters, iterations);
+    printf("std::mutex finished in %lf ms\n", runChunkLockContention<std::mutex>(numReaders, numWriters, iterations));
+    printf("RWSpinLock finished in %lf ms\n", runChunkLockContention<RWSpinLock>(numReaders, numWriters, iterations));
+    fflush(stdout);
+}
+
+/************************************************************************/
+/* Voxel Layout                                                         */
+/************************************************************************/
+/// Terrain-like test chunk in the storage order of Layout
+template<typename Layout>
+static std::vector<ui16> makeLayoutTestChunk() {
+    std::vector<ui16> data(CHUNK_SIZE);
+    for (ui32 c = 0; c < CHUNK_SIZE; c++) {
+        i32v3 p = getPosFromBlockIndex(c);
+        // Solid below a bumpy surface, with caves of air
+        ui16 id = p.y < 12 + ((p.x * 7 + p.z * 3) & 7) ? 1 : 0;
+        if (((c * 2654435761u) >> 29) == 0) id = 0;
+        data[Layout::toStorage(c)] = id;
+    }
+    return data;
+}
+
+/// Reads the 6-neighbourhood of every interior voxel, like a CA or light update pass
+template<typename Layout>
+static f64 runLayoutSweep(const std::vector<ui16>& data, size_t numChunks, size_t iterations, ui64& checksum) {
+    PreciseTimer timer;
+    timer.start();
+    for (size_t i = 0; i < iterations; i++) {
+        for (size_t n = 0; n < numChunks; n++) {
+            const ui16* chunk = data.data() + n * CHUNK_SIZE;
+            // Storage order, which is the natural walk for each layout
+            for (ui32 s = 0; s < CHUNK_SIZE; s++) {
+                i32v3 p = Layout::getPos(s);
+                if (p.x == 0 || p.y == 0 || p.z == 0 || p.x == CHUNK_WIDTH - 1 || p.y == CHUNK_WIDTH - 1 || p.z == CHUNK_WIDTH - 1) continue;
+                checksum += chunk[Layout::offset(s, -1, 0, 0)] + chunk[Layout::offset(s, 1, 0, 0)] +
+                    chunk[Layout::offset(s, 0, -1, 0)] + chunk[Layout::offset(s, 0, 1, 0)] +
+                    chunk[Layout::offset(s, 0, 0, -1)] + chunk[Layout::offset(s, 0, 0, 1)];
+            }
+        }
+    }
+    return timer.stop();
+}
+
+/// Breadth first flood through air from the top layer, like sunlight propagation
+template<typename Layout>
+static f64 runLayoutFlood(const std::vector<ui16>& data, size_t numChunks, size_t iterations, ui64& checksum) {
+    std::vector<ui32> queue;
+    queue.reserve(CHUNK_SIZE);
+    std::vector<ui8> visited(CHUNK_SIZE);
+    PreciseTimer timer;
+    timer.start();
+    for (size_t i = 0; i < iterations; i++) {
+        for (size_t n = 0; n < numChunks; n++) {
+            const ui16* chunk = data.data() + n * CHUNK_SIZE;
+            queue.clear();
+            std::fill(visited.begin(), visited.end(), (ui8)0);
+            for (ui32 z = 0; z < CHUNK_WIDTH; z++) {
+                for (ui32 x = 0; x < CHUNK_WIDTH; x++) {
+                    ui32 s = Layout::getStorageIndex(x, CHUNK_WIDTH - 1, z);
+                    visited[s] = 1;
+                    queue.push_back(s);
+                }
+            }
+            for (size_t q = 0; q < queue.size(); q++) {
+                ui32 s = queue[q];
+                i32v3 p = Layout::getPos(s);
+#define VISIT(cond, dx, dy, dz) \
+                if (cond) { \
+                    ui32 nb = Layout::offset(s, dx, dy, dz); \
+                    if (!visited[nb] && chunk[nb] == 0) { \
+                        visited[nb] = 1; \
+                        queue.push_back(nb); \
+                    } \
+                }
+                VISIT(p.x > 0, -1, 0, 0);
+                VISIT(p.x < CHUNK_WIDTH - 1, 1, 0, 0);
+                VISIT(p.y > 0, 0, -1, 0);
+                VISIT(p.y < CHUNK_WIDTH - 1, 0, 1, 0);
+                VISIT(p.z > 0, 0, 0, -1);
+                VISIT(p.z < CHUNK_WIDTH - 1, 0, 0, 1);
+#undef VISIT
+            }
+            checksum += queue.size();
+        }
+    }
+    return timer.stop();
+}
+
+template<typename Layout>
+static void runLayoutBenchmark(const char* name, size_t numChunks, size_t iterations) {
+    // Enough chunks to spill out of cache, like a real meshing or lighting backlog
+    std::vector<ui16> data(numChunks * CHUNK_SIZE);
+    std::vector<ui16> chunk = makeLayoutTestChunk<Layout>();
+    for (size_t n = 0; n < numChunks; n++) {
+        std::copy(chunk.begin(), chunk.end(), data.begin() + n * CHUNK_SIZE);
+    }
+    ui64 sweepSum = 0, floodSum = 0;
+    f64 sweepMs = runLayoutSweep<Layout>(data, numChunks, iterations, sweepSum);
+    f64 floodMs = runLayoutFlood<Layout>(data, numChunks, iterations, floodSum);
+    // The sums must match between layouts
+    printf("%s: sweep %lf ms (sum %llu), flood %lf ms (sum %llu)\n", name,
+           sweepMs, (unsigned long long)sweepSum, floodMs, (unsigned long long)floodSum);
+}
+
+void runVoxelLayout(size_t numChunks, size_t iterations) {
+    printf("Voxel layout: %zu chunks, %zu iterations, chunk storage is %s\n", numChunks, iterations,
+           vvox::ChunkLayout::IS_LINEAR ? "linear" : "morton");
+    runLayoutBenchmark<vvox::LinearLayout>("Linear", numChunks, iterations);
+    runLayoutBenchmark<vvox::MortonLayout>("Morton", numChunks, iterations);
+    fflush(stdout);
+}
+
+/************************************************************************/
+/* Noise Batch                                                          */
+/************************************************************************/
+void runNoiseBatch(size_t count, size_t iterations) {
+    std::mt19937_64 rng(1337);
+    std::uniform_real_distribution<f64> dist(-5000.0, 5000.0);
+    std::vector<f64> x(count), y(count), z(count);
+    for (size_t i = 0; i < count; i++) {
+        x[i] = dist(rng);
+        y[i] = dist(rng);
+        z[i] = dist(rng);
+    }
+
+    // One point at a time
+    std::vector<f64> raw(count), f1(count), f2(count);
+    PreciseTimer timer;
+    timer.start();
+    for (size_t it = 0; it < iterations; it++) {
+        for (size_t i = 0; i < count; i++) raw[i] = Noise::raw(x[i], y[i], z[i]);
+    }
+    f64 rawMs = timer.stop();
+    timer.start();
+    for (size_t it = 0; it < iterations; it++) {
+        for (size_t i = 0; i < count; i++) {
+            f64v2 ff = Noise::cellular(f64v3(x[i], y[i], z[i]));
+            f1[i] = ff.x;
+            f2[i] = ff.y;
+        }
+    }
+    f64 cellMs = timer.stop();
+    printf("Noise batch: %zu points, %zu iterations\n", count, iterations);
+    printf("Single: simplex %lf ms, cellular %lf ms\n", rawMs, cellMs);
+
+    // Batched, from the best level down
+    static const char* LEVEL_NAMES[] = { "None", "SSE4.1", "AVX2" };
+    Noise::SimdLevel cpuLevel = Noise::getSimdLevel();
+    std::vector<f64> braw(count), bf1(count), bf2(count);
+    for (int level = (int)cpuLevel; level >= 0; level--) {
+        Noise::setMaxSimdLevel((Noise::SimdLevel)level);
+        timer.start();
+        for (size_t it = 0; it < iterations; it++) Noise::raw(x.data(), y.data(), z.data(), braw.data(), count);
+        f64 bRawMs = timer.stop();
+        timer.start();
+        for (size_t it = 0; it < iterations; it++) Noise::cellular(x.data(), y.data(), z.data(), bf1.data(), bf2.data(), count);
+        f64 bCellMs = timer.stop();
+        size_t mismatches = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (braw[i] != raw[i] || bf1[i] != f1[i] || bf2[i] != f2[i]) mismatches++;
+        }
+        printf("%s: simplex %lf ms (%.2fx), cellular %lf ms (%.2fx), %zu mismatches\n", LEVEL_NAMES[level],
+               bRawMs, rawMs / bRawMs, bCellMs, cellMs / bCellMs, mismatches);
+    }
+    Noise::setMaxSimdLevel(cpuLevel);
+    fflush(stdout);
+}
+
+/************************************************************************/
+/* Adaptive Heightmap                                                   */
+/************************************************************************/
+void runAdaptiveHeightmap(const cString terrainPath, f64 radius, size_t numChunks, f32 tolerance) {
+    vio::IOManager iom;
+    PlanetGenLoader loader;
+    loader.init(&iom);
+    PlanetGenData* genData = loader.loadPlanetGenData(terrainPath);
+    if (!genData) {
+        printf("Failed to load %s\n", terrainPath);
+        return;
+    }
+    genData->radius = radius;
+
+    // Exact child biome noise, so each method is measured on its own
+    SphericalHeightmapGenerator full;
+    full.init(genData);
+    full.setHeightTolerance(0.0f);
+    full.setBiomeTilesEnabled(false);
+    SphericalHeightmapGenerator adaptive;
+    adaptive.init(genData);
+    adaptive.setBiomeTilesEnabled(false);
+    SphericalHeightmapGenerator tiled;
+    tiled.init(genData);
+    tiled.setHeightTolerance(0.0f);
+    tiled.setBiomeTilesEnabled(true);
+
+    // Random chunk columns anywhere on the planet
+    std::mt19937 rng(1337);
+    i32 faceChunks = (i32)(radius * VOXELS_PER_KM) / CHUNK_WIDTH;
+    std::uniform_int_distribution<i32> chunkDist(-faceChunks, faceChunks - 1);
+    std::vector<VoxelPosition2D> corners(numChunks);
+    for (auto& c : corners) {
+        c.face = (WorldCubeFace)(rng() % 6);
+        c.pos = f64v2(chunkDist(rng) * CHUNK_WIDTH, chunkDist(rng) * CHUNK_WIDTH);
+    }
+
+    std::vector<PlanetHeightData> expected(numChunks * CHUNK_LAYER);
+    std::vector<PlanetHeightData> actual(numChunks * CHUNK_LAYER);
+    std::vector<PlanetHeightData> tiledActual(numChunks * CHUNK_LAYER);
+    PreciseTimer timer;
+    timer.start();
+    for (size_t i = 0; i < numChunks; i++) {
+        full.generateHeightData(&expected[i * CHUNK_LAYER], corners[i], CHUNK_WIDTH);
+    }
+    f64 fullMs = timer.stop();
+    size_t numEvaluated = 0;
+    timer.start();
+    for (size_t i = 0; i < numChunks; i++) {
+        numEvaluated += adaptive.generateHeightDataAdaptive(&actual[i * CHUNK_LAYER], corners[i], CHUNK_WIDTH, 1, tolerance);
+    }
+    f64 adaptiveMs = timer.stop();
+    timer.start();
+    for (size_t i = 0; i < numChunks; i++) {
+        tiled.generateHeightData(&tiledActual[i * CHUNK_LAYER], corners[i], CHUNK_WIDTH);
+    }
+    f64 tiledMs = timer.stop();
+
+    // Compare against full sampling
+    f64 maxError = 0.0;
+    f64 totalError = 0.0;
+    size_t overTolerance = 0;
+    size_t biomeMismatches = 0;
+    size_t floraMismatches = 0;
+    f64 tiledMaxError = 0.0;
+    f64 tiledTotalError = 0.0;
+    size_t tiledHeightMismatches = 0;
+    size_t tiledBiomeMismatches = 0;
+    for (size_t i = 0; i < expected.size(); i++) {
+        f64 error = glm::abs((f64)actual[i].height - (f64)expected[i].height);
+        maxError = glm::max(maxError, error);
+        totalError += error;
+        if (error > tolerance) overTolerance++;
+        if (actual[i].biome != expected[i].biome) biomeMismatches++;
+        if (actual[i].flora != expected[i].flora) floraMismatches++;
+
+        error = glm::abs((f64)tiledActual[i].height - (f64)expected[i].height);
+        tiledMaxError = glm::max(tiledMaxError, error);
+        tiledTotalError += error;
+        if (tiledActual[i].height != expected[i].height) tiledHeightMismatches++;
+        if (tiledActual[i].biome != expected[i].biome) tiledBiomeMismatches++;
+    }
+    printf("Adaptive heightmap: %zu chunks, tolerance %f voxels\n", numChunks, tolerance);
+    printf("Full %lf ms, adaptive %lf ms (%.2fx), %.1f%% of noise evaluations skipped\n", fullMs, adaptiveMs, fullMs / adaptiveMs,
+           100.0 * (1.0 - (f64)numEvaluated / expected.size()));
+    printf("Height error: max %lf, mean %lf, %zu columns over tolerance. %zu biome and %zu flora mismatches\n",
+           maxError, totalError / expected.size(), overTolerance, biomeMismatches, floraMismatches);
+    printf("Biome tiles: %lf ms (%.2fx), %zu tiles. Height error: max %lf, mean %lf, %zu columns differ. %zu biome mismatches\n",
+           tiledMs, fullMs / tiledMs, tiled.getNumBiomeTiles(), tiledMaxError, tiledTotalError / expected.size(),
+           tiledHeightMismatches, tiledBiomeMismatches);
+    fflush(stdout);
+    delete genData;
+}
+
+/************************************************************************/
+/* Mesher                                                               */
+/************************************************************************/
+/// Meshes sections of every chunk iterations times with method, downsampled to lod
+/// @return Time taken in milliseconds
+static f64 runMesherPass(ChunkMesher* mesher, std::vector<ChunkHandle>& chunks, size_t iterations, OpaqueMeshMethod method, ui8 sections, ui8 lod, size_t& numQuads) {
+    ChunkMesher::opaqueMeshMethod = method;
+    numQuads = 0;
+    PreciseTimer timer;
+    timer.start();
+    for (size_t i = 0; i < iterations; i++) {
+        for (auto& chunk : chunks) {
+            mesher->prepareData(chunk);
+            mesher->downsampleData(lod);
+            ChunkMeshData* meshData = mesher->createChunkMeshData(MeshTaskType::DEFAULT, sections);
+            for (auto& section : meshData->sections) numQuads += section.getNumOpaqueQuads();
+            delete meshData;
+        }
+    }
+    return timer.stop();
+}
+
+/// Meshes every chunk iterations times through cache, which only meshes those it misses
+/// @return Time taken in milliseconds
+static f64 runMesherCachePass(ChunkMesher* mesher, ChunkMeshCache& cache, std::vector<ChunkHandle>& chunks, size_t iterations, size_t& numQuads) {
+    numQuads = 0;
+    PreciseTimer timer;
+    timer.start();
+    for (size_t i = 0; i < iterations; i++) {
+        for (auto& chunk : chunks) {
+            mesher->prepareData(chunk);
+            ChunkMeshKey key = ChunkMeshCache::computeKey(*mesher);
+            ChunkMeshData* meshData = cache.get(key);
+            if (!meshData) {
+                meshData = mesher->createChunkMeshData(MeshTaskType::DEFAULT);
+                cache.put(key, *meshData);
+            }
+            for (auto& section : meshData->sections) numQuads += section.getNumOpaqueQuads();
+            delete meshData;
+        }
+    }
+    return timer.stop();
+}
+
+void runMesher(size_t numChunks, size_t iterations) {
+    // Plain untextured blocks, so every face can be merged
+    BlockTexture texture;
+    BlockPack blocks;
+    BlockID layerIDs[3];
+    const cString layerNames[3] = { "stone", "dirt", "grass" };
+    for (int i = 0; i < 3; i++) {
+        Block b;
+        b.sID = layerNames[i];
+        b.name = layerNames[i];
+        for (int f = 0; f < 6; f++) b.textures[f] = &texture;
+        layerIDs[i] = blocks.append(b);
+    }
+
+    // Rolling terrain with caves, different in every chunk
+    PagedChunkAllocator allocator;
+    ChunkAccessor accessor;
+    accessor.init(&allocator);
+    std::vector<ChunkHandle> chunks(numChunks);
+    std::vector<ui16> data(CHUNK_SIZE);
+    std::vector<IntervalTree<ui16>::LNode> nodes;
+    for (size_t n = 0; n < numChunks; n++) {
+        chunks[n] = accessor.acquire(ChunkID((i32)n, 0, 0));
+        Chunk* chunk = chunks[n];
+        chunk->initAndFillEmpty(FACE_TOP);
+        for (ui32 c = 0; c < CHUNK_SIZE; c++) {
+            i32v3 p = getPosFromBlockIndex(c);
+            i32 height = 12 + (((p.x * 7 + p.z * 3) / 4 + (i32)n) & 15);
+            ui16 id = 0;
+            if (p.y < height - 4) {
+                id = layerIDs[0];
+            } else if (p.y < height - 1) {
+                id = layerIDs[1];
+            } else if (p.y < height) {
+                id = layerIDs[2];
+            }
+            if ((((c + n * 7919) * 2654435761u) >> 28) == 0) id = 0;
+            data[vvox::ChunkLayout::toStorage(c)] = id;
+        }
+        nodes.clear();
+        for (ui32 c = 0; c < CHUNK_SIZE;) {
+            ui32 start = c;
+            while (c < CHUNK_SIZE && data[c] == data[start]) c++;
+            nodes.emplace_back();
+            nodes.back().set(start, c - start, data[start]);
+        }
+        chunk->blocks.initFromSortedArray(vvox::VoxelStorageState::INTERVAL_TREE, nodes);
+    }
+
+    ChunkMesher* mesher = new ChunkMesher;
+    mesher->init(&blocks);
+    OpaqueMeshMethod prevMethod = ChunkMesher::opaqueMeshMethod;
+    size_t mergeQuads, greedyQuads, sectionQuads;
+    f64 mergeMs = runMesherPass(mesher, chunks, iterations, OpaqueMeshMethod::QUAD_MERGE, ALL_CHUNK_MESH_SECTIONS, 0, mergeQuads);
+    f64 greedyMs = runMesherPass(mesher, chunks, iterations, OpaqueMeshMethod::BINARY_GREEDY, ALL_CHUNK_MESH_SECTIONS, 0, greedyQuads);
+    // What an edit on the terrain surface remeshes
+    f64 sectionMs = runMesherPass(mesher, chunks, iterations, OpaqueMeshMethod::BINARY_GREEDY, 1 << 1, 0, sectionQuads);
+    size_t lodQuads[MAX_CHUNK_MESH_LOD];
+    f64 lodMs[MAX_CHUNK_MESH_LOD];
+    for (ui8 lod = 1; lod <= MAX_CHUNK_MESH_LOD; lod++) {
+        lodMs[lod - 1] = runMesherPass(mesher, chunks, iterations, OpaqueMeshMethod::BINARY_GREEDY, ALL_CHUNK_MESH_SECTIONS, lod, lodQuads[lod - 1]);
+    }
+    // Chunks that reload unchanged. The first pass fills the cache.
+    ChunkMeshCache cache(&blocks);
+    size_t cacheQuads;
+    runMesherCachePass(mesher, cache, chunks, 1, cacheQuads);
+    f64 cacheMs = runMesherCachePass(mesher, cache, chunks, iterations, cacheQuads);
+    ChunkMesher::opaqueMeshMethod = prevMethod;
+
+    size_t numMeshes = numChunks * iterations;
+    printf("Mesher: %zu chunks, %zu iterations\n", numChunks, iterations);
+    printf("Quad merge: %lf ms (%.1f meshes/sec), %zu quads per chunk\n", mergeMs, numMeshes / (mergeMs / 1000.0), mergeQuads / numMeshes);
+    printf("Binary greedy: %lf ms (%.1f meshes/sec), %zu quads per chunk\n", greedyMs, numMeshes / (greedyMs / 1000.0), greedyQuads / numMeshes);
+    printf("Binary greedy, one section: %lf ms (%.1f meshes/sec), %zu quads per section\n", sectionMs, numMeshes / (sectionMs / 1000.0), sectionQuads / numMeshes);
+    for (int lod = 1; lod <= MAX_CHUNK_MESH_LOD; lod++) {
+        printf("Binary greedy, LOD %d: %lf ms (%.1f meshes/sec), %zu quads per chunk\n", lod, lodMs[lod - 1], numMeshes / (lodMs[lod - 1] / 1000.0), lodQuads[lod - 1] / numMeshes);
+    }
+    printf("Binary greedy, cached: %lf ms (%.1f meshes/sec), %zu quads per chunk, %zu hits, %zu misses, %zu KB\n", cacheMs, numMeshes / (cacheMs / 1000.0),
+           cacheQuads / numMeshes, cache.getNumHits(), cache.getNumMisses(), cache.getNumBytes() / 1024);
+    fflush(stdout);
+
+    delete mesher;
+    for (auto& h : chunks) h.release();
+}
@@ -24,7 +24,53 @@ struct ChunkAccessSpeedData;
 ChunkAccessSpeedData* createCASData(size_t numThreads, size_t requestCount, ui64 maxID);
 void runCAS(ChunkAccessSpeedData* data);
 void freeCAS(ChunkAccessSpeedData* data);
+/// Runs the chunk access test with 1, 2, 4... up to maxThreads threads
+/// and prints throughput and speedup over one thread.
+void runCASScaling(size_t maxThreads, size_t requestCount, ui64 maxID);
 
 void runCHS();
+/// Acquires, copies, moves and releases handles on numThreads threads. Run
+/// under a thread sanitizer to check handle lifetime.
+void runCHStress(size_t numThreads, size_t iterations);
+
+/************************************************************************/
+/* Chunk Data Lock                                                      */
+/************************************************************************/
+/// Compares std::mutex against RWSpinLock for mesh-like readers copying a
+/// chunk and its neighbor slabs while writers place voxels.
+void runCDL(size_t numReaders, size_t numWriters, size_t iterations);
+
+/************************************************************************/
+/* Voxel Layout                                                         */
+/************************************************************************/
+/// Times 6-neighbourhood sweeps and flood fills over numChunks chunks
+/// stored in linear and in Morton order. Build with VOXEL_LAYOUT_MORTON
+/// to store chunks in Morton order.
+void runVoxelLayout(size_t numChunks, size_t iterations);
+
+/************************************************************************/
+/* Noise Batch                                                          */
+/************************************************************************/
+/// Times simplex and cellular noise for count random points, one point at
+/// a time and batched at each SIMD level the CPU supports. Also counts
+/// batched results that differ from the one at a time results.
+void runNoiseBatch(size_t count, size_t iterations);
+
+/************************************************************************/
+/* Adaptive Heightmap                                                   */
+/************************************************************************/
+/// Generates numChunks random chunk heightmaps of the planet in terrainPath
+/// with every column sampled, adaptively with the given tolerance in voxels,
+/// and with child biome noise from biome tiles. Prints the times, the
+/// evaluations skipped and the height and biome errors against exact noise.
+void runAdaptiveHeightmap(const cString terrainPath, f64 radius, size_t numChunks, f32 tolerance);
+
+/************************************************************************/
+/* Mesher                                                               */
+/************************************************************************/
+/// Meshes numChunks synthetic terrain chunks iterations times with each
+/// OpaqueMeshMethod and prints the time and opaque quad count of each,
+/// then again through a ChunkMeshCache that already holds them.
+void runMesher(size_t numChunks, size_t iterations);
 
 #endif // !ConsoleTests_h__
@@ -37,6 +37,10 @@ const i32 CHUNK_WIDTH_M1 = 31;
 const i32 HALF_CHUNK_WIDTH = CHUNK_WIDTH / 2;
 const i32 CHUNK_LAYER = CHUNK_WIDTH*CHUNK_WIDTH;
 const i32 CHUNK_SIZE = CHUNK_LAYER*CHUNK_WIDTH;
+// Chunk meshes are built in slabs of this many layers, so edits only remesh the slabs they touch
+const i32 CHUNK_MESH_SECTION_HEIGHT = 8;
+const i32 NUM_CHUNK_MESH_SECTIONS = CHUNK_WIDTH / CHUNK_MESH_SECTION_HEIGHT;
+const ui8 ALL_CHUNK_MESH_SECTIONS = (1 << NUM_CHUNK_MESH_SECTIONS) - 1;
 const i32 SURFACE_DEPTH = 256;
 const i32 OBJECT_LIST_SIZE = 24096;
 
@@ -147,6 +147,87 @@ inline void offsetByPos(int& x, int& y, int& z, ui32& chunkOffset, const i32v3&
 #pragma endregion
 #endif//VORB_OS_WINDOWS
 
+ui32 NodeFieldMap::find(ui32 chunkOffset) const {
+    if (m_entries.empty()) return NO_NODE_FIELD;
+    ui32 mask = (ui32)m_entries.size() - 1;
+    for (ui32 i = (chunkOffset * 2654435761u) & mask;; i = (i + 1) & mask) {
+        const Entry& e = m_entries[i];
+        if (e.chunkOffset == chunkOffset) return e.field;
+        if (e.chunkOffset == 0xFFFFFFFFu) return NO_NODE_FIELD;
+    }
+}
+
+void NodeFieldMap::insert(ui32 chunkOffset, ui32 field) {
+    // Stay at most half full so probes are short
+    if ((m_size + 1) * 2 > m_entries.size()) grow();
+    ui32 mask = (ui32)m_entries.size() - 1;
+    for (ui32 i = (chunkOffset * 2654435761u) & mask;; i = (i + 1) & mask) {
+        Entry& e = m_entries[i];
+        if (e.chunkOffset == 0xFFFFFFFFu) {
+            e.chunkOffset = chunkOffset;
+            e.field = field;
+            m_size++;
+            return;
+        }
+        if (e.chunkOffset == chunkOffset) {
+            e.field = field;
+            return;
+        }
+    }
+}
+
+void NodeFieldMap::clear() {
+    if (m_size == 0) return;
+    for (auto& e : m_entries) e.chunkOffset = 0xFFFFFFFFu;
+    m_size = 0;
+}
+
+void NodeFieldMap::grow() {
+    std::vector<Entry> old;
+    old.swap(m_entries);
+    Entry empty = { 0xFFFFFFFFu, 0 };
+    m_entries.resize(old.empty() ? 32 : old.size() * 2, empty);
+    m_size = 0;
+    for (auto& e : old) {
+        if (e.chunkOffset != 0xFFFFFFFFu) insert(e.chunkOffset, e.field);
+    }
+}
+
+void SCLeafSet::insert(ui32 i) {
+    ui32 w = i >> 6;
+    if (w >= m_words.size()) m_words.resize(w + 1, 0);
+    if (w >= m_numUsedWords) m_numUsedWords = w + 1;
+    m_words[w] |= 1ull << (i & 63);
+}
+
+void SCLeafSet::erase(ui32 i) {
+    ui32 w = i >> 6;
+    if (w < m_numUsedWords) m_words[w] &= ~(1ull << (i & 63));
+}
+
+void SCLeafSet::clear() {
+    if (m_numUsedWords) memset(m_words.data(), 0, m_numUsedWords * sizeof(ui64));
+    m_numUsedWords = 0;
+}
+
+ui32 SCLeafSet::next(ui32 i) const {
+    // NO_SC_LEAF + 1 wraps to 0
+    i++;
+    ui32 w = i >> 6;
+    if (w >= m_numUsedWords) return NO_SC_LEAF;
+    ui64 bits = m_words[w] >> (i & 63);
+    while (!bits) {
+        if (++w >= m_numUsedWords) return NO_SC_LEAF;
+        bits = m_words[w];
+        i = w << 6;
+    }
+    while (!(bits & 1)) {
+        bits >>= 1;
+        i++;
+    }
+    return i;
+}
+
 // Smooths an input factor on the range 0-1
 inline void smoothInterpFactor(f32& l, const FloraInterpType& type) {
     switch (type) {
@@ -186,11 +267,68 @@ void FloraGenerator::generateChunkFlora(const Chunk* chunk, const PlanetHeightDa
             generateFlora(b->flora[hd.flora].data, age, fNodes, wNodes, NO_CHUNK_OFFSET, blockIndex);
         } else {
             // It's a tree
-            generateTree(b->trees[hd.flora - b->flora.size()].data, age, fNodes, wNodes, b->genData, NO_CHUNK_OFFSET, blockIndex);
+            placeTree(b->trees[hd.flora - b->flora.size()].data, age, m_rGen.gen(), fNodes, wNodes, b->genData, NO_CHUNK_OFFSET, blockIndex);
         }
     }
 }
 
+// Copies template nodes to a tree rooted at root
+inline void stampTemplateNodes(const std::vector<FloraTemplateNode>& src, OUT std::vector<FloraNode>& dst, const i32v3& root, ui32 chunkOffset) {
+    dst.reserve(dst.size() + src.size());
+    for (auto& n : src) {
+        i32v3 pos(root.x + n.x, root.y + n.y, root.z + n.z);
+        // Arithmetic shift so negative positions go to the previous chunk
+        ui32 nodeOffset = chunkOffset + X_1 * (pos.x >> 5) + Y_1 * (pos.y >> 5) + Z_1 * (pos.z >> 5);
+        pos &= 0x1f; // Modulo 32
+        dst.emplace_back(n.blockID, (ui16)(pos.x + pos.y * CHUNK_LAYER + pos.z * CHUNK_WIDTH), nodeOffset);
+    }
+}
+
+void FloraGenerator::placeTree(const NTreeType* type, f32 age, ui32 variant, OUT std::vector<FloraNode>& fNodes, OUT std::vector<FloraNode>& wNodes, const PlanetGenData* genData, ui32 chunkOffset /*= NO_CHUNK_OFFSET*/, ui16 blockIndex /*= 0*/) {
+    FloraTemplateKey key;
+    key.type = type;
+    key.ageBucket = (ui16)glm::clamp((i32)(age * FLORA_TEMPLATE_AGE_BUCKETS), 0, (i32)FLORA_TEMPLATE_AGE_BUCKETS - 1);
+    key.variant = (ui16)(variant % FLORA_TEMPLATE_VARIANTS);
+
+    const FloraTemplate* tmpl = genData->floraTemplates.get(key);
+    if (!tmpl) {
+        FloraTemplate newTemplate;
+        generateTreeTemplate(key, genData, newTemplate);
+        tmpl = genData->floraTemplates.insert(key, std::move(newTemplate));
+    }
+
+    i32v3 root(blockIndex & 0x1F, // & 0x1F = % 32
+               blockIndex / CHUNK_LAYER,
+               (blockIndex & 0x3FF) / CHUNK_WIDTH); // & 0x3FF = % 1024
+    stampTemplateNodes(tmpl->wNodes, wNodes, root, chunkOffset);
+    stampTemplateNodes(tmpl->fNodes, fNodes, root, chunkOffset);
+}
+
+void FloraGenerator::generateTreeTemplate(const FloraTemplateKey& key, const PlanetGenData* genData, OUT FloraTemplate& tmpl) {
+    std::vector<FloraNode> fNodes;
+    std::vector<FloraNode> wNodes;
+    // The seed only depends on the key, so a template is the same whoever makes it.
+    // Types are seeded by their index, their address changes between runs.
+    ui32 typeIndex = (ui32)(key.type - genData->trees.data());
+    m_rGen.seed(typeIndex, (ui32)key.ageBucket, (ui32)key.variant);
+    m_center = i32v3(0);
+    f32 age = ((f32)key.ageBucket + 0.5f) / FLORA_TEMPLATE_AGE_BUCKETS;
+    generateTree(key.type, age, fNodes, wNodes, genData);
+
+    // Convert to positions relative to the root
+    auto toTemplate = [](const std::vector<FloraNode>& src, OUT std::vector<FloraTemplateNode>& dst) {
+        dst.reserve(src.size());
+        for (auto& n : src) {
+            i32 x = (n.blockIndex & 0x1F) + getChunkXOffset(n.chunkOffset) * CHUNK_WIDTH; // & 0x1F = % 32
+            i32 y = n.blockIndex / CHUNK_LAYER + getChunkYOffset(n.chunkOffset) * CHUNK_WIDTH;
+            i32 z = (n.blockIndex & 0x3FF) / CHUNK_WIDTH + getChunkZOffset(n.chunkOffset) * CHUNK_WIDTH; // & 0x3FF = % 1024
+            dst.emplace_back((i16)x, (i16)y, (i16)z, n.blockID);
+        }
+    };
+    toTemplate(wNodes, tmpl.wNodes);
+    toTemplate(fNodes, tmpl.fNodes);
+}
+
 #ifdef VORB_OS_WINDOWS
 #pragma region lerping
 #endif//VORB_OS_WINDOWS
@@ -332,7 +470,6 @@ void FloraGenerator::generateTree(const NTreeType* type, f32 age, OUT std::vecto
     m_currChunkOff = 0;
     generateTreeProperties(type, age, m_treeData);
     m_nodeFields.reserve(m_treeData.height / CHUNK_WIDTH + 3);
-    m_nodeFieldsMap.reserve(200);
     // Get handles
     m_wNodes = &wNodes;
     m_fNodes = &fNodes;
@@ -422,7 +559,7 @@ void FloraGenerator::generateTree(const NTreeType* type, f32 age, OUT std::vecto
     // Branches
     if (m_treeData.branchVolumes.size()) {
         spaceColonization(m_startPos);
-        std::vector<SCTreeNode>().swap(m_scNodes);
+        m_scNodes.clear();
     }
 
     // Generate deferred branches so they don't conflict with space colonization
@@ -467,8 +604,8 @@ void FloraGenerator::generateTree(const NTreeType* type, f32 age, OUT std::vecto
     // Place nodes for branches
     if (m_scRayNodes.size()) {
         generateSCBranches();
-        std::vector<SCRayNode>().swap(m_scRayNodes);
-        std::set<ui32>().swap(m_scLeafSet);
+        m_scRayNodes.clear();
+        m_scLeafSet.clear();
     }
 
     // Place leaves last to prevent node overlap
@@ -483,12 +620,12 @@ void FloraGenerator::generateTree(const NTreeType* type, f32 age, OUT std::vecto
 
     }
     
-    // Clear container memory
-    std::vector<LeavesToPlace>().swap(m_leavesToPlace);
-    std::vector<BranchToGenerate>().swap(m_branchesToGenerate);
-    std::vector<TreeTrunkProperties>().swap(m_scTrunkProps);
-    std::unordered_map<ui32, ui32>().swap(m_nodeFieldsMap);
-    std::vector<NodeField>().swap(m_nodeFields);
+    // Clear containers, keeping their memory for the next tree
+    m_leavesToPlace.clear();
+    m_branchesToGenerate.clear();
+    m_scTrunkProps.clear();
+    m_nodeFieldsMap.clear();
+    m_numNodeFields = 0;
 }
 
 void FloraGenerator::generateFlora(const FloraType* type, f32 age, OUT std::vector<FloraNode>& fNodes, OUT std::vector<FloraNode>& wNodes VORB_UNUSED, ui32 chunkOffset /*= NO_CHUNK_OFFSET*/, ui16 blockIndex /*= 0*/) {
@@ -661,7 +798,8 @@ void FloraGenerator::generateFloraProperties(const FloraType* type, f32 age, OUT
 #endif//VORB_OS_WINDOWS
 
 void FloraGenerator::spaceColonization(const f32v3& startPos) {
-    std::vector<f32v3> attractPoints;
+    std::vector<f32v3>& attractPoints = m_scAttractPoints;
+    attractPoints.clear();
 
     // int numPoints = 500;
 
@@ -732,8 +870,7 @@ void FloraGenerator::spaceColonization(const f32v3& startPos) {
                 ui32 nextIndex = m_scRayNodes.size();
                 // Change leaf node
                 // TODO(Ben): This can be a vector mebby?
-                auto it = m_scLeafSet.find(tn.rayNode);
-                if (it != m_scLeafSet.end()) m_scLeafSet.erase(it);
+                m_scLeafSet.erase(tn.rayNode);
                 m_scLeafSet.insert(nextIndex);
     
                 // Have to make temp copies with emplace_back
@@ -754,13 +891,16 @@ void FloraGenerator::spaceColonization(const f32v3& startPos) {
 inline void FloraGenerator::tryPlaceNode(std::vector<FloraNode>* nodes, ui8 priority, ui16 blockID, ui16 blockIndex, ui32 chunkOffset) {
     if (m_currChunkOff != chunkOffset) {
         m_currChunkOff = chunkOffset;
-        auto it = m_nodeFieldsMap.find(chunkOffset);
-        if (it == m_nodeFieldsMap.end()) {
-            m_currNodeField = m_nodeFields.size();
-            m_nodeFields.emplace_back();
-            m_nodeFieldsMap.insert(std::pair<ui32, int>(chunkOffset, m_currNodeField));
-        } else {
-            m_currNodeField = it->second;
+        m_currNodeField = m_nodeFieldsMap.find(chunkOffset);
+        if (m_currNodeField == NO_NODE_FIELD) {
+            m_currNodeField = m_numNodeFields++;
+            if (m_currNodeField < m_nodeFields.size()) {
+                // Reuse a field from an earlier tree
+                memset(m_nodeFields[m_currNodeField].vals, 0, sizeof(NodeField::vals));
+            } else {
+                m_nodeFields.emplace_back();
+            }
+            m_nodeFieldsMap.insert(chunkOffset, m_currNodeField);
         }
     }
     // For memory compression we pack 4 nodes into each val
@@ -1000,14 +1140,16 @@ void FloraGenerator::generateSCBranches() {
         if (m_scRayNodes.size() > 32768) {
             printf("ERROR: Tree has %zuray nodes but limited to 32768\n", m_scRayNodes.size());
             m_scRayNodes.clear();
+            m_scLeafSet.clear();
         } else {
             printf("Performance warning: tree has %zu ray nodes\n", m_scRayNodes.size());
         }
     }
 
-    std::vector <ui32> lNodesToAdd;
+    std::vector<ui32>& lNodesToAdd = m_scLeavesToAdd;
+    lNodesToAdd.clear();
     // Set widths and sub branches
-    for (auto& l : m_scLeafSet) {
+    for (ui32 l = m_scLeafSet.next(NO_SC_LEAF); l != NO_SC_LEAF; l = m_scLeafSet.next(l)) {
         ui32 i = l;
         while (true) {
             SCRayNode& a = m_scRayNodes[i];
@@ -1083,7 +1225,7 @@ void FloraGenerator::generateSCBranches() {
 
     // Make branches
     // int a = 0;
-    for (auto& l : m_scLeafSet) {
+    for (ui32 l = m_scLeafSet.next(NO_SC_LEAF); l != NO_SC_LEAF; l = m_scLeafSet.next(l)) {
         ui32 i = l;
         bool hasLeaves = true;
         while (true) {
@@ -17,6 +17,7 @@
 
 #include "Flora.h"
 #include "Chunk.h"
+#include "FloraTemplateCache.h"
 #include "soaUtils.h"
 
 // 0111111111 0111111111 0111111111 = 0x1FF7FDFF
@@ -62,6 +63,43 @@ struct NodeField {
     ui8 vals[CHUNK_SIZE / 4];
 };
 
+#define NO_NODE_FIELD 0xFFFFFFFFu
+
+// Open addressing map from chunk offsets to node field indices. Keeps its
+// memory when cleared, so it doesn't allocate once it has grown.
+class NodeFieldMap {
+public:
+    /// @return The field index or NO_NODE_FIELD
+    ui32 find(ui32 chunkOffset) const;
+    void insert(ui32 chunkOffset, ui32 field);
+    void clear();
+private:
+    struct Entry {
+        ui32 chunkOffset; ///< 0xFFFFFFFF when empty, which is never a valid offset
+        ui32 field;
+    };
+    void grow();
+
+    std::vector<Entry> m_entries; ///< Size is a power of 2
+    ui32 m_size = 0;
+};
+
+#define NO_SC_LEAF 0xFFFFFFFFu
+
+// Set of ray node indices stored as bits. Iterates in ascending order like
+// the std::set it replaces, so trees come out the same.
+class SCLeafSet {
+public:
+    void insert(ui32 i);
+    void erase(ui32 i);
+    void clear();
+    /// @return First index after i, or NO_SC_LEAF. Pass NO_SC_LEAF to get the first index.
+    ui32 next(ui32 i) const;
+private:
+    std::vector<ui64> m_words;
+    ui32 m_numUsedWords = 0; ///< Words past this are all zero
+};
+
 // Defer leaf placement to prevent node overlap
 struct LeavesToPlace {
     LeavesToPlace(ui16 blockIndex, ui32 chunkOffset, const TreeLeafProperties* leafProps) :
@@ -91,7 +129,11 @@ class FloraGenerator {
     /// @param gridData: The heightmap to use
     /// @param fNodes: Returned low priority nodes, for flora and leaves.
     /// @param wNodes: Returned high priority nodes, for tree "wood".
+    /// fNodeBuffer and wNodeBuffer can be used for fNodes and wNodes so they keep their memory between chunks.
     void generateChunkFlora(const Chunk* chunk, const PlanetHeightData* heightData, OUT std::vector<FloraNode>& fNodes, OUT std::vector<FloraNode>& wNodes);
+    /// Places a tree from genData's template cache, generating the template the first time.
+    /// @param variant: Picks one of the FLORA_TEMPLATE_VARIANTS trees for this type and age
+    void placeTree(const NTreeType* type, f32 age, ui32 variant, OUT std::vector<FloraNode>& fNodes, OUT std::vector<FloraNode>& wNodes, const PlanetGenData* genData, ui32 chunkOffset = NO_CHUNK_OFFSET, ui16 blockIndex = 0);
     /// Generates standalone tree.
     void generateTree(const NTreeType* type, f32 age, OUT std::vector<FloraNode>& fNodes, OUT std::vector<FloraNode>& wNodes, const PlanetGenData* genData, ui32 chunkOffset = NO_CHUNK_OFFSET, ui16 blockIndex = 0);
     /// Generates standalone flora.
@@ -111,11 +153,17 @@ class FloraGenerator {
     static inline int getChunkZOffset(ui32 chunkOffset) {
         return (int)(chunkOffset & 0x3FF) - 0x1FF;
     }
+
+    // Reusable output for generateChunkFlora. The generator is per worker so nothing else touches these.
+    std::vector<FloraNode> fNodeBuffer;
+    std::vector<FloraNode> wNodeBuffer;
 private:
     enum TreeDir {
         TREE_LEFT = 0, TREE_BACK, TREE_RIGHT, TREE_FRONT, TREE_UP, TREE_DOWN, TREE_NO_DIR
     };
 
+    /// Runs generateTree at the origin and stores the result relative to the root
+    void generateTreeTemplate(const FloraTemplateKey& key, const PlanetGenData* genData, OUT FloraTemplate& tmpl);
     void tryPlaceNode(std::vector<FloraNode>* nodes, ui8 priority, ui16 blockID, ui16 blockIndex, ui32 chunkOffset);
     void makeTrunkSlice(ui32 chunkOffset, const TreeTrunkProperties& props);
     void generateBranch(ui32 chunkOffset, int x, int y, int z, f32 length, f32 width, f32 endWidth, f32v3 dir, bool makeLeaves, bool hasParent, const TreeBranchProperties& props);
@@ -126,9 +174,14 @@ class FloraGenerator {
     void generateMushroomCap(ui32 chunkOffset, int x, int y, int z, const TreeLeafProperties& props);
     void newDirFromAngle(f32v3& dir, f32 minAngle, f32 maxAngle);
 
-    std::set<ui32> m_scLeafSet;
-    std::unordered_map<ui32, ui32> m_nodeFieldsMap;
+    // Containers are cleared rather than freed after each tree, so a worker stops
+    // allocating once they have grown to fit its biggest tree
+    SCLeafSet m_scLeafSet;
+    NodeFieldMap m_nodeFieldsMap;
     std::vector<NodeField> m_nodeFields;
+    ui32 m_numNodeFields = 0; ///< Fields in use. Later ones are left over from bigger trees.
+    std::vector<f32v3> m_scAttractPoints;
+    std::vector<ui32> m_scLeavesToAdd;
     std::vector<SCRayNode> m_scRayNodes;
     std::vector<SCTreeNode> m_scNodes;
     std::vector<LeavesToPlace> m_leavesToPlace;
@@ -0,0 +1,35 @@
+#include "stdafx.h"
+#include "FloraTemplateCache.h"
+
+const FloraTemplate* FloraTemplateCache::get(const FloraTemplateKey& key) const {
+    std::lock_guard<std::mutex> l(m_lock);
+    auto it = m_templates.find(key);
+    if (it == m_templates.end()) return nullptr;
+    return it->second.get();
+}
+
+const FloraTemplate* FloraTemplateCache::insert(const FloraTemplateKey& key, FloraTemplate&& tmpl) {
+    std::lock_guard<std::mutex> l(m_lock);
+    auto& slot = m_templates[key];
+    if (!slot) {
+        m_numNodes += tmpl.fNodes.size() + tmpl.wNodes.size();
+        slot.reset(new FloraTemplate(std::move(tmpl)));
+    }
+    return slot.get();
+}
+
+void FloraTemplateCache::clear() {
+    std::lock_guard<std::mutex> l(m_lock);
+    m_templates.clear();
+    m_numNodes = 0;
+}
+
+size_t FloraTemplateCache::getNumTemplates() const {
+    std::lock_guard<std::mutex> l(m_lock);
+    return m_templates.size();
+}
+
+size_t FloraTemplateCache::getNumNodes() const {
+    std::lock_guard<std::mutex> l(m_lock);
+    return m_numNodes;
+}
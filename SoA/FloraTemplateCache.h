@@ -0,0 +1,81 @@
+//
+// FloraTemplateCache.h
+// Seed of Andromeda
+//
+// Copyright 2014 Regrowth Studios
+// MIT License
+//
+// Summary:
+// Stores pre-generated trees as lists of blocks relative to their root,
+// so that placing a tree is a copy with an offset instead of a full run
+// of the tree generator. Trees are keyed by type, age bucket and variant.
+//
+
+#pragma once
+
+#ifndef FloraTemplateCache_h__
+#define FloraTemplateCache_h__
+
+#include <memory>
+
+struct NTreeType;
+
+const ui32 FLORA_TEMPLATE_AGE_BUCKETS = 4; ///< Ages are rounded into this many buckets
+const ui32 FLORA_TEMPLATE_VARIANTS = 8; ///< Different trees kept per type and age bucket
+
+/// A block of a tree, relative to the root
+struct FloraTemplateNode {
+    FloraTemplateNode(i16 x, i16 y, i16 z, ui16 blockID) :
+        x(x), y(y), z(z), blockID(blockID) {
+    };
+    i16 x;
+    i16 y;
+    i16 z;
+    ui16 blockID;
+};
+
+struct FloraTemplate {
+    std::vector<FloraTemplateNode> fNodes; ///< Low priority nodes, for flora and leaves
+    std::vector<FloraTemplateNode> wNodes; ///< High priority nodes, for tree "wood"
+};
+
+struct FloraTemplateKey {
+    const NTreeType* type;
+    ui16 ageBucket;
+    ui16 variant;
+
+    bool operator==(const FloraTemplateKey& other) const {
+        return type == other.type && ageBucket == other.ageBucket && variant == other.variant;
+    }
+};
+
+namespace std {
+    template <>
+    struct hash<FloraTemplateKey> {
+        size_t operator()(const FloraTemplateKey& k) const {
+            return std::hash<const void*>()(k.type) ^ (((size_t)k.ageBucket << 8) | k.variant) * 0x9E3779B9u;
+        }
+    };
+}
+
+class FloraTemplateCache {
+public:
+    /// Gets a stored template. Thread safe.
+    /// @return nullptr if it hasn't been generated yet
+    const FloraTemplate* get(const FloraTemplateKey& key) const;
+    /// Stores a template. Templates are never removed before clear(), so the
+    /// returned pointer stays valid. Thread safe.
+    /// @return The stored template, which is an earlier one if another thread got there first
+    const FloraTemplate* insert(const FloraTemplateKey& key, FloraTemplate&& tmpl);
+    /// Frees all templates. Pointers from get and insert become invalid.
+    void clear();
+
+    size_t getNumTemplates() const;
+    size_t getNumNodes() const;
+private:
+    mutable std::mutex m_lock;
+    std::unordered_map<FloraTemplateKey, std::unique_ptr<FloraTemplate> > m_templates;
+    size_t m_numNodes = 0;
+};
+
+#endif // FloraTemplateCache_h__
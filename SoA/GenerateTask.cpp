@@ -5,42 +5,44 @@
 #include "ChunkGenerator.h"
 #include "ChunkGrid.h"
 #include "FloraGenerator.h"
+#include "VoxelNodeSetterTask.h"
 
 void GenerateTask::execute(WorkerData* workerData) {
+    // Heightmaps are generated by ColumnGenerateTask, so this is always a chunk gen
+    generate(workerData);
+    chunkGenerator->finishQuery(query);
+}
+
+void GenerateTask::generate(WorkerData* workerData) {
     Chunk& chunk = query->chunk;
 
-    // Check if this is a heightmap gen
-    if (chunk.gridData->isLoading) {
-        chunkGenerator->m_proceduralGenerator.generateHeightmap(&chunk, heightData);
-    } else { // Its a chunk gen
-
-        switch (query->genLevel) {
-            case ChunkGenLevel::GEN_DONE:
-            case ChunkGenLevel::GEN_TERRAIN:
-                chunkGenerator->m_proceduralGenerator.generateChunk(&chunk, heightData);
-                chunk.genLevel = GEN_TERRAIN;
-                // TODO(Ben): Not lazy load.
-                if (!workerData->floraGenerator) {
-                    workerData->floraGenerator = new FloraGenerator;
-                }
-                generateFlora(workerData, chunk);
-                chunk.genLevel = ChunkGenLevel::GEN_DONE;
-                break;
-            case ChunkGenLevel::GEN_FLORA:
-                chunk.genLevel = ChunkGenLevel::GEN_DONE;
-                break;
-            case ChunkGenLevel::GEN_SCRIPT:
-                chunk.genLevel = ChunkGenLevel::GEN_DONE;
-                break;
-            default:
-                break;
-        }
-        query->m_isFinished = true;
-        query->m_cond.notify_one();
-        // TODO(Ben): Not true for all gen?
-        chunk.isAccessible = true;
+    switch (query->genLevel) {
+        case ChunkGenLevel::GEN_DONE:
+        case ChunkGenLevel::GEN_TERRAIN:
+            chunkGenerator->m_proceduralGenerator.generateChunk(&chunk, heightData);
+            chunk.genLevel = GEN_TERRAIN;
+            // TODO(Ben): Not lazy load.
+            if (!workerData->floraGenerator) {
+                workerData->floraGenerator = new FloraGenerator;
+            }
+            generateFlora(workerData, chunk);
+            chunk.genLevel = ChunkGenLevel::GEN_DONE;
+            break;
+        case ChunkGenLevel::GEN_FLORA:
+            chunk.genLevel = ChunkGenLevel::GEN_DONE;
+            break;
+        case ChunkGenLevel::GEN_SCRIPT:
+            chunk.genLevel = ChunkGenLevel::GEN_DONE;
+            break;
+        default:
+            break;
     }
-    chunkGenerator->finishQuery(query);
+    // Place voxels other chunks' flora left for this one
+    query->grid->nodeSetter.flush(&chunk);
+    query->m_isFinished = true;
+    query->m_cond.notify_one();
+    // TODO(Ben): Not true for all gen?
+    chunk.isAccessible = true;
 }
 
 struct ChunkFloraArrays {
@@ -49,7 +51,11 @@ struct ChunkFloraArrays {
 };
 
 void GenerateTask::generateFlora(WorkerData* workerData, Chunk& chunk) {
-    std::vector<FloraNode> fNodes, wNodes;
+    // Reuse the worker's buffers so they don't reallocate for every chunk
+    std::vector<FloraNode>& fNodes = workerData->floraGenerator->fNodeBuffer;
+    std::vector<FloraNode>& wNodes = workerData->floraGenerator->wNodeBuffer;
+    fNodes.clear();
+    wNodes.clear();
     workerData->floraGenerator->generateChunkFlora(&chunk, heightData, fNodes, wNodes);
 
 
@@ -80,18 +86,14 @@ void GenerateTask::generateFlora(WorkerData* workerData, Chunk& chunk) {
         // TODO(Ben): Handle other case
         if (h->genLevel >= GEN_TERRAIN) {
             {
-                std::lock_guard<std::mutex> l(h->dataMutex);
-                for (auto& node : it.second.wNodes) {
-                    h->blocks.set(node.blockIndex, node.blockID);
-                }
-                for (auto& node : it.second.fNodes) {
-                    if (h->blocks.get(node.blockIndex) == 0) {
-                        h->blocks.set(node.blockIndex, node.blockID);
-                    }
-                }
+                std::lock_guard<RWSpinLock> l(h->dataMutex);
+                VoxelNodeSetterTask::placeNodes(h, it.second.wNodes, it.second.fNodes);
             }
 
-            if (h->genLevel == GEN_DONE) h->DataChange(h);
+            if (h->genLevel == GEN_DONE) {
+                h->dirtyMeshSections |= ALL_CHUNK_MESH_SECTIONS;
+                h->DataChange(h);
+            }
         } else {
             query->grid->nodeSetter.setNodes(h, GEN_TERRAIN, it.second.wNodes, it.second.fNodes);
         }
@@ -99,4 +101,37 @@ void GenerateTask::generateFlora(WorkerData* workerData, Chunk& chunk) {
     }
 
     std::vector<ui16>().swap(chunk.floraToGenerate);
-}
\ No newline at end of file
+}
+
+void ColumnGenerateTask::execute(WorkerData* workerData) {
+    Chunk* chunk;
+    {
+        std::lock_guard<std::mutex> l(column->lock);
+        Chunk& first = column->queries[0]->chunk;
+        chunk = &first;
+    }
+    chunkGenerator->m_proceduralGenerator.generateHeightmap(chunk, gridData->heightData);
+
+    // Take every query that came in while the heightmap was generating. Later ones
+    // wait in ChunkGenerator until the column is marked loaded.
+    {
+        std::lock_guard<std::mutex> l(column->lock);
+        column->isClosed = true;
+    }
+    std::vector<ChunkQuery*>& queries = column->queries;
+    // Bottom to top, with the highest gen level first for each chunk
+    std::sort(queries.begin(), queries.end(), [](const ChunkQuery* a, const ChunkQuery* b) {
+        if (a->chunkPos.y != b->chunkPos.y) return a->chunkPos.y < b->chunkPos.y;
+        return a->genLevel > b->genLevel;
+    });
+    for (auto& q : queries) {
+        // Repeat queries for a chunk are already satisfied
+        if (q->chunk->genLevel >= q->genLevel) continue;
+        q->genTask.generate(workerData);
+    }
+    chunkGenerator->finishColumn(gridData);
+}
+
+void ColumnGenerateTask::cleanup() {
+    delete this;
+}
@@ -7,7 +7,7 @@
 /// MIT License
 ///
 /// Summary:
-/// Implements the generate task for SoA chunk generation
+/// Implements the generate tasks for SoA chunk generation
 ///
 
 #pragma once
@@ -21,10 +21,12 @@
 
 class Chunk;
 class ChunkGenerator;
+class ChunkGridData;
 class ChunkQuery;
 struct PlanetHeightData;
 
 #define GENERATE_TASK_ID 1
+#define COLUMN_GENERATE_TASK_ID 8
 
 // Represents A Chunk Load Task
 
@@ -42,6 +44,9 @@ class GenerateTask : public vcore::IThreadPoolTask<WorkerData> {
 
     void execute(WorkerData* workerData) override;
 
+    /// Generates the chunk up to the query's gen level. The heightmap must be loaded.
+    void generate(WorkerData* workerData);
+
     // Chunk To Be Loaded
     ChunkQuery* query;
     ChunkGenerator* chunkGenerator; ///< send finished query here
@@ -53,4 +58,34 @@ class GenerateTask : public vcore::IThreadPoolTask<WorkerData> {
     void generateFlora(WorkerData* workerData, Chunk& chunk);
 };
 
+/// Queries for a column whose heightmap is being generated. Owned by ChunkGenerator.
+struct ColumnQueries {
+    std::mutex lock;
+    bool isClosed = false; ///< Set once the task has taken the queries
+    std::vector<ChunkQuery*> queries;
+};
+
+// Generates a column's heightmap, then every chunk queried in the column
+// while it was being generated, so a stack of chunks costs one task.
+class ColumnGenerateTask : public vcore::IThreadPoolTask<WorkerData> {
+public:
+    ColumnGenerateTask() : vcore::IThreadPoolTask<WorkerData>(COLUMN_GENERATE_TASK_ID) {}
+
+    void init(ChunkGridData* gridData,
+              ColumnQueries* column,
+              ChunkGenerator* chunkGenerator) {
+        this->gridData = gridData;
+        this->column = column;
+        this->chunkGenerator = chunkGenerator;
+    }
+
+    void execute(WorkerData* workerData) override;
+
+    void cleanup() override;
+
+    ChunkGridData* gridData;
+    ColumnQueries* column; ///< Must have a query before the task is added
+    ChunkGenerator* chunkGenerator; ///< send finished column here
+};
+
 #endif // LoadTask_h__
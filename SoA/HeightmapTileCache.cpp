@@ -0,0 +1,405 @@
+#include "stdafx.h"
+#include "HeightmapTileCache.h"
+
+#include "PlanetGenData.h"
+#include "SphericalHeightmapGenerator.h"
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define REGION_WIDTH 16 ///< Tiles per region file side
+#define REGION_TILES (REGION_WIDTH * REGION_WIDTH)
+#define MAX_OPEN_REGIONS 32
+
+#define REGION_MAGIC 0x544D4853 // "SHMT"
+#define REGION_VERSION 1
+#define NO_BIOME 0xFFFF
+
+namespace {
+    /// Packed PlanetHeightData for region files. Biomes are stored as
+    /// indices into PlanetGenData::biomes.
+    struct DiskSample {
+        f32 height;
+        ui16 flora;
+        ui16 biome;
+        ui8 temperature;
+        ui8 humidity;
+        ui8 flags;
+        ui8 padding;
+    };
+    static_assert(sizeof(DiskSample) == 12, "DiskSample should be packed");
+
+    struct RegionHeader {
+        ui32 magic;
+        ui32 version;
+        ui64 fingerprint;
+        ui8 present[REGION_TILES / 8]; ///< Bit per tile that has been written
+    };
+
+    const size_t TILE_BYTES = HEIGHTMAP_TILE_SIZE * sizeof(DiskSample);
+    const size_t REGION_FILE_SIZE = sizeof(RegionHeader) + REGION_TILES * TILE_BYTES;
+
+    inline i32 floorDiv(i32 a, i32 b) {
+        return (a >= 0) ? a / b : (a - b + 1) / b;
+    }
+
+    /// FNV-1a
+    class Fingerprint {
+    public:
+        void add(const void* data, size_t size) {
+            const ui8* bytes = (const ui8*)data;
+            for (size_t i = 0; i < size; i++) {
+                m_hash ^= bytes[i];
+                m_hash *= 1099511628211ull;
+            }
+        }
+        template<typename T>
+        void add(const T& value) { add(&value, sizeof(T)); }
+        void add(const nString& s) { add(s.data(), s.size()); add(s.size()); }
+        void add(const NoiseBase& noise) {
+            add(noise.base);
+            add(noise.funcs);
+        }
+        void add(const Array<TerrainFuncProperties>& funcs) {
+            add(funcs.size());
+            for (size_t i = 0; i < funcs.size(); i++) {
+                auto& fn = funcs[i];
+                add(fn.func);
+                add(fn.op);
+                add(fn.octaves);
+                add(fn.persistence);
+                add(fn.frequency);
+                add(fn.low);
+                add(fn.high);
+                add(fn.clamp);
+                add(fn.children);
+            }
+        }
+        ui64 get() const { return m_hash; }
+    private:
+        ui64 m_hash = 14695981039346656037ull;
+    };
+}
+
+struct HeightmapTileCache::Region {
+    HeightmapTileKey key; ///< Position is in regions
+    ui8* data = nullptr;
+#if defined(_WIN32) || defined(_WIN64)
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+
+    RegionHeader* getHeader() { return (RegionHeader*)data; }
+    DiskSample* getTile(ui32 index) { return (DiskSample*)(data + sizeof(RegionHeader) + index * TILE_BYTES); }
+    ui32 getTileIndex(const HeightmapTileKey& tile) const {
+        return (tile.pos.y - key.pos.y * REGION_WIDTH) * REGION_WIDTH + (tile.pos.x - key.pos.x * REGION_WIDTH);
+    }
+};
+
+HeightmapTileCache::HeightmapTileCache(const SphericalHeightmapGenerator* generator, size_t maxTiles) :
+    m_generator(generator),
+    m_genData(generator->getGenData()),
+    m_maxTiles(maxTiles) {
+    m_fingerprint = computeFingerprint(m_generator);
+}
+
+HeightmapTileCache::~HeightmapTileCache() {
+    closeDiskStore();
+}
+
+void HeightmapTileCache::getTile(const HeightmapTileKey& key, OUT PlanetHeightData* heights) {
+    { // Memory
+        std::lock_guard<std::mutex> l(m_lock);
+        auto it = m_tileMap.find(key);
+        if (it != m_tileMap.end()) {
+            memcpy(heights, it->second->data, sizeof(it->second->data));
+            // Move to the front
+            m_tiles.splice(m_tiles.begin(), m_tiles, it->second);
+            m_numHits++;
+            return;
+        }
+    }
+    // Disk, then generate. Two threads may generate the same tile, but
+    // that is rare and cheaper than holding the lock while generating.
+    if (loadFromDisk(key, heights)) {
+        m_numDiskHits++;
+    } else {
+        generate(key, heights);
+        saveToDisk(key, heights);
+        m_numMisses++;
+    }
+    insert(key, heights);
+}
+
+void HeightmapTileCache::getSamples(WorldCubeFace face, ui32 lod, const i32v2& start, const ui32v2& size, OUT PlanetHeightData* heights) {
+    const i32 W = (i32)HEIGHTMAP_TILE_WIDTH;
+    i32v2 end = start + i32v2(size);
+    i32v2 startTile(floorDiv(start.x, W), floorDiv(start.y, W));
+    i32v2 endTile(floorDiv(end.x - 1, W), floorDiv(end.y - 1, W));
+
+    std::vector<PlanetHeightData> tile(HEIGHTMAP_TILE_SIZE);
+    HeightmapTileKey key;
+    key.face = face;
+    key.lod = lod;
+    for (key.pos.y = startTile.y; key.pos.y <= endTile.y; key.pos.y++) {
+        for (key.pos.x = startTile.x; key.pos.x <= endTile.x; key.pos.x++) {
+            getTile(key, tile.data());
+            // Copy the part that overlaps
+            i32v2 tileStart = key.pos * W;
+            i32 x0 = glm::max(start.x, tileStart.x);
+            i32 x1 = glm::min(end.x, tileStart.x + W);
+            i32 z0 = glm::max(start.y, tileStart.y);
+            i32 z1 = glm::min(end.y, tileStart.y + W);
+            for (i32 z = z0; z < z1; z++) {
+                memcpy(&heights[(z - start.y) * size.x + (x0 - start.x)],
+                       &tile[(z - tileStart.y) * W + (x0 - tileStart.x)],
+                       (x1 - x0) * sizeof(PlanetHeightData));
+            }
+        }
+    }
+}
+
+bool HeightmapTileCache::openDiskStore(const nString& dir) {
+    std::lock_guard<std::mutex> l(m_diskLock);
+    for (auto& region : m_regions) closeRegion(region);
+    m_regions.clear();
+    m_diskDir = dir;
+    if (m_diskDir.size() && (m_diskDir.back() == '/' || m_diskDir.back() == '\\')) m_diskDir.pop_back();
+    return m_diskDir.size() != 0;
+}
+
+void HeightmapTileCache::closeDiskStore() {
+    std::lock_guard<std::mutex> l(m_diskLock);
+    for (auto& region : m_regions) closeRegion(region);
+    m_regions.clear();
+    m_diskDir.clear();
+}
+
+void HeightmapTileCache::setMaxTiles(size_t maxTiles) {
+    std::lock_guard<std::mutex> l(m_lock);
+    m_maxTiles = maxTiles;
+    while (m_tiles.size() > m_maxTiles) {
+        m_tileMap.erase(m_tiles.back().key);
+        m_tiles.pop_back();
+    }
+}
+
+size_t HeightmapTileCache::getNumTiles() const {
+    std::lock_guard<std::mutex> l(m_lock);
+    return m_tiles.size();
+}
+
+void HeightmapTileCache::insert(const HeightmapTileKey& key, const PlanetHeightData* heights) {
+    std::lock_guard<std::mutex> l(m_lock);
+    if (m_maxTiles == 0 || m_tileMap.find(key) != m_tileMap.end()) return;
+    if (m_tiles.size() >= m_maxTiles) {
+        // Reuse the least recently used tile
+        m_tileMap.erase(m_tiles.back().key);
+        m_tiles.splice(m_tiles.begin(), m_tiles, std::prev(m_tiles.end()));
+    } else {
+        m_tiles.emplace_front();
+    }
+    Tile& tile = m_tiles.front();
+    tile.key = key;
+    memcpy(tile.data, heights, sizeof(tile.data));
+    m_tileMap[key] = m_tiles.begin();
+}
+
+void HeightmapTileCache::generate(const HeightmapTileKey& key, OUT PlanetHeightData* heights) const {
+    ui32 step = 1u << key.lod;
+    VoxelPosition2D cornerPos;
+    cornerPos.face = key.face;
+    cornerPos.pos = f64v2(key.pos) * (f64)(HEIGHTMAP_TILE_WIDTH * (f64)step);
+    m_generator->generateHeightData(heights, cornerPos, HEIGHTMAP_TILE_WIDTH, step);
+}
+
+/************************************************************************/
+/* Disk                                                                 */
+/************************************************************************/
+HeightmapTileCache::Region* HeightmapTileCache::getRegion(const HeightmapTileKey& key) {
+    HeightmapTileKey regionKey = key;
+    regionKey.pos = i32v2(floorDiv(key.pos.x, REGION_WIDTH), floorDiv(key.pos.y, REGION_WIDTH));
+    for (size_t i = 0; i < m_regions.size(); i++) {
+        if (m_regions[i]->key == regionKey) {
+            Region* region = m_regions[i];
+            m_regions.erase(m_regions.begin() + i);
+            m_regions.push_back(region);
+            return region;
+        }
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "/%d_%u_%d_%d.hmt", (int)regionKey.face, regionKey.lod, regionKey.pos.x, regionKey.pos.y);
+    nString path = m_diskDir + name;
+
+    Region* region = new Region;
+    region->key = regionKey;
+#if defined(_WIN32) || defined(_WIN64)
+    region->file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (region->file != INVALID_HANDLE_VALUE) {
+        // Grows the file to the full size if it is smaller
+        region->mapping = CreateFileMappingA(region->file, nullptr, PAGE_READWRITE, 0, (DWORD)REGION_FILE_SIZE, nullptr);
+        if (region->mapping) {
+            region->data = (ui8*)MapViewOfFile(region->mapping, FILE_MAP_ALL_ACCESS, 0, 0, REGION_FILE_SIZE);
+        }
+    }
+#else
+    region->fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (region->fd >= 0) {
+        struct stat st;
+        // New files are sparse, so unwritten tiles take no space
+        if (fstat(region->fd, &st) == 0 && ((size_t)st.st_size == REGION_FILE_SIZE || ftruncate(region->fd, REGION_FILE_SIZE) == 0)) {
+            void* data = mmap(nullptr, REGION_FILE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, region->fd, 0);
+            if (data != MAP_FAILED) region->data = (ui8*)data;
+        }
+    }
+#endif
+    if (!region->data) {
+        fprintf(stderr, "Failed to map heightmap region %s\n", path.c_str());
+        closeRegion(region);
+        return nullptr;
+    }
+
+    RegionHeader* header = region->getHeader();
+    if (header->magic != REGION_MAGIC || header->version != REGION_VERSION || header->fingerprint != m_fingerprint) {
+        // New file or made for other generation data
+        memset(header, 0, sizeof(RegionHeader));
+        header->magic = REGION_MAGIC;
+        header->version = REGION_VERSION;
+        header->fingerprint = m_fingerprint;
+    }
+
+    if (m_regions.size() >= MAX_OPEN_REGIONS) {
+        closeRegion(m_regions.front());
+        m_regions.erase(m_regions.begin());
+    }
+    m_regions.push_back(region);
+    return region;
+}
+
+void HeightmapTileCache::closeRegion(Region* region) {
+#if defined(_WIN32) || defined(_WIN64)
+    if (region->data) UnmapViewOfFile(region->data);
+    if (region->mapping) CloseHandle(region->mapping);
+    if (region->file != INVALID_HANDLE_VALUE) CloseHandle(region->file);
+#else
+    if (region->data) munmap(region->data, REGION_FILE_SIZE);
+    if (region->fd >= 0) close(region->fd);
+#endif
+    delete region;
+}
+
+bool HeightmapTileCache::loadFromDisk(const HeightmapTileKey& key, OUT PlanetHeightData* heights) {
+    std::lock_guard<std::mutex> l(m_diskLock);
+    if (m_diskDir.empty()) return false;
+    Region* region = getRegion(key);
+    if (!region) return false;
+
+    ui32 index = region->getTileIndex(key);
+    if (!(region->getHeader()->present[index >> 3] & (1 << (index & 7)))) return false;
+
+    const DiskSample* samples = region->getTile(index);
+    const std::vector<Biome>& biomes = m_genData->biomes;
+    for (ui32 i = 0; i < HEIGHTMAP_TILE_SIZE; i++) {
+        const DiskSample& s = samples[i];
+        if (s.biome >= biomes.size()) return false;
+        PlanetHeightData& h = heights[i];
+        h.biome = &biomes[s.biome];
+        h.height = s.height;
+        h.flora = s.flora;
+        h.temperature = s.temperature;
+        h.humidity = s.humidity;
+        h.flags = s.flags;
+    }
+    return true;
+}
+
+void HeightmapTileCache::saveToDisk(const HeightmapTileKey& key, const PlanetHeightData* heights) {
+    std::lock_guard<std::mutex> l(m_diskLock);
+    if (m_diskDir.empty()) return;
+
+    // Only biomes owned by the planet can be stored
+    const std::vector<Biome>& biomes = m_genData->biomes;
+    for (ui32 i = 0; i < HEIGHTMAP_TILE_SIZE; i++) {
+        if (heights[i].biome < biomes.data() || heights[i].biome >= biomes.data() + biomes.size()) return;
+    }
+
+    Region* region = getRegion(key);
+    if (!region) return;
+    ui32 index = region->getTileIndex(key);
+    DiskSample* samples = region->getTile(index);
+    for (ui32 i = 0; i < HEIGHTMAP_TILE_SIZE; i++) {
+        const PlanetHeightData& h = heights[i];
+        DiskSample& s = samples[i];
+        s.height = h.height;
+        s.flora = h.flora;
+        s.biome = (ui16)(h.biome - biomes.data());
+        s.temperature = h.temperature;
+        s.humidity = h.humidity;
+        s.flags = h.flags;
+        s.padding = 0;
+    }
+    // Mark it last so a half written tile is never read
+    region->getHeader()->present[index >> 3] |= (ui8)(1 << (index & 7));
+}
+
+ui64 HeightmapTileCache::computeFingerprint(const SphericalHeightmapGenerator* generator) {
+    const PlanetGenData* genData = generator->getGenData();
+    Fingerprint f;
+    f.add(generator->getHeightTolerance());
+    f.add(generator->getBiomeTilesEnabled() ? BIOME_TILE_SPACING : 0u);
+    f.add(genData->terrainFilePath);
+    f.add(genData->radius);
+    f.add(genData->baseTerrainFuncs);
+    f.add(genData->tempTerrainFuncs);
+    f.add(genData->humTerrainFuncs);
+    f.add(genData->tempLatitudeFalloff);
+    f.add(genData->tempHeightFalloff);
+    f.add(genData->humLatitudeFalloff);
+    f.add(genData->humHeightFalloff);
+
+    const Biome* biomes = genData->biomes.data();
+    f.add(genData->biomes.size());
+    for (auto& biome : genData->biomes) {
+        f.add(biome.id);
+        f.add(biome.terrainNoise);
+        f.add(biome.childNoise);
+        f.add(biome.heightRange);
+        f.add(biome.heightScale);
+        f.add(biome.noiseRange);
+        f.add(biome.noiseScale);
+        f.add(biome.children.size());
+        for (auto& child : biome.children) f.add((size_t)(child - biomes));
+        f.add(biome.trees.size());
+        for (auto& tree : biome.trees) {
+            f.add(tree.id);
+            f.add(tree.chance);
+        }
+        f.add(biome.flora.size());
+        for (auto& flora : biome.flora) {
+            f.add(flora.id);
+            f.add(flora.chance);
+        }
+    }
+    // The biome map decides which base biomes blend where
+    for (int y = 0; y < BIOME_MAP_WIDTH; y++) {
+        for (int x = 0; x < BIOME_MAP_WIDTH; x++) {
+            f.add((size_t)(genData->baseBiomeLookup[y][x] - biomes));
+            auto& influences = genData->baseBiomeInfluenceMap[y][x];
+            f.add(influences.size());
+            for (auto& b : influences) {
+                f.add((size_t)(b.b - biomes));
+                f.add(b.weight);
+            }
+        }
+    }
+    return f.get();
+}
@@ -0,0 +1,125 @@
+//
+// HeightmapTileCache.h
+// Seed of Andromeda
+//
+// Copyright 2014 Regrowth Studios
+// MIT License
+//
+// Summary:
+// Caches planet height data in square tiles so that voxel chunks and
+// terrain patches share it instead of generating it separately. Tiles are
+// kept in an in-memory LRU. Once a save is open they can also be kept in
+// memory-mapped region files under the save's cache directory.
+//
+
+#pragma once
+
+#ifndef HeightmapTileCache_h__
+#define HeightmapTileCache_h__
+
+#include "PlanetHeightData.h"
+#include "VoxelCoordinateSpaces.h"
+
+#include <atomic>
+#include <list>
+
+class SphericalHeightmapGenerator;
+struct PlanetGenData;
+
+const ui32 HEIGHTMAP_TILE_WIDTH = 32; ///< Samples per tile side. LOD 0 tiles are chunk heightmaps.
+const ui32 HEIGHTMAP_TILE_SIZE = HEIGHTMAP_TILE_WIDTH * HEIGHTMAP_TILE_WIDTH;
+const ui32 HEIGHTMAP_MAX_LOD = 30;
+
+struct HeightmapTileKey {
+    WorldCubeFace face;
+    ui32 lod; ///< Samples are 2^lod voxels apart
+    i32v2 pos; ///< Position on the face in tiles
+
+    bool operator==(const HeightmapTileKey& other) const {
+        return face == other.face && lod == other.lod && pos == other.pos;
+    }
+};
+
+namespace std {
+    template <>
+    struct hash<HeightmapTileKey> {
+        size_t operator()(const HeightmapTileKey& k) const {
+            ui64 h = ((ui64)(ui32)k.pos.x << 32) | (ui32)k.pos.y;
+            h ^= ((ui64)k.face << 59) ^ ((ui64)k.lod << 53);
+            return std::hash<ui64>()(h);
+        }
+    };
+}
+
+class HeightmapTileCache {
+public:
+    /// @param generator: Generates missing tiles. Must outlive the cache.
+    /// @param maxTiles: Tiles kept in memory. Each is about 24KB.
+    HeightmapTileCache(const SphericalHeightmapGenerator* generator, size_t maxTiles = 1024);
+    ~HeightmapTileCache();
+
+    /// Copies a tile to heights, generating it if it isn't cached. Flora is
+    /// only placed in LOD 0 tiles. Thread safe.
+    /// @param heights: HEIGHTMAP_TILE_SIZE samples, row by row
+    void getTile(const HeightmapTileKey& key, OUT PlanetHeightData* heights);
+    /// Copies a block of samples at one LOD, which may span several tiles. Thread safe.
+    /// @param start: First sample, in samples from the face origin
+    /// @param size: Samples in x and z
+    /// @param heights: size.x * size.y samples, row by row
+    void getSamples(WorldCubeFace face, ui32 lod, const i32v2& start, const ui32v2& size, OUT PlanetHeightData* heights);
+
+    /// Also stores tiles in region files in dir, so they are kept between
+    /// sessions. Files written for different generation data are replaced.
+    /// @param dir: Existing directory for this planet
+    /// @return false if the directory can't be used
+    bool openDiskStore(const nString& dir);
+    void closeDiskStore();
+    bool hasDiskStore() const { return m_diskDir.size() != 0; }
+
+    void setMaxTiles(size_t maxTiles);
+    size_t getNumTiles() const;
+
+    // Counters, to check the cache is pulling its weight
+    size_t getNumHits() const { return m_numHits; }
+    size_t getNumDiskHits() const { return m_numDiskHits; }
+    size_t getNumMisses() const { return m_numMisses; }
+private:
+    struct Tile {
+        HeightmapTileKey key;
+        PlanetHeightData data[HEIGHTMAP_TILE_SIZE];
+    };
+    struct Region;
+
+    void insert(const HeightmapTileKey& key, const PlanetHeightData* heights);
+    void generate(const HeightmapTileKey& key, OUT PlanetHeightData* heights) const;
+
+    /// Gets the mapped region file holding a tile. Needs m_diskLock.
+    Region* getRegion(const HeightmapTileKey& key);
+    void closeRegion(Region* region);
+    bool loadFromDisk(const HeightmapTileKey& key, OUT PlanetHeightData* heights);
+    void saveToDisk(const HeightmapTileKey& key, const PlanetHeightData* heights);
+
+    /// Changes whenever anything that affects the generated heights changes
+    static ui64 computeFingerprint(const SphericalHeightmapGenerator* generator);
+
+    const SphericalHeightmapGenerator* m_generator;
+    const PlanetGenData* m_genData;
+
+    // Memory, most recently used first
+    mutable std::mutex m_lock;
+    std::list<Tile> m_tiles;
+    std::unordered_map<HeightmapTileKey, std::list<Tile>::iterator> m_tileMap;
+    size_t m_maxTiles;
+
+    // Disk
+    std::mutex m_diskLock;
+    nString m_diskDir;
+    ui64 m_fingerprint = 0;
+    std::vector<Region*> m_regions; ///< Open regions, most recently used last
+
+    std::atomic<size_t> m_numHits{ 0 };
+    std::atomic<size_t> m_numDiskHits{ 0 };
+    std::atomic<size_t> m_numMisses{ 0 };
+};
+
+#endif // HeightmapTileCache_h__
@@ -2,6 +2,17 @@
 #include "Noise.h"
 
 #include <Vorb/utils.h>
+#include <atomic>
+
+#include "NoiseSIMD.h"
+
+#ifdef NOISE_SIMD_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
 
 KEG_TYPE_DEF_SAME_NAME(NoiseBase, kt) {
     KEG_TYPE_INIT_ADD_MEMBER(kt, NoiseBase, base, F64);
@@ -590,3 +601,94 @@ f64 Noise::raw(const f64 x, const f64 y, const f64 z, const f64 w) {
     // Sum up and scale the result to cover the range [-1,1]
     return 27.0 * (n0 + n1 + n2 + n3 + n4);
 }
+
+/************************************************************************/
+/* Batched                                                              */
+/************************************************************************/
+namespace {
+    Noise::SimdLevel detectSimdLevel() {
+#ifdef NOISE_SIMD_X86
+        ui32 regs[4] = {}; // eax, ebx, ecx, edx
+#if defined(_MSC_VER)
+        __cpuid((int*)regs, 1);
+#else
+        __get_cpuid(1, &regs[0], &regs[1], &regs[2], &regs[3]);
+#endif
+        if (!(regs[2] & (1u << 19))) return Noise::SimdLevel::NONE;
+
+        // AVX needs the OS to save the YMM registers
+        const ui32 OSXSAVE_AVX = (1u << 27) | (1u << 28);
+        if ((regs[2] & OSXSAVE_AVX) != OSXSAVE_AVX) return Noise::SimdLevel::SSE4_1;
+#if defined(_MSC_VER)
+        ui64 xcr0 = _xgetbv(0);
+#else
+        ui32 xcr0Lo, xcr0Hi;
+        __asm__ volatile("xgetbv" : "=a"(xcr0Lo), "=d"(xcr0Hi) : "c"(0));
+        ui64 xcr0 = ((ui64)xcr0Hi << 32) | xcr0Lo;
+#endif
+        if ((xcr0 & 6) != 6) return Noise::SimdLevel::SSE4_1;
+
+#if defined(_MSC_VER)
+        __cpuidex((int*)regs, 7, 0);
+#else
+        __get_cpuid_count(7, 0, &regs[0], &regs[1], &regs[2], &regs[3]);
+#endif
+        if (regs[1] & (1u << 5)) return Noise::SimdLevel::AVX2;
+        return Noise::SimdLevel::SSE4_1;
+#else
+        return Noise::SimdLevel::NONE;
+#endif
+    }
+
+    const Noise::SimdLevel cpuSimdLevel = detectSimdLevel();
+    std::atomic<Noise::SimdLevel> simdLevel(cpuSimdLevel);
+}
+
+Noise::SimdLevel Noise::getSimdLevel() {
+    return simdLevel.load(std::memory_order_relaxed);
+}
+
+void Noise::setMaxSimdLevel(SimdLevel level) {
+    simdLevel = (SimdLevel)glm::min((int)level, (int)cpuSimdLevel);
+}
+
+void Noise::raw(const f64* x, const f64* y, const f64* z, OUT f64* result, size_t count) {
+    size_t done = 0;
+#ifdef NOISE_SIMD_X86
+    switch (getSimdLevel()) {
+        case SimdLevel::AVX2:
+            done = NoiseSIMD::rawAVX2(perm, &grad3[0][0], x, y, z, result, count);
+            break;
+        case SimdLevel::SSE4_1:
+            done = NoiseSIMD::rawSSE41(perm, &grad3[0][0], x, y, z, result, count);
+            break;
+        default:
+            break;
+    }
+#endif
+    // Leftovers that don't fill a register
+    for (size_t i = done; i < count; i++) {
+        result[i] = raw(x[i], y[i], z[i]);
+    }
+}
+
+void Noise::cellular(const f64* x, const f64* y, const f64* z, OUT f64* f1, OUT f64* f2, size_t count) {
+    size_t done = 0;
+#ifdef NOISE_SIMD_X86
+    switch (getSimdLevel()) {
+        case SimdLevel::AVX2:
+            done = NoiseSIMD::cellularAVX2(x, y, z, f1, f2, count);
+            break;
+        case SimdLevel::SSE4_1:
+            done = NoiseSIMD::cellularSSE41(x, y, z, f1, f2, count);
+            break;
+        default:
+            break;
+    }
+#endif
+    for (size_t i = done; i < count; i++) {
+        f64v2 ff = cellular(f64v3(x[i], y[i], z[i]));
+        f1[i] = ff.x;
+        f2[i] = ff.y;
+    }
+}
@@ -88,6 +88,30 @@ namespace Noise {
     f64 raw(const f64 x, const f64 y, const f64 z);
     f64 raw(const f64 x, const f64 y, const f64, const f64 w);
 
+    /************************************************************************/
+    /* Batched                                                              */
+    /************************************************************************/
+    // These evaluate many points per call with the widest instruction set
+    // the CPU has, and give the same results as the single point versions.
+
+    enum class SimdLevel {
+        NONE = 0,
+        SSE4_1, ///< 2 points per instruction
+        AVX2 ///< 4 points per instruction
+    };
+    /// @return The instruction set the batched functions use
+    SimdLevel getSimdLevel();
+    /// Limits the instruction set the batched functions use, for testing
+    /// and benchmarks. It can't raise it above what the CPU supports.
+    void setMaxSimdLevel(SimdLevel level);
+
+    /// Raw 3D simplex noise for count points
+    void raw(const f64* x, const f64* y, const f64* z, OUT f64* result, size_t count);
+    /// Cellular noise for count points
+    /// @param f1: Distances to the nearest feature points
+    /// @param f2: Distances to the second nearest feature points
+    void cellular(const f64* x, const f64* y, const f64* z, OUT f64* f1, OUT f64* f2, size_t count);
+
     // Scaled Multi-octave Simplex noise
     // The result will be between the two parameters passed.
     inline f64 scaledFractal(const int octaves, const f64 persistence, const f64 freq, const f64 loBound, const f64 hiBound, const f64 x, const f64 y) {
@@ -0,0 +1,63 @@
+#include "NoiseSIMD.h"
+
+// Built with AVX2 enabled, so nothing here may run before the CPU check.
+// Only built in types and intrinsics, see NoiseSIMD.h.
+#ifdef NOISE_SIMD_X86
+#include <immintrin.h>
+
+namespace {
+    /// Four double lanes. Integer lanes are the matching four ints.
+    struct LanesAVX2 {
+        typedef __m256d D;
+        typedef __m128i I;
+        static const size_t WIDTH = 4;
+
+        static D load(const double* p) { return _mm256_loadu_pd(p); }
+        static void store(double* p, D v) { _mm256_storeu_pd(p, v); }
+        static D set1(double v) { return _mm256_set1_pd(v); }
+        static D zero() { return _mm256_setzero_pd(); }
+
+        static D add(D a, D b) { return _mm256_add_pd(a, b); }
+        static D sub(D a, D b) { return _mm256_sub_pd(a, b); }
+        static D mul(D a, D b) { return _mm256_mul_pd(a, b); }
+        static D div(D a, D b) { return _mm256_div_pd(a, b); }
+        static D min(D a, D b) { return _mm256_min_pd(a, b); }
+        static D max(D a, D b) { return _mm256_max_pd(a, b); }
+        static D sqrt(D a) { return _mm256_sqrt_pd(a); }
+        static D floor(D a) { return _mm256_floor_pd(a); }
+
+        static D lt(D a, D b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+        static D ge(D a, D b) { return _mm256_cmp_pd(a, b, _CMP_GE_OQ); }
+        static D and_(D a, D b) { return _mm256_and_pd(a, b); }
+        static D or_(D a, D b) { return _mm256_or_pd(a, b); }
+        /// ~a & b
+        static D andNot(D a, D b) { return _mm256_andnot_pd(a, b); }
+
+        static I toInt(D a) { return _mm256_cvttpd_epi32(a); }
+        static I iset1(int v) { return _mm_set1_epi32(v); }
+        static I iadd(I a, I b) { return _mm_add_epi32(a, b); }
+        static I isub(I a, I b) { return _mm_sub_epi32(a, b); }
+        static I imul(I a, I b) { return _mm_mullo_epi32(a, b); }
+        static I iand(I a, I b) { return _mm_and_si128(a, b); }
+        static I ishr11(I a) { return _mm_srli_epi32(a, 11); }
+
+        // The masked forms avoid reading an uninitialized source register
+        static I igather(const int* table, I index) {
+            return _mm_mask_i32gather_epi32(_mm_setzero_si128(), table, index, _mm_set1_epi32(-1), 4);
+        }
+        static D gather(const double* table, I index) {
+            return _mm256_mask_i32gather_pd(_mm256_setzero_pd(), table, index, _mm256_castsi256_pd(_mm256_set1_epi64x(-1)), 8);
+        }
+    };
+}
+
+#include "NoiseSIMD.inl"
+
+size_t NoiseSIMD::rawAVX2(const int* perm, const double* grad3, const double* x, const double* y, const double* z, double* result, size_t count) {
+    return simplex3Batch<LanesAVX2>(perm, grad3, x, y, z, result, count);
+}
+
+size_t NoiseSIMD::cellularAVX2(const double* x, const double* y, const double* z, double* f1, double* f2, size_t count) {
+    return cellularBatch<LanesAVX2>(x, y, z, f1, f2, count);
+}
+#endif
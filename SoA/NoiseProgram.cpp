@@ -0,0 +1,452 @@
+#include "stdafx.h"
+#include "NoiseProgram.h"
+
+namespace {
+    /// Positions run through the program together. Small enough that the
+    /// registers stay in cache, big enough to amortize the dispatch.
+    const size_t BLOCK_SIZE = 256;
+    /// Scaled positions and two noise results
+    const size_t NUM_NOISE_SCRATCH = 5;
+    const ui16 NO_REGISTER = 0xFFFF;
+
+    // Per thread so one program can be shared by generator threads
+    thread_local std::vector<f64> registerScratch;
+    thread_local std::vector<ui8> maskScratch;
+
+    inline f64 applyOp(TerrainOp op, f64 a, f64 b) {
+        switch (op) {
+            case TerrainOp::ADD: return a + b;
+            case TerrainOp::SUB: return a - b;
+            case TerrainOp::MUL: return a * b;
+            case TerrainOp::DIV: return a / b;
+        }
+        return 0.0;
+    }
+}
+
+/************************************************************************/
+/* Compiler                                                             */
+/************************************************************************/
+class NoiseProgram::Compiler {
+public:
+    /// What a node's value is known to be while compiling
+    struct Value {
+        bool isConstant = true;
+        f64 constant = 0.0;
+        ui16 reg = NO_REGISTER;
+        bool owned = false; ///< The register belongs to this value, so it can be changed in place and freed
+    };
+
+    Compiler(NoiseProgram& program) : m_program(program) {}
+
+    /// Mirrors SphericalHeightmapGenerator::getNoiseValue, emitting code instead of evaluating
+    /// @param depth: Number of masks in effect
+    void compile(const Array<TerrainFuncProperties>& funcs, Value* modifier, TerrainOp op, ui32 depth) {
+        for (size_t f = 0; f < funcs.size(); ++f) {
+            auto& fn = funcs[f];
+            bool hasClamp = fn.clamp[0] != 0.0 || fn.clamp[1] != 0.0;
+
+            Value h;
+            Value* nextMod;
+            TerrainOp nextOp;
+            if (fn.func == TerrainStage::CONSTANT) {
+                nextMod = &h;
+                h = constant(fn.low);
+                if (modifier) {
+                    h = combine(op, h, *modifier);
+                }
+                if (hasClamp) {
+                    // Clamps the modifier, not the result, same as getNoiseValue
+                    Value clamped = clampValue(modifier ? *modifier : h, fn, false);
+                    release(h);
+                    h = clamped;
+                }
+                nextOp = fn.op;
+            } else if (fn.func == TerrainStage::PASS_THROUGH) {
+                nextMod = modifier;
+                if (modifier) {
+                    h = combine(op, *modifier, constant(fn.low));
+                    if (hasClamp) h = clampValue(h, fn, true);
+                }
+                nextOp = op;
+            } else if (fn.func == TerrainStage::SQUARED || fn.func == TerrainStage::CUBED) {
+                nextMod = modifier;
+                if (modifier) {
+                    power(*modifier, fn.func == TerrainStage::SQUARED ? OpCode::SQUARE : OpCode::CUBE);
+                    // h is still 0 here
+                    if (hasClamp) h = constant(glm::clamp(0.0, fn.clamp[0], fn.clamp[1]));
+                }
+                nextOp = op;
+            } else {
+                nextMod = &h;
+                h = noiseValue(fn, depth);
+                if (fn.low != -1.0 || fn.high != 1.0) h = scaleValue(h, fn);
+                if (hasClamp) h = clampValue(h, fn, true);
+                if (modifier) {
+                    Value modified = combine(op, h, *modifier);
+                    release(h);
+                    h = modified;
+                }
+                nextOp = fn.op;
+            }
+
+            if (fn.children.size()) {
+                // Children may change the value in place
+                if (nextMod == &h && !h.isConstant && !h.owned) h = copy(h);
+
+                if (nextOp == TerrainOp::MUL && nextMod && !nextMod->isConstant) {
+                    // Early exit per position
+                    size_t push = emit(OpCode::PUSH_MASK);
+                    m_program.m_code[push].a = nextMod->reg;
+                    m_program.m_maxMaskDepth = std::max(m_program.m_maxMaskDepth, depth + 1);
+                    compile(fn.children, nextMod, nextOp, depth + 1);
+                    m_program.m_code[push].jump = (ui32)emit(OpCode::POP_MASK);
+                } else if (!(nextOp == TerrainOp::MUL && nextMod && nextMod->constant == 0.0)) {
+                    // Constant modifiers decide the early exit here
+                    compile(fn.children, nextMod, nextOp, depth);
+                }
+            } else {
+                accumulate(fn.op, h);
+            }
+            release(h);
+        }
+    }
+private:
+    struct NoiseKey {
+        TerrainStage stage;
+        i32 octaves;
+        f64 frequency;
+        f64 persistence;
+        ui16 reg;
+    };
+
+    size_t emit(OpCode code) {
+        Instruction inst = {};
+        inst.code = code;
+        inst.dst = NO_REGISTER;
+        inst.a = NO_REGISTER;
+        inst.b = NO_REGISTER;
+        m_program.m_code.push_back(inst);
+        return m_program.m_code.size() - 1;
+    }
+
+    ui16 allocRegister() {
+        if (m_freeRegisters.size()) {
+            ui16 reg = m_freeRegisters.back();
+            m_freeRegisters.pop_back();
+            return reg;
+        }
+        return (ui16)m_program.m_numRegisters++;
+    }
+    void release(Value& v) {
+        if (!v.isConstant && v.owned) {
+            m_freeRegisters.push_back(v.reg);
+            v.owned = false;
+        }
+    }
+
+    static Value constant(f64 c) {
+        Value v;
+        v.constant = c;
+        return v;
+    }
+    /// Register holding v, loading it first if it is a constant
+    ui16 materialize(const Value& v, OUT Value& temp) {
+        if (!v.isConstant) return v.reg;
+        temp = fromInstruction(emit(OpCode::CONSTANT));
+        m_program.m_code.back().v0 = v.constant;
+        return temp.reg;
+    }
+    /// Gives the instruction a new register to write to
+    Value fromInstruction(size_t index) {
+        Value v;
+        v.isConstant = false;
+        v.reg = allocRegister();
+        v.owned = true;
+        m_program.m_code[index].dst = v.reg;
+        return v;
+    }
+
+    Value combine(TerrainOp op, const Value& a, const Value& b) {
+        if (a.isConstant && b.isConstant) return constant(applyOp(op, a.constant, b.constant));
+        Value ta, tb;
+        ui16 ra = materialize(a, ta);
+        ui16 rb = materialize(b, tb);
+        Value v = fromInstruction(emit(OpCode::OPERATION));
+        Instruction& inst = m_program.m_code.back();
+        inst.op = op;
+        inst.a = ra;
+        inst.b = rb;
+        release(ta);
+        release(tb);
+        return v;
+    }
+    Value clampValue(Value v, const TerrainFuncProperties& fn, bool inPlace) {
+        if (v.isConstant) return constant(glm::clamp(v.constant, fn.clamp[0], fn.clamp[1]));
+        Value rv = v;
+        size_t index = emit(OpCode::CLAMP);
+        if (inPlace && v.owned) {
+            m_program.m_code[index].dst = v.reg;
+        } else {
+            rv = fromInstruction(index);
+        }
+        Instruction& inst = m_program.m_code[index];
+        inst.a = v.reg;
+        inst.v0 = fn.clamp[0];
+        inst.v1 = fn.clamp[1];
+        return rv;
+    }
+    Value scaleValue(Value v, const TerrainFuncProperties& fn) {
+        Value rv = v;
+        size_t index = emit(OpCode::SCALE);
+        if (v.owned) {
+            m_program.m_code[index].dst = v.reg;
+        } else {
+            rv = fromInstruction(index);
+        }
+        Instruction& inst = m_program.m_code[index];
+        inst.a = v.reg;
+        inst.v0 = fn.high - fn.low;
+        inst.v1 = (fn.high + fn.low) * 0.5;
+        return rv;
+    }
+    Value copy(const Value& v) {
+        Value rv = fromInstruction(emit(OpCode::COPY));
+        m_program.m_code.back().a = v.reg;
+        return rv;
+    }
+    void power(Value& v, OpCode code) {
+        if (v.isConstant) {
+            v.constant = (code == OpCode::SQUARE) ? v.constant * v.constant : v.constant * v.constant * v.constant;
+            return;
+        }
+        m_program.m_code[emit(code)].dst = v.reg;
+    }
+    void accumulate(TerrainOp op, const Value& v) {
+        Value temp;
+        ui16 reg = materialize(v, temp);
+        size_t index = emit(OpCode::ACCUMULATE);
+        m_program.m_code[index].op = op;
+        m_program.m_code[index].a = reg;
+        release(temp);
+    }
+
+    /// Noise outside of any mask is computed once and shared
+    Value noiseValue(const TerrainFuncProperties& fn, ui32 depth) {
+        for (auto& key : m_noise) {
+            if (key.stage == fn.func && key.octaves == fn.octaves &&
+                key.frequency == fn.frequency && key.persistence == fn.persistence) {
+                Value v;
+                v.isConstant = false;
+                v.reg = key.reg;
+                return v;
+            }
+        }
+        size_t index = emit(OpCode::NOISE);
+        Value v = fromInstruction(index);
+        Instruction& inst = m_program.m_code[index];
+        inst.stage = fn.func;
+        inst.octaves = fn.octaves;
+        inst.v0 = fn.frequency;
+        inst.v1 = fn.persistence;
+        if (depth == 0) {
+            // Never freed
+            v.owned = false;
+            m_noise.push_back({ fn.func, fn.octaves, fn.frequency, fn.persistence, v.reg });
+        }
+        return v;
+    }
+
+    NoiseProgram& m_program;
+    std::vector<ui16> m_freeRegisters;
+    std::vector<NoiseKey> m_noise;
+};
+
+void NoiseProgram::compile(const Array<TerrainFuncProperties>& funcs) {
+    m_code.clear();
+    m_numRegisters = 0;
+    m_maxMaskDepth = 0;
+    Compiler compiler(*this);
+    compiler.compile(funcs, nullptr, TerrainOp::ADD, 0);
+}
+
+/************************************************************************/
+/* Evaluation                                                           */
+/************************************************************************/
+void NoiseProgram::evaluate(const f64* x, const f64* y, const f64* z, size_t count, f64* heights) const {
+    if (m_code.empty()) return;
+
+    size_t blockSize = std::min(count, BLOCK_SIZE);
+    registerScratch.resize((m_numRegisters + NUM_NOISE_SCRATCH) * blockSize);
+    maskScratch.resize(std::max(m_maxMaskDepth, 1u) * blockSize);
+    for (size_t start = 0; start < count; start += blockSize) {
+        size_t n = std::min(blockSize, count - start);
+        runBlock(x + start, y + start, z + start, n, heights + start, registerScratch.data(), maskScratch.data());
+    }
+}
+
+void NoiseProgram::evaluate(const f64v3& pos, f64& height) const {
+    evaluate(&pos.x, &pos.y, &pos.z, 1, &height);
+}
+
+void NoiseProgram::runBlock(const f64* x, const f64* y, const f64* z, size_t count, f64* heights, f64* registers, ui8* masks) const {
+#define REG(r) (registers + (r) * count)
+    f64* noiseScratch = REG(m_numRegisters);
+    const ui8* mask = nullptr; ///< Active positions, or null when all are
+    ui32 depth = 0;
+    for (size_t pc = 0; pc < m_code.size(); pc++) {
+        const Instruction& inst = m_code[pc];
+        switch (inst.code) {
+            case OpCode::NOISE:
+                runNoise(inst, x, y, z, count, REG(inst.dst), noiseScratch);
+                break;
+            case OpCode::SCALE: {
+                const f64* a = REG(inst.a);
+                f64* dst = REG(inst.dst);
+                for (size_t i = 0; i < count; i++) dst[i] = a[i] * inst.v0 * 0.5 + inst.v1;
+            } break;
+            case OpCode::CLAMP: {
+                const f64* a = REG(inst.a);
+                f64* dst = REG(inst.dst);
+                for (size_t i = 0; i < count; i++) dst[i] = glm::clamp(a[i], inst.v0, inst.v1);
+            } break;
+            case OpCode::CONSTANT: {
+                f64* dst = REG(inst.dst);
+                for (size_t i = 0; i < count; i++) dst[i] = inst.v0;
+            } break;
+            case OpCode::COPY:
+                memcpy(REG(inst.dst), REG(inst.a), count * sizeof(f64));
+                break;
+            case OpCode::OPERATION: {
+                const f64* a = REG(inst.a);
+                const f64* b = REG(inst.b);
+                f64* dst = REG(inst.dst);
+                // Switch outside the loop so the loop can vectorize
+                switch (inst.op) {
+                    case TerrainOp::ADD: for (size_t i = 0; i < count; i++) dst[i] = a[i] + b[i]; break;
+                    case TerrainOp::SUB: for (size_t i = 0; i < count; i++) dst[i] = a[i] - b[i]; break;
+                    case TerrainOp::MUL: for (size_t i = 0; i < count; i++) dst[i] = a[i] * b[i]; break;
+                    case TerrainOp::DIV: for (size_t i = 0; i < count; i++) dst[i] = a[i] / b[i]; break;
+                }
+            } break;
+            case OpCode::SQUARE: {
+                f64* dst = REG(inst.dst);
+                for (size_t i = 0; i < count; i++) {
+                    if (!mask || mask[i]) dst[i] = dst[i] * dst[i];
+                }
+            } break;
+            case OpCode::CUBE: {
+                f64* dst = REG(inst.dst);
+                for (size_t i = 0; i < count; i++) {
+                    if (!mask || mask[i]) dst[i] = dst[i] * dst[i] * dst[i];
+                }
+            } break;
+            case OpCode::ACCUMULATE: {
+                const f64* a = REG(inst.a);
+                if (mask) {
+                    for (size_t i = 0; i < count; i++) {
+                        if (mask[i]) heights[i] = applyOp(inst.op, heights[i], a[i]);
+                    }
+                } else {
+                    for (size_t i = 0; i < count; i++) heights[i] = applyOp(inst.op, heights[i], a[i]);
+                }
+            } break;
+            case OpCode::PUSH_MASK: {
+                const f64* a = REG(inst.a);
+                ui8* next = masks + depth * count;
+                size_t numActive = 0;
+                for (size_t i = 0; i < count; i++) {
+                    next[i] = (!mask || mask[i]) && a[i] != 0.0;
+                    numActive += next[i];
+                }
+                mask = next;
+                depth++;
+                // Skip to the POP_MASK if nothing is left
+                if (numActive == 0) pc = inst.jump - 1;
+            } break;
+            case OpCode::POP_MASK:
+                depth--;
+                mask = depth ? masks + (depth - 1) * count : nullptr;
+                break;
+        }
+    }
+#undef REG
+}
+
+void NoiseProgram::runNoise(const Instruction& inst, const f64* x, const f64* y, const f64* z, size_t count, f64* dst, f64* scratch) const {
+    f64* sx = scratch;
+    f64* sy = sx + count;
+    f64* sz = sy + count;
+    f64* n = sz + count;
+    f64* n2 = n + count;
+
+    // NOTE: Make sure this matches SphericalHeightmapGenerator::getNoiseValue
+    std::fill(dst, dst + count, 0.0);
+    f64 maxAmplitude = 0.0;
+    f64 amplitude = 1.0;
+    f64 frequency = inst.v0;
+    for (int o = 0; o < inst.octaves; o++) {
+        for (size_t i = 0; i < count; i++) {
+            sx[i] = x[i] * frequency;
+            sy[i] = y[i] * frequency;
+            sz[i] = z[i] * frequency;
+        }
+        switch (inst.stage) {
+            case TerrainStage::CUBED_NOISE:
+            case TerrainStage::SQUARED_NOISE:
+            case TerrainStage::NOISE:
+                Noise::raw(sx, sy, sz, n, count);
+                for (size_t i = 0; i < count; i++) dst[i] += n[i] * amplitude;
+                break;
+            case TerrainStage::RIDGED_NOISE:
+                Noise::raw(sx, sy, sz, n, count);
+                for (size_t i = 0; i < count; i++) dst[i] += ((1.0 - glm::abs(n[i])) * 2.0 - 1.0) * amplitude;
+                break;
+            case TerrainStage::ABS_NOISE:
+                Noise::raw(sx, sy, sz, n, count);
+                for (size_t i = 0; i < count; i++) dst[i] += glm::abs(n[i]) * amplitude;
+                break;
+            case TerrainStage::CELLULAR_NOISE:
+                Noise::cellular(sx, sy, sz, n, n2, count);
+                for (size_t i = 0; i < count; i++) dst[i] += (n2[i] - n[i]) * amplitude;
+                break;
+            case TerrainStage::CELLULAR_SQUARED_NOISE:
+                Noise::cellular(sx, sy, sz, n, n2, count);
+                for (size_t i = 0; i < count; i++) {
+                    f64 tmp = n2[i] - n[i];
+                    dst[i] += tmp * tmp * amplitude;
+                }
+                break;
+            case TerrainStage::CELLULAR_CUBED_NOISE:
+                Noise::cellular(sx, sy, sz, n, n2, count);
+                for (size_t i = 0; i < count; i++) {
+                    f64 tmp = n2[i] - n[i];
+                    dst[i] += tmp * tmp * tmp * amplitude;
+                }
+                break;
+            default:
+                break;
+        }
+        frequency *= 2.0;
+        maxAmplitude += amplitude;
+        amplitude *= inst.v1;
+    }
+    // Handle any post processes per noise
+    switch (inst.stage) {
+        case TerrainStage::CUBED_NOISE:
+            for (size_t i = 0; i < count; i++) {
+                f64 total = dst[i] / maxAmplitude;
+                dst[i] = total * total * total;
+            }
+            break;
+        case TerrainStage::SQUARED_NOISE:
+            for (size_t i = 0; i < count; i++) {
+                f64 total = dst[i] / maxAmplitude;
+                dst[i] = total * total;
+            }
+            break;
+        default:
+            for (size_t i = 0; i < count; i++) dst[i] /= maxAmplitude;
+            break;
+    }
+}
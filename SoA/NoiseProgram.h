@@ -0,0 +1,71 @@
+//
+// NoiseProgram.h
+// Seed of Andromeda
+//
+// Copyright 2014 Regrowth Studios
+// MIT License
+//
+// Summary:
+// Flattens a TerrainFuncProperties tree into a list of register
+// instructions, folding constants and clamps on the way, so that the
+// tree can be evaluated for many positions without walking it each time.
+//
+
+#pragma once
+
+#ifndef NoiseProgram_h__
+#define NoiseProgram_h__
+
+#include "Noise.h"
+
+class NoiseProgram {
+public:
+    /// Compiles funcs, replacing the current program. Evaluating gives the same
+    /// results as SphericalHeightmapGenerator::getNoiseValue with no modifier.
+    void compile(const Array<TerrainFuncProperties>& funcs);
+
+    /// Applies the noise to count heights at positions given as x, y and z arrays
+    /// @param heights: Starting values, usually NoiseBase::base. Updated in place.
+    void evaluate(const f64* x, const f64* y, const f64* z, size_t count, f64* heights) const;
+    /// Applies the noise to one height
+    void evaluate(const f64v3& pos, f64& height) const;
+
+    size_t getNumInstructions() const { return m_code.size(); }
+    ui32 getNumRegisters() const { return m_numRegisters; }
+private:
+    enum class OpCode : ui8 {
+        NOISE, ///< dst = octaves of stage noise, post processed
+        SCALE, ///< dst = a * v0 * 0.5 + v1
+        CLAMP, ///< dst = clamp(a, v0, v1)
+        CONSTANT, ///< dst = v0
+        COPY, ///< dst = a
+        OPERATION, ///< dst = a op b
+        SQUARE, ///< dst = dst * dst where active
+        CUBE, ///< dst = dst * dst * dst where active
+        ACCUMULATE, ///< height = height op a where active
+        PUSH_MASK, ///< Deactivates positions where a == 0. Jumps to the matching POP_MASK if none are left.
+        POP_MASK
+    };
+    struct Instruction {
+        OpCode code;
+        TerrainStage stage;
+        TerrainOp op;
+        ui16 dst;
+        ui16 a;
+        ui16 b;
+        i32 octaves;
+        ui32 jump;
+        f64 v0;
+        f64 v1;
+    };
+    class Compiler;
+
+    void runBlock(const f64* x, const f64* y, const f64* z, size_t count, f64* heights, f64* registers, ui8* masks) const;
+    void runNoise(const Instruction& inst, const f64* x, const f64* y, const f64* z, size_t count, f64* dst, f64* scratch) const;
+
+    std::vector<Instruction> m_code;
+    ui32 m_numRegisters = 0;
+    ui32 m_maxMaskDepth = 0;
+};
+
+#endif // NoiseProgram_h__
@@ -0,0 +1,43 @@
+//
+// NoiseSIMD.h
+// Seed of Andromeda
+//
+// Copyright 2014 Regrowth Studios
+// MIT License
+//
+// Summary:
+// SSE4.1 and AVX2 kernels behind the batched functions in Noise.h. Each
+// kernel lives in a file built for its instruction set, so only call
+// them after checking the CPU, which Noise.cpp does.
+//
+// Those files must not include stdafx.h or any other shared header. An
+// inline function they use would be compiled for their instruction set,
+// and the linker may keep that copy for the whole program. So this
+// header and NoiseSIMD.inl only use built in types.
+//
+
+#pragma once
+
+#ifndef NoiseSIMD_h__
+#define NoiseSIMD_h__
+
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define NOISE_SIMD_X86
+#endif
+
+namespace NoiseSIMD {
+    // Each kernel handles as many leading points as fit its lane width
+    // and returns how many that was. The caller does the rest.
+    // The simplex kernels take Noise::perm and Noise::grad3, since Noise.h
+    // can't be included where they are built.
+
+    size_t rawSSE41(const int* perm, const double* grad3, const double* x, const double* y, const double* z, double* result, size_t count);
+    size_t rawAVX2(const int* perm, const double* grad3, const double* x, const double* y, const double* z, double* result, size_t count);
+
+    size_t cellularSSE41(const double* x, const double* y, const double* z, double* f1, double* f2, size_t count);
+    size_t cellularAVX2(const double* x, const double* y, const double* z, double* f1, double* f2, size_t count);
+}
+
+#endif // NoiseSIMD_h__
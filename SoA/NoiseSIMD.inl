@@ -0,0 +1,220 @@
+//
+// NoiseSIMD.inl
+// Seed of Andromeda
+//
+// Copyright 2014 Regrowth Studios
+// MIT License
+//
+// Summary:
+// Lane width independent simplex and cellular noise kernels. Include
+// after defining a lane type V with the operations used below; see
+// NoiseSSE41.cpp and NoiseAVX2.cpp. The arithmetic follows the scalar
+// versions in Noise.cpp step for step, so results match them.
+//
+
+#pragma once
+
+#ifndef NoiseSIMD_inl__
+#define NoiseSIMD_inl__
+
+#include <cfloat>
+
+namespace {
+    /************************************************************************/
+    /* Simplex                                                              */
+    /************************************************************************/
+    /// perm[i] % 12 for the values in perm, which are all below 256
+    template<typename V>
+    inline typename V::I mod12(typename V::I v) {
+        // (v * 171) >> 11 == v / 12 for v < 256
+        typename V::I q = V::ishr11(V::imul(v, V::iset1(171)));
+        return V::isub(v, V::imul(q, V::iset1(12)));
+    }
+
+    /// Contribution of one simplex corner
+    template<typename V>
+    inline typename V::D simplexCorner(const double* grad, typename V::I gi, typename V::D x, typename V::D y, typename V::D z) {
+        typedef typename V::D D;
+        // Gradients are rows of 3 in grad3
+        typename V::I row = V::imul(gi, V::iset1(3));
+        D gx = V::gather(grad, row);
+        D gy = V::gather(grad + 1, row);
+        D gz = V::gather(grad + 2, row);
+
+        D t = V::sub(V::sub(V::sub(V::set1(0.6), V::mul(x, x)), V::mul(y, y)), V::mul(z, z));
+        D outside = V::lt(t, V::zero());
+        D dot = V::add(V::add(V::mul(gx, x), V::mul(gy, y)), V::mul(gz, z));
+        t = V::mul(t, t);
+        return V::andNot(outside, V::mul(V::mul(t, t), dot));
+    }
+
+    /// Hashes a corner the same way as perm[ii + i1 + perm[jj + j1 + perm[kk + k1]]] % 12
+    template<typename V>
+    inline typename V::I simplexHash(const int* perm, typename V::I ii, typename V::I jj, typename V::I kk) {
+        typename V::I h = V::igather(perm, kk);
+        h = V::igather(perm, V::iadd(jj, h));
+        h = V::igather(perm, V::iadd(ii, h));
+        return mod12<V>(h);
+    }
+
+    template<typename V>
+    inline typename V::D simplex3(const int* perm, const double* grad3, typename V::D x, typename V::D y, typename V::D z) {
+        typedef typename V::D D;
+        typedef typename V::I I;
+        const double F3 = 1.0 / 3.0;
+        const double G3 = 1.0 / 6.0;
+        const D one = V::set1(1.0);
+
+        // Skew the input space to determine which simplex cell we're in
+        D s = V::mul(V::add(V::add(x, y), z), V::set1(F3));
+        D i = V::floor(V::add(x, s));
+        D j = V::floor(V::add(y, s));
+        D k = V::floor(V::add(z, s));
+
+        D t = V::mul(V::add(V::add(i, j), k), V::set1(G3));
+        D x0 = V::sub(x, V::sub(i, t));
+        D y0 = V::sub(y, V::sub(j, t));
+        D z0 = V::sub(z, V::sub(k, t));
+
+        // Same simplex choice as the branches in Noise::raw
+        D a = V::ge(x0, y0);
+        D b = V::ge(y0, z0);
+        D c = V::ge(x0, z0);
+        D ac = V::and_(a, c);
+        D i2Mask = V::or_(a, V::and_(b, c));
+        D i1 = V::and_(ac, one);
+        D j1 = V::and_(V::andNot(a, b), one);
+        D k1 = V::andNot(V::or_(b, ac), one);
+        D i2 = V::and_(i2Mask, one);
+        D j2 = V::andNot(V::andNot(b, a), one);
+        D k2 = V::or_(V::and_(V::andNot(b, a), one), V::andNot(i2Mask, one));
+
+        D x1 = V::add(V::sub(x0, i1), V::set1(G3));
+        D y1 = V::add(V::sub(y0, j1), V::set1(G3));
+        D z1 = V::add(V::sub(z0, k1), V::set1(G3));
+        D x2 = V::add(V::sub(x0, i2), V::set1(2.0 * G3));
+        D y2 = V::add(V::sub(y0, j2), V::set1(2.0 * G3));
+        D z2 = V::add(V::sub(z0, k2), V::set1(2.0 * G3));
+        D x3 = V::add(V::sub(x0, one), V::set1(3.0 * G3));
+        D y3 = V::add(V::sub(y0, one), V::set1(3.0 * G3));
+        D z3 = V::add(V::sub(z0, one), V::set1(3.0 * G3));
+
+        // Work out the hashed gradient indices of the four simplex corners
+        const I mask = V::iset1(255);
+        I ii = V::iand(V::toInt(i), mask);
+        I jj = V::iand(V::toInt(j), mask);
+        I kk = V::iand(V::toInt(k), mask);
+        const I ione = V::iset1(1);
+        I gi0 = simplexHash<V>(perm, ii, jj, kk);
+        I gi1 = simplexHash<V>(perm, V::iadd(ii, V::toInt(i1)), V::iadd(jj, V::toInt(j1)), V::iadd(kk, V::toInt(k1)));
+        I gi2 = simplexHash<V>(perm, V::iadd(ii, V::toInt(i2)), V::iadd(jj, V::toInt(j2)), V::iadd(kk, V::toInt(k2)));
+        I gi3 = simplexHash<V>(perm, V::iadd(ii, ione), V::iadd(jj, ione), V::iadd(kk, ione));
+
+        D n0 = simplexCorner<V>(grad3, gi0, x0, y0, z0);
+        D n1 = simplexCorner<V>(grad3, gi1, x1, y1, z1);
+        D n2 = simplexCorner<V>(grad3, gi2, x2, y2, z2);
+        D n3 = simplexCorner<V>(grad3, gi3, x3, y3, z3);
+        return V::mul(V::set1(32.0), V::add(V::add(V::add(n0, n1), n2), n3));
+    }
+
+    template<typename V>
+    inline size_t simplex3Batch(const int* perm, const double* grad3, const double* x, const double* y, const double* z, double* result, size_t count) {
+        size_t i = 0;
+        for (; i + V::WIDTH <= count; i += V::WIDTH) {
+            V::store(result + i, simplex3<V>(perm, grad3, V::load(x + i), V::load(y + i), V::load(z + i)));
+        }
+        return i;
+    }
+
+    /************************************************************************/
+    /* Cellular                                                             */
+    /************************************************************************/
+    template<typename V>
+    inline typename V::D mod(typename V::D x, double y) {
+        // Same as glm::mod
+        return V::sub(x, V::mul(V::set1(y), V::floor(V::div(x, V::set1(y)))));
+    }
+    template<typename V>
+    inline typename V::D fract(typename V::D x) {
+        return V::sub(x, V::floor(x));
+    }
+    /// Permutation polynomial: (34x^2 + x) mod 289
+    template<typename V>
+    inline typename V::D permute(typename V::D x) {
+        return mod<V>(V::mul(V::add(V::mul(V::set1(34.0), x), V::set1(1.0)), x), 289.0);
+    }
+    /// Steps a cell coordinate by -1, 0 or 1 like the scalar code does
+    template<typename V>
+    inline typename V::D step(typename V::D x, int d) {
+        if (d < 0) return V::sub(x, V::set1(1.0));
+        if (d > 0) return V::add(x, V::set1(1.0));
+        return x;
+    }
+
+    template<typename V>
+    inline void cellular(typename V::D px, typename V::D py, typename V::D pz,
+                         typename V::D& outF1, typename V::D& outF2) {
+        typedef typename V::D D;
+        const double K = 0.142857142857; // 1/7
+        const double Ko = 0.428571428571; // 1/2-K/2
+        const double K2 = 0.020408163265306; // 1/(7*7)
+        const double Kz = 0.166666666667; // 1/6
+        const double Kzo = 0.416666666667; // 1/2-1/6*2
+
+        D pix = mod<V>(V::floor(px), 289.0);
+        D piy = mod<V>(V::floor(py), 289.0);
+        D piz = mod<V>(V::floor(pz), 289.0);
+        D half = V::set1(0.5);
+        D pfx = V::sub(fract<V>(px), half);
+        D pfy = V::sub(fract<V>(py), half);
+        D pfz = V::sub(fract<V>(pz), half);
+
+        // Cell offsets -1, 0, 1 pair with distance offsets 1, 0, -1
+        const double OFFSETS[3] = { 1.0, 0.0, -1.0 };
+        D dxs[3], dys[3], dzs[3];
+        for (int n = 0; n < 3; n++) {
+            dxs[n] = V::add(pfx, V::set1(OFFSETS[n]));
+            dys[n] = V::add(pfy, V::set1(OFFSETS[n]));
+            dzs[n] = V::add(pfz, V::set1(OFFSETS[n]));
+        }
+
+        D f1 = V::set1(DBL_MAX);
+        D f2 = f1;
+        for (int a = 0; a < 3; a++) {
+            D p = permute<V>(step<V>(pix, a - 1));
+            for (int b = 0; b < 3; b++) {
+                D pb = permute<V>(step<V>(V::add(p, piy), b - 1));
+                for (int c = 0; c < 3; c++) {
+                    D pc = permute<V>(step<V>(V::add(pb, piz), c - 1));
+                    D pk = V::mul(pc, V::set1(K));
+                    D ox = V::sub(fract<V>(pk), V::set1(Ko));
+                    D oy = V::sub(V::mul(mod<V>(V::floor(pk), 7.0), V::set1(K)), V::set1(Ko));
+                    D oz = V::sub(V::mul(V::floor(V::mul(pc, V::set1(K2))), V::set1(Kz)), V::set1(Kzo));
+                    D dx = V::add(dxs[a], ox);
+                    D dy = V::add(dys[b], oy);
+                    D dz = V::add(dzs[c], oz);
+                    D d = V::add(V::add(V::mul(dx, dx), V::mul(dy, dy)), V::mul(dz, dz));
+                    // Keep the two smallest distances
+                    f2 = V::min(f2, V::max(f1, d));
+                    f1 = V::min(f1, d);
+                }
+            }
+        }
+        outF1 = V::sqrt(f1);
+        outF2 = V::sqrt(f2);
+    }
+
+    template<typename V>
+    inline size_t cellularBatch(const double* x, const double* y, const double* z, double* f1, double* f2, size_t count) {
+        size_t i = 0;
+        for (; i + V::WIDTH <= count; i += V::WIDTH) {
+            typename V::D a, b;
+            cellular<V>(V::load(x + i), V::load(y + i), V::load(z + i), a, b);
+            V::store(f1 + i, a);
+            V::store(f2 + i, b);
+        }
+        return i;
+    }
+}
+
+#endif // NoiseSIMD_inl__
@@ -0,0 +1,63 @@
+#include "NoiseSIMD.h"
+
+// Built with SSE4.1 enabled, so nothing here may run before the CPU check.
+// Only built in types and intrinsics, see NoiseSIMD.h.
+#ifdef NOISE_SIMD_X86
+#include <smmintrin.h>
+
+namespace {
+    /// Two double lanes. Integer lanes are the low two ints.
+    struct LanesSSE41 {
+        typedef __m128d D;
+        typedef __m128i I;
+        static const size_t WIDTH = 2;
+
+        static D load(const double* p) { return _mm_loadu_pd(p); }
+        static void store(double* p, D v) { _mm_storeu_pd(p, v); }
+        static D set1(double v) { return _mm_set1_pd(v); }
+        static D zero() { return _mm_setzero_pd(); }
+
+        static D add(D a, D b) { return _mm_add_pd(a, b); }
+        static D sub(D a, D b) { return _mm_sub_pd(a, b); }
+        static D mul(D a, D b) { return _mm_mul_pd(a, b); }
+        static D div(D a, D b) { return _mm_div_pd(a, b); }
+        static D min(D a, D b) { return _mm_min_pd(a, b); }
+        static D max(D a, D b) { return _mm_max_pd(a, b); }
+        static D sqrt(D a) { return _mm_sqrt_pd(a); }
+        static D floor(D a) { return _mm_floor_pd(a); }
+
+        static D lt(D a, D b) { return _mm_cmplt_pd(a, b); }
+        static D ge(D a, D b) { return _mm_cmpge_pd(a, b); }
+        static D and_(D a, D b) { return _mm_and_pd(a, b); }
+        static D or_(D a, D b) { return _mm_or_pd(a, b); }
+        /// ~a & b
+        static D andNot(D a, D b) { return _mm_andnot_pd(a, b); }
+
+        static I toInt(D a) { return _mm_cvttpd_epi32(a); }
+        static I iset1(int v) { return _mm_set1_epi32(v); }
+        static I iadd(I a, I b) { return _mm_add_epi32(a, b); }
+        static I isub(I a, I b) { return _mm_sub_epi32(a, b); }
+        static I imul(I a, I b) { return _mm_mullo_epi32(a, b); }
+        static I iand(I a, I b) { return _mm_and_si128(a, b); }
+        static I ishr11(I a) { return _mm_srli_epi32(a, 11); }
+
+        // No gathers before AVX2
+        static I igather(const int* table, I index) {
+            return _mm_setr_epi32(table[_mm_cvtsi128_si32(index)], table[_mm_extract_epi32(index, 1)], 0, 0);
+        }
+        static D gather(const double* table, I index) {
+            return _mm_setr_pd(table[_mm_cvtsi128_si32(index)], table[_mm_extract_epi32(index, 1)]);
+        }
+    };
+}
+
+#include "NoiseSIMD.inl"
+
+size_t NoiseSIMD::rawSSE41(const int* perm, const double* grad3, const double* x, const double* y, const double* z, double* result, size_t count) {
+    return simplex3Batch<LanesSSE41>(perm, grad3, x, y, z, result, count);
+}
+
+size_t NoiseSIMD::cellularSSE41(const double* x, const double* y, const double* z, double* f1, double* f2, size_t count) {
+    return cellularBatch<LanesSSE41>(x, y, z, f1, f2, count);
+}
+#endif
@@ -23,6 +23,7 @@
 
 #include "Noise.h"
 #include "Biome.h"
+#include "FloraTemplateCache.h"
 
 DECL_VG(class GLProgram; class BitmapResource);
 
@@ -260,6 +261,8 @@ struct PlanetGenData {
         tempHeightFalloff(0.0f),
         humLatitudeFalloff(0.0f),
         humHeightFalloff(0.0f),
+        heightTolerance(0.0f),
+        useBiomeTiles(false),
         liquidBlock(0),
         surfaceBlock(0),
         radius(0.0)
@@ -280,6 +283,8 @@ struct PlanetGenData {
     f32 tempHeightFalloff;
     f32 humLatitudeFalloff;
     f32 humHeightFalloff;
+    f32 heightTolerance; ///< Voxel height error adaptive heightmap sampling aims for. 0 samples every column.
+    bool useBiomeTiles; ///< Interpolate child biome noise from cached tiles near the player. Can seam against far terrain.
     PlanetBlockInitInfo blockInfo;
     std::vector<BlockLayer> blockLayers;
     ui32 liquidBlock;
@@ -300,6 +305,8 @@ struct PlanetGenData {
     std::map<nString, ui32> floraMap;
     std::vector<NTreeType> trees;
     std::map<nString, ui32> treeMap;
+    /// Generated trees, filled in by FloraGenerator as they are needed
+    mutable FloraTemplateCache floraTemplates;
 
     /************************************************************************/
     /* Biomes                                                               */
@@ -100,6 +100,10 @@ CALLER_DELETE PlanetGenData* PlanetGenLoader::loadPlanetGenData(const nString& t
             genData->tempHeightFalloff = keg::convert<f32>(value);
         } else if (type == "humHeightFalloff") {
             genData->humHeightFalloff = keg::convert<f32>(value);
+        } else if (type == "heightTolerance") {
+            genData->heightTolerance = keg::convert<f32>(value);
+        } else if (type == "biomeTiles") {
+            genData->useBiomeTiles = keg::convert<bool>(value);
         } else if (type == "baseHeight") {
             parseTerrainFuncs(&genData->baseTerrainFuncs, context, value);
         } else if (type == "temperature") {
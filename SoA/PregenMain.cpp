@@ -0,0 +1,54 @@
+#include "stdafx.h"
+
+#include "Pregenerator.h"
+
+namespace {
+    void printHelp() {
+        printf(R"(
+Usage:
+soa_pregen <terrain file> <radius km> <face> <min x> <min y> <min z> <max x> <max y> <max z> [save dir] [threads]
+
+Generates terrain and flora for every chunk in the box on the face and saves
+it to <save dir>/Region. Faces are 0 top, 1 left, 2 right, 3 front, 4 back, 5 bottom.
+The save dir defaults to "Saves/Pregen" and threads to one per core.
+)");
+    }
+}
+
+// Headless entry. Generation only needs IO and threads, so no Vorb modules
+// are initialized and nothing opens a window.
+int main(int argc, char **argv) {
+    if (argc < 10) {
+        printHelp();
+        return 1;
+    }
+    nString terrainPath = argv[1];
+    f64 radius = atof(argv[2]);
+    int face = atoi(argv[3]);
+    i32v3 minChunk(atoi(argv[4]), atoi(argv[5]), atoi(argv[6]));
+    i32v3 maxChunk(atoi(argv[7]), atoi(argv[8]), atoi(argv[9]));
+    nString saveDir = argc > 10 ? argv[10] : "Saves/Pregen";
+    ui32 numThreads = argc > 11 ? (ui32)atoi(argv[11]) : 0;
+
+    if (radius <= 0.0 || face < 0 || face >= (int)FACE_NONE ||
+        maxChunk.x < minChunk.x || maxChunk.y < minChunk.y || maxChunk.z < minChunk.z) {
+        printHelp();
+        return 1;
+    }
+
+    Pregenerator pregen;
+    if (!pregen.init(terrainPath, radius, saveDir, numThreads)) {
+        pregen.dispose();
+        return 1;
+    }
+    PregenStats stats = pregen.run((WorldCubeFace)face, minChunk, maxChunk);
+    pregen.dispose();
+
+    f64 totalMs = stats.terrainMs + stats.floraMs + stats.saveMs;
+    printf("Pregenerated %zu chunks (+%zu margin) on face %d to %s/Region\n",
+           stats.numChunks, stats.numMarginChunks, face, saveDir.c_str());
+    printf("Terrain %lf ms, flora %lf ms, save %lf ms\n", stats.terrainMs, stats.floraMs, stats.saveMs);
+    printf("%.1f chunks/sec. %zu flora voxels dropped past the margin, %zu failed saves\n",
+           stats.numChunks / (totalMs / 1000.0), stats.numDroppedNodes, stats.numFailedSaves);
+    return stats.numFailedSaves ? 1 : 0;
+}
@@ -0,0 +1,228 @@
+#include "stdafx.h"
+#include "Pregenerator.h"
+
+#include <Vorb/io/IOManager.h>
+#include <Vorb/Timing.h>
+
+#include "BlockLoader.h"
+#include "Chunk.h"
+#include "FloraGenerator.h"
+#include "PlanetGenData.h"
+#include "PlanetGenLoader.h"
+#include "RegionFileManager.h"
+#include "SoaEngine.h"
+#include "VoxelNodeSetterTask.h"
+
+void PregenColumnTask::execute(WorkerData* workerData) {
+    if (isFloraPass) {
+        pregen->generateColumnFlora(workerData, column);
+    } else {
+        pregen->generateColumnTerrain(column);
+    }
+    pregen->m_numTasksDone++;
+}
+
+void PregenColumnTask::cleanup() {
+    delete this;
+}
+
+bool Pregenerator::init(const nString& terrainPath, f64 radius, const nString& saveDir, ui32 numThreads /*= 0*/) {
+    { // Blocks
+        vio::IOManager iom;
+        iom.setSearchDirectory("Data/Blocks/");
+        if (!BlockLoader::loadBlocks(iom, &m_blocks)) {
+            printf("Failed to load Data/Blocks/BlockData.yml\n");
+            return false;
+        }
+    }
+
+    { // Planet
+        vio::IOManager iom;
+        PlanetGenLoader loader;
+        loader.init(&iom);
+        m_genData = loader.loadPlanetGenData(terrainPath);
+        if (!m_genData) {
+            printf("Failed to load %s\n", terrainPath.c_str());
+            return false;
+        }
+        m_genData->radius = radius;
+        SoaEngine::initVoxelGen(m_genData, m_blocks);
+        m_proceduralGenerator.init(m_genData);
+    }
+
+    { // Save directory
+        vio::IOManager iom;
+        iom.makeDirectory(saveDir);
+        iom.makeDirectory(saveDir + "/Region");
+        m_regionFileManager = new RegionFileManager(saveDir);
+        m_regionFileManager->saveVersionFile();
+    }
+
+    // Nothing else runs here, so use every core
+    if (numThreads == 0) numThreads = glm::max(std::thread::hardware_concurrency(), 1u);
+    m_threadPool.init(numThreads);
+    return true;
+}
+
+PregenStats Pregenerator::run(WorldCubeFace face, const i32v3& minChunk, const i32v3& maxChunk) {
+    PregenStats stats;
+
+    m_boxMin = minChunk;
+    m_boxMax = maxChunk;
+    m_genMin = m_boxMin - i32v3(FLORA_MARGIN);
+    m_genMax = m_boxMax + i32v3(FLORA_MARGIN);
+    m_genSize = m_genMax - m_genMin + i32v3(1);
+    m_numDroppedNodes = 0;
+
+    m_grid.init(face, &m_threadPool, 1, m_genData, &m_allocator);
+    m_grid.blockPack = &m_blocks;
+
+    // Acquire everything up front so workers never touch the accessor
+    m_chunks.resize(m_genSize.x * m_genSize.y * m_genSize.z);
+    for (i32 y = m_genMin.y; y <= m_genMax.y; y++) {
+        for (i32 z = m_genMin.z; z <= m_genMax.z; z++) {
+            for (i32 x = m_genMin.x; x <= m_genMax.x; x++) {
+                i32v3 pos(x, y, z);
+                getChunk(pos) = m_grid.accessor.acquire(ChunkID(pos));
+            }
+        }
+    }
+    i32v3 boxSize = m_boxMax - m_boxMin + i32v3(1);
+    stats.numChunks = boxSize.x * boxSize.y * boxSize.z;
+    stats.numMarginChunks = m_chunks.size() - stats.numChunks;
+
+    // Every chunk needs its terrain before any flora can be placed in it
+    PreciseTimer timer;
+    timer.start();
+    runPass(false);
+    stats.terrainMs = timer.stop();
+    timer.start();
+    runPass(true);
+    stats.floraMs = timer.stop();
+    stats.numDroppedNodes = m_numDroppedNodes;
+
+    timer.start();
+    saveChunks(stats);
+    stats.saveMs = timer.stop();
+
+    for (auto& h : m_chunks) h.release();
+    std::vector<ChunkHandle>().swap(m_chunks);
+    m_grid.dispose();
+    return stats;
+}
+
+void Pregenerator::dispose() {
+    m_threadPool.destroy();
+    delete m_regionFileManager;
+    m_regionFileManager = nullptr;
+    delete m_genData;
+    m_genData = nullptr;
+}
+
+void Pregenerator::generateColumnTerrain(const i32v2& column) {
+    ChunkHandle& bottom = getChunk(i32v3(column.x, m_genMin.y, column.y));
+    ChunkGridData* gridData = bottom->gridData;
+    m_proceduralGenerator.generateHeightmap(bottom, gridData->heightData);
+    gridData->isLoaded = true;
+
+    for (i32 y = m_genMin.y; y <= m_genMax.y; y++) {
+        ChunkHandle& h = getChunk(i32v3(column.x, y, column.y));
+        m_proceduralGenerator.generateChunk(h, gridData->heightData);
+        h->genLevel = ChunkGenLevel::GEN_TERRAIN;
+    }
+}
+
+struct PregenFloraArrays {
+    std::vector<VoxelToPlace> fNodes;
+    std::vector<VoxelToPlace> wNodes;
+};
+
+void Pregenerator::generateColumnFlora(WorkerData* workerData, const i32v2& column) {
+    if (!workerData->floraGenerator) {
+        workerData->floraGenerator = new FloraGenerator;
+    }
+    std::vector<FloraNode>& fNodes = workerData->floraGenerator->fNodeBuffer;
+    std::vector<FloraNode>& wNodes = workerData->floraGenerator->wNodeBuffer;
+    std::map<ChunkID, PregenFloraArrays> chunkMap;
+
+    for (i32 y = m_genMin.y; y <= m_genMax.y; y++) {
+        Chunk* chunk = getChunk(i32v3(column.x, y, column.y));
+        if (chunk->floraToGenerate.empty()) continue;
+        fNodes.clear();
+        wNodes.clear();
+        workerData->floraGenerator->generateChunkFlora(chunk, chunk->gridData->heightData, fNodes, wNodes);
+
+        // Sort based on chunk to minimize locking
+        chunkMap.clear();
+        for (auto& it : fNodes) {
+            ChunkID id(chunk->getID());
+            id.x += FloraGenerator::getChunkXOffset(it.chunkOffset);
+            id.y += FloraGenerator::getChunkYOffset(it.chunkOffset);
+            id.z += FloraGenerator::getChunkZOffset(it.chunkOffset);
+            chunkMap[id].fNodes.emplace_back(it.blockID, it.blockIndex);
+        }
+        for (auto& it : wNodes) {
+            ChunkID id(chunk->getID());
+            id.x += FloraGenerator::getChunkXOffset(it.chunkOffset);
+            id.y += FloraGenerator::getChunkYOffset(it.chunkOffset);
+            id.z += FloraGenerator::getChunkZOffset(it.chunkOffset);
+            chunkMap[id].wNodes.emplace_back(it.blockID, it.blockIndex);
+        }
+
+        // Every chunk in the area already has terrain, so nodes go straight in.
+        // Nodes past the margin can't reach the box and are dropped.
+        for (auto& it : chunkMap) {
+            i32v3 pos(it.first.x, it.first.y, it.first.z);
+            if (!isInGenArea(pos)) {
+                m_numDroppedNodes += it.second.fNodes.size() + it.second.wNodes.size();
+                continue;
+            }
+            Chunk* target = getChunk(pos);
+            std::lock_guard<RWSpinLock> l(target->dataMutex);
+            VoxelNodeSetterTask::placeNodes(target, it.second.wNodes, it.second.fNodes);
+        }
+
+        std::vector<ui16>().swap(chunk->floraToGenerate);
+    }
+}
+
+void Pregenerator::runPass(bool isFloraPass) {
+    m_numTasksDone = 0;
+    size_t numTasks = 0;
+    for (i32 z = m_genMin.z; z <= m_genMax.z; z++) {
+        for (i32 x = m_genMin.x; x <= m_genMax.x; x++) {
+            PregenColumnTask* task = new PregenColumnTask;
+            task->pregen = this;
+            task->column = i32v2(x, z);
+            task->isFloraPass = isFloraPass;
+            m_threadPool.addTask(task);
+            numTasks++;
+        }
+    }
+    while (m_numTasksDone < numTasks) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+void Pregenerator::saveChunks(OUT PregenStats& stats) {
+    i32v3 regionMin(fastFloor((f32)m_boxMin.x / REGION_WIDTH), fastFloor((f32)m_boxMin.y / REGION_WIDTH), fastFloor((f32)m_boxMin.z / REGION_WIDTH));
+    i32v3 regionMax(fastFloor((f32)m_boxMax.x / REGION_WIDTH), fastFloor((f32)m_boxMax.y / REGION_WIDTH), fastFloor((f32)m_boxMax.z / REGION_WIDTH));
+    for (i32 ry = regionMin.y; ry <= regionMax.y; ry++) {
+        for (i32 rz = regionMin.z; rz <= regionMax.z; rz++) {
+            for (i32 rx = regionMin.x; rx <= regionMax.x; rx++) {
+                i32v3 start = glm::max(i32v3(rx, ry, rz) * REGION_WIDTH, m_boxMin);
+                i32v3 end = glm::min(i32v3(rx, ry, rz) * REGION_WIDTH + i32v3(REGION_WIDTH - 1), m_boxMax);
+                for (i32 y = start.y; y <= end.y; y++) {
+                    for (i32 z = start.z; z <= end.z; z++) {
+                        for (i32 x = start.x; x <= end.x; x++) {
+                            Chunk* chunk = getChunk(i32v3(x, y, z));
+                            chunk->genLevel = ChunkGenLevel::GEN_DONE;
+                            if (!m_regionFileManager->saveChunk(chunk)) stats.numFailedSaves++;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    m_regionFileManager->flush();
+}
@@ -0,0 +1,114 @@
+//
+// Pregenerator.h
+// Seed of Andromeda
+//
+// Copyright 2014 Regrowth Studios
+// MIT License
+//
+// Summary:
+// Generates a box of chunks on one face of a planet ahead of time and saves
+// them to region files, without a window or a space system. Used to bake
+// spawn regions before anyone connects.
+//
+
+#pragma once
+
+#ifndef Pregenerator_h__
+#define Pregenerator_h__
+
+#include <Vorb/IThreadPoolTask.h>
+#include <Vorb/ThreadPool.h>
+
+#include "BlockPack.h"
+#include "ChunkAllocator.h"
+#include "ChunkGrid.h"
+#include "ProceduralChunkGenerator.h"
+#include "VoxPool.h"
+
+#include <atomic>
+
+class Pregenerator;
+class RegionFileManager;
+
+#define PREGEN_TASK_ID 9
+
+/// Generates one column of the pregen box for one pass
+class PregenColumnTask : public vcore::IThreadPoolTask<WorkerData> {
+public:
+    PregenColumnTask() : vcore::IThreadPoolTask<WorkerData>(PREGEN_TASK_ID) {}
+
+    void execute(WorkerData* workerData) override;
+
+    void cleanup() override;
+
+    Pregenerator* pregen = nullptr;
+    i32v2 column; ///< x and z of the column in chunks
+    bool isFloraPass = false;
+};
+
+struct PregenStats {
+    size_t numChunks = 0; ///< Chunks generated and saved
+    size_t numMarginChunks = 0; ///< Chunks generated only for the flora that grows into the box
+    size_t numFailedSaves = 0;
+    size_t numDroppedNodes = 0; ///< Flora voxels that fell outside the margin
+    f64 terrainMs = 0.0;
+    f64 floraMs = 0.0;
+    f64 saveMs = 0.0;
+};
+
+class Pregenerator {
+    friend class PregenColumnTask;
+public:
+    /// Loads the blocks and planet and starts the workers
+    /// @param terrainPath: Path to the planet's terrain generation file
+    /// @param radius: Planet radius in KM
+    /// @param saveDir: Save directory, regions go in saveDir/Region
+    /// @param numThreads: Worker count, 0 for one per core
+    /// @return false if something failed to load
+    bool init(const nString& terrainPath, f64 radius, const nString& saveDir, ui32 numThreads = 0);
+    /// Generates terrain and flora for every chunk in [minChunk, maxChunk] and saves them.
+    /// Chunks in a margin around the box are generated too so trees rooted
+    /// outside it still grow into it, but they are not saved. Blocks until done.
+    PregenStats run(WorldCubeFace face, const i32v3& minChunk, const i32v3& maxChunk);
+    void dispose();
+
+    /// Chunks around the box that are generated for their flora
+    static const i32 FLORA_MARGIN = 1;
+private:
+    /// Generates the heightmap and terrain of every chunk in a column
+    void generateColumnTerrain(const i32v2& column);
+    /// Generates flora for every chunk in a column and places it in its target chunks
+    void generateColumnFlora(WorkerData* workerData, const i32v2& column);
+    /// Runs one task per column of the generated area and waits for them all
+    void runPass(bool isFloraPass);
+    /// Saves the box a region at a time, so region files aren't reopened
+    void saveChunks(OUT PregenStats& stats);
+
+    bool isInGenArea(const i32v3& pos) const {
+        return pos.x >= m_genMin.x && pos.y >= m_genMin.y && pos.z >= m_genMin.z &&
+               pos.x <= m_genMax.x && pos.y <= m_genMax.y && pos.z <= m_genMax.z;
+    }
+    ChunkHandle& getChunk(const i32v3& pos) {
+        i32v3 p = pos - m_genMin;
+        return m_chunks[(p.y * m_genSize.z + p.z) * m_genSize.x + p.x];
+    }
+
+    vcore::ThreadPool<WorkerData> m_threadPool;
+    PagedChunkAllocator m_allocator;
+    ChunkGrid m_grid;
+    ProceduralChunkGenerator m_proceduralGenerator;
+    BlockPack m_blocks;
+    PlanetGenData* m_genData = nullptr;
+    RegionFileManager* m_regionFileManager = nullptr; ///< Heap allocated, it holds large buffers
+
+    i32v3 m_boxMin; ///< Saved chunks
+    i32v3 m_boxMax;
+    i32v3 m_genMin; ///< Generated chunks, which is the box plus the margin
+    i32v3 m_genMax;
+    i32v3 m_genSize;
+    std::vector<ChunkHandle> m_chunks; ///< Every generated chunk, y then z then x
+    std::atomic<size_t> m_numTasksDone;
+    std::atomic<size_t> m_numDroppedNodes;
+};
+
+#endif // Pregenerator_h__
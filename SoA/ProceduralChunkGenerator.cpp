@@ -3,12 +3,15 @@
 
 #include "Chunk.h"
 #include "Constants.h"
+#include "HeightmapTileCache.h"
 #include "VoxelSpaceConversions.h"
+#include "VoxelUtils.h"
 
 #include "SmartVoxelContainer.hpp"
 
-void ProceduralChunkGenerator::init(PlanetGenData* genData) {
+void ProceduralChunkGenerator::init(PlanetGenData* genData, OPT HeightmapTileCache* heightmapCache /*= nullptr*/) {
     m_genData = genData;
+    m_heightmapCache = heightmapCache;
     m_heightGenerator.init(genData);
 }
 
@@ -35,112 +38,161 @@ void ProceduralChunkGenerator::generateChunk(Chunk* chunk, PlanetHeightData* hei
     size_t blockDataSize = 0;
     size_t tertiaryDataSize = 0;
 
-    ui16 c = 0;
+    // Chunks entirely above the surface, or below it in one block layer, are a
+    // single block, so they don't need the per voxel loops
+    int minHeight = INT_MAX;
+    int maxHeight = INT_MIN;
+    for (size_t c = 0; c < CHUNK_LAYER; ++c) {
+        mapHeight = (int)heightData[c].height;
+        minHeight = glm::min(minHeight, mapHeight);
+        maxHeight = glm::max(maxHeight, mapHeight);
+    }
+    int bottom = (int)voxPosition.pos.y;
+    int top = bottom + CHUNK_WIDTH - 1;
+    bool isUniform = false;
+    blockID = 0;
+    if (bottom - maxHeight > 1) {
+        // Above the surface and the flora on it. Liquid fills everything below 0.
+        if (top < 0 && m_genData->liquidBlock) {
+            isUniform = true;
+            blockID = (ui16)m_genData->liquidBlock;
+        } else if (bottom >= 0 || !m_genData->liquidBlock) {
+            isUniform = true;
+        }
+    } else if (top < minHeight && blockLayers.size()) {
+        ui32 layerIndex = getBlockLayerIndex(minHeight - top);
+        if (layerIndex == getBlockLayerIndex(maxHeight - bottom)) {
+            isUniform = true;
+            blockID = blockLayers[layerIndex].block;
+        }
+    }
+    if (isUniform) {
+        if (blockID != 0) chunk->numBlocks = CHUNK_SIZE;
+        blockDataArray[blockDataSize++].set(0, CHUNK_SIZE, blockID);
+        tertiaryDataArray[tertiaryDataSize++].set(0, CHUNK_SIZE, 0);
+        chunk->blocks.initFromSortedArray(vvox::VoxelStorageState::INTERVAL_TREE, blockDataArray, blockDataSize);
+        chunk->tertiary.initFromSortedArray(vvox::VoxelStorageState::INTERVAL_TREE, tertiaryDataArray, tertiaryDataSize);
+        return;
+    }
+
+    // Below the surface across several block layers. With linear storage each
+    // y slab is contiguous, so a slab that sits in one layer is a single run and
+    // only slabs crossing a layer boundary need a lookup per column.
+    if (vvox::ChunkLayout::IS_LINEAR && top < minHeight && blockLayers.size()) {
+        for (int y = 0; y < CHUNK_WIDTH; y++) {
+            height = bottom + y;
+            ui32 s = (ui32)y * CHUNK_LAYER;
+            ui32 layerIndex = getBlockLayerIndex(minHeight - height);
+            if (layerIndex == getBlockLayerIndex(maxHeight - height)) {
+                addRun(blockDataArray, blockDataSize, s, CHUNK_LAYER, blockLayers[layerIndex].block);
+            } else {
+                for (size_t c = 0; c < CHUNK_LAYER; ++c) {
+                    depth = (int)heightData[c].height - height;
+                    addRun(blockDataArray, blockDataSize, s + (ui32)c, 1, blockLayers[getBlockLayerIndex(depth)].block);
+                }
+            }
+        }
+        for (size_t i = 0; i < blockDataSize; i++) {
+            if (blockDataArray[i].data != 0) chunk->numBlocks += blockDataArray[i].length;
+        }
+        tertiaryDataArray[tertiaryDataSize++].set(0, CHUNK_SIZE, 0);
+        chunk->blocks.initFromSortedArray(vvox::VoxelStorageState::INTERVAL_TREE, blockDataArray, blockDataSize);
+        chunk->tertiary.initFromSortedArray(vvox::VoxelStorageState::INTERVAL_TREE, tertiaryDataArray, tertiaryDataSize);
+        return;
+    }
+
     bool allAir = true;
 
     ui32 layerIndices[CHUNK_LAYER];
+    ui16 bottomBlockIDs[CHUNK_LAYER];
 
     // First pass at y = 0. We separate it so we can getBlockLayerIndex a single
-    // time and cut out some comparisons.
-    for (size_t z = 0; z < CHUNK_WIDTH; ++z) {
-        for (size_t x = 0; x < CHUNK_WIDTH; ++x, ++c) {
-            tertiaryData = 0;
-
-            mapHeight = (int)heightData[c].height;
-            // TODO(Matthew): These statements weren't used, revisit this function to make sure it is behaving correctly.
-            //temperature = heightData[c].temperature;
-            //rainfall = heightData[c].humidity;
-
-            //tooSteep = (flags & TOOSTEEP) != 0;
-            
-            // TODO(Ben): Fastfloor?
-            height = (int)voxPosition.pos.y;
-            depth = mapHeight - height; // Get depth of voxel
+    // time per column and cut out some comparisons.
+    for (size_t c = 0; c < CHUNK_LAYER; ++c) {
+        mapHeight = (int)heightData[c].height;
+        // TODO(Matthew): These statements weren't used, revisit this function to make sure it is behaving correctly.
+        //temperature = heightData[c].temperature;
+        //rainfall = heightData[c].humidity;
 
-            // Determine the layer
-            if (depth < 0) {
-                layerIndices[c] = 0;
-            } else {
-                allAir = false;
-                layerIndices[c] = getBlockLayerIndex(depth);
-            }
-            BlockLayer& layer = blockLayers[layerIndices[c]];
-            // Get the block ID
-            blockID = getBlockID(chunk, c, depth, mapHeight, height, heightData[c], layer);
+        //tooSteep = (flags & TOOSTEEP) != 0;
 
-            if (blockID != 0) chunk->numBlocks++;
+        // TODO(Ben): Fastfloor?
+        height = (int)voxPosition.pos.y;
+        depth = mapHeight - height; // Get depth of voxel
 
-            // Set up the data arrays
-            if (blockDataSize == 0) {
-                blockDataArray[blockDataSize++].set(c, 1, blockID);
-                tertiaryDataArray[tertiaryDataSize++].set(c, 1, tertiaryData);
-            } else {
-                if (blockID == blockDataArray[blockDataSize - 1].data) {
-                    ++blockDataArray[blockDataSize - 1].length;
-                } else {
-                    blockDataArray[blockDataSize++].set(c, 1, blockID);
-                }
-                if (tertiaryData == tertiaryDataArray[tertiaryDataSize - 1].data) {
-                    ++tertiaryDataArray[tertiaryDataSize - 1].length;
-                } else {
-                    tertiaryDataArray[tertiaryDataSize++].set(c, 1, tertiaryData);
-                }
-            }
+        // Determine the layer
+        if (depth < 0) {
+            layerIndices[c] = 0;
+        } else {
+            allAir = false;
+            layerIndices[c] = getBlockLayerIndex(depth);
         }
+        BlockLayer& layer = blockLayers[layerIndices[c]];
+        // Get the block ID
+        bottomBlockIDs[c] = getBlockID(chunk, (int)c, depth, mapHeight, height, heightData[c], layer);
+        if (bottomBlockIDs[c] != 0) chunk->numBlocks++;
+        // Any difference means we can't take the early exit
+        if (bottomBlockIDs[c] != bottomBlockIDs[0]) allAir = false;
     }
 
     // Early exit optimization for solid air chunks
-    if (allAir && blockDataSize == 1 && tertiaryDataSize == 1) {
+    if (allAir) {
         // Set up interval trees
-        blockDataArray[0].length = CHUNK_SIZE;
-        tertiaryDataArray[0].length = CHUNK_SIZE;
+        blockDataArray[blockDataSize++].set(0, CHUNK_SIZE, bottomBlockIDs[0]);
+        tertiaryDataArray[tertiaryDataSize++].set(0, CHUNK_SIZE, 0);
         chunk->blocks.initFromSortedArray(vvox::VoxelStorageState::INTERVAL_TREE, blockDataArray, blockDataSize);
         chunk->tertiary.initFromSortedArray(vvox::VoxelStorageState::INTERVAL_TREE, tertiaryDataArray, tertiaryDataSize);
         return;
     }
 
-    // All the rest of the layers.
-    for (size_t y = 1; y < CHUNK_WIDTH; ++y) {
-        for (size_t z = 0; z < CHUNK_WIDTH; ++z) {
-            for (size_t x = 0; x < CHUNK_WIDTH; ++x, ++c) {
-                tertiaryData = 0;
-                hIndex = (c & 0x3FF); // Same as % CHUNK_LAYER
-
-                mapHeight = heightData[hIndex].height;
-                //temperature = heightData[hIndex].temperature;
-                //rainfall = heightData[hIndex].humidity;
-
-                // TODO(Ben): Fastfloor?
-                height = (int)(y + voxPosition.pos.y);
-                depth = mapHeight - height; // Get depth of voxel
-
-                // Check for going up one layer
-                ui16 layerIndex = layerIndices[hIndex];
-                if (blockLayers[layerIndex].start > (ui32)depth && layerIndex > 0) layerIndex--;
-                // Get the block ID
-                BlockLayer& layer = blockLayers[layerIndex];
-                blockID = getBlockID(chunk, c, depth, mapHeight, height, heightData[hIndex], layer);
-
-                //if (tooSteep) dh += 3; // If steep, increase depth
-
-                // TODO: Modulate dh with noise
-
-                // TODO(Ben): Check for underground
-                
-                if (blockID != 0) ++chunk->numBlocks;
-
-                // Add to the data arrays
-                if (blockID == blockDataArray[blockDataSize - 1].data) {
-                    ++blockDataArray[blockDataSize - 1].length;
-                } else {
-                    blockDataArray[blockDataSize++].set(c, 1, blockID);
-                }
-                if (tertiaryData == tertiaryDataArray[tertiaryDataSize - 1].data) {
-                    ++tertiaryDataArray[tertiaryDataSize - 1].length;
-                } else {
-                    tertiaryDataArray[tertiaryDataSize++].set(c, 1, tertiaryData);
-                }
-            }
+    // Build the intervals in storage order so they can go straight into the containers
+    for (ui32 s = 0; s < CHUNK_SIZE; ++s) {
+        i32v3 pos = vvox::ChunkLayout::getPos(s);
+        tertiaryData = 0;
+        hIndex = pos.z * CHUNK_WIDTH + pos.x;
+
+        if (pos.y == 0) {
+            blockID = bottomBlockIDs[hIndex];
+        } else {
+            mapHeight = heightData[hIndex].height;
+            //temperature = heightData[hIndex].temperature;
+            //rainfall = heightData[hIndex].humidity;
+
+            // TODO(Ben): Fastfloor?
+            height = (int)(pos.y + voxPosition.pos.y);
+            depth = mapHeight - height; // Get depth of voxel
+
+            // Check for going up one layer
+            ui16 layerIndex = layerIndices[hIndex];
+            if (blockLayers[layerIndex].start > (ui32)depth && layerIndex > 0) layerIndex--;
+            // Get the block ID
+            BlockLayer& layer = blockLayers[layerIndex];
+            blockID = getBlockID(chunk, getBlockIndexFromPos(pos), depth, mapHeight, height, heightData[hIndex], layer);
+
+            //if (tooSteep) dh += 3; // If steep, increase depth
+
+            // TODO: Modulate dh with noise
+
+            // TODO(Ben): Check for underground
+
+            if (blockID != 0) ++chunk->numBlocks;
+        }
+
+        // Add to the data arrays
+        if (blockDataSize == 0) {
+            blockDataArray[blockDataSize++].set(s, 1, blockID);
+            tertiaryDataArray[tertiaryDataSize++].set(s, 1, tertiaryData);
+            continue;
+        }
+        if (blockID == blockDataArray[blockDataSize - 1].data) {
+            ++blockDataArray[blockDataSize - 1].length;
+        } else {
+            blockDataArray[blockDataSize++].set(s, 1, blockID);
+        }
+        if (tertiaryData == tertiaryDataArray[tertiaryDataSize - 1].data) {
+            ++tertiaryDataArray[tertiaryDataSize - 1].length;
+        } else {
+            tertiaryDataArray[tertiaryDataSize++].set(s, 1, tertiaryData);
         }
     }
     // Set up interval trees
@@ -149,19 +201,33 @@ void ProceduralChunkGenerator::generateChunk(Chunk* chunk, PlanetHeightData* hei
 }
 
 void ProceduralChunkGenerator::generateHeightmap(Chunk* chunk, PlanetHeightData* heightData) const {
+    static_assert(CHUNK_WIDTH == HEIGHTMAP_TILE_WIDTH, "Chunk heightmaps must be LOD 0 tiles");
+    if (m_heightmapCache) {
+        const ChunkPosition3D& chunkPos = chunk->getChunkPosition();
+        HeightmapTileKey key;
+        key.face = chunkPos.face;
+        key.lod = 0;
+        key.pos = i32v2(chunkPos.pos.x, chunkPos.pos.z);
+        m_heightmapCache->getTile(key, heightData);
+        return;
+    }
+
     VoxelPosition3D cornerPos3D = chunk->getVoxelPosition();
     VoxelPosition2D cornerPos2D;
     cornerPos2D.pos.x = cornerPos3D.pos.x;
     cornerPos2D.pos.y = cornerPos3D.pos.z;
     cornerPos2D.face = cornerPos3D.face;
 
-    for (int z = 0; z < CHUNK_WIDTH; z++) {
-        for (int x = 0; x < CHUNK_WIDTH; x++) {
-            VoxelPosition2D pos = cornerPos2D;
-            pos.pos.x += x;
-            pos.pos.y += z;
-            m_heightGenerator.generateHeightData(heightData[z * CHUNK_WIDTH + x], pos);
-        }
+    // Whole layer at once so the noise can be batched
+    m_heightGenerator.generateHeightData(heightData, cornerPos2D, CHUNK_WIDTH);
+}
+
+// Extends the last run or starts a new one
+void ProceduralChunkGenerator::addRun(IntervalTree<ui16>::LNode* runs, size_t& numRuns, ui32 start, ui32 length, ui16 blockID) {
+    if (numRuns && runs[numRuns - 1].data == blockID) {
+        runs[numRuns - 1].length += (ui16)length;
+    } else {
+        runs[numRuns++].set(start, length, blockID);
     }
 }
 
@@ -19,20 +19,27 @@ struct PlanetGenData;
 struct PlanetHeightData;
 struct BlockLayer;
 class Chunk;
+class HeightmapTileCache;
 
 #include "SphericalHeightmapGenerator.h"
 
+#include <Vorb/voxel/IntervalTree.h>
+
 class ProceduralChunkGenerator {
 public:
-    void init(PlanetGenData* genData);
+    /// @param heightmapCache: Where heightmaps come from when set, so they are shared with terrain patches
+    void init(PlanetGenData* genData, OPT HeightmapTileCache* heightmapCache = nullptr);
     void generateChunk(Chunk* chunk, PlanetHeightData* heightData) const;
     void generateHeightmap(Chunk* chunk, PlanetHeightData* heightData) const;
 private:
     ui32 getBlockLayerIndex(ui32 depth) const;
+    /// Appends a run of blockID, merging it into the last run if it matches
+    static void addRun(IntervalTree<ui16>::LNode* runs, size_t& numRuns, ui32 start, ui32 length, ui16 blockID);
     ui16 getBlockID(Chunk* chunk, int blockIndex, int depth, int mapHeight, int height, const PlanetHeightData& hd, BlockLayer& layer) const;
 
     PlanetGenData* m_genData = nullptr;
     SphericalHeightmapGenerator m_heightGenerator;
+    HeightmapTileCache* m_heightmapCache = nullptr;
 };
 
 #endif // ProceduralChunkGenerator_h__
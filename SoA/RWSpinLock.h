@@ -0,0 +1,81 @@
+//
+// RWSpinLock.h
+// Seed of Andromeda
+//
+// Copyright 2014 Regrowth Studios
+// MIT License
+//
+// Summary:
+// Writer preferring reader/writer spin lock for short critical sections
+// such as chunk voxel data. Works with std::lock_guard, std::unique_lock
+// and std::shared_lock.
+//
+
+#pragma once
+
+#ifndef RWSpinLock_h__
+#define RWSpinLock_h__
+
+#include <atomic>
+#include <shared_mutex>
+#include <thread>
+
+#include <Vorb/types.h>
+
+class RWSpinLock {
+public:
+    RWSpinLock() : m_state(0) {}
+    RWSpinLock(const RWSpinLock&) = delete;
+    RWSpinLock& operator=(const RWSpinLock&) = delete;
+
+    /// Exclusive lock, for writers
+    void lock() {
+        ui32 spins = 0;
+        while (!try_lock()) {
+            // Stop new readers from getting in while we wait for the current ones
+            ui32 s = m_state.load(std::memory_order_relaxed);
+            if (!(s & WRITER_WAITING)) m_state.fetch_or(WRITER_WAITING, std::memory_order_relaxed);
+            backoff(spins);
+        }
+    }
+    bool try_lock() {
+        ui32 s = m_state.load(std::memory_order_relaxed);
+        // No writer and no readers. Taking the lock clears our waiting flag.
+        if (s & ~WRITER_WAITING) return false;
+        return m_state.compare_exchange_strong(s, WRITER, std::memory_order_acquire, std::memory_order_relaxed);
+    }
+    void unlock() {
+        // Keeps any waiting flag another writer set while we held the lock
+        m_state.fetch_and(~WRITER, std::memory_order_release);
+    }
+
+    /// Shared lock, for readers
+    void lock_shared() {
+        ui32 spins = 0;
+        while (!try_lock_shared()) {
+            backoff(spins);
+        }
+    }
+    bool try_lock_shared() {
+        ui32 s = m_state.load(std::memory_order_relaxed);
+        if (s & (WRITER | WRITER_WAITING)) return false;
+        return m_state.compare_exchange_weak(s, s + 1, std::memory_order_acquire, std::memory_order_relaxed);
+    }
+    void unlock_shared() {
+        m_state.fetch_sub(1, std::memory_order_release);
+    }
+private:
+    static const ui32 WRITER = 1u << 31;
+    static const ui32 WRITER_WAITING = 1u << 30;
+    static const ui32 SPINS_BEFORE_YIELD = 64;
+
+    static void backoff(ui32& spins) {
+        if (++spins > SPINS_BEFORE_YIELD) {
+            std::this_thread::yield();
+        }
+    }
+
+    std::atomic<ui32> m_state; ///< Writer bit, writer waiting bit and reader count
+};
+
+#endif // RWSpinLock_h__
@@ -22,7 +22,7 @@
 
 // TODO: Reimplement missing parts and remove VORB_UNUSED tags.
 
-// const char TAG_VOXELDATA_STR[4] = { TAG_VOXELDATA, 0, 0, 0 };
+const char TAG_VOXELDATA_STR[4] = { TAG_VOXELDATA, 0, 0, 0 };
 
 inline i32 fileTruncate(i32 fd, i64 size)
 {
@@ -201,11 +201,13 @@ void RegionFileManager::closeRegionFile(RegionFile* regionFile) {
 
     if (regionFile->file == nullptr) return;
 
-    if (_regionFile->isHeaderDirty) {
+    if (regionFile->isHeaderDirty) {
+        _regionFile = regionFile;
         saveRegionHeader();
     }
 
     fclose(regionFile->file);
+    if (_regionFile == regionFile) _regionFile = nullptr;
     delete regionFile;
 }
 
@@ -261,128 +263,128 @@ bool RegionFileManager::tryLoadChunk(Chunk* chunk VORB_UNUSED) {
 }
 
 //Saves a chunk to a region file
-bool RegionFileManager::saveChunk(Chunk* chunk VORB_UNUSED) {
+bool RegionFileManager::saveChunk(Chunk* chunk) {
 
-    ////Used for copying sectors if we need to resize the file
-    //if (_copySectorsBuffer) {
-    //    delete[] _copySectorsBuffer;
-    //    _copySectorsBuffer = nullptr;
-    //}
+    //Used for copying sectors if we need to resize the file
+    if (_copySectorsBuffer) {
+        delete[] _copySectorsBuffer;
+        _copySectorsBuffer = nullptr;
+    }
 
-    //nString regionString = getRegionString(chunk);
+    nString regionString = getRegionString(chunk);
 
-    //if (!openRegionFile(regionString, chunk->gridPosition, true)) return false;
+    if (!openRegionFile(regionString, chunk->getChunkPosition(), true)) return false;
 
-    //ui32 tableOffset;
-    //ui32 chunkSectorOffset = getChunkSectorOffset(chunk, &tableOffset);
+    ui32 tableOffset;
+    ui32 chunkSectorOffset = getChunkSectorOffset(chunk, &tableOffset);
 
-    //i32 numOldSectors;
+    i32 numOldSectors;
 
-    ////If chunkOffset is zero, then we need to add the entry
-    //if (chunkSectorOffset == 0) {
+    //If chunkOffset is zero, then we need to add the entry
+    if (chunkSectorOffset == 0) {
 
-    //    //Set the sector offset in the table
-    //    BufferUtils::setInt(_regionFile->header.lookupTable, tableOffset, _regionFile->totalSectors + 1); //we add 1 so that 0 can indicate not saved
-    //    _regionFile->isHeaderDirty = true;
-
-    //    chunkSectorOffset = _regionFile->totalSectors;
-
-    //    numOldSectors = 0;
-    //  
-    //} else {
-    //    //Convert sector offset from 1 indexed to 0 indexed
-    //    chunkSectorOffset--;
-    //    //seek to the chunk
-    //    if (!seekToChunk(chunkSectorOffset)){
-    //        pError("Region: Chunk data fseek save error BB! " + std::to_string(chunkSectorOffset));
-    //        return false;
-    //    }
+        //Set the sector offset in the table
+        BufferUtils::setInt(_regionFile->header.lookupTable, tableOffset, _regionFile->totalSectors + 1); //we add 1 so that 0 can indicate not saved
+        _regionFile->isHeaderDirty = true;
 
-    //    //Get the chunk header
-    //    if (!readChunkHeader()) return false;
-    //    ui32 oldDataLength = BufferUtils::extractInt(_chunkHeader.dataLength);
-    //    numOldSectors = sectorsFromBytes(oldDataLength + sizeof(ChunkHeader));
+        chunkSectorOffset = _regionFile->totalSectors;
 
-    //    if (numOldSectors > _regionFile->totalSectors) {
-    //        std::cout << (std::to_string(chunkSectorOffset) + " " + std::to_string(tableOffset) + "Chunk Header Corrupted\n");
-    //        return false;
-    //    }
-    //}
+        numOldSectors = 0;
+      
+    } else {
+        //Convert sector offset from 1 indexed to 0 indexed
+        chunkSectorOffset--;
+        //seek to the chunk
+        if (!seekToChunk(chunkSectorOffset)){
+            pError("Region: Chunk data fseek save error BB! " + std::to_string(chunkSectorOffset));
+            return false;
+        }
+
+        //Get the chunk header
+        if (!readChunkHeader()) return false;
+        ui32 oldDataLength = BufferUtils::extractInt(_chunkHeader.dataLength);
+        numOldSectors = sectorsFromBytes(oldDataLength + sizeof(ChunkHeader));
+
+        if (numOldSectors > _regionFile->totalSectors) {
+            std::cout << (std::to_string(chunkSectorOffset) + " " + std::to_string(tableOffset) + "Chunk Header Corrupted\n");
+            return false;
+        }
+    }
 
-    ////Compress the chunk data
-    //rleCompressChunk(chunk);
-    //zlibCompress();
+    //Compress the chunk data
+    if (!rleCompressChunk(chunk)) return false;
+    if (!zlibCompress()) return false;
 
-    //i32 numSectors = sectorsFromBytes(_compressedBufferSize);
-    //i32 sectorDiff = numSectors - numOldSectors;
+    i32 numSectors = sectorsFromBytes(_compressedBufferSize);
+    i32 sectorDiff = numSectors - numOldSectors;
 
-    ////If we need to resize the number of sectors in the file and this chunk is not at the end of file,
-    ////then we should copy all sectors at the end of the file so we can resize it. This operation should be
-    ////fairly rare.
-    //if ((sectorDiff != 0) && ((chunkSectorOffset + numOldSectors) != _regionFile->totalSectors)) {
-    //    if (!seekToChunk(chunkSectorOffset + numOldSectors)){
-    //        pError("Region: Failed to seek for sectorCopy " + std::to_string(chunkSectorOffset) + " " + std::to_string(numOldSectors) + " " + std::to_string(_regionFile->totalSectors));
-    //        return false;
-    //    }
+    //If we need to resize the number of sectors in the file and this chunk is not at the end of file,
+    //then we should copy all sectors at the end of the file so we can resize it. This operation should be
+    //fairly rare.
+    if ((sectorDiff != 0) && ((chunkSectorOffset + numOldSectors) != _regionFile->totalSectors)) {
+        if (!seekToChunk(chunkSectorOffset + numOldSectors)){
+            pError("Region: Failed to seek for sectorCopy " + std::to_string(chunkSectorOffset) + " " + std::to_string(numOldSectors) + " " + std::to_string(_regionFile->totalSectors));
+            return false;
+        }
 
-    //    _copySectorsBufferSize = (_regionFile->totalSectors - (chunkSectorOffset + numOldSectors)) * SECTOR_SIZE;
-    //    _copySectorsBuffer = new ui8[_copySectorsBufferSize]; //for storing all the data that will need to be copied in the end
-    //   
-    //    readSectors(_copySectorsBuffer, _copySectorsBufferSize);
-    //}
+        _copySectorsBufferSize = (_regionFile->totalSectors - (chunkSectorOffset + numOldSectors)) * SECTOR_SIZE;
+        _copySectorsBuffer = new ui8[_copySectorsBufferSize]; //for storing all the data that will need to be copied in the end
+       
+        readSectors(_copySectorsBuffer, _copySectorsBufferSize);
+    }
 
-    ////Set the header data
-    //BufferUtils::setInt(_chunkHeader.compression, COMPRESSION_RLE | COMPRESSION_ZLIB);
-    //BufferUtils::setInt(_chunkHeader.timeStamp, 0);
-    //BufferUtils::setInt(_chunkHeader.dataLength, _compressedBufferSize - sizeof(ChunkHeader));
+    //Set the header data
+    BufferUtils::setInt(_chunkHeader.compression, COMPRESSION_RLE | COMPRESSION_ZLIB);
+    BufferUtils::setInt(_chunkHeader.timeStamp, 0);
+    BufferUtils::setInt(_chunkHeader.dataLength, _compressedBufferSize - sizeof(ChunkHeader));
 
-    ////Copy the header data to the write buffer
-    //memcpy(_compressedByteBuffer, &_chunkHeader, sizeof(ChunkHeader));
+    //Copy the header data to the write buffer
+    memcpy(_compressedByteBuffer, &_chunkHeader, sizeof(ChunkHeader));
 
-    ////seek to the chunk
-    //if (!seekToChunk(chunkSectorOffset)){
-    //    pError("Region: Chunk data fseek save error GG! " + std::to_string(chunkSectorOffset));
-    //    return false;
-    //}
+    //seek to the chunk
+    if (!seekToChunk(chunkSectorOffset)){
+        pError("Region: Chunk data fseek save error GG! " + std::to_string(chunkSectorOffset));
+        return false;
+    }
 
-    ////Write the header and data
-    //writeSectors(_compressedByteBuffer, (ui32)_compressedBufferSize);
+    //Write the header and data
+    writeSectors(_compressedByteBuffer, (ui32)_compressedBufferSize);
 
-    ////Keep track of total sectors in file so we can infer filesize
-    //_regionFile->totalSectors += sectorDiff;
+    //Keep track of total sectors in file so we can infer filesize
+    _regionFile->totalSectors += sectorDiff;
 
-    ////If we need to move some sectors around
-    //if (_copySectorsBuffer) {
+    //If we need to move some sectors around
+    if (_copySectorsBuffer) {
    
-    //    if (!seekToChunk(chunkSectorOffset + numSectors)){
-    //        pError("Region: Chunk data fseek save error GG! " + std::to_string(chunkSectorOffset));
-    //        return false;
-    //    }
-    //    //Write the buffer of sectors
-    //    writeSectors(_copySectorsBuffer, _copySectorsBufferSize);
-    //    delete[] _copySectorsBuffer;
-    //    _copySectorsBuffer = nullptr;
-
-    //    //if the file got smaller
-    //    if (sectorDiff < 0){
-    //        //truncate the file
-    //        if (fileTruncate(_regionFile->fileDescriptor, sizeof(RegionFileHeader)+_regionFile->totalSectors * SECTOR_SIZE) != 0) {
-    //            perror("Region file: Truncate error!\n");
-    //        }
-    //    }
+        if (!seekToChunk(chunkSectorOffset + numSectors)){
+            pError("Region: Chunk data fseek save error GG! " + std::to_string(chunkSectorOffset));
+            return false;
+        }
+        //Write the buffer of sectors
+        writeSectors(_copySectorsBuffer, _copySectorsBufferSize);
+        delete[] _copySectorsBuffer;
+        _copySectorsBuffer = nullptr;
 
-    //    //Update the table
-    //    ui32 nextChunkSectorOffset;
-    //    for (int i = 0; i < REGION_SIZE * 4; i += 4){
-    //        nextChunkSectorOffset = BufferUtils::extractInt(_regionFile->header.lookupTable, i);
-    //        //See if the 1 indexed nextChunkSectorOffset is > the 0 indexed chunkSectorOffset
-    //        if (nextChunkSectorOffset > (chunkSectorOffset + 1)){ 
-    //            BufferUtils::setInt(_regionFile->header.lookupTable, i, nextChunkSectorOffset + sectorDiff);
-    //        } 
-    //    }
-    //    _regionFile->isHeaderDirty = true;
-    //}
-    //fflush(_regionFile->file);
+        //if the file got smaller
+        if (sectorDiff < 0){
+            //truncate the file
+            if (fileTruncate(_regionFile->fileDescriptor, sizeof(RegionFileHeader)+_regionFile->totalSectors * SECTOR_SIZE) != 0) {
+                perror("Region file: Truncate error!\n");
+            }
+        }
+
+        //Update the table
+        ui32 nextChunkSectorOffset;
+        for (int i = 0; i < REGION_SIZE * 4; i += 4){
+            nextChunkSectorOffset = BufferUtils::extractInt(_regionFile->header.lookupTable, i);
+            //See if the 1 indexed nextChunkSectorOffset is > the 0 indexed chunkSectorOffset
+            if (nextChunkSectorOffset > (chunkSectorOffset + 1)){ 
+                BufferUtils::setInt(_regionFile->header.lookupTable, i, nextChunkSectorOffset + sectorDiff);
+            } 
+        }
+        _regionFile->isHeaderDirty = true;
+    }
+    fflush(_regionFile->file);
     return true;
 }
 
@@ -452,7 +454,7 @@ bool RegionFileManager::readChunkData_v0() {
         return false;
     }
 
-    _chunkBufferSize = CHUNK_DATA_SIZE + CHUNK_SIZE * 2;
+    _chunkBufferSize = sizeof(_chunkBuffer);
     int zresult = uncompress(_chunkBuffer, &_chunkBufferSize, _compressedByteBuffer, dataLength);
 
     return (!checkZlibError("decompression", zresult));
@@ -740,65 +742,30 @@ void RegionFileManager::rleCompressArray(ui16* data, int jStart, int jMult, int
     tot += count;
 }
 
-bool RegionFileManager::rleCompressChunk(Chunk* chunk VORB_UNUSED) {
+bool RegionFileManager::rleCompressChunk(Chunk* chunk) {
 
-    // TODO(Ben): Fix
-
-    //ui16* blockIDData;
-    //ui8* sunlightData;
-    //ui16* lampLightData;
-    //ui16* tertiaryData;
-
-    ////Need to lock so that nobody modifies the interval tree out from under us
-    //chunk->lock();
-    //if (chunk->_blockIDContainer.getState() == vvox::VoxelStorageState::INTERVAL_TREE) {
-    //    blockIDData = _blockIDBuffer;
-    //    chunk->_blockIDContainer.uncompressIntoBuffer(blockIDData);
-    //} else {
-    //    blockIDData = chunk->_blockIDContainer.getDataArray();
-    //}
-    //if (chunk->_lampLightContainer.getState() == vvox::VoxelStorageState::INTERVAL_TREE) {
-    //    lampLightData = _lampLightBuffer;
-    //    chunk->_lampLightContainer.uncompressIntoBuffer(lampLightData);
-    //} else {
-    //    lampLightData = chunk->_lampLightContainer.getDataArray();
-    //}
-    //if (chunk->_sunlightContainer.getState() == vvox::VoxelStorageState::INTERVAL_TREE) {
-    //    sunlightData = _sunlightBuffer;
-    //    chunk->_sunlightContainer.uncompressIntoBuffer(sunlightData);
-    //} else {
-    //    sunlightData = chunk->_sunlightContainer.getDataArray();
-    //}
-    //if (chunk->_tertiaryDataContainer.getState() == vvox::VoxelStorageState::INTERVAL_TREE) {
-    //    tertiaryData = _tertiaryDataBuffer;
-    //    chunk->_tertiaryDataContainer.uncompressIntoBuffer(tertiaryData);
-    //} else {
-    //    tertiaryData = chunk->_tertiaryDataContainer.getDataArray();
-    //}
-    //chunk->unlock();
-
-    //_bufferSize = 0;
+    // Copy out under the read lock so nobody modifies the data out from under us
+    {
+        std::shared_lock<RWSpinLock> l(chunk->dataMutex);
+        chunk->blocks.copyRange(0, CHUNK_SIZE, _blockIDBuffer);
+        chunk->tertiary.copyRange(0, CHUNK_SIZE, _tertiaryDataBuffer);
+    }
 
-    //// Set the tag
-    //memcpy(_chunkBuffer, TAG_VOXELDATA_STR, 4);
-    //_bufferSize += 4;
+    _bufferSize = 0;
 
-    //int jStart, jEnd, jInc;
-    //int kStart, kEnd, kInc;
-    //int jMult, kMult;
+    // Set the tag
+    memcpy(_chunkBuffer, TAG_VOXELDATA_STR, 4);
+    _bufferSize += 4;
 
-    //chunk->voxelMapData->getIterationConstants(jStart, jMult, jEnd, jInc, kStart, kMult, kEnd, kInc);
-
-    //rleCompressArray(blockIDData, jStart, jMult, jEnd, jInc, kStart, kMult, kEnd, kInc);
-    //rleCompressArray(lampLightData, jStart, jMult, jEnd, jInc, kStart, kMult, kEnd, kInc);
-    //rleCompressArray(sunlightData, jStart, jMult, jEnd, jInc, kStart, kMult, kEnd, kInc);
-    //rleCompressArray(tertiaryData, jStart, jMult, jEnd, jInc, kStart, kMult, kEnd, kInc);
+    // Block data is stored y, z, x on every face, so there is no face specific iteration order
+    rleCompressArray(_blockIDBuffer, 0, CHUNK_WIDTH, CHUNK_WIDTH, 1, 0, 1, CHUNK_WIDTH, 1);
+    rleCompressArray(_tertiaryDataBuffer, 0, CHUNK_WIDTH, CHUNK_WIDTH, 1, 0, 1, CHUNK_WIDTH, 1);
 
     return true;
 }
 
 bool RegionFileManager::zlibCompress() {
-    _compressedBufferSize = CHUNK_DATA_SIZE + CHUNK_SIZE * 2;
+    _compressedBufferSize = sizeof(_compressedByteBuffer) - sizeof(ChunkHeader);
     //Compress the data, and leave space for the uncompressed chunk header
     int zresult = compress2(_compressedByteBuffer + sizeof(ChunkHeader), &_compressedBufferSize, _chunkBuffer, _bufferSize, 6);
     _compressedBufferSize += sizeof(ChunkHeader);
@@ -846,32 +813,32 @@ bool RegionFileManager::seekToChunk(ui32 chunkSectorOffset) {
     return seek(sizeof(RegionFileHeader) + chunkSectorOffset * SECTOR_SIZE);
 }
 
-ui32 RegionFileManager::getChunkSectorOffset(Chunk* chunk VORB_UNUSED, ui32* retTableOffset VORB_UNUSED) {
+ui32 RegionFileManager::getChunkSectorOffset(Chunk* chunk, ui32* retTableOffset) {
     
-    //const ChunkPosition3D& gridPos = chunk->gridPosition;
+    const ChunkPosition3D& gridPos = chunk->getChunkPosition();
 
-    //int x = gridPos.pos.x % REGION_WIDTH;
-    //int y = gridPos.pos.y % REGION_WIDTH;
-    //int z = gridPos.pos.z % REGION_WIDTH;
+    int x = gridPos.pos.x % REGION_WIDTH;
+    int y = gridPos.pos.y % REGION_WIDTH;
+    int z = gridPos.pos.z % REGION_WIDTH;
 
-    ////modulus is weird in c++ for negative numbers
-    //if (x < 0) x += REGION_WIDTH;
-    //if (y < 0) y += REGION_WIDTH;
-    //if (z < 0) z += REGION_WIDTH;
-    //ui32 tableOffset = 4 * (x + z * REGION_WIDTH + y * REGION_LAYER);
+    //modulus is weird in c++ for negative numbers
+    if (x < 0) x += REGION_WIDTH;
+    if (y < 0) y += REGION_WIDTH;
+    if (z < 0) z += REGION_WIDTH;
+    ui32 tableOffset = 4 * (x + z * REGION_WIDTH + y * REGION_LAYER);
 
-    ////If the caller asked for the table offset, return it
-    //if (retTableOffset) *retTableOffset = tableOffset;
+    //If the caller asked for the table offset, return it
+    if (retTableOffset) *retTableOffset = tableOffset;
 
-    //return BufferUtils::extractInt(_regionFile->header.lookupTable, tableOffset);
-    return 0;
+    return BufferUtils::extractInt(_regionFile->header.lookupTable, tableOffset);
 }
 
 nString RegionFileManager::getRegionString(Chunk *ch)
 {
     const ChunkPosition3D& gridPos = ch->getChunkPosition();
 
-    return "r." + std::to_string(fastFloor((float)gridPos.pos.x / REGION_WIDTH)) + "."
+    // Each cube face has its own chunk grid, so regions must be per face
+    return "f" + std::to_string((int)gridPos.face) + ".r." + std::to_string(fastFloor((float)gridPos.pos.x / REGION_WIDTH)) + "."
         + std::to_string(fastFloor((float)gridPos.pos.y / REGION_WIDTH)) + "."
         + std::to_string(fastFloor((float)gridPos.pos.z / REGION_WIDTH));
 }
\ No newline at end of file
@@ -24,6 +24,8 @@
 #define CURRENT_REGION_VER REGION_VER_0
 
 #define CHUNK_DATA_SIZE (CHUNK_SIZE * 4) //right now a voxel is 4 bytes
+//Worst case RLE of the block ID and tertiary arrays, plus the section tag
+#define CHUNK_RLE_BUFFER_SIZE (CHUNK_SIZE * 8 + 4)
 
 #define COMPRESSION_RLE 0x1
 #define COMPRESSION_ZLIB 0x10
@@ -106,18 +108,18 @@ class RegionFileManager {
     
     //Byte buffer for reading chunk data
     ui32 _bufferSize;
-    ui8 _chunkBuffer[CHUNK_DATA_SIZE];
-    //Byte buffer for compressed data. It is slightly larger because of worst case with RLE
+    ui8 _chunkBuffer[CHUNK_RLE_BUFFER_SIZE];
+    //Byte buffer for compressed data. It is slightly larger because zlib can grow incompressible data
     uLongf _compressedBufferSize;
-    ui8 _compressedByteBuffer[CHUNK_DATA_SIZE + CHUNK_SIZE * 4 + sizeof(ChunkHeader)];
+    ui8 _compressedByteBuffer[CHUNK_RLE_BUFFER_SIZE + CHUNK_SIZE + sizeof(ChunkHeader)];
     //Dynamic byte buffer used in copying contents of a file for resize
-//    ui32 _copySectorsBufferSize;
+    ui32 _copySectorsBufferSize;
     ui8* _copySectorsBuffer;
 
-//    ui16 _blockIDBuffer[CHUNK_SIZE];
+    ui16 _blockIDBuffer[CHUNK_SIZE];
 //    ui8 _sunlightBuffer[CHUNK_SIZE];
 //    ui16 _lampLightBuffer[CHUNK_SIZE];
-//    ui16 _tertiaryDataBuffer[CHUNK_SIZE];
+    ui16 _tertiaryDataBuffer[CHUNK_SIZE];
 
 //    ui8 _chunkHeaderBuffer[sizeof(ChunkHeader)];
 //    ui8 _regionFileHeaderBuffer[sizeof(RegionFileHeader)];
@@ -15,15 +15,20 @@
 #ifndef SmartVoxelContainer_h__
 #define SmartVoxelContainer_h__
 
+#include <algorithm>
+#include <atomic>
 #include <mutex>
+#include <vector>
 
 #include "Constants.h"
+#include "VoxelLayout.h"
 
 #include <Vorb/FixedSizeArrayRecycler.hpp>
 #include <Vorb/voxel/IntervalTree.h>
 
 #define QUIET_FRAMES_UNTIL_COMPRESS 60
 #define ACCESS_COUNT_UNTIL_DECOMPRESS 5
+#define MAX_PALETTE_SIZE 256 ///< Palettes larger than this fall back to other states
 
 // TODO(Cristian): We'll see how to fit it into Vorb
 namespace vorb {
@@ -68,7 +73,8 @@ namespace vorb {
 
         enum class VoxelStorageState {
             FLAT_ARRAY = 0,
-            INTERVAL_TREE = 1
+            INTERVAL_TREE = 1,
+            PALETTE = 2 ///< Per container palette with 1, 2, 4 or 8 bit packed indices
         };
 
         template <typename T, size_t SIZE = CHUNK_SIZE>
@@ -111,17 +117,23 @@ namespace vorb {
             }
 
             /// Creates the tree using a sorted array of data. 
-            /// The number of voxels should add up to CHUNK_SIZE
+            /// The number of voxels should add up to CHUNK_SIZE.
+            /// Intervals are in storage order, see ChunkLayout.
             /// @param state: Initial state of the container
             /// @param data: The sorted array used to populate the container
             inline void initFromSortedArray(VoxelStorageState state,
                                             const std::vector <typename IntervalTree<T>::LNode>& data) {
                 _state = state;
-                _accessCount = 0;
-                _quietFrames = 0;
+                _accessCount.store(0, std::memory_order_relaxed);
+                _quietFrames.store(0, std::memory_order_relaxed);
                 if (_state == VoxelStorageState::INTERVAL_TREE) {
                     _dataTree.initFromSortedArray(data);
                     _dataTree.checkTreeValidity();
+                } else if (_state == VoxelStorageState::PALETTE) {
+                    if (!initPaletteFromSortedArray(data.data(), data.size())) {
+                        _state = VoxelStorageState::INTERVAL_TREE;
+                        _dataTree.initFromSortedArray(data);
+                    }
                 } else {
                     _dataArray = _arrayRecycler->create();
                     int index = 0;
@@ -135,11 +147,16 @@ namespace vorb {
             inline void initFromSortedArray(VoxelStorageState state,
                                             const typename IntervalTree<T>::LNode data[], size_t size) {
                 _state = state;
-                _accessCount = 0;
-                _quietFrames = 0;
+                _accessCount.store(0, std::memory_order_relaxed);
+                _quietFrames.store(0, std::memory_order_relaxed);
                 if (_state == VoxelStorageState::INTERVAL_TREE) {
                     _dataTree.initFromSortedArray(data, size);
                     _dataTree.checkTreeValidity();
+                } else if (_state == VoxelStorageState::PALETTE) {
+                    if (!initPaletteFromSortedArray(data, size)) {
+                        _state = VoxelStorageState::INTERVAL_TREE;
+                        _dataTree.initFromSortedArray(data, size);
+                    }
                 } else {
                     _dataArray = _arrayRecycler->create();
                     int index = 0;
@@ -151,58 +168,94 @@ namespace vorb {
                 }
             }
 
-            inline void changeState(VoxelStorageState newState, std::mutex& dataLock) {
+            template <typename Lock>
+            inline void changeState(VoxelStorageState newState, Lock& dataLock) {
                 if (newState == _state) return;
-                if (newState == VoxelStorageState::INTERVAL_TREE) {
-                    compress(dataLock);
-                } else {
+                // Compressed states convert through the flat array
+                if (_state != VoxelStorageState::FLAT_ARRAY) {
                     uncompress(dataLock);
                 }
-                _quietFrames = 0;
-                _accessCount = 0;
+                if (newState != VoxelStorageState::FLAT_ARRAY) {
+                    compress(dataLock, newState);
+                }
+                _quietFrames.store(0, std::memory_order_relaxed);
+                _accessCount.store(0, std::memory_order_relaxed);
             }
 
             /// Updates the container. Call once per frame
-            /// @param dataLock: The mutex that guards the data
-            inline void update(std::mutex& dataLock) {
+            /// @param dataLock: The lock that guards the data
+            template <typename Lock>
+            inline void update(Lock& dataLock) {
+                // Check if we should compress the data. compress() picks
+                // between the interval tree and the palette.
+                if (updateHeat(dataLock) && totalContainerCompressions <= MAX_COMPRESSIONS_PER_FRAME) {
+                    compress(dataLock);
+                }
+            }
+            /// Updates access heat and uncompresses the container if it is hot,
+            /// but leaves compression to the caller. Call once per frame.
+            /// @param dataLock: The lock that guards the data. Needs lock_shared().
+            /// @return true if the container is cold and can be compressed
+            template <typename Lock>
+            inline bool updateHeat(Lock& dataLock) {
                 // If access count is higher than the threshold, this is not a quiet frame
-                if (_accessCount >= ACCESS_COUNT_UNTIL_DECOMPRESS) {
-                    _quietFrames = 0;
-                } else {
-                    _quietFrames++;
+                int quietFrames = 0;
+                if (_accessCount.exchange(0, std::memory_order_relaxed) < ACCESS_COUNT_UNTIL_DECOMPRESS) {
+                    quietFrames = _quietFrames.load(std::memory_order_relaxed) + 1;
                 }
+                _quietFrames.store(quietFrames, std::memory_order_relaxed);
 
-                if (_state == VoxelStorageState::INTERVAL_TREE) {
+                // Workers change the state under the lock
+                dataLock.lock_shared();
+                VoxelStorageState state = _state;
+                dataLock.unlock_shared();
+                if (state != VoxelStorageState::FLAT_ARRAY) {
                     // Check if we should uncompress the data
-                    if (_quietFrames == 0) {
+                    if (quietFrames == 0) {
                         uncompress(dataLock);
                     }
-                } else {
-                    // Check if we should compress the data
-                    if (_quietFrames >= QUIET_FRAMES_UNTIL_COMPRESS && totalContainerCompressions <= MAX_COMPRESSIONS_PER_FRAME) {
-                        compress(dataLock);
-                    }
+                    return false;
                 }
-                _accessCount = 0;
+                return quietFrames >= QUIET_FRAMES_UNTIL_COMPRESS;
+            }
+            /// Compresses the container if it is still flat and has stayed quiet.
+            /// Safe to call from any thread.
+            /// @param dataLock: The lock that guards the data
+            /// @return true if the container was compressed
+            template <typename Lock>
+            inline bool tryCompress(Lock& dataLock) {
+                // It may have heated up since it was scheduled
+                if (_quietFrames.load(std::memory_order_relaxed) < QUIET_FRAMES_UNTIL_COMPRESS) return false;
+                return compress(dataLock);
             }
 
             /// Clears the container and frees memory
             inline void clear() {
-                _accessCount = 0;
-                _quietFrames = 0;
+                _accessCount.store(0, std::memory_order_relaxed);
+                _quietFrames.store(0, std::memory_order_relaxed);
                 if (_state == VoxelStorageState::INTERVAL_TREE) {
                     _dataTree.clear();
+                } else if (_state == VoxelStorageState::PALETTE) {
+                    clearPalette();
                 } else if (_dataArray) {
                     _arrayRecycler->recycle(_dataArray);
                     _dataArray = nullptr;
                 }
             }
 
-            /// Uncompressed the interval tree into a buffer.
-            /// May only be called when getState() == VoxelStorageState::INTERVAL_TREE
+            /// Uncompresses the interval tree or palette into a buffer, in storage order.
+            /// May only be called when getState() != VoxelStorageState::FLAT_ARRAY
             /// or you will get a null access violation.
             /// @param buffer: Buffer of memory to store the result
-            inline void uncompressIntoBuffer(T* buffer) { _dataTree.uncompressIntoBuffer(buffer); }
+            inline void uncompressIntoBuffer(T* buffer) {
+                if (_state == VoxelStorageState::PALETTE) {
+                    for (size_t i = 0; i < SIZE; i++) {
+                        buffer[i] = _palette[readPaletteIndex(i)];
+                    }
+                } else {
+                    _dataTree.uncompressIntoBuffer(buffer);
+                }
+            }
 
             /// Getters
             const VoxelStorageState& getState() const {
@@ -220,6 +273,26 @@ namespace vorb {
             const IntervalTree<T>& getTree() const {
                 return _dataTree;
             }
+            const std::vector<T>& getPalette() const {
+                return _palette;
+            }
+            const ui32& getPaletteBits() const {
+                return _paletteBits;
+            }
+            int getQuietFrames() const {
+                return _quietFrames.load(std::memory_order_relaxed);
+            }
+            /// @return Approximate number of bytes of voxel data held by the container
+            size_t getMemoryUsage() const {
+                switch (_state) {
+                    case VoxelStorageState::INTERVAL_TREE:
+                        return _dataTree.size() * sizeof(typename IntervalTree<T>::Node);
+                    case VoxelStorageState::PALETTE:
+                        return _paletteIndices.size() * sizeof(ui32) + _palette.size() * sizeof(T);
+                    default:
+                        return _dataArray ? SIZE * sizeof(T) : 0;
+                }
+            }
 
             /// Gets the element at index
             /// @param index: must be (0, SIZE]
@@ -231,41 +304,409 @@ namespace vorb {
             /// @param index: must be (0, SIZE]
             /// @param value: The value to set at index
             inline void set(size_t index, T value) {
-                _accessCount++;
+                _accessCount.fetch_add(1, std::memory_order_relaxed);
                 (setters[(size_t)_state])(this, index, value);
             }
+
+            /************************************************************************/
+            /* Bulk access                                                          */
+            /************************************************************************/
+            /// Calls f(start, length, value) for each run of equal values.
+            /// start is a storage index, see ChunkLayout. Runs are visited in
+            /// storage order, except in the INTERVAL_TREE state where they
+            /// are visited in tree node order.
+            template<typename F>
+            inline void forEachRun(F f) const {
+                switch (_state) {
+                    case VoxelStorageState::INTERVAL_TREE:
+                        for (size_t i = 0; i < _dataTree.size(); i++) {
+                            f((size_t)_dataTree[i].getStart(), (size_t)_dataTree[i].length, _dataTree[i].data);
+                        }
+                        break;
+                    case VoxelStorageState::PALETTE: {
+                        size_t start = 0;
+                        ui32 p = readPaletteIndex(0);
+                        for (size_t i = 1; i < SIZE; i++) {
+                            ui32 p2 = readPaletteIndex(i);
+                            if (p2 != p) {
+                                f(start, i - start, _palette[p]);
+                                start = i;
+                                p = p2;
+                            }
+                        }
+                        f(start, SIZE - start, _palette[p]);
+                        break;
+                    }
+                    default: {
+                        size_t start = 0;
+                        for (size_t i = 1; i < SIZE; i++) {
+                            if (!(_dataArray[i] == _dataArray[start])) {
+                                f(start, i - start, _dataArray[start]);
+                                start = i;
+                            }
+                        }
+                        f(start, SIZE - start, _dataArray[start]);
+                        break;
+                    }
+                }
+            }
+            /// Copies the elements in [begin, end) to out
+            /// @param out: Must have room for end - begin elements
+            inline void copyRange(size_t begin, size_t end, T* out) const {
+                if (!ChunkLayout::IS_LINEAR) {
+                    gatherRange(begin, end, out);
+                    return;
+                }
+                switch (_state) {
+                    case VoxelStorageState::INTERVAL_TREE:
+                        // One pass over the tree instead of a lookup per element
+                        for (size_t i = 0; i < _dataTree.size(); i++) {
+                            size_t s = std::max((size_t)_dataTree[i].getStart(), begin);
+                            size_t e = std::min((size_t)_dataTree[i].getStart() + _dataTree[i].length, end);
+                            if (s < e) std::fill(out + (s - begin), out + (e - begin), _dataTree[i].data);
+                        }
+                        break;
+                    case VoxelStorageState::PALETTE:
+                        for (size_t i = begin; i < end; i++) {
+                            *out++ = _palette[readPaletteIndex(i)];
+                        }
+                        break;
+                    default:
+                        std::copy(_dataArray + begin, _dataArray + end, out);
+                        break;
+                }
+            }
+            /// Copies the CHUNK_LAYER elements of layer y to out
+            inline void copyLayer(size_t y, T* out) const {
+                copyRange(y * CHUNK_LAYER, (y + 1) * CHUNK_LAYER, out);
+            }
+            /// Copies the box [min, max) to out in y, z, x order
+            /// @param out: Must have room for the volume of the box
+            inline void copyBox(const i32v3& min, const i32v3& max, T* out) const {
+                const size_t sizeX = max.x - min.x;
+                const size_t sizeZ = max.z - min.z;
+                switch (_state) {
+                    case VoxelStorageState::INTERVAL_TREE:
+                        if (!ChunkLayout::IS_LINEAR) {
+                            // Nodes aren't made of rows, so place each voxel
+                            for (size_t i = 0; i < _dataTree.size(); i++) {
+                                const auto& node = _dataTree[i];
+                                size_t end = (size_t)node.getStart() + node.length;
+                                for (size_t s = node.getStart(); s < end; s++) {
+                                    i32v3 p = ChunkLayout::getPos((ui32)s);
+                                    if (p.x >= min.x && p.x < max.x && p.y >= min.y && p.y < max.y && p.z >= min.z && p.z < max.z) {
+                                        out[((p.y - min.y) * sizeZ + (p.z - min.z)) * sizeX + (p.x - min.x)] = node.data;
+                                    }
+                                }
+                            }
+                            break;
+                        }
+                        for (size_t i = 0; i < _dataTree.size(); i++) {
+                            const auto& node = _dataTree[i];
+                            size_t end = (size_t)node.getStart() + node.length;
+                            // Walk the node one row at a time
+                            for (size_t c = node.getStart(); c < end;) {
+                                i32 x = (i32)(c & (CHUNK_WIDTH - 1));
+                                i32 y = (i32)(c / CHUNK_LAYER);
+                                i32 z = (i32)((c / CHUNK_WIDTH) & (CHUNK_WIDTH - 1));
+                                size_t rowEnd = std::min(c - x + CHUNK_WIDTH, end);
+                                if (y >= min.y && y < max.y && z >= min.z && z < max.z) {
+                                    i32 x1 = std::min((i32)(rowEnd - (c - x)), max.x);
+                                    T* row = out + ((y - min.y) * sizeZ + (z - min.z)) * sizeX;
+                                    for (i32 x0 = std::max(x, min.x); x0 < x1; x0++) {
+                                        row[x0 - min.x] = node.data;
+                                    }
+                                }
+                                c = rowEnd;
+                            }
+                        }
+                        break;
+                    default:
+                        for (i32 y = min.y; y < max.y; y++) {
+                            for (i32 z = min.z; z < max.z; z++) {
+                                size_t rowStart = y * CHUNK_LAYER + z * CHUNK_WIDTH;
+                                copyRange(rowStart + min.x, rowStart + max.x, out);
+                                out += sizeX;
+                            }
+                        }
+                        break;
+                }
+            }
+            /// Sets every element in the box [min, max) to value.
+            /// The caller must hold the data lock.
+            inline void fillBox(const i32v3& min, const i32v3& max, T value) {
+                const size_t count = (size_t)(max.x - min.x) * (max.y - min.y) * (max.z - min.z);
+                if (count == 0) return;
+                _accessCount.fetch_add((int)count, std::memory_order_relaxed);
+                prepareBulkSet(count);
+                ui32 p = 0;
+                if (_state == VoxelStorageState::PALETTE && !findOrAddPaletteEntry(value, p)) {
+                    toFlatArray();
+                }
+                for (i32 y = min.y; y < max.y; y++) {
+                    for (i32 z = min.z; z < max.z; z++) {
+                        size_t rowStart = y * CHUNK_LAYER + z * CHUNK_WIDTH;
+                        switch (_state) {
+                            case VoxelStorageState::FLAT_ARRAY:
+                                if (ChunkLayout::IS_LINEAR) {
+                                    std::fill(_dataArray + rowStart + min.x, _dataArray + rowStart + max.x, value);
+                                } else {
+                                    for (i32 x = min.x; x < max.x; x++) _dataArray[ChunkLayout::toStorage((ui32)(rowStart + x))] = value;
+                                }
+                                break;
+                            case VoxelStorageState::PALETTE:
+                                for (i32 x = min.x; x < max.x; x++) writePaletteIndex(ChunkLayout::toStorage((ui32)(rowStart + x)), p);
+                                break;
+                            default:
+                                for (i32 x = min.x; x < max.x; x++) _dataTree.insert(ChunkLayout::toStorage((ui32)(rowStart + x)), value);
+                                break;
+                        }
+                    }
+                }
+            }
+            /// Sets values[i] at indices[i] for each i in [0, count).
+            /// Later entries win when an index repeats. The caller must hold the data lock.
+            inline void setMany(const ui16* indices, const T* values, size_t count) {
+                if (count == 0) return;
+                _accessCount.fetch_add((int)count, std::memory_order_relaxed);
+                prepareBulkSet(count);
+                switch (_state) {
+                    case VoxelStorageState::FLAT_ARRAY:
+                        for (size_t i = 0; i < count; i++) _dataArray[ChunkLayout::toStorage(indices[i])] = values[i];
+                        break;
+                    case VoxelStorageState::PALETTE:
+                        for (size_t i = 0; i < count; i++) {
+                            // May switch to the flat array if the palette overflows
+                            (setters[(size_t)_state])(this, indices[i], values[i]);
+                        }
+                        break;
+                    default:
+                        for (size_t i = 0; i < count; i++) _dataTree.insert(ChunkLayout::toStorage(indices[i]), values[i]);
+                        break;
+                }
+            }
         private:
             typedef const T& (*Getter)(const SmartVoxelContainer*, size_t);
             typedef void(*Setter)(SmartVoxelContainer*, size_t, T);
 
+            // These take block indices and map them to storage
             static const T& getInterval(const SmartVoxelContainer* container, size_t index) {
-                return container->_dataTree.getData(index);
+                return container->_dataTree.getData(ChunkLayout::toStorage((ui32)index));
             }
             static const T& getFlat(const SmartVoxelContainer* container, size_t index) {
-                return container->_dataArray[index];
+                return container->_dataArray[ChunkLayout::toStorage((ui32)index)];
             }
             static void setInterval(SmartVoxelContainer* container, size_t index, T data) {
-                container->_dataTree.insert(index, data);
+                container->_dataTree.insert(ChunkLayout::toStorage((ui32)index), data);
             }
             static void setFlat(SmartVoxelContainer* container, size_t index, T data) {
-                container->_dataArray[index] = data;
+                container->_dataArray[ChunkLayout::toStorage((ui32)index)] = data;
+            }
+            static const T& getPaletted(const SmartVoxelContainer* container, size_t index) {
+                return container->_palette[container->readPaletteIndex(ChunkLayout::toStorage((ui32)index))];
+            }
+            static void setPaletted(SmartVoxelContainer* container, size_t index, T data) {
+                container->setPaletteData(ChunkLayout::toStorage((ui32)index), data);
+            }
+
+            /// copyRange for non linear layouts, where [begin, end) is scattered in storage
+            inline void gatherRange(size_t begin, size_t end, T* out) const {
+                switch (_state) {
+                    case VoxelStorageState::INTERVAL_TREE:
+                        // Cheaper to walk every node than to search the tree per element
+                        for (size_t i = 0; i < _dataTree.size(); i++) {
+                            size_t nodeEnd = (size_t)_dataTree[i].getStart() + _dataTree[i].length;
+                            for (size_t s = _dataTree[i].getStart(); s < nodeEnd; s++) {
+                                size_t c = ChunkLayout::toBlockIndex((ui32)s);
+                                if (c >= begin && c < end) out[c - begin] = _dataTree[i].data;
+                            }
+                        }
+                        break;
+                    case VoxelStorageState::PALETTE:
+                        for (size_t c = begin; c < end; c++) {
+                            *out++ = _palette[readPaletteIndex(ChunkLayout::toStorage((ui32)c))];
+                        }
+                        break;
+                    default:
+                        for (size_t c = begin; c < end; c++) {
+                            *out++ = _dataArray[ChunkLayout::toStorage((ui32)c)];
+                        }
+                        break;
+                }
             }
 
-            static Getter getters[2];
-            static Setter setters[2];
+            static Getter getters[3];
+            static Setter setters[3];
+
+            /************************************************************************/
+            /* Palette                                                              */
+            /************************************************************************/
+            /// Gets the smallest supported index width that can address paletteSize entries
+            static ui32 getPaletteBitsFor(size_t paletteSize) {
+                if (paletteSize <= 2) return 1;
+                if (paletteSize <= 4) return 2;
+                if (paletteSize <= 16) return 4;
+                return 8;
+            }
+            inline ui32 readPaletteIndex(size_t index) const {
+                size_t bit = index * _paletteBits;
+                return (_paletteIndices[bit >> 5] >> (bit & 31)) & _paletteMask;
+            }
+            inline void writePaletteIndex(size_t index, ui32 paletteIndex) {
+                size_t bit = index * _paletteBits;
+                ui32& word = _paletteIndices[bit >> 5];
+                word = (word & ~(_paletteMask << (bit & 31))) | (paletteIndex << (bit & 31));
+            }
+            /// Resizes the index array for a new index width. Indices are zeroed.
+            inline void allocPaletteIndices(ui32 bits) {
+                _paletteBits = bits;
+                _paletteMask = (1u << bits) - 1u;
+                _paletteIndices.assign((SIZE * bits + 31) / 32, 0u);
+            }
+            /// Re-encodes all indices with a wider index width
+            inline void repackPalette(ui32 bits) {
+                std::vector<ui32> oldIndices;
+                oldIndices.swap(_paletteIndices);
+                ui32 oldBits = _paletteBits;
+                ui32 oldMask = _paletteMask;
+                allocPaletteIndices(bits);
+                for (size_t i = 0; i < SIZE; i++) {
+                    size_t bit = i * oldBits;
+                    writePaletteIndex(i, (oldIndices[bit >> 5] >> (bit & 31)) & oldMask);
+                }
+            }
+            /// Finds or adds data in the palette
+            /// @param p: Resulting palette index
+            /// @return false if the palette is full
+            inline bool findOrAddPaletteEntry(T data, ui32& p) {
+                // Palettes are small, so a linear search is fine here
+                p = 0;
+                while (p < _palette.size() && !(_palette[p] == data)) p++;
+                if (p == _palette.size()) {
+                    if (_palette.size() == MAX_PALETTE_SIZE) return false;
+                    _palette.push_back(data);
+                    if (_palette.size() > (size_t)_paletteMask + 1) {
+                        repackPalette(getPaletteBitsFor(_palette.size()));
+                    }
+                }
+                return true;
+            }
+            inline void setPaletteData(size_t index, T data) {
+                ui32 p;
+                if (findOrAddPaletteEntry(data, p)) {
+                    writePaletteIndex(index, p);
+                } else {
+                    // Too many unique values, fall back to the flat array
+                    toFlatArray();
+                    _dataArray[index] = data;
+                }
+            }
+            /// Builds the palette from sorted intervals.
+            /// @return false if there are too many unique values for a palette
+            inline bool initPaletteFromSortedArray(const typename IntervalTree<T>::LNode data[], size_t size) {
+                T uniques[MAX_PALETTE_SIZE];
+                size_t numUniques;
+                if (!getSortedUniques(data, size, uniques, numUniques)) return false;
+
+                _palette.assign(uniques, uniques + numUniques);
+                allocPaletteIndices(getPaletteBitsFor(_palette.size()));
+                for (size_t i = 0; i < size; i++) {
+                    ui32 p = (ui32)(std::lower_bound(_palette.begin(), _palette.end(), data[i].data) - _palette.begin());
+                    // Index 0 is already zeroed
+                    if (p == 0) continue;
+                    size_t end = data[i].getStart() + data[i].length;
+                    for (size_t j = data[i].getStart(); j < end; j++) {
+                        writePaletteIndex(j, p);
+                    }
+                }
+                return true;
+            }
+            /// Gathers the sorted unique values of the intervals
+            /// @return false if there are more than MAX_PALETTE_SIZE unique values
+            static bool getSortedUniques(const typename IntervalTree<T>::LNode data[], size_t size,
+                                         T uniques[MAX_PALETTE_SIZE], size_t& numUniques) {
+                numUniques = 0;
+                for (size_t i = 0; i < size; i++) {
+                    T* end = uniques + numUniques;
+                    T* it = std::lower_bound(uniques, end, data[i].data);
+                    if (it != end && *it == data[i].data) continue;
+                    if (numUniques == MAX_PALETTE_SIZE) return false;
+                    std::copy_backward(it, end, end + 1);
+                    *it = data[i].data;
+                    numUniques++;
+                }
+                return true;
+            }
+            /// Large batches of writes to an interval tree would be followed by
+            /// an uncompress in update() anyway, so do it up front rather than
+            /// paying for an insert per element.
+            inline void prepareBulkSet(size_t count) {
+                if (_state == VoxelStorageState::INTERVAL_TREE && count >= ACCESS_COUNT_UNTIL_DECOMPRESS) {
+                    toFlatArray();
+                }
+            }
+            inline void clearPalette() {
+                std::vector<T>().swap(_palette);
+                std::vector<ui32>().swap(_paletteIndices);
+                _paletteBits = 0;
+                _paletteMask = 0;
+            }
+            /// Picks the smaller of the interval tree and palette representations
+            /// @param numNodes: Number of intervals in the data
+            /// @param data: The sorted intervals
+            inline VoxelStorageState getCompressedState(const typename IntervalTree<T>::LNode data[], size_t numNodes) const {
+                size_t treeBytes = numNodes * sizeof(typename IntervalTree<T>::Node);
+                // Even a 1 bit palette can't beat a tree this small
+                if (treeBytes <= SIZE / 8) return VoxelStorageState::INTERVAL_TREE;
+
+                T uniques[MAX_PALETTE_SIZE];
+                size_t numUniques;
+                if (!getSortedUniques(data, numNodes, uniques, numUniques)) return VoxelStorageState::INTERVAL_TREE;
+                size_t paletteBytes = SIZE * getPaletteBitsFor(numUniques) / 8 + numUniques * sizeof(T);
+                return paletteBytes < treeBytes ? VoxelStorageState::PALETTE : VoxelStorageState::INTERVAL_TREE;
+            }
 
-            inline void uncompress(std::mutex& dataLock) {
+            template <typename Lock>
+            inline void uncompress(Lock& dataLock) {
                 dataLock.lock();
-                _dataArray = _arrayRecycler->create();
-                uncompressIntoBuffer(_dataArray);
+                // A bulk set or palette overflow on another thread may have beaten us to it
+                if (_state == VoxelStorageState::FLAT_ARRAY) {
+                    dataLock.unlock();
+                    return;
+                }
+                toFlatArray();
+                dataLock.unlock();
+            }
+            /// Converts a compressed container to the flat array.
+            /// The caller must hold the data lock.
+            inline void toFlatArray() {
+                T* dataArray = _arrayRecycler->create();
+                uncompressIntoBuffer(dataArray);
                 // Free memory
-                _dataTree.clear();
+                if (_state == VoxelStorageState::PALETTE) {
+                    clearPalette();
+                } else {
+                    _dataTree.clear();
+                }
                 // Set the new state
+                _dataArray = dataArray;
                 _state = VoxelStorageState::FLAT_ARRAY;
-                dataLock.unlock();
             }
-            inline void compress(std::mutex& dataLock) {
+            /// Compresses to whichever compressed state is smaller
+            template <typename Lock>
+            inline bool compress(Lock& dataLock) {
+                return compress(dataLock, VoxelStorageState::FLAT_ARRAY);
+            }
+            /// @param newState: The compressed state to use, or FLAT_ARRAY to pick the smaller one
+            /// @return false if the container was not in the flat state
+            template <typename Lock>
+            inline bool compress(Lock& dataLock, VoxelStorageState newState) {
                 dataLock.lock();
+                // Another thread may have changed the state before we got the lock
+                if (_state != VoxelStorageState::FLAT_ARRAY || !_dataArray) {
+                    dataLock.unlock();
+                    return false;
+                }
                 // Sorted array for creating the interval tree
                 // Using stack array to avoid allocations, beware stack overflow
                 typename IntervalTree<T>::LNode data[CHUNK_SIZE];
@@ -279,25 +720,41 @@ namespace vorb {
                         data[++index].set(i, 1, _dataArray[i]);
                     }
                 }
+                size_t numNodes = index + 1;
+                if (newState == VoxelStorageState::FLAT_ARRAY) {
+                    newState = getCompressedState(data, numNodes);
+                }
                 // Set new state
-                _state = VoxelStorageState::INTERVAL_TREE;
-                // Create the tree
-                _dataTree.initFromSortedArray(data, index + 1);
+                _state = newState;
+                if (_state != VoxelStorageState::PALETTE || !initPaletteFromSortedArray(data, numNodes)) {
+                    // Create the tree
+                    _state = VoxelStorageState::INTERVAL_TREE;
+                    _dataTree.initFromSortedArray(data, numNodes);
+                }
 
+                // Detach the array before unlocking. Once unlocked, an
+                // uncompress() on another thread may install a new one.
+                T* dataArray = _dataArray;
+                _dataArray = nullptr;
                 dataLock.unlock();
 
                 // Recycle memory
-                _arrayRecycler->recycle(_dataArray);
-                _dataArray = nullptr;
+                _arrayRecycler->recycle(dataArray);
 
                 totalContainerCompressions++;
+                return true;
             }
 
             IntervalTree<T> _dataTree; ///< Interval tree of voxel data
+            std::vector<T> _palette; ///< Unique values for the PALETTE state
+            std::vector<ui32> _paletteIndices; ///< Bit packed indices into _palette
+            ui32 _paletteBits = 0; ///< Bits per index, one of 1, 2, 4 or 8
+            ui32 _paletteMask = 0; ///< (1 << _paletteBits) - 1
 
             T* _dataArray = nullptr; ///< pointer to an array of voxel data
-            int _accessCount = 0; ///< Number of times the container was accessed this frame
-            int _quietFrames = 0; ///< Number of frames since we have had heavy updates
+            // Atomic since compression checks them on worker threads
+            std::atomic<int> _accessCount{ 0 }; ///< Number of times the container was accessed this frame
+            std::atomic<int> _quietFrames{ 0 }; ///< Number of frames since we have had heavy updates
 
             VoxelStorageState _state = VoxelStorageState::FLAT_ARRAY; ///< Current data structure state
 
@@ -324,14 +781,16 @@ namespace vorb {
         }
 
         template<typename T, size_t SIZE>
-        typename SmartVoxelContainer<T, SIZE>::Getter SmartVoxelContainer<T, SIZE>::getters[2] = {
+        typename SmartVoxelContainer<T, SIZE>::Getter SmartVoxelContainer<T, SIZE>::getters[3] = {
             SmartVoxelContainer<T, SIZE>::getFlat,
-            SmartVoxelContainer<T, SIZE>::getInterval
+            SmartVoxelContainer<T, SIZE>::getInterval,
+            SmartVoxelContainer<T, SIZE>::getPaletted
         };
         template<typename T, size_t SIZE>
-        typename SmartVoxelContainer<T, SIZE>::Setter SmartVoxelContainer<T, SIZE>::setters[2] = {
+        typename SmartVoxelContainer<T, SIZE>::Setter SmartVoxelContainer<T, SIZE>::setters[3] = {
             SmartVoxelContainer<T, SIZE>::setFlat,
-            SmartVoxelContainer<T, SIZE>::setInterval
+            SmartVoxelContainer<T, SIZE>::setInterval,
+            SmartVoxelContainer<T, SIZE>::setPaletted
         };
 
     }
@@ -4,6 +4,7 @@
 #include "BlockData.h"
 #include "BlockPack.h"
 #include "ChunkMeshManager.h"
+#include "ChunkMesher.h"
 #include "ChunkUpdater.h"
 #include "DebugRenderer.h"
 #include "GameSystemComponentBuilders.h"
@@ -42,6 +43,8 @@ void SoaEngine::initOptions(SoaOptions& options) {
     options.addOption(OPT_BORDERLESS, "Borderless Window", OptionValue(false));
     options.addOption(OPT_SCREEN_WIDTH, "Screen Width", OptionValue(1280));
     options.addOption(OPT_SCREEN_HEIGHT, "Screen Height", OptionValue(720));
+    // Needs a restart. The packed chunk shaders don't do normal or displacement maps yet.
+    options.addOption(OPT_PACKED_CHUNK_VERTICES, "Packed Chunk Vertices", OptionValue(false));
     options.addStringOption("Texture Pack", "Default");
 
     SoaEngine::optionsController.setDefault();
@@ -97,6 +100,8 @@ void SoaEngine::initState(SoaState* state) {
 
 void SoaEngine::initClientState(SoaState* soaState, ClientState& state) {
     state.debugRenderer = new DebugRenderer;
+    // Fixed from here on, meshes and the chunk programs have to agree
+    ChunkMesher::vertexFormat = soaOptions.get(OPT_PACKED_CHUNK_VERTICES).value.b ? ChunkVertexFormat::PACKED : ChunkVertexFormat::BLOCK;
     state.chunkMeshManager = new ChunkMeshManager(soaState->threadPool, &soaState->blocks);
     state.systemViewer = new MainMenuSystemViewer;
     // TODO(Ben): This is also elsewhere?
@@ -71,6 +71,7 @@ enum DefaultOptions : int {
     OPT_BORDERLESS,
     OPT_SCREEN_WIDTH,
     OPT_SCREEN_HEIGHT,
+    OPT_PACKED_CHUNK_VERTICES,
     OPT_NUM_OPTIONS // This should be last
 };
 
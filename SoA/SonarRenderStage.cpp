@@ -7,6 +7,7 @@
 #include "BlockPack.h"
 #include "BlockTexturePack.h"
 #include "ChunkMeshManager.h"
+#include "ChunkMesher.h"
 #include "ChunkRenderer.h"
 #include "GameRenderParams.h"
 #include "SoaOptions.h"
@@ -17,6 +18,29 @@
 const f32 SONAR_DISTANCE = 200.0f;
 const f32 SONAR_WIDTH = 30.0f;
 
+namespace {
+    // Draws a ring that sweeps out from the camera. Uses ChunkRenderer::OPAQUE_VERT_SRC,
+    // for ChunkVertexFormat::PACKED meshes.
+    const cString FRAG_SRC = R"(
+uniform float sonarDistance;
+uniform float waveWidth;
+uniform float dt;
+uniform float fadeDistance;
+
+in vec3 fPosition;
+in vec3 fNormal;
+
+out vec4 fColor;
+
+void main() {
+    float dist = length(fPosition);
+    float wave = 1.0 - clamp(abs(mod(dist - dt, sonarDistance) - waveWidth) / waveWidth, 0.0, 1.0);
+    float fade = 1.0 - clamp(dist / (sonarDistance * fadeDistance), 0.0, 1.0);
+    fColor = vec4(0.0, wave * fade, wave * fade * 0.5, wave * fade * (0.5 + 0.5 * abs(fNormal.y)));
+}
+)";
+}
+
 SonarRenderStage::SonarRenderStage(const GameRenderParams* gameRenderParams) :
     m_gameRenderParams(gameRenderParams) {
     // Empty
@@ -26,12 +50,21 @@ void SonarRenderStage::render(const Camera* camera VORB_MAYBE_UNUSED) {
     glDisable(GL_DEPTH_TEST);
     ChunkMeshManager* cmm = m_gameRenderParams->chunkMeshmanager;
 
+    const bool isPacked = ChunkMesher::vertexFormat == ChunkVertexFormat::PACKED;
     if (!m_program.isCreated()) {
-        m_program = ShaderLoader::createProgramFromFile("Shaders/BlockShading/standardShading.vert",
-                                                             "Shaders/BlockShading/sonarShading.frag");
+        if (isPacked) {
+            m_program = ShaderLoader::createProgram("Sonar", ChunkRenderer::OPAQUE_VERT_SRC, FRAG_SRC);
+        } else {
+            m_program = ShaderLoader::createProgramFromFile("Shaders/BlockShading/standardShading.vert",
+                                                            "Shaders/BlockShading/sonarShading.frag");
+        }
     }
     m_program.use();
-    m_program.enableVertexAttribArrays();
+    if (isPacked) {
+        glUniform1i(m_program.getUniform("unPalette"), 1);
+    } else {
+        m_program.enableVertexAttribArrays();
+    }
 
     // Bind the block textures
     glActiveTexture(GL_TEXTURE0);
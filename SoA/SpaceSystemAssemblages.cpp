@@ -4,7 +4,9 @@
 #include "ChunkGrid.h"
 #include "ChunkIOManager.h"
 #include "ChunkAllocator.h"
+#include "ChunkMeshManager.h"
 #include "FarTerrainPatch.h"
+#include "HeightmapTileCache.h"
 #include "OrbitComponentUpdater.h"
 #include "SoAState.h"
 #include "SpaceSystem.h"
@@ -266,9 +268,34 @@ vecs::ComponentID SpaceSystemAssemblages::addSphericalVoxelComponent(SpaceSystem
 
     svcmp.chunkIo->beginThread();
 
+    // Keep heightmaps with the save so they aren't generated again next session
+    HeightmapTileCache* heightmapCache = ftcmp.sphericalTerrainData->heightmapCache;
+    if (heightmapCache && !heightmapCache->hasDiskStore()) {
+        vio::IOManager& iom = soaState->saveFileIom;
+        nString dir = "cache/heightmaps/" + spaceSystem->namePosition.get(namePositionComponent).name;
+        iom.makeDirectory("cache/heightmaps");
+        iom.makeDirectory(dir);
+        vio::Path path;
+        if (iom.resolvePath(dir, path)) {
+            heightmapCache->openDiskStore(path.getString());
+        }
+    }
+    // Chunk meshes too. Block textures are loaded by now.
+    ChunkMeshManager* chunkMeshManager = soaState->clientState.chunkMeshManager;
+    if (chunkMeshManager && !chunkMeshManager->getMeshCache().hasDiskStore()) {
+        vio::IOManager& iom = soaState->saveFileIom;
+        nString dir = "cache/meshes/" + spaceSystem->namePosition.get(namePositionComponent).name;
+        iom.makeDirectory("cache/meshes");
+        iom.makeDirectory(dir);
+        vio::Path path;
+        if (iom.resolvePath(dir, path)) {
+            chunkMeshManager->getMeshCache().openDiskStore(path.getString());
+        }
+    }
+
     svcmp.chunkGrids = new ChunkGrid[6];
     for (int i = 0; i < 6; i++) {
-        svcmp.chunkGrids[i].init(static_cast<WorldCubeFace>(i), svcmp.threadPool, 1, ftcmp.planetGenData, &soaState->chunkAllocator);
+        svcmp.chunkGrids[i].init(static_cast<WorldCubeFace>(i), svcmp.threadPool, 1, ftcmp.planetGenData, &soaState->chunkAllocator, heightmapCache);
         svcmp.chunkGrids[i].blockPack = &soaState->blocks;
     }
 
@@ -318,6 +345,7 @@ vecs::ComponentID SpaceSystemAssemblages::addSphericalTerrainComponent(SpaceSyst
         stCmp.meshManager = new TerrainPatchMeshManager(planetGenData);
         stCmp.cpuGenerator = new SphericalHeightmapGenerator;
         stCmp.cpuGenerator->init(planetGenData);
+        stCmp.heightmapCache = new HeightmapTileCache(stCmp.cpuGenerator);
     }
     
     stCmp.radius = radius;
@@ -326,6 +354,7 @@ vecs::ComponentID SpaceSystemAssemblages::addSphericalTerrainComponent(SpaceSyst
     f64 patchWidth = (radius * 2.0) / ST_PATCH_ROW;
     stCmp.sphericalTerrainData = new TerrainPatchData(radius, patchWidth, stCmp.cpuGenerator,
                                                       stCmp.meshManager, threadPool);
+    stCmp.sphericalTerrainData->heightmapCache = stCmp.heightmapCache;
 
     return stCmpId;
 }
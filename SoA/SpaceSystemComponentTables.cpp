@@ -7,6 +7,7 @@
 #include "ChunkAllocator.h"
 #include "ChunkIOManager.h"
 #include "FarTerrainPatch.h"
+#include "HeightmapTileCache.h"
 #include "ChunkGrid.h"
 #include "PlanetGenData.h"
 #include "SphericalHeightmapGenerator.h"
@@ -30,6 +31,7 @@ void SphericalTerrainComponentTable::disposeComponent(vecs::ComponentID cID, vec
     }
     if (cmp.planetGenData) {
         delete cmp.meshManager;
+        delete cmp.heightmapCache;
         delete cmp.cpuGenerator;
     }
     // TODO(Ben): Memory leak
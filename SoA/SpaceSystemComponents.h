@@ -35,6 +35,7 @@ class BlockPack;
 class ChunkIOManager;
 class ChunkManager;
 class FarTerrainPatch;
+class HeightmapTileCache;
 class PagedChunkAllocator;
 class ParticleEngine;
 class PhysicsEngine;
@@ -203,6 +204,7 @@ struct SphericalTerrainComponent {
 
     TerrainPatchMeshManager* meshManager = nullptr;
     SphericalHeightmapGenerator* cpuGenerator = nullptr;
+    HeightmapTileCache* heightmapCache = nullptr;
 
     PlanetGenData* planetGenData = nullptr;
     VoxelPosition3D startVoxelPosition;
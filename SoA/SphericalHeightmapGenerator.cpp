@@ -8,26 +8,286 @@
 #include <random>
 
 #define WEIGHT_THRESHOLD 0.001
+#define ADAPTIVE_CELL_WIDTH 4u ///< Positions per lattice cell side for adaptive sampling
+#define ADAPTIVE_CLIMATE_TOLERANCE 1.0f ///< Temperature and humidity error allowed at cell centers
 
 void SphericalHeightmapGenerator::init(const PlanetGenData* planetGenData) {
     m_genData = planetGenData;
+    m_heightTolerance = m_genData->heightTolerance;
+    m_useBiomeTiles = m_genData->useBiomeTiles;
+    m_baseTerrainProgram.compile(m_genData->baseTerrainFuncs.funcs);
+    m_tempTerrainProgram.compile(m_genData->tempTerrainFuncs.funcs);
+    m_humTerrainProgram.compile(m_genData->humTerrainFuncs.funcs);
+    m_biomeTerrainPrograms.resize(m_genData->biomes.size());
+    m_biomeChildPrograms.resize(m_genData->biomes.size());
+    m_childNoiseSlots.assign(m_genData->biomes.size(), UINT32_MAX);
+    m_childNoiseBiomes.clear();
+    for (size_t i = 0; i < m_genData->biomes.size(); i++) {
+        const Biome& biome = m_genData->biomes[i];
+        m_biomeTerrainPrograms[i].compile(biome.terrainNoise.funcs);
+        m_biomeChildPrograms[i].compile(biome.childNoise.funcs);
+        if (biome.children.size()) {
+            m_childNoiseSlots[i] = (ui32)m_childNoiseBiomes.size();
+            m_childNoiseBiomes.push_back(i);
+        }
+    }
+    m_biomeTiles.clear();
 }
 
 void SphericalHeightmapGenerator::generateHeightData(OUT PlanetHeightData& height, const VoxelPosition2D& facePosition) const {
     // Need to convert to world-space
-    f32v2 coordMults = f32v2(VoxelSpaceConversions::FACE_TO_WORLD_MULTS[(int)facePosition.face]);
-    i32v3 coordMapping = VoxelSpaceConversions::VOXEL_TO_WORLD[(int)facePosition.face];
-
-    f64v3 pos;
-    pos[coordMapping.x] = facePosition.pos.x * KM_PER_VOXEL * coordMults.x;
-    pos[coordMapping.y] = m_genData->radius * (f64)VoxelSpaceConversions::FACE_Y_MULTS[(int)facePosition.face];
-    pos[coordMapping.z] = facePosition.pos.y * KM_PER_VOXEL * coordMults.y;
-
+    f64v3 pos = getCubePosition(facePosition);
     f64v3 normal = glm::normalize(pos);
 
     generateHeightData(height, normal * m_genData->radius, normal);
 
     // For Voxel Position, automatically get tree or flora
+    generateFlora(height, facePosition, pos);
+}
+
+void SphericalHeightmapGenerator::generateHeightData(OUT PlanetHeightData& height, const f64v3& normal) const {
+    generateHeightData(height, normal * m_genData->radius, normal);
+}
+
+void SphericalHeightmapGenerator::generateHeightData(OUT PlanetHeightData* heights, const VoxelPosition2D& cornerPos, ui32 width, ui32 step) const {
+    if (m_heightTolerance > 0.0f && width % ADAPTIVE_CELL_WIDTH == 0 && width >= ADAPTIVE_CELL_WIDTH * 2) {
+        generateHeightDataAdaptive(heights, cornerPos, width, step, m_heightTolerance);
+        return;
+    }
+    std::vector<f64v2> facePositions(width * width);
+    for (ui32 z = 0; z < width; z++) {
+        for (ui32 x = 0; x < width; x++) {
+            facePositions[z * width + x] = f64v2(cornerPos.pos.x + (f64)x * step, cornerPos.pos.y + (f64)z * step);
+        }
+    }
+    generateHeightDataBatch(heights, cornerPos.face, facePositions.data(), facePositions.size(), step, step == 1);
+}
+
+size_t SphericalHeightmapGenerator::generateHeightDataAdaptive(OUT PlanetHeightData* heights, const VoxelPosition2D& cornerPos, ui32 width, ui32 step, f32 tolerance) const {
+    const ui32 CELLS = width / ADAPTIVE_CELL_WIDTH;
+    const ui32 N = CELLS + 1; ///< Lattice points per side, including the far edge
+    const f64 LATTICE_STEP = (f64)ADAPTIVE_CELL_WIDTH * step;
+
+    // Evaluate the lattice
+    std::vector<f64v2> facePositions;
+    facePositions.reserve(width * width);
+    for (ui32 z = 0; z < N; z++) {
+        for (ui32 x = 0; x < N; x++) {
+            facePositions.emplace_back(cornerPos.pos.x + x * LATTICE_STEP, cornerPos.pos.y + z * LATTICE_STEP);
+        }
+    }
+    std::vector<PlanetHeightData> lattice(N * N);
+    generateHeightDataBatch(lattice.data(), cornerPos.face, facePositions.data(), lattice.size(), step, false);
+    size_t numEvaluated = lattice.size();
+
+    // Second differences of the height at each lattice point. They are h^2 times the
+    // second derivative, where h is the lattice step. Edges use the nearest interior point.
+    std::vector<f32> curvatureX(N * N);
+    std::vector<f32> curvatureZ(N * N);
+    for (ui32 z = 0; z < N; z++) {
+        ui32 cz = glm::clamp(z, 1u, N - 2);
+        for (ui32 x = 0; x < N; x++) {
+            ui32 cx = glm::clamp(x, 1u, N - 2);
+            curvatureX[z * N + x] = glm::abs(lattice[z * N + cx - 1].height - 2.0f * lattice[z * N + cx].height + lattice[z * N + cx + 1].height);
+            curvatureZ[z * N + x] = glm::abs(lattice[(cz - 1) * N + x].height - 2.0f * lattice[cz * N + x].height + lattice[(cz + 1) * N + x].height);
+        }
+    }
+
+    // Find the cells that can't be interpolated
+    std::vector<bool> refine(CELLS * CELLS);
+    std::vector<ui32> candidates;
+    for (ui32 cz = 0; cz < CELLS; cz++) {
+        for (ui32 cx = 0; cx < CELLS; cx++) {
+            ui32 c[4] = { cz * N + cx, cz * N + cx + 1, (cz + 1) * N + cx, (cz + 1) * N + cx + 1 };
+            f32 maxX = 0.0f;
+            f32 maxZ = 0.0f;
+            bool sameBiome = true;
+            for (int i = 0; i < 4; i++) {
+                maxX = glm::max(maxX, curvatureX[c[i]]);
+                maxZ = glm::max(maxZ, curvatureZ[c[i]]);
+                sameBiome &= (lattice[c[i]].biome == lattice[c[0]].biome);
+            }
+            // Bilinear interpolation error is at most h^2 / 8 * (|f_xx| + |f_zz|), but
+            // only for terrain that is smooth between lattice points
+            if (sameBiome && (maxX + maxZ) * 0.125f <= tolerance) {
+                candidates.push_back(cz * CELLS + cx);
+            } else {
+                refine[cz * CELLS + cx] = true;
+            }
+        }
+    }
+
+    // Features narrower than the lattice don't show up in its curvature, and
+    // temperature and humidity aren't checked by it at all. So also sample
+    // the center of each remaining cell, where interpolation is furthest from
+    // the lattice, and refine the cell if anything is off. Centers keep their
+    // sampled values either way.
+    const ui32 MID = ADAPTIVE_CELL_WIDTH / 2;
+    std::vector<bool> hasCenter(CELLS * CELLS);
+    facePositions.clear();
+    for (ui32 cell : candidates) {
+        ui32 px = (cell % CELLS) * ADAPTIVE_CELL_WIDTH + MID;
+        ui32 pz = (cell / CELLS) * ADAPTIVE_CELL_WIDTH + MID;
+        facePositions.emplace_back(cornerPos.pos.x + (f64)px * step, cornerPos.pos.y + (f64)pz * step);
+    }
+    if (facePositions.size()) {
+        std::vector<PlanetHeightData> centers(facePositions.size());
+        generateHeightDataBatch(centers.data(), cornerPos.face, facePositions.data(), centers.size(), step, step == 1);
+        for (size_t i = 0; i < candidates.size(); i++) {
+            ui32 cx = candidates[i] % CELLS;
+            ui32 cz = candidates[i] / CELLS;
+            const PlanetHeightData& h00 = lattice[cz * N + cx];
+            const PlanetHeightData& h10 = lattice[cz * N + cx + 1];
+            const PlanetHeightData& h01 = lattice[(cz + 1) * N + cx];
+            const PlanetHeightData& h11 = lattice[(cz + 1) * N + cx + 1];
+            const PlanetHeightData& center = centers[i];
+            // Every corner weighs a quarter at the center
+            f32 height = (h00.height + h10.height + h01.height + h11.height) * 0.25f;
+            f32 temperature = (h00.temperature + h10.temperature + h01.temperature + h11.temperature) * 0.25f;
+            f32 humidity = (h00.humidity + h10.humidity + h01.humidity + h11.humidity) * 0.25f;
+            if (center.biome != h00.biome || glm::abs(center.height - height) > tolerance ||
+                glm::abs(center.temperature - temperature) > ADAPTIVE_CLIMATE_TOLERANCE ||
+                glm::abs(center.humidity - humidity) > ADAPTIVE_CLIMATE_TOLERANCE) {
+                refine[candidates[i]] = true;
+            }
+            hasCenter[candidates[i]] = true;
+            heights[(cz * ADAPTIVE_CELL_WIDTH + MID) * width + cx * ADAPTIVE_CELL_WIDTH + MID] = center;
+        }
+        numEvaluated += centers.size();
+    }
+
+    // Evaluate the refined cells in full
+    std::vector<ui32> refinedIndices;
+    facePositions.clear();
+    for (ui32 cz = 0; cz < CELLS; cz++) {
+        for (ui32 cx = 0; cx < CELLS; cx++) {
+            if (!refine[cz * CELLS + cx]) continue;
+            bool skipCenter = hasCenter[cz * CELLS + cx];
+            for (ui32 z = 0; z < ADAPTIVE_CELL_WIDTH; z++) {
+                for (ui32 x = 0; x < ADAPTIVE_CELL_WIDTH; x++) {
+                    if (x == 0 && z == 0) continue; // Already on the lattice
+                    if (skipCenter && x == MID && z == MID) continue;
+                    ui32 px = cx * ADAPTIVE_CELL_WIDTH + x;
+                    ui32 pz = cz * ADAPTIVE_CELL_WIDTH + z;
+                    refinedIndices.push_back(pz * width + px);
+                    facePositions.emplace_back(cornerPos.pos.x + (f64)px * step, cornerPos.pos.y + (f64)pz * step);
+                }
+            }
+        }
+    }
+    if (facePositions.size()) {
+        std::vector<PlanetHeightData> refined(facePositions.size());
+        generateHeightDataBatch(refined.data(), cornerPos.face, facePositions.data(), refined.size(), step, step == 1);
+        for (size_t i = 0; i < refinedIndices.size(); i++) {
+            heights[refinedIndices[i]] = refined[i];
+        }
+        numEvaluated += refined.size();
+    }
+
+    // Fill in everything else
+    const f32 INV_CELL_WIDTH = 1.0f / ADAPTIVE_CELL_WIDTH;
+    for (ui32 cz = 0; cz < CELLS; cz++) {
+        for (ui32 cx = 0; cx < CELLS; cx++) {
+            const PlanetHeightData& h00 = lattice[cz * N + cx];
+            const PlanetHeightData& h10 = lattice[cz * N + cx + 1];
+            const PlanetHeightData& h01 = lattice[(cz + 1) * N + cx];
+            const PlanetHeightData& h11 = lattice[(cz + 1) * N + cx + 1];
+            bool isRefined = refine[cz * CELLS + cx];
+            bool skipCenter = hasCenter[cz * CELLS + cx];
+            for (ui32 z = 0; z < ADAPTIVE_CELL_WIDTH; z++) {
+                for (ui32 x = 0; x < ADAPTIVE_CELL_WIDTH; x++) {
+                    if (isRefined && (x != 0 || z != 0)) continue;
+                    if (skipCenter && x == MID && z == MID) continue;
+                    ui32 px = cx * ADAPTIVE_CELL_WIDTH + x;
+                    ui32 pz = cz * ADAPTIVE_CELL_WIDTH + z;
+                    PlanetHeightData& height = heights[pz * width + px];
+                    f32 fx = x * INV_CELL_WIDTH;
+                    f32 fz = z * INV_CELL_WIDTH;
+                    f32 w00 = (1.0f - fx) * (1.0f - fz);
+                    f32 w10 = fx * (1.0f - fz);
+                    f32 w01 = (1.0f - fx) * fz;
+                    f32 w11 = fx * fz;
+                    height.biome = h00.biome;
+                    height.flags = h00.flags;
+                    height.height = h00.height * w00 + h10.height * w10 + h01.height * w01 + h11.height * w11;
+                    height.temperature = (ui8)(h00.temperature * w00 + h10.temperature * w10 + h01.temperature * w01 + h11.temperature * w11 + 0.5f);
+                    height.humidity = (ui8)(h00.humidity * w00 + h10.humidity * w10 + h01.humidity * w01 + h11.humidity * w11 + 0.5f);
+                    height.flora = FLORA_ID_NONE;
+                    // Flora is per voxel, so it means nothing at coarser steps
+                    if (step == 1) {
+                        VoxelPosition2D facePosition;
+                        facePosition.face = cornerPos.face;
+                        facePosition.pos = f64v2(cornerPos.pos.x + px, cornerPos.pos.y + pz);
+                        generateFlora(height, facePosition, getCubePosition(facePosition));
+                    }
+                }
+            }
+        }
+    }
+    return numEvaluated;
+}
+
+void SphericalHeightmapGenerator::generateHeightDataBatch(OUT PlanetHeightData* heights, WorldCubeFace face, const f64v2* facePositions, size_t count, ui32 step, bool placeFlora) const {
+    // Positions are split into x, y and z arrays for the batched noise
+    std::vector<f64> posData(count * 3);
+    f64* px = posData.data();
+    f64* py = px + count;
+    f64* pz = py + count;
+    std::vector<f64v3> cubePositions(count);
+    std::vector<f64v3> normals(count);
+    VoxelPosition2D facePosition;
+    facePosition.face = face;
+    for (size_t i = 0; i < count; i++) {
+        facePosition.pos = facePositions[i];
+        cubePositions[i] = getCubePosition(facePosition);
+        normals[i] = glm::normalize(cubePositions[i]);
+        f64v3 pos = normals[i] * m_genData->radius;
+        px[i] = pos.x;
+        py[i] = pos.y;
+        pz[i] = pos.z;
+    }
+
+    // Base height, temperature and humidity noise for every position at once
+    std::vector<f64> values(count * 3);
+    f64* h = values.data();
+    f64* temperatures = h + count;
+    f64* humidities = temperatures + count;
+    std::fill(h, h + count, (f64)m_genData->baseTerrainFuncs.base);
+    std::fill(temperatures, temperatures + count, (f64)m_genData->tempTerrainFuncs.base);
+    std::fill(humidities, humidities + count, (f64)m_genData->humTerrainFuncs.base);
+    m_baseTerrainProgram.evaluate(px, py, pz, count, h);
+    m_tempTerrainProgram.evaluate(px, py, pz, count, temperatures);
+    m_humTerrainProgram.evaluate(px, py, pz, count, humidities);
+
+    // Child biome noise is interpolated from tiles when positions are close enough together
+    // for the tiles to be reused. Far apart positions, such as distant terrain patches, evaluate it.
+    bool useBiomeTiles = m_useBiomeTiles && m_childNoiseBiomes.size() && step < BIOME_TILE_SPACING;
+    std::vector<f64> childNoise(m_childNoiseBiomes.size());
+    std::shared_ptr<const BiomeTile> biomeTile;
+
+    // Biomes and flora depend on each position's own values, so they stay per position
+    for (size_t i = 0; i < count; i++) {
+        PlanetHeightData& height = heights[i];
+        height.height = (f32)(h[i] * VOXELS_PER_M);
+        f64 hkm = h[i] * KM_PER_M;
+        f64 angle = computeAngleFromNormal(normals[i]);
+        f64 temperature = calculateTemperature(m_genData->tempLatitudeFalloff, angle, temperatures[i] - glm::max(0.0, m_genData->tempHeightFalloff * hkm));
+        f64 humidity = calculateHumidity(m_genData->humLatitudeFalloff, angle, humidities[i] - glm::max(0.0, m_genData->humHeightFalloff * hkm));
+        if (useBiomeTiles) {
+            sampleBiomeTile(face, facePositions[i], biomeTile, childNoise.data());
+            generateBiomeData(height, f64v3(px[i], py[i], pz[i]), temperature, humidity, childNoise.data());
+        } else {
+            generateBiomeData(height, f64v3(px[i], py[i], pz[i]), temperature, humidity);
+        }
+
+        if (placeFlora) {
+            facePosition.pos = facePositions[i];
+            generateFlora(height, facePosition, cubePositions[i]);
+        }
+    }
+}
+
+void SphericalHeightmapGenerator::generateFlora(OUT PlanetHeightData& height, const VoxelPosition2D& facePosition, const f64v3& pos) const {
     height.flora = getTreeID(height.biome, facePosition, pos);
     // If no tree, try flora
     if (height.flora == FLORA_ID_NONE) {
@@ -35,8 +295,82 @@ void SphericalHeightmapGenerator::generateHeightData(OUT PlanetHeightData& heigh
     }
 }
 
-void SphericalHeightmapGenerator::generateHeightData(OUT PlanetHeightData& height, const f64v3& normal) const {
-    generateHeightData(height, normal * m_genData->radius, normal);
+void SphericalHeightmapGenerator::sampleBiomeTile(WorldCubeFace face, const f64v2& facePosition, std::shared_ptr<const BiomeTile>& tile, OUT f64* childNoise) const {
+    BiomeTileKey key;
+    key.face = face;
+    key.pos.x = (i32)floor(facePosition.x / BIOME_TILE_WIDTH);
+    key.pos.y = (i32)floor(facePosition.y / BIOME_TILE_WIDTH);
+    if (!tile || !(tile->key == key)) tile = getBiomeTile(key);
+
+    // Cell and position in it
+    f64 fx = (facePosition.x - (f64)key.pos.x * BIOME_TILE_WIDTH) / BIOME_TILE_SPACING;
+    f64 fz = (facePosition.y - (f64)key.pos.y * BIOME_TILE_WIDTH) / BIOME_TILE_SPACING;
+    ui32 cx = glm::min((ui32)fx, BIOME_TILE_CELLS - 1);
+    ui32 cz = glm::min((ui32)fz, BIOME_TILE_CELLS - 1);
+    fx -= cx;
+    fz -= cz;
+
+    const size_t n = m_childNoiseBiomes.size();
+    const f64* v00 = &tile->values[(cz * BIOME_TILE_SAMPLES + cx) * n];
+    const f64* v10 = v00 + n;
+    const f64* v01 = v00 + BIOME_TILE_SAMPLES * n;
+    const f64* v11 = v01 + n;
+    for (size_t i = 0; i < n; i++) {
+        f64 a = v00[i] + (v10[i] - v00[i]) * fx;
+        f64 b = v01[i] + (v11[i] - v01[i]) * fx;
+        childNoise[i] = a + (b - a) * fz;
+    }
+}
+
+std::shared_ptr<const BiomeTile> SphericalHeightmapGenerator::getBiomeTile(const BiomeTileKey& key) const {
+    std::shared_ptr<const BiomeTile> cached = m_biomeTiles.get(key);
+    if (cached) return cached;
+
+    // Sample positions, made the same way as in generateHeightDataBatch
+    const size_t SAMPLES = BIOME_TILE_SAMPLES * BIOME_TILE_SAMPLES;
+    std::vector<f64> posData(SAMPLES * 3);
+    f64* px = posData.data();
+    f64* py = px + SAMPLES;
+    f64* pz = py + SAMPLES;
+    VoxelPosition2D facePosition;
+    facePosition.face = key.face;
+    for (ui32 z = 0; z < BIOME_TILE_SAMPLES; z++) {
+        for (ui32 x = 0; x < BIOME_TILE_SAMPLES; x++) {
+            facePosition.pos.x = (f64)key.pos.x * BIOME_TILE_WIDTH + (f64)x * BIOME_TILE_SPACING;
+            facePosition.pos.y = (f64)key.pos.y * BIOME_TILE_WIDTH + (f64)z * BIOME_TILE_SPACING;
+            f64v3 pos = glm::normalize(getCubePosition(facePosition)) * m_genData->radius;
+            size_t i = z * BIOME_TILE_SAMPLES + x;
+            px[i] = pos.x;
+            py[i] = pos.y;
+            pz[i] = pos.z;
+        }
+    }
+
+    std::shared_ptr<BiomeTile> tile = std::make_shared<BiomeTile>();
+    tile->key = key;
+    const size_t n = m_childNoiseBiomes.size();
+    tile->values.resize(SAMPLES * n);
+    std::vector<f64> noise(SAMPLES);
+    for (size_t slot = 0; slot < n; slot++) {
+        size_t biomeIndex = m_childNoiseBiomes[slot];
+        std::fill(noise.begin(), noise.end(), (f64)m_genData->biomes[biomeIndex].childNoise.base);
+        m_biomeChildPrograms[biomeIndex].evaluate(px, py, pz, SAMPLES, noise.data());
+        for (size_t i = 0; i < SAMPLES; i++) {
+            tile->values[i * n + slot] = noise[i];
+        }
+    }
+    return m_biomeTiles.insert(tile);
+}
+
+f64v3 SphericalHeightmapGenerator::getCubePosition(const VoxelPosition2D& facePosition) const {
+    f32v2 coordMults = f32v2(VoxelSpaceConversions::FACE_TO_WORLD_MULTS[(int)facePosition.face]);
+    i32v3 coordMapping = VoxelSpaceConversions::VOXEL_TO_WORLD[(int)facePosition.face];
+
+    f64v3 pos;
+    pos[coordMapping.x] = facePosition.pos.x * KM_PER_VOXEL * coordMults.x;
+    pos[coordMapping.y] = m_genData->radius * (f64)VoxelSpaceConversions::FACE_Y_MULTS[(int)facePosition.face];
+    pos[coordMapping.z] = facePosition.pos.y * KM_PER_VOXEL * coordMults.y;
+    return pos;
 }
 
 FloraID SphericalHeightmapGenerator::getTreeID(const Biome* biome, const VoxelPosition2D& facePosition, const f64v3& worldPos) const {
@@ -194,6 +528,10 @@ inline void SphericalHeightmapGenerator::generateHeightData(OUT PlanetHeightData
     h *= KM_PER_M;
     f64 temperature = getTemperatureValue(pos, normal, h);
     f64 humidity = getHumidityValue(pos, normal, h);
+    generateBiomeData(height, pos, temperature, humidity);
+}
+
+void SphericalHeightmapGenerator::generateBiomeData(OUT PlanetHeightData& height, const f64v3& pos, f64 temperature, f64 humidity, const f64* childNoise /*= nullptr*/) const {
     height.temperature = (ui8)temperature;
     height.humidity = (ui8)humidity;
     height.flora = FLORA_ID_NONE;
@@ -210,20 +548,21 @@ inline void SphericalHeightmapGenerator::generateHeightData(OUT PlanetHeightData
         f64 baseWeight = bb.first.weight * bb.second;
         // Get base biome terrain
         f64 newHeight = biome->terrainNoise.base + height.height;
-        getNoiseValue(pos, biome->terrainNoise.funcs, nullptr, TerrainOp::ADD, newHeight);
+        getBiomeTerrainValue(biome, pos, newHeight);
         // Mix in height with squared interpolation
         height.height = (f32)((baseWeight * newHeight) + (1.0 - baseWeight) * (f64)height.height);
         // Sub biomes
-        recurseChildBiomes(biome, pos, height.height, biggestWeight, bestBiome, baseWeight);
+        recurseChildBiomes(biome, pos, height.height, biggestWeight, bestBiome, baseWeight, childNoise);
     }
     // Mark biome that is the best
     height.biome = bestBiome;
 }
 
-void SphericalHeightmapGenerator::recurseChildBiomes(const Biome* biome, const f64v3& pos, f32& height, f64& biggestWeight, const Biome*& bestBiome, f64 baseWeight) const {
+void SphericalHeightmapGenerator::recurseChildBiomes(const Biome* biome, const f64v3& pos, f32& height, f64& biggestWeight, const Biome*& bestBiome, f64 baseWeight, const f64* childNoise) const {
+    // Nothing to pick, so skip the noise
+    if (biome->children.empty()) return;
     // Get child noise value
-    f64 noiseVal = biome->childNoise.base;
-    getNoiseValue(pos, biome->childNoise.funcs, nullptr, TerrainOp::ADD, noiseVal);
+    f64 noiseVal = getChildNoiseValue(biome, pos, childNoise);
     // Sub biomes
     for (auto& child : biome->children) {
         f64 weight = 1.0;
@@ -282,7 +621,7 @@ void SphericalHeightmapGenerator::recurseChildBiomes(const Biome* biome, const f
         }
         // If we reach here, the biome exists.
         f64 newHeight = child->terrainNoise.base + height;
-        getNoiseValue(pos, child->terrainNoise.funcs, nullptr, TerrainOp::ADD, newHeight);
+        getBiomeTerrainValue(child, pos, newHeight);
         // Biggest weight biome is the next biome
         if (weight >= biggestWeight) {
             biggestWeight = weight;
@@ -293,26 +632,49 @@ void SphericalHeightmapGenerator::recurseChildBiomes(const Biome* biome, const f
         height = (f32)((weight * newHeight) + (1.0 - weight) * height);
         // Recurse children
         if (child->children.size() && weight > WEIGHT_THRESHOLD) {
-            recurseChildBiomes(child, pos, height, biggestWeight, bestBiome, weight);
+            recurseChildBiomes(child, pos, height, biggestWeight, bestBiome, weight, childNoise);
         }
     }
 }
 
+f64 SphericalHeightmapGenerator::getChildNoiseValue(const Biome* biome, const f64v3& pos, const f64* childNoise) const {
+    size_t index = biome - m_genData->biomes.data();
+    f64 noiseVal = biome->childNoise.base;
+    if (index < m_biomeChildPrograms.size()) {
+        if (childNoise) return childNoise[m_childNoiseSlots[index]];
+        m_biomeChildPrograms[index].evaluate(pos, noiseVal);
+    } else {
+        // Not one of the planet's biomes, such as DEFAULT_BIOME
+        getNoiseValue(pos, biome->childNoise.funcs, nullptr, TerrainOp::ADD, noiseVal);
+    }
+    return noiseVal;
+}
+
+void SphericalHeightmapGenerator::getBiomeTerrainValue(const Biome* biome, const f64v3& pos, f64& height) const {
+    size_t index = biome - m_genData->biomes.data();
+    if (index < m_biomeTerrainPrograms.size()) {
+        m_biomeTerrainPrograms[index].evaluate(pos, height);
+    } else {
+        // Not one of the planet's biomes, such as DEFAULT_BIOME
+        getNoiseValue(pos, biome->terrainNoise.funcs, nullptr, TerrainOp::ADD, height);
+    }
+}
+
 f64 SphericalHeightmapGenerator::getBaseHeightValue(const f64v3& pos) const {
     f64 genHeight = m_genData->baseTerrainFuncs.base;
-    getNoiseValue(pos, m_genData->baseTerrainFuncs.funcs, nullptr, TerrainOp::ADD, genHeight);
+    m_baseTerrainProgram.evaluate(pos, genHeight);
     return genHeight;
 }
 
 f64 SphericalHeightmapGenerator::getTemperatureValue(const f64v3& pos, const f64v3& normal, f64 height) const {
     f64 genHeight = m_genData->tempTerrainFuncs.base;
-    getNoiseValue(pos, m_genData->tempTerrainFuncs.funcs, nullptr, TerrainOp::ADD, genHeight);
+    m_tempTerrainProgram.evaluate(pos, genHeight);
     return calculateTemperature(m_genData->tempLatitudeFalloff, computeAngleFromNormal(normal), genHeight - glm::max(0.0, m_genData->tempHeightFalloff * height));
 }
 
 f64 SphericalHeightmapGenerator::getHumidityValue(const f64v3& pos, const f64v3& normal, f64 height) const {
     f64 genHeight = m_genData->humTerrainFuncs.base;
-    getNoiseValue(pos, m_genData->humTerrainFuncs.funcs, nullptr, TerrainOp::ADD, genHeight);
+    m_humTerrainProgram.evaluate(pos, genHeight);
     return SphericalHeightmapGenerator::calculateHumidity(m_genData->humLatitudeFalloff, computeAngleFromNormal(normal), genHeight - glm::max(0.0, m_genData->humHeightFalloff * height));
 }
 
@@ -20,6 +20,8 @@
 #include "TerrainPatchMesher.h"
 #include "VoxelCoordinateSpaces.h"
 #include "PlanetGenData.h"
+#include "NoiseProgram.h"
+#include "BiomeTileMap.h"
 
 #include <Vorb/Event.hpp>
 
@@ -31,11 +33,30 @@ typedef Delegate<void, PlanetHeightData&, f64v3, PlanetGenData> heightmapGenFunc
 
 class SphericalHeightmapGenerator {
 public:
+    /// Compiles the planet's noise, so call it again if the gen data changes
     void init(const PlanetGenData* planetGenData);
 
     /// Gets the height at a specific face position.
     void generateHeightData(OUT PlanetHeightData& height, const VoxelPosition2D& facePosition) const;
     void generateHeightData(OUT PlanetHeightData& height, const f64v3& normal) const;
+    /// Gets the heights for a width * width square of face positions, row by row,
+    /// starting at cornerPos. Same results as the per position version, but the
+    /// noise for all positions is evaluated together which is much faster.
+    /// Uses generateHeightDataAdaptive when there is a height tolerance and width allows it.
+    /// @param step: Voxels between positions. Flora is only placed when it is 1.
+    void generateHeightData(OUT PlanetHeightData* heights, const VoxelPosition2D& cornerPos, ui32 width, ui32 step = 1) const;
+    /// Same as the batched generateHeightData, but only evaluates the noise on a lattice
+    /// of every 4th position and at the center of each cell. Cells of the lattice are
+    /// filled by bilinear interpolation, unless their curvature says the height would be
+    /// off by more than tolerance, their corners have different biomes, or their center
+    /// doesn't match the interpolated height, temperature or humidity. Those cells are
+    /// evaluated in full.
+    /// The tolerance is a heuristic, not a bound. Features narrower than the lattice
+    /// that miss the cell centers are still smoothed away.
+    /// @param width: Must be a multiple of 4, and at least 8
+    /// @param tolerance: Height error in voxels to aim for
+    /// @return The number of positions the noise was evaluated at
+    size_t generateHeightDataAdaptive(OUT PlanetHeightData* heights, const VoxelPosition2D& cornerPos, ui32 width, ui32 step, f32 tolerance) const;
 
     // Gets the tree id that should be at a specific worldspace position
     FloraID getTreeID(const Biome* biome, const VoxelPosition2D& facePosition, const f64v3& worldPos) const;
@@ -43,9 +64,38 @@ class SphericalHeightmapGenerator {
     FloraID getFloraID(const Biome* biome, const VoxelPosition2D& facePosition, const f64v3& worldPos) const;
     
     const PlanetGenData* getGenData() const { return m_genData; }
+
+    /// Sets the height error allowed in batched generation. 0 evaluates every position.
+    /// init sets it to PlanetGenData::heightTolerance.
+    void setHeightTolerance(f32 tolerance) { m_heightTolerance = tolerance; }
+    f32 getHeightTolerance() const { return m_heightTolerance; }
+    /// Sets whether batched generation with steps below BIOME_TILE_SPACING interpolates
+    /// child biome noise from cached tiles instead of evaluating it per position.
+    /// init sets it to PlanetGenData::useBiomeTiles.
+    void setBiomeTilesEnabled(bool enabled) { m_useBiomeTiles = enabled; }
+    bool getBiomeTilesEnabled() const { return m_useBiomeTiles; }
+    size_t getNumBiomeTiles() const { return m_biomeTiles.getNumTiles(); }
 private:
     void generateHeightData(OUT PlanetHeightData& height, const f64v3& pos, const f64v3& normal) const;
-    void recurseChildBiomes(const Biome* biome, const f64v3& pos, f32& height, f64& biggestWeight, const Biome*& bestBiome, f64 baseWeight) const;
+    /// Generates count face positions, given in voxels, with the noise batched
+    /// @param step: Voxels between neighbouring positions, which decides if biome tiles are worth it
+    void generateHeightDataBatch(OUT PlanetHeightData* heights, WorldCubeFace face, const f64v2* facePositions, size_t count, ui32 step, bool placeFlora) const;
+    /// Picks the tree or flora for a column
+    void generateFlora(OUT PlanetHeightData& height, const VoxelPosition2D& facePosition, const f64v3& pos) const;
+    /// Gets the unnormalized position of a face position on the cube, in KM
+    f64v3 getCubePosition(const VoxelPosition2D& facePosition) const;
+    /// Picks the biome and blends in its terrain once height, temperature and humidity are known
+    /// @param childNoise: Child noise for each biome with children, from sampleBiomeTile. Evaluated when null.
+    void generateBiomeData(OUT PlanetHeightData& height, const f64v3& pos, f64 temperature, f64 humidity, const f64* childNoise = nullptr) const;
+    void recurseChildBiomes(const Biome* biome, const f64v3& pos, f32& height, f64& biggestWeight, const Biome*& bestBiome, f64 baseWeight, const f64* childNoise) const;
+    /// Gets the child noise of a biome, from childNoise when it is there
+    f64 getChildNoiseValue(const Biome* biome, const f64v3& pos, const f64* childNoise) const;
+    /// Interpolates the child noise for a face position from its biome tile
+    /// @param tile: The last tile used. Replaced when the position is in another tile.
+    /// @param childNoise: One value per biome with children
+    void sampleBiomeTile(WorldCubeFace face, const f64v2& facePosition, std::shared_ptr<const BiomeTile>& tile, OUT f64* childNoise) const;
+    /// Gets a biome tile from the cache, building it if needed
+    std::shared_ptr<const BiomeTile> getBiomeTile(const BiomeTileKey& key) const;
     
     /// Gets noise value using terrainFuncs
     /// @return the noise value
@@ -54,6 +104,8 @@ class SphericalHeightmapGenerator {
                       f64* modifier,
                       const TerrainOp& op,
                       f64& height) const;
+    /// Adds the biome's terrain noise to height
+    void getBiomeTerrainValue(const Biome* biome, const f64v3& pos, f64& height) const;
 
     f64 getBaseHeightValue(const f64v3& pos) const;
     f64 getTemperatureValue(const f64v3& pos, const f64v3& normal, f64 height) const;
@@ -74,6 +126,20 @@ class SphericalHeightmapGenerator {
     static f64 computeAngleFromNormal(const f64v3& normal);
 
     const PlanetGenData* m_genData = nullptr; ///< Planet generation data for this generator
+    f32 m_heightTolerance = 0.0f;
+
+    // Compiled noise, so the trees aren't walked for every position
+    NoiseProgram m_baseTerrainProgram;
+    NoiseProgram m_tempTerrainProgram;
+    NoiseProgram m_humTerrainProgram;
+    std::vector<NoiseProgram> m_biomeTerrainPrograms; ///< Same order as PlanetGenData::biomes
+    std::vector<NoiseProgram> m_biomeChildPrograms; ///< Same order as PlanetGenData::biomes
+
+    // Biome tiles
+    bool m_useBiomeTiles = false;
+    std::vector<ui32> m_childNoiseSlots; ///< Slot in BiomeTile samples for each biome, or UINT32_MAX without children
+    std::vector<size_t> m_childNoiseBiomes; ///< Biome index for each slot
+    mutable BiomeTileMap m_biomeTiles;
 };
 
 #endif // SphericalTerrainCpuGenerator_h__
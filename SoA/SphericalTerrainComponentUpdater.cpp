@@ -1,6 +1,7 @@
 #include "stdafx.h"
 #include "SphericalTerrainComponentUpdater.h"
 
+#include "HeightmapTileCache.h"
 #include "SoAState.h"
 #include "SpaceSystem.h"
 #include "SpaceSystemAssemblages.h"
@@ -33,8 +34,10 @@ void SphericalTerrainComponentUpdater::update(SoaState* state, const f64v3& came
             stCmp.cpuGenerator->init(data);
             // Do this last to prevent race condition with regular update
             data->radius = stCmp.radius;
+            stCmp.heightmapCache = new HeightmapTileCache(stCmp.cpuGenerator);
             stCmp.planetGenData = data;
             stCmp.sphericalTerrainData->generator = stCmp.cpuGenerator;
+            stCmp.sphericalTerrainData->heightmapCache = stCmp.heightmapCache;
             stCmp.sphericalTerrainData->meshManager = stCmp.meshManager;
         }
 
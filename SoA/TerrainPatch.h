@@ -21,6 +21,7 @@
 
 #include <Vorb/graphics/gtypes.h>
 
+class HeightmapTileCache;
 class TerrainPatchMesh;
 class TerrainPatchMesher;
 class SphericalHeightmapGenerator;
@@ -45,6 +46,7 @@ struct TerrainPatchData { // TODO(Ben): probably dont need this
     f64 radius; ///< Radius of the planet in KM
     f64 patchWidth; ///< Width of a patch in KM
     SphericalHeightmapGenerator* generator;
+    HeightmapTileCache* heightmapCache = nullptr; ///< Shared with the voxel chunks when set
     TerrainPatchMeshManager* meshManager;
     vcore::ThreadPool<WorkerData>* threadPool;
 };
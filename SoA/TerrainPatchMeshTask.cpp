@@ -1,4 +1,5 @@
 #include "stdafx.h"
+#include "HeightmapTileCache.h"
 #include "SphericalHeightmapGenerator.h"
 #include "TerrainPatchMesh.h"
 #include "TerrainPatchMeshManager.h"
@@ -33,6 +34,10 @@ void TerrainPatchMeshTask::execute(WorkerData* workerData) {
     const float VERT_WIDTH = m_width / (PATCH_WIDTH - 1);
     bool isSpherical = m_mesh->getIsSpherical();
 
+    // Share height data with nearby patches and voxel chunks when we can
+    bool useCache = m_patchData->heightmapCache != nullptr;
+    if (useCache) getCachedHeightData(heightData, VERT_WIDTH);
+
     if (isSpherical) {
         const i32v3& coordMapping = VoxelSpaceConversions::VOXEL_TO_WORLD[(int)m_cubeFace];
         const f32v2& coordMults = f32v2(VoxelSpaceConversions::FACE_TO_WORLD_MULTS[(int)m_cubeFace]);
@@ -44,7 +49,7 @@ void TerrainPatchMeshTask::execute(WorkerData* workerData) {
                 pos[coordMapping.y] = m_startPos.y;
                 pos[coordMapping.z] = (m_startPos.z + (z - 1) * VERT_WIDTH) * coordMults.y;
                 f64v3 normal(glm::normalize(pos));
-                generator->generateHeightData(heightData[z][x], normal);
+                if (!useCache) generator->generateHeightData(heightData[z][x], normal);
                 
                 // offset position by height;
                 positionData[z][x] = normal * (m_patchData->radius + heightData[z][x].height * KM_PER_VOXEL);
@@ -64,7 +69,7 @@ void TerrainPatchMeshTask::execute(WorkerData* workerData) {
                 pos[coordMapping.y] = m_startPos.y;
                 pos[coordMapping.z] = spos.y * coordMults.y;
                 f64v3 normal(glm::normalize(pos));
-                generator->generateHeightData(heightData[z][x], normal);
+                if (!useCache) generator->generateHeightData(heightData[z][x], normal);
 
                 // offset position by height;
                 positionData[z][x] = f64v3(spos.x, heightData[z][x].height * KM_PER_VOXEL, spos.y);
@@ -83,3 +88,52 @@ void TerrainPatchMeshTask::execute(WorkerData* workerData) {
     // Finally, add to the mesh manager
     m_patchData->meshManager->addMeshAsync(m_mesh);
 }
+
+void TerrainPatchMeshTask::getCachedHeightData(OUT PlanetHeightData heightData[PADDED_PATCH_WIDTH][PADDED_PATCH_WIDTH], f32 vertWidth) const {
+    // Pick the coarsest lattice that still has a sample between every pair of vertices
+    f64 vertVoxels = (f64)vertWidth * VOXELS_PER_KM;
+    ui32 lod = 0;
+    while (lod < HEIGHTMAP_MAX_LOD && (f64)(2ull << lod) <= vertVoxels) lod++;
+    const f64 step = (f64)(1ull << lod);
+
+    // Vertex positions in samples. The first row and column are padding.
+    f64 startX = ((f64)m_startPos.x - vertWidth) * VOXELS_PER_KM / step;
+    f64 startZ = ((f64)m_startPos.z - vertWidth) * VOXELS_PER_KM / step;
+    f64 sampleStride = vertVoxels / step;
+    f64 endX = startX + sampleStride * (PADDED_PATCH_WIDTH - 1);
+    f64 endZ = startZ + sampleStride * (PADDED_PATCH_WIDTH - 1);
+    i32v2 start((i32)floor(startX), (i32)floor(startZ));
+    ui32v2 size((ui32)((i32)floor(endX) - start.x + 2), (ui32)((i32)floor(endZ) - start.y + 2));
+
+    std::vector<PlanetHeightData> samples(size.x * size.y);
+    m_patchData->heightmapCache->getSamples(m_cubeFace, lod, start, size, samples.data());
+
+    for (int z = 0; z < PADDED_PATCH_WIDTH; z++) {
+        f64 sz = startZ + z * sampleStride - start.y;
+        ui32 iz = glm::min((ui32)sz, size.y - 2);
+        f64 fz = sz - iz;
+        for (int x = 0; x < PADDED_PATCH_WIDTH; x++) {
+            f64 sx = startX + x * sampleStride - start.x;
+            ui32 ix = glm::min((ui32)sx, size.x - 2);
+            f64 fx = sx - ix;
+            const PlanetHeightData& s00 = samples[iz * size.x + ix];
+            const PlanetHeightData& s10 = samples[iz * size.x + ix + 1];
+            const PlanetHeightData& s01 = samples[(iz + 1) * size.x + ix];
+            const PlanetHeightData& s11 = samples[(iz + 1) * size.x + ix + 1];
+            f64 w00 = (1.0 - fx) * (1.0 - fz);
+            f64 w10 = fx * (1.0 - fz);
+            f64 w01 = (1.0 - fx) * fz;
+            f64 w11 = fx * fz;
+
+            PlanetHeightData& h = heightData[z][x];
+            // Biome and flags can't be blended, so take the nearest sample
+            const PlanetHeightData& nearest = (fz < 0.5) ? ((fx < 0.5) ? s00 : s10) : ((fx < 0.5) ? s01 : s11);
+            h.biome = nearest.biome;
+            h.flags = nearest.flags;
+            h.flora = FLORA_ID_NONE;
+            h.height = (f32)(s00.height * w00 + s10.height * w10 + s01.height * w01 + s11.height * w11);
+            h.temperature = (ui8)(s00.temperature * w00 + s10.temperature * w10 + s01.temperature * w01 + s11.temperature * w11 + 0.5);
+            h.humidity = (ui8)(s00.humidity * w00 + s10.humidity * w10 + s01.humidity * w01 + s11.humidity * w11 + 0.5);
+        }
+    }
+}
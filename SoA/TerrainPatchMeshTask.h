@@ -18,6 +18,8 @@
 #include <Vorb/IThreadPoolTask.h>
 
 #include "Constants.h"
+#include "PlanetHeightData.h"
+#include "TerrainPatchConstants.h"
 #include "VoxPool.h"
 #include "VoxelCoordinateSpaces.h"
 
@@ -45,6 +47,9 @@ class TerrainPatchMeshTask : public vcore::IThreadPoolTask < WorkerData > {
     void execute(WorkerData* workerData) override;
 
 private:
+    /// Fills heightData by interpolating cached samples no further apart than the vertices
+    void getCachedHeightData(OUT PlanetHeightData heightData[PADDED_PATCH_WIDTH][PADDED_PATCH_WIDTH], f32 vertWidth) const;
+
     f32v3 m_startPos;
     WorldCubeFace m_cubeFace;
     float m_width;
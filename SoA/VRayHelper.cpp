@@ -46,14 +46,14 @@ const VoxelRayQuery VRayHelper::getQuery(const f64v3& pos, const f32v3& dir, f64
             query.chunkID = id;
             if (chunk.isAquired()) {
                 if (locked) {
-                    chunk->dataMutex.unlock();
+                    chunk->dataMutex.unlock_shared();
                     locked = false;
                 }
                 chunk.release();
             }
             chunk = cg.accessor.acquire(id);
             if (chunk->isAccessible) {
-                chunk->dataMutex.lock();
+                chunk->dataMutex.lock_shared();
                 locked = true;
             }
         }
@@ -70,7 +70,7 @@ const VoxelRayQuery VRayHelper::getQuery(const f64v3& pos, const f32v3& dir, f64
 
             // Check For The Block ID
             if (f(cg.blockPack->operator[](query.id))) {
-                if (locked) chunk->dataMutex.unlock();
+                if (locked) chunk->dataMutex.unlock_shared();
                 chunk.release();
                 return query;
             }
@@ -81,7 +81,7 @@ const VoxelRayQuery VRayHelper::getQuery(const f64v3& pos, const f32v3& dir, f64
         query.distance = vr.getDistanceTraversed();
     }
     if (chunk.isAquired()) {
-        if (locked) chunk->dataMutex.unlock();
+        if (locked) chunk->dataMutex.unlock_shared();
         chunk.release();
     }
     return query;
@@ -120,14 +120,14 @@ const VoxelRayFullQuery VRayHelper::getFullQuery(const f64v3& pos, const f32v3&
             query.inner.chunkID = id;
             if (chunk.isAquired()) {
                 if (locked) {
-                    chunk->dataMutex.unlock();
+                    chunk->dataMutex.unlock_shared();
                     locked = false;
                 }
                 chunk.release();
             }
             chunk = cg.accessor.acquire(id);
             if (chunk->isAccessible) {
-                chunk->dataMutex.lock();
+                chunk->dataMutex.lock_shared();
                 locked = true;
             }
         }
@@ -145,7 +145,7 @@ const VoxelRayFullQuery VRayHelper::getFullQuery(const f64v3& pos, const f32v3&
 
             // Check For The Block ID
             if (f(cg.blockPack->operator[](query.inner.id))) {
-                if (locked) chunk->dataMutex.unlock();
+                if (locked) chunk->dataMutex.unlock_shared();
                 chunk.release();
                 return query;
             }
@@ -159,7 +159,7 @@ const VoxelRayFullQuery VRayHelper::getFullQuery(const f64v3& pos, const f32v3&
         query.inner.distance = vr.getDistanceTraversed();
     }
     if (chunk.isAquired()) {
-        if (locked) chunk->dataMutex.unlock();
+        if (locked) chunk->dataMutex.unlock_shared();
         chunk.release();
     }
     return query;
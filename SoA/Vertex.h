@@ -77,16 +77,39 @@ struct BlockVertex {
     ui8 mesherFlags;
 
     color3 overlayColor;
-    ui8 padding;
+    ui8 ao; ///< 0 fully occluded to 3 unoccluded
 
     // This isn't a full comparison. Its just for greedy mesh comparison so its lightweight.
     bool operator==(const BlockVertex& rhs) const {
         return (color == rhs.color && overlayColor == rhs.overlayColor &&
-                texturePosition == rhs.texturePosition);
+                texturePosition == rhs.texturePosition && ao == rhs.ao);
     }
 };
 static_assert(sizeof(BlockVertex) == 32, "Size of BlockVertex is not 32");
 
+// Size: 8 Bytes
+// Opaque block vertex with every attribute quantized. Decoded by the opaque
+// chunk shader in ChunkRenderer.cpp, so keep the two in sync.
+struct PackedBlockVertex {
+    /// Packs the voxel the quad starts at, the corner of the quad this vertex is
+    /// and the quad's size in voxels along the face's right and front axes.
+    /// @param ao: 0 fully occluded to 3 unoccluded
+    static ui32 packGeometry(const ui8v3& voxel, ui32 face, ui32 corner, ui32 width, ui32 height, ui32 ao) {
+        return (ui32)voxel.x | ((ui32)voxel.y << 5) | ((ui32)voxel.z << 10) | (face << 15) |
+            (corner << 18) | ((width - 1) << 20) | ((height - 1) << 25) | (ao << 30);
+    }
+    /// @param texture: Base texture index, atlas page included
+    /// @param palette: Index into the mesh's ChunkPaletteEntry array
+    /// @param light: 0 dark to 255 fully lit
+    static ui32 packMaterial(ui32 texture, ui32 palette, ui32 light) {
+        return (texture & 0xFFFF) | (palette << 16) | (light << 24);
+    }
+
+    ui32 geometry; ///< x, y, z: 5 bits each, face: 3, corner: 2, width - 1: 5, height - 1: 5, ao: 2
+    ui32 material; ///< Texture index: 16 bits, palette index: 8, light: 8
+};
+static_assert(sizeof(PackedBlockVertex) == 8, "Size of PackedBlockVertex is not 8");
+
 class LiquidVertex {
 public:
     // TODO: x and z can be bytes?
@@ -11,6 +11,25 @@
 
 // TODO: Implement and remove VORB_UNUSED tags.
 
+// Fires DataChange for the edited chunks, and for neighbors whose meshes show
+// their border voxels, then releases the edited chunks
+inline void notifyDataChange(std::map<ChunkID, ChunkHandle>& modifiedChunks) {
+    for (auto& it : modifiedChunks) {
+        if (!it.second->isAccessible) continue;
+        it.second->DataChange(it.second);
+        for (int i = 0; i < 6; i++) {
+            ChunkHandle& n = it.second->neighbors[i];
+            if (n.isAquired() && n->isAccessible && n->dirtyMeshSections &&
+                modifiedChunks.find(n.getID()) == modifiedChunks.end()) {
+                n->DataChange(n);
+            }
+        }
+    }
+    for (auto& it : modifiedChunks) {
+        it.second.release();
+    }
+}
+
 void VoxelEditor::editVoxels(ChunkGrid& grid, ItemStack* block) {
     if (m_startPosition.x == INT_MAX || m_endPosition.x == INT_MAX) {
         return;
@@ -107,14 +126,10 @@ void VoxelEditor::placeAABox(ChunkGrid& grid, ItemStack* block) {
 
                         // ChunkUpdater::placeBlock(chunk, )
                         ChunkUpdater::placeBlockNoUpdate(chunk, voxelIndex, block->pack->operator[](block->id).blockID);
+                        chunk->flagVoxelDirty((BlockIndex)voxelIndex);
                         if (block->count == 0) {
                             if (locked) chunk->dataMutex.unlock();
-                            for (auto& it : modifiedChunks) {
-                                if (it.second->isAccessible) {
-                                    it.second->DataChange(it.second);
-                                }
-                                it.second.release();
-                            }
+                            notifyDataChange(modifiedChunks);
                             stopDragging();
                             return;
                         }
@@ -125,12 +140,7 @@ void VoxelEditor::placeAABox(ChunkGrid& grid, ItemStack* block) {
         }
     }
     if (locked) chunk->dataMutex.unlock();
-    for (auto& it : modifiedChunks) {
-        if (it.second->isAccessible) {
-            it.second->DataChange(it.second);
-        }
-        it.second.release();
-    }
+    notifyDataChange(modifiedChunks);
     stopDragging();
 }
 
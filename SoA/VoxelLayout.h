@@ -0,0 +1,109 @@
+//
+// VoxelLayout.h
+// Seed of Andromeda
+//
+// Copyright 2014 Regrowth Studios
+// MIT License
+//
+// Summary:
+// Maps block indices to where the voxel lives in chunk storage. Block
+// indices are always x + y * CHUNK_LAYER + z * CHUNK_WIDTH, but storage
+// may be Morton (Z-order) so that 6-neighbourhoods share cache lines.
+// Define VOXEL_LAYOUT_MORTON to switch chunk storage to Morton order.
+//
+
+#pragma once
+
+#ifndef VoxelLayout_h__
+#define VoxelLayout_h__
+
+#include "Constants.h"
+
+namespace vorb {
+    namespace voxel {
+
+        /// Storage order is y, z, x. Storage index == block index.
+        struct LinearLayout {
+            static const bool IS_LINEAR = true;
+
+            static inline ui32 toStorage(ui32 blockIndex) { return blockIndex; }
+            static inline ui32 toBlockIndex(ui32 storageIndex) { return storageIndex; }
+            static inline ui32 getStorageIndex(ui32 x, ui32 y, ui32 z) {
+                return x | (y << 10) | (z << 5);
+            }
+            static inline i32v3 getPos(ui32 storageIndex) {
+                return i32v3(storageIndex & 0x1f, storageIndex >> 10, (storageIndex >> 5) & 0x1f);
+            }
+            /// Steps to a neighbour. The result must stay inside the chunk.
+            static inline ui32 offset(ui32 storageIndex, i32 dx, i32 dy, i32 dz) {
+                return (ui32)((i32)storageIndex + dx + dy * CHUNK_LAYER + dz * CHUNK_WIDTH);
+            }
+        };
+
+        /// Storage order interleaves the bits of x, z and y, so every
+        /// aligned 2x2x2, 4x4x4, ... block is contiguous.
+        struct MortonLayout {
+            static const bool IS_LINEAR = false;
+
+            static const ui32 X_MASK = 0x1249;
+            static const ui32 Z_MASK = X_MASK << 1;
+            static const ui32 Y_MASK = X_MASK << 2;
+
+            static inline ui32 toStorage(ui32 blockIndex) {
+                return getStorageIndex(blockIndex & 0x1f, blockIndex >> 10, (blockIndex >> 5) & 0x1f);
+            }
+            static inline ui32 toBlockIndex(ui32 storageIndex) {
+                return compact(storageIndex) | (compact(storageIndex >> 2) << 10) | (compact(storageIndex >> 1) << 5);
+            }
+            static inline ui32 getStorageIndex(ui32 x, ui32 y, ui32 z) {
+                return spread(x) | (spread(z) << 1) | (spread(y) << 2);
+            }
+            static inline i32v3 getPos(ui32 storageIndex) {
+                return i32v3(compact(storageIndex), compact(storageIndex >> 2), compact(storageIndex >> 1));
+            }
+            /// Steps to a neighbour. The result must stay inside the chunk.
+            static inline ui32 offset(ui32 storageIndex, i32 dx, i32 dy, i32 dz) {
+                if (dx) storageIndex = addMasked(storageIndex, X_MASK, dx, 0);
+                if (dy) storageIndex = addMasked(storageIndex, Y_MASK, dy, 2);
+                if (dz) storageIndex = addMasked(storageIndex, Z_MASK, dz, 1);
+                return storageIndex;
+            }
+        private:
+            /// Moves bit n of a 5 bit value to bit 3n
+            static inline ui32 spread(ui32 v) {
+                static const ui16 SPREAD[32] = {
+                    0x0000, 0x0001, 0x0008, 0x0009, 0x0040, 0x0041, 0x0048, 0x0049,
+                    0x0200, 0x0201, 0x0208, 0x0209, 0x0240, 0x0241, 0x0248, 0x0249,
+                    0x1000, 0x1001, 0x1008, 0x1009, 0x1040, 0x1041, 0x1048, 0x1049,
+                    0x1200, 0x1201, 0x1208, 0x1209, 0x1240, 0x1241, 0x1248, 0x1249
+                };
+                return SPREAD[v];
+            }
+            /// Inverse of spread
+            static inline ui32 compact(ui32 v) {
+                v &= X_MASK;
+                v = (v ^ (v >> 2)) & 0x030C30C3;
+                v = (v ^ (v >> 4)) & 0x0300F00F;
+                v = (v ^ (v >> 8)) & 0x1F;
+                return v;
+            }
+            /// Adds d to the coordinate held in the bits of mask without decoding it
+            static inline ui32 addMasked(ui32 s, ui32 mask, i32 d, ui32 shift) {
+                if (d > 0) {
+                    // Filling the gaps with ones makes the carry skip over them
+                    return (((s | ~mask) + (spread((ui32)d) << shift)) & mask) | (s & ~mask);
+                }
+                return (((s & mask) - (spread((ui32)-d) << shift)) & mask) | (s & ~mask);
+            }
+        };
+
+#ifdef VOXEL_LAYOUT_MORTON
+        typedef MortonLayout ChunkLayout;
+#else
+        typedef LinearLayout ChunkLayout;
+#endif
+    }
+}
+namespace vvox = vorb::voxel;
+
+#endif // VoxelLayout_h__
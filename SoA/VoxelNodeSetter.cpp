@@ -4,72 +4,82 @@
 #include "ChunkGrid.h"
 
 void VoxelNodeSetter::setNodes(ChunkHandle& h, ChunkGenLevel requiredGenLevel, std::vector<VoxelToPlace>& forcedNodes, std::vector<VoxelToPlace>& condNodes) {
-    {
-        std::lock_guard<std::mutex> l(m_lckVoxelsToAdd);
-        auto it = m_handleLookup.find(h);
-        if (it != m_handleLookup.end()) {
-            VoxelNodeSetterLookupData& ld = it->second;
-            // Copy new voxels to add
-            size_t oldSize = ld.forcedNodes.size();
-            ld.forcedNodes.resize(oldSize + forcedNodes.size());
-            memcpy(&ld.forcedNodes[oldSize], forcedNodes.data(), forcedNodes.size() * sizeof(VoxelToPlace));
-            oldSize = ld.condNodes.size();
-            ld.condNodes.resize(oldSize + condNodes.size());
-            memcpy(&ld.condNodes[oldSize], condNodes.data(), condNodes.size() * sizeof(VoxelToPlace));
-            // Update required gen level if needed
-            if (m_waitingChunks[ld.waitingChunksIndex].requiredGenLevel < requiredGenLevel) {
-                m_waitingChunks[ld.waitingChunksIndex].requiredGenLevel = requiredGenLevel;
-            }
-        } else {
-            VoxelNodeSetterLookupData& ld = m_handleLookup[h];
-            ld.forcedNodes.swap(forcedNodes);
-            ld.condNodes.swap(condNodes);
-            ld.h = h.acquire();
-            ld.waitingChunksIndex = m_waitingChunks.size();
+    VoxelNodeBatch* batch = new VoxelNodeBatch;
+    batch->h = h.acquire();
+    batch->requiredGenLevel = requiredGenLevel;
+    batch->forcedNodes.swap(forcedNodes);
+    batch->condNodes.swap(condNodes);
+    pushBatches(h, batch, batch);
 
-            VoxelNodeSetterWaitingChunk wc;
-            wc.ch = h;
-            wc.requiredGenLevel = requiredGenLevel;
-            m_waitingChunks.push_back(std::move(wc));
-        }
+    // The chunk may have reached the level before the generator could see the
+    // batch, so check after pushing. Pairs with the fence in flush.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (h->genLevel.load() >= requiredGenLevel) {
+        flush(h);
+    } else {
+        // TODO(Ben): Faster overload?
+        grid->submitQuery(h->getChunkPosition(), requiredGenLevel, true);
     }
-    // TODO(Ben): Faster overload?
-    grid->submitQuery(h->getChunkPosition(), requiredGenLevel, true);
 }
 
-void VoxelNodeSetter::update() {
-    if (m_waitingChunks.size()) {
-        std::cout << m_waitingChunks.size() << std::endl;
-    }
-    std::lock_guard<std::mutex> l(m_lckVoxelsToAdd);
-    for (int i = (int)m_waitingChunks.size() - 1; i >= 0; i--) {
-        VoxelNodeSetterWaitingChunk& v = m_waitingChunks[i];
+void VoxelNodeSetter::flush(Chunk* chunk) {
+    while (true) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        // Taking the whole list means producers never race with a pop
+        VoxelNodeBatch* batch = chunk->pendingNodes.exchange(nullptr, std::memory_order_acquire);
+        if (!batch) return;
 
-        if (v.ch->genLevel >= v.requiredGenLevel) {
-            auto it = m_handleLookup.find(v.ch);
+        // The list is newest first. Reverse it so voxels are placed in the order they were set.
+        VoxelNodeBatch* ordered = nullptr;
+        while (batch) {
+            VoxelNodeBatch* next = batch->next;
+            batch->next = ordered;
+            ordered = batch;
+            batch = next;
+        }
 
-            {
-                // Send task
-                // TODO(Ben): MEMORY MANAGEMENT PROBLEM
-                VoxelNodeSetterTask* newTask = new VoxelNodeSetterTask;
-                newTask->h = it->second.h.acquire();
-                newTask->forcedNodes.swap(it->second.forcedNodes);
-                newTask->condNodes.swap(it->second.condNodes);
-                threadPool->addTask(newTask);
+        ChunkGenLevel genLevel = chunk->genLevel.load();
+        VoxelNodeSetterTask* task = nullptr;
+        VoxelNodeBatch* waitingFirst = nullptr;
+        VoxelNodeBatch* waitingLast = nullptr;
+        ChunkGenLevel minWaitingLevel = ChunkGenLevel::GEN_DONE;
+        while (ordered) {
+            batch = ordered;
+            ordered = ordered->next;
+            if (genLevel >= batch->requiredGenLevel) {
+                if (!task) {
+                    task = new VoxelNodeSetterTask;
+                    task->h = batch->h.acquire();
+                    task->forcedNodes.swap(batch->forcedNodes);
+                    task->condNodes.swap(batch->condNodes);
+                } else {
+                    task->forcedNodes.insert(task->forcedNodes.end(), batch->forcedNodes.begin(), batch->forcedNodes.end());
+                    task->condNodes.insert(task->condNodes.end(), batch->condNodes.begin(), batch->condNodes.end());
+                }
+                batch->h.release();
+                delete batch;
+            } else {
+                // Keep them newest first, like the list
+                batch->next = waitingFirst;
+                waitingFirst = batch;
+                if (!waitingLast) waitingLast = batch;
+                if (batch->requiredGenLevel < minWaitingLevel) minWaitingLevel = batch->requiredGenLevel;
             }
-           
-            it->second.h.release();
-            m_handleLookup.erase(it);
-            
-            // Copy back node for fast removal from vector
-            VoxelNodeSetterWaitingChunk& bn = m_waitingChunks.back();
-            v.ch = bn.ch;
-            v.requiredGenLevel = bn.requiredGenLevel;
-
-            // Update lookup index
-            m_handleLookup[v.ch].waitingChunksIndex = i;
-
-            m_waitingChunks.pop_back();
         }
+        if (task) threadPool->addTask(task);
+        if (!waitingFirst) return;
+
+        // Put back what the chunk isn't ready for, then check it didn't become
+        // ready while they were off the list
+        pushBatches(chunk, waitingFirst, waitingLast);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (chunk->genLevel.load() < minWaitingLevel) return;
     }
 }
+
+void VoxelNodeSetter::pushBatches(Chunk* chunk, VoxelNodeBatch* first, VoxelNodeBatch* last) {
+    VoxelNodeBatch* head = chunk->pendingNodes.load(std::memory_order_relaxed);
+    do {
+        last->next = head;
+    } while (!chunk->pendingNodes.compare_exchange_weak(head, first, std::memory_order_release, std::memory_order_relaxed));
+}
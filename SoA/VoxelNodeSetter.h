@@ -22,34 +22,34 @@
 class ChunkHandle;
 class ChunkGrid;
 
-struct VoxelNodeSetterWaitingChunk {
-    Chunk* ch;
+/// Voxels waiting on a chunk's pendingNodes list
+struct VoxelNodeBatch {
+    ChunkHandle h; ///< Keeps the chunk alive until the batch is placed
     ChunkGenLevel requiredGenLevel;
-};
-
-struct VoxelNodeSetterLookupData {
-    ui32 waitingChunksIndex;
-    ChunkHandle h;
     std::vector<VoxelToPlace> forcedNodes; ///< Always added
     std::vector<VoxelToPlace> condNodes; ///< Conditionally added
+    VoxelNodeBatch* next = nullptr;
 };
 
 class VoxelNodeSetter {
 public:
-    // Contents of vectors may be cleared
+    /// Queues voxels on the chunk until it reaches requiredGenLevel, and
+    /// requests that level. Thread safe.
+    /// Contents of vectors may be cleared
     void setNodes(ChunkHandle& h,
                   ChunkGenLevel requiredGenLevel,
                   std::vector<VoxelToPlace>& forcedNodes,
                   std::vector<VoxelToPlace>& condNodes);
 
-    void update();
+    /// Sends the queued voxels the chunk is ready for to a VoxelNodeSetterTask.
+    /// Call after raising the chunk's genLevel. Thread safe.
+    void flush(Chunk* chunk);
 
     ChunkGrid* grid = nullptr;
     vcore::ThreadPool<WorkerData>* threadPool;
 private:
-    std::mutex m_lckVoxelsToAdd;
-    std::vector<VoxelNodeSetterWaitingChunk> m_waitingChunks;
-    std::map<Chunk*, VoxelNodeSetterLookupData> m_handleLookup; ///< Stores handles since they fk up in vector.
+    /// Puts a list of batches back on the chunk
+    static void pushBatches(Chunk* chunk, VoxelNodeBatch* first, VoxelNodeBatch* last);
 };
 
 #endif // VoxelNodeSetter_h__
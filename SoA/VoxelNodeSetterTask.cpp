@@ -4,21 +4,18 @@
 #include "ChunkHandle.h"
 #include "Chunk.h"
 
+#include <bitset>
+
 void VoxelNodeSetterTask::execute(WorkerData* workerData VORB_MAYBE_UNUSED) {
     {
-        std::lock_guard<std::mutex> l(h->dataMutex);
-        for (auto& node : forcedNodes) {
-            h->blocks.set(node.blockIndex, node.blockID);
-        }
-        for (auto& node : condNodes) {
-            // TODO(Ben): Custom condition
-            if (h->blocks.get(node.blockIndex) == 0) {
-                h->blocks.set(node.blockIndex, node.blockID);
-            }
-        }
+        std::lock_guard<RWSpinLock> l(h->dataMutex);
+        placeNodes(h, forcedNodes, condNodes);
     }
 
-    if (h->genLevel >= GEN_DONE) h->DataChange(h);
+    if (h->genLevel >= GEN_DONE) {
+        h->dirtyMeshSections |= ALL_CHUNK_MESH_SECTIONS;
+        h->DataChange(h);
+    }
 
     h.release();
 }
@@ -27,3 +24,43 @@ void VoxelNodeSetterTask::cleanup() {
     // TODO(Ben): Better memory management.
     delete this;
 }
+
+// Stable, so for a voxel set more than once the last forced node and the first conditional node still win
+inline void sortToStorageOrder(std::vector<VoxelToPlace>& nodes) {
+    std::stable_sort(nodes.begin(), nodes.end(), [](const VoxelToPlace& a, const VoxelToPlace& b) {
+        return vvox::ChunkLayout::toStorage(a.blockIndex) < vvox::ChunkLayout::toStorage(b.blockIndex);
+    });
+}
+
+void VoxelNodeSetterTask::placeNodes(Chunk* chunk,
+                                     std::vector<VoxelToPlace>& forcedNodes,
+                                     std::vector<VoxelToPlace>& condNodes) {
+    // Neighbouring sets then hit the same intervals and palette words
+    sortToStorageOrder(forcedNodes);
+    sortToStorageOrder(condNodes);
+
+    std::vector<ui16> indices;
+    std::vector<ui16> ids;
+    indices.reserve(std::max(forcedNodes.size(), condNodes.size()));
+    ids.reserve(indices.capacity());
+
+    for (auto& node : forcedNodes) {
+        indices.push_back(node.blockIndex);
+        ids.push_back(node.blockID);
+    }
+    chunk->blocks.setMany(indices.data(), ids.data(), indices.size());
+
+    // Conditional nodes see the forced nodes, and the first one to claim a voxel wins.
+    indices.clear();
+    ids.clear();
+    std::bitset<CHUNK_SIZE> claimed;
+    for (auto& node : condNodes) {
+        // TODO(Ben): Custom condition
+        if (!claimed[node.blockIndex] && chunk->blocks.get(node.blockIndex) == 0) {
+            claimed[node.blockIndex] = true;
+            indices.push_back(node.blockIndex);
+            ids.push_back(node.blockID);
+        }
+    }
+    chunk->blocks.setMany(indices.data(), ids.data(), indices.size());
+}
@@ -18,6 +18,7 @@
 #include <Vorb/IThreadPoolTask.h>
 #include "ChunkHandle.h"
 
+class Chunk;
 class WorkerData;
 
 struct VoxelToPlace {
@@ -34,6 +35,13 @@ class VoxelNodeSetterTask : public vcore::IThreadPoolTask<WorkerData> {
 
     void cleanup() override;
 
+    /// Sets the nodes as a batch. Conditional nodes are only placed on air.
+    /// The nodes are sorted into storage order first, keeping the order of
+    /// nodes for the same voxel. The caller must hold the chunk's data lock.
+    static void placeNodes(Chunk* chunk,
+                           std::vector<VoxelToPlace>& forcedNodes,
+                           std::vector<VoxelToPlace>& condNodes);
+
     ChunkHandle h;
     std::vector<VoxelToPlace> forcedNodes; ///< Always added
     std::vector<VoxelToPlace> condNodes; ///< Conditionally added